@@ -0,0 +1,97 @@
+#ifndef BINSCRIPT_BENCH
+#define BINSCRIPT_BENCH
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "convert.h"
+#include "langdef.h"
+
+/**
+ * Shared helpers for the scripter_bench benchmark executable
+ **/
+
+/**
+ * returns a monotonic timestamp in seconds
+ **/
+static inline double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * prints the result of a single benchmark
+ *
+ * name: the name of the benchmark
+ * seconds: total time spent over all iterations
+ * iterations: number of times the benchmarked operation ran
+ * items: number of items processed per iteration
+ * item_name: what an item is (e.g. "functions")
+ **/
+void bench_report(const char *name, double seconds, size_t iterations,
+                  size_t items, const char *item_name);
+
+/**
+ * prints the result of a benchmark like bench_report, along with the
+ * throughput of the `bytes` bytes processed per iteration
+ **/
+void bench_report_bytes(const char *name, double seconds, size_t iterations,
+                        size_t items, const char *item_name, size_t bytes);
+
+/**
+ * Appends random, valid statements of a language to `out` until it
+ * holds at least `bytes` bytes, followed by a terminator. The same seed
+ * always generates the same binary.
+ *
+ * text_safe: only generate statements that survive formatting as text
+ *      and parsing back (no hex arguments or empty strings, and
+ *      integers that fit in 32 bits)
+ *
+ * returns the number of statements generated, not counting the
+ * terminator
+ **/
+size_t bench_generate_binary(language_def *l, size_t bytes, uint64_t seed,
+                             bool text_safe, bs_buffer *out);
+
+/**
+ * Appends random, valid script text of a language to `out` until it
+ * holds at least `bytes` bytes, followed by a null byte that is not
+ * counted in out->len.
+ *
+ * returns the number of statements generated
+ **/
+size_t bench_generate_script(language_def *l, size_t bytes, uint64_t seed,
+                             bs_buffer *out);
+
+/**
+ * Times decoding, encoding, formatting and parsing `bytes` bytes of
+ * generated input for the language defined at `path`, along with
+ * loading the language and looking up its functions. `name` labels the
+ * results.
+ **/
+void bench_codec(const char *name, const char *path, size_t bytes);
+
+/**
+ * Times parsing, finalizing, caching and querying a generated language
+ * with `function_ct` opcodes.
+ **/
+void bench_langload(unsigned int function_ct);
+
+/**
+ * Times decode requests against an in-process daemon, one at a time
+ * (round trip latency) and pipelined (throughput).
+ **/
+void bench_daemon(void);
+
+/**
+ * Times the ordered output merger alone, and converting `bytes` bytes of
+ * generated binary for the language defined at `path` to text on one
+ * thread and on doubling thread counts up to the CPU count (see
+ * ordered.h). `name` labels the results.
+ **/
+void bench_ordered(const char *name, const char *path, size_t bytes);
+
+#endif
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+// machine readable results, one JSON object per line, or NULL
+static FILE *results;
+
+static const char *bench_usage =
+    "usage: %s [-r ROOT] [-s BYTES] [-o RESULTS] [FUNCTION_CT]\n"
+    "\n"
+    "  -r ROOT     directory holding example.langdef and tests/languages\n"
+    "              (default: .)\n"
+    "  -s BYTES    size of the generated inputs (default: 4 MiB)\n"
+    "  -o RESULTS  also append every result to RESULTS as a line of JSON\n"
+    "  FUNCTION_CT functions in the generated language for the language\n"
+    "              load benchmarks (default: 10000)\n";
+
+void bench_report_bytes(const char *name, double seconds, size_t iterations,
+                        size_t items, const char *item_name, size_t bytes) {
+    double per_iter = seconds / iterations;
+    double mb_per_s = (double)bytes / per_iter / (1024 * 1024);
+    if (bytes > 0) {
+        printf("%-32s %10.3f ms/iter %14.0f %s/s %10.1f MB/s\n", name,
+               per_iter * 1e3, (double)items / per_iter, item_name, mb_per_s);
+    } else {
+        printf("%-32s %10.3f ms/iter %14.0f %s/s\n", name, per_iter * 1e3,
+               (double)items / per_iter, item_name);
+    }
+
+    if (results != NULL) {
+        fprintf(results,
+                "{\"name\": \"%s\", \"ms_per_iter\": %.6f, "
+                "\"items_per_s\": %.1f, \"item\": \"%s\"",
+                name, per_iter * 1e3, (double)items / per_iter, item_name);
+        if (bytes > 0)
+            fprintf(results, ", \"mb_per_s\": %.3f", mb_per_s);
+        fprintf(results, "}\n");
+    }
+}
+
+void bench_report(const char *name, double seconds, size_t iterations,
+                  size_t items, const char *item_name) {
+    bench_report_bytes(name, seconds, iterations, items, item_name, 0);
+}
+
+int main(int argc, char **argv) {
+    unsigned int function_ct = 10000;
+    size_t bytes = 4 * 1024 * 1024;
+    const char *root = ".";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:s:o:h")) != -1) {
+        switch (opt) {
+        case 'r':
+            root = optarg;
+            break;
+        case 's':
+            bytes = (size_t)strtoull(optarg, NULL, 0);
+            break;
+        case 'o':
+            results = fopen(optarg, "a");
+            if (results == NULL) {
+                printf("could not open '%s'\n", optarg);
+                return 2;
+            }
+            break;
+        default:
+            printf(bench_usage, argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (optind < argc) {
+        function_ct = (unsigned int)strtoul(argv[optind], NULL, 0);
+    }
+
+    const char *languages[][2] = {
+        { "example", "example.langdef" },
+        { "melee", "tests/languages/melee.langdef" },
+        { "stress", "tests/languages/stress.langdef" },
+    };
+    for (size_t i = 0; i < sizeof(languages) / sizeof(languages[0]); i++) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", root, languages[i][1]);
+        bench_codec(languages[i][0], path, bytes);
+    }
+
+    char stress_path[4096];
+    snprintf(stress_path, sizeof(stress_path), "%s/%s", root,
+             "tests/languages/stress.langdef");
+    bench_ordered("stress", stress_path, bytes);
+
+    bench_langload(function_ct);
+    bench_daemon();
+
+    if (results != NULL)
+        fclose(results);
+    return 0;
+}
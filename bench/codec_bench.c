@@ -0,0 +1,337 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "convert.h"
+#include "langdef.h"
+#include "parsescript.h"
+#include "translator.h"
+#include "util.h"
+
+#define CODEC_ITERATIONS 5
+#define CODEC_LOOKUPS 1000000
+#define CODEC_SEED 0x5eed
+#define CODEC_FILE_PATH "codec_bench.bin"
+
+static void codec_fail(const char *what, binscript_error e) {
+    printf("%s failed (%s)\n", what, binscript_error_name(e));
+    exit(1);
+}
+
+// decodes a whole binary into calls, returning how many there were.
+// Calls are taken from `pool` if it is not NULL.
+static size_t decode_all(language_def *l, bs_buffer *bin,
+                         function_call ***calls, bs_call_pool *pool) {
+    binscript_consumer *c =
+        binscript_mem_consumer(l, bin->data, "<bench:decode>", BIN2SCRIPT);
+    consumer_set_size(c, NULL_TERMINATED, 0);
+    consumer_set_source_len(c, bin->len);
+    consumer_set_pool(c, pool);
+
+    size_t ct = 0, cap = 1024;
+    function_call *call;
+    binscript_error e;
+    if (calls != NULL)
+        *calls = malloc(sizeof(function_call *) * cap);
+    while (BS_OK == (e = binscript_next_checked(c, &call)) && call != NULL) {
+        if (calls == NULL) {
+            free_call(call);
+        } else {
+            if (ct == cap) {
+                cap *= 2;
+                *calls = realloc(*calls, sizeof(function_call *) * cap);
+            }
+            (*calls)[ct] = call;
+        }
+        ct++;
+    }
+    binscript_free(c);
+    if (e != BS_OK)
+        codec_fail("decoding", e);
+    return ct;
+}
+
+// visitor callbacks that only count the arguments they are shown
+static bool count_argument(void *user, function_def *fn, unsigned int index,
+                           const bs_value *value) {
+    (void)fn;
+    (void)index;
+    (void)value;
+    (*(size_t *)user)++;
+    return true;
+}
+
+static const bs_visitor counting_visitor = { NULL, count_argument, NULL };
+
+// decodes the binary in CODEC_FILE_PATH through a file consumer,
+// prefetching it in chunks unless `prefetch` is 0
+static size_t decode_file(language_def *l, unsigned int prefetch,
+                          bs_call_pool *pool) {
+    FILE *f = fopen(CODEC_FILE_PATH, "rb");
+    if (f == NULL) {
+        printf("could not open '%s'\n", CODEC_FILE_PATH);
+        exit(1);
+    }
+    binscript_consumer *c =
+        binscript_file_consumer(l, f, CODEC_FILE_PATH, BIN2SCRIPT);
+    consumer_set_size(c, NULL_TERMINATED, 0);
+    consumer_set_pool(c, pool);
+    if (prefetch > 0 && !consumer_set_prefetch(c, 0, prefetch))
+        codec_fail("prefetching", BS_IO_ERROR);
+
+    size_t ct = 0;
+    function_call *call;
+    binscript_error e;
+    while (BS_OK == (e = binscript_next_checked(c, &call)) && call != NULL) {
+        free_call(call);
+        ct++;
+    }
+    binscript_free(c);
+    fclose(f);
+    if (e != BS_OK)
+        codec_fail("decoding a file", e);
+    return ct;
+}
+
+static void bench_codec_binary(const char *name, language_def *l,
+                               size_t bytes) {
+    char label[128];
+    double start, elapsed;
+    bs_buffer bin, out;
+    bs_buffer_init(&bin);
+    bs_buffer_init(&out);
+
+    size_t statement_ct =
+        bench_generate_binary(l, bytes, CODEC_SEED, false, &bin);
+
+    // decode into calls, and free them
+    start = bench_now();
+    for (int i = 0; i < CODEC_ITERATIONS; i++) {
+        if (decode_all(l, &bin, NULL, NULL) != statement_ct) {
+            printf("%s: decoded a different number of statements\n", name);
+            exit(1);
+        }
+    }
+    elapsed = bench_now() - start;
+    snprintf(label, sizeof(label), "codec/%s/decode", name);
+    bench_report_bytes(label, elapsed, CODEC_ITERATIONS, statement_ct,
+                       "statements", bin.len);
+
+    // the same, recycling calls through a pool
+    bs_call_pool pool;
+    bs_call_pool_init(&pool, l, NULL);
+    start = bench_now();
+    for (int i = 0; i < CODEC_ITERATIONS; i++) {
+        decode_all(l, &bin, NULL, &pool);
+    }
+    elapsed = bench_now() - start;
+    bs_call_pool_free(&pool);
+    snprintf(label, sizeof(label), "codec/%s/decode-pooled", name);
+    bench_report_bytes(label, elapsed, CODEC_ITERATIONS, statement_ct,
+                       "statements", bin.len);
+
+    // hand each statement to a visitor, without building calls
+    start = bench_now();
+    for (int i = 0; i < CODEC_ITERATIONS; i++) {
+        size_t args = 0;
+        binscript_consumer *c =
+            binscript_mem_consumer(l, bin.data, "<bench:visit>", BIN2SCRIPT);
+        consumer_set_size(c, NULL_TERMINATED, 0);
+        consumer_set_source_len(c, bin.len);
+        binscript_error e = binscript_visit(c, &counting_visitor, &args);
+        binscript_free(c);
+        if (e != BS_OK)
+            codec_fail("visiting", e);
+    }
+    elapsed = bench_now() - start;
+    snprintf(label, sizeof(label), "codec/%s/visit", name);
+    bench_report_bytes(label, elapsed, CODEC_ITERATIONS, statement_ct,
+                       "statements", bin.len);
+
+    // decode from a file, reading synchronously and then ahead of the
+    // decoder, recycling calls so that reading stands out
+    FILE *f = fopen(CODEC_FILE_PATH, "wb");
+    if (f == NULL || bin.len != fwrite(bin.data, 1, bin.len, f)) {
+        printf("could not write '%s'\n", CODEC_FILE_PATH);
+        exit(1);
+    }
+    fclose(f);
+    unsigned int prefetch_chunks[] = { 0, 2 };
+    for (size_t p = 0; p < 2; p++) {
+        bs_call_pool_init(&pool, l, NULL);
+        start = bench_now();
+        for (int i = 0; i < CODEC_ITERATIONS; i++) {
+            if (decode_file(l, prefetch_chunks[p], &pool) != statement_ct) {
+                printf("%s: decoded a different number of statements\n",
+                       name);
+                exit(1);
+            }
+        }
+        elapsed = bench_now() - start;
+        bs_call_pool_free(&pool);
+        snprintf(label, sizeof(label), "codec/%s/decode-file%s", name,
+                 prefetch_chunks[p] > 0 ? "-prefetch" : "");
+        bench_report_bytes(label, elapsed, CODEC_ITERATIONS, statement_ct,
+                           "statements", bin.len);
+    }
+    remove(CODEC_FILE_PATH);
+
+    // decode and format as text
+    start = bench_now();
+    for (int i = 0; i < CODEC_ITERATIONS; i++) {
+        bs_buffer_clear(&out);
+        binscript_error e = binscript_convert(l, BIN2SCRIPT, NULL_TERMINATED,
+                                              bin.data, bin.len, &out, NULL);
+        if (e != BS_OK)
+            codec_fail("formatting", e);
+    }
+    elapsed = bench_now() - start;
+    snprintf(label, sizeof(label), "codec/%s/format", name);
+    bench_report_bytes(label, elapsed, CODEC_ITERATIONS, statement_ct,
+                       "statements", bin.len);
+
+    // encode decoded calls back into a binary. Hex fields wider than a
+    // long cannot be encoded, so these come from a binary of the calls
+    // scripts can hold
+    function_call **calls;
+    bs_buffer_clear(&bin);
+    statement_ct = bench_generate_binary(l, bytes, CODEC_SEED, true, &bin);
+    decode_all(l, &bin, &calls, NULL);
+    start = bench_now();
+    for (int i = 0; i < CODEC_ITERATIONS; i++) {
+        bs_buffer_clear(&out);
+        bs_buffer_reserve(&out, bin.len);
+        for (size_t j = 0; j < statement_ct; j++) {
+            size_t width = bits2bytes(func_call_width(l, calls[j]->defn));
+            size_t written;
+            memset(out.data + out.len, 0, width);
+            binscript_error e = binary_encode_function_call_checked(
+                out.data + out.len, width, l, calls[j], &written);
+            if (e != BS_OK)
+                codec_fail("encoding", e);
+            out.len += width;
+        }
+    }
+    elapsed = bench_now() - start;
+    snprintf(label, sizeof(label), "codec/%s/encode", name);
+    bench_report_bytes(label, elapsed, CODEC_ITERATIONS, statement_ct,
+                       "statements", out.len);
+    for (size_t j = 0; j < statement_ct; j++) {
+        free_call(calls[j]);
+    }
+    free(calls);
+
+    bs_buffer_free(&bin);
+    bs_buffer_free(&out);
+}
+
+static void bench_codec_script(const char *name, language_def *l,
+                               size_t bytes) {
+    char label[128];
+    double start, elapsed;
+    bs_buffer text, out;
+    bs_buffer_init(&text);
+    bs_buffer_init(&out);
+
+    size_t statement_ct = bench_generate_script(l, bytes, CODEC_SEED, &text);
+
+    // parse text into calls, without encoding them
+    start = bench_now();
+    for (int i = 0; i < CODEC_ITERATIONS; i++) {
+        binscript_consumer *c = binscript_mem_consumer(
+            l, text.data, "<bench:parse>", SCRIPT2BIN);
+        function_call *call;
+        binscript_error e;
+        size_t ct = 0;
+        while (BS_OK == (e = binscript_next_checked(c, &call)) &&
+               call != NULL) {
+            free_call(call);
+            ct++;
+        }
+        binscript_free(c);
+        if (e != BS_OK)
+            codec_fail("parsing", e);
+        if (ct != statement_ct) {
+            printf("%s: parsed a different number of statements\n", name);
+            exit(1);
+        }
+    }
+    elapsed = bench_now() - start;
+    snprintf(label, sizeof(label), "codec/%s/parse", name);
+    bench_report_bytes(label, elapsed, CODEC_ITERATIONS, statement_ct,
+                       "statements", text.len);
+
+    // parse and encode into a binary
+    start = bench_now();
+    for (int i = 0; i < CODEC_ITERATIONS; i++) {
+        bs_buffer_clear(&out);
+        binscript_error e = binscript_convert(l, SCRIPT2BIN, NULL_TERMINATED,
+                                              text.data, text.len, &out, NULL);
+        if (e != BS_OK)
+            codec_fail("converting", e);
+    }
+    elapsed = bench_now() - start;
+    snprintf(label, sizeof(label), "codec/%s/script2bin", name);
+    bench_report_bytes(label, elapsed, CODEC_ITERATIONS, statement_ct,
+                       "statements", text.len);
+
+    bs_buffer_free(&text);
+    bs_buffer_free(&out);
+}
+
+// times loading the language from its file, and looking up its opcodes
+static bool bench_codec_load(const char *name, const char *path,
+                             language_def *l) {
+    char label[128];
+    double start, elapsed;
+
+    start = bench_now();
+    for (int i = 0; i < CODEC_ITERATIONS; i++) {
+        FILE *f = fopen(path, "r");
+        if (f == NULL) {
+            printf("could not open '%s', skipping\n", path);
+            return false;
+        }
+        detailed_parse_error *e = parse_language_from_file(l, f, path);
+        fclose(f);
+        if (e != NULL) {
+            print_err(e);
+            free_err(e);
+            exit(1);
+        }
+        if (i + 1 < CODEC_ITERATIONS)
+            free_lang(l);
+    }
+    elapsed = bench_now() - start;
+    snprintf(label, sizeof(label), "codec/%s/load", name);
+    bench_report(label, elapsed, CODEC_ITERATIONS, l->function_ct,
+                 "functions");
+
+    lang_build_dispatch(l);
+    unsigned int found = 0;
+    start = bench_now();
+    for (unsigned int i = 0; i < CODEC_LOOKUPS; i++) {
+        function_def *fn = l->functions[(i * 7919) % l->function_ct];
+        found += lang_getplan(l, fn->function_binary_value) != NULL;
+    }
+    elapsed = bench_now() - start;
+    if (found != CODEC_LOOKUPS) {
+        printf("lookup mismatch: found %u of %u\n", found, CODEC_LOOKUPS);
+        exit(1);
+    }
+    snprintf(label, sizeof(label), "codec/%s/lookup", name);
+    bench_report(label, elapsed, 1, CODEC_LOOKUPS, "lookups");
+    return true;
+}
+
+void bench_codec(const char *name, const char *path, size_t bytes) {
+    language_def l;
+    printf("codec: %s, %zu bytes of input\n", path, bytes);
+    if (!bench_codec_load(name, path, &l))
+        return;
+
+    bench_codec_binary(name, &l, bytes);
+    bench_codec_script(name, &l, bytes);
+    free_lang(&l);
+}
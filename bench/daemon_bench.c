@@ -0,0 +1,129 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "convert.h"
+#include "daemon.h"
+#include "langdef.h"
+#include "parsescript.h"
+
+#define DAEMON_BENCH_REQUESTS 20000
+#define DAEMON_BENCH_PIPELINE 64
+#define DAEMON_BENCH_SOCKET "bench_daemon.sock"
+
+static char *daemon_bench_lang = "meta\n"
+                                       "    endianness big\n"
+                                       "    namewidth 8\n"
+                                       "\n"
+                                       "def 0x01 move {\n"
+                                       "    int16(x) int16(y) uint8(speed)\n"
+                                       "}\n"
+                                       "def 0x02 wait { uint16(frames) }\n";
+
+// a small script, as an editor would send on every save
+static const char daemon_bench_bin[] = {
+    0x01, 0x00, 0x10, 0x00, 0x20, 0x04, // move(16 32 4)
+    0x02, 0x00, 0x3c,                   // wait(60)
+    0x01, 0x00, 0x01, 0x00, 0x02, 0x01, // move(1 2 1)
+    0x00,
+};
+
+static void *daemon_bench_serve(void *arg) {
+    bs_daemon_run(arg);
+    return NULL;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double da = *(const double *)a, db = *(const double *)b;
+    return da < db ? -1 : da > db;
+}
+
+void bench_daemon(void) {
+    language_def lang;
+    detailed_parse_error *e =
+        parse_language_from_str(&lang, daemon_bench_lang, "<bench:daemon>");
+    if (e != NULL) {
+        print_err(e);
+        free_err(e);
+        exit(1);
+    }
+
+    language_def *langs[] = { &lang };
+    const char *names[] = { "bench" };
+    bs_daemon *d = bs_daemon_create(DAEMON_BENCH_SOCKET, langs, names, 1, 0);
+    if (d == NULL) {
+        printf("could not listen on '%s'\n", DAEMON_BENCH_SOCKET);
+        exit(1);
+    }
+    pthread_t server;
+    pthread_create(&server, NULL, daemon_bench_serve, d);
+
+    int fd = bs_client_connect(DAEMON_BENCH_SOCKET);
+    if (fd < 0) {
+        printf("could not connect to '%s'\n", DAEMON_BENCH_SOCKET);
+        exit(1);
+    }
+
+    bs_buffer payload;
+    bs_buffer_init(&payload);
+    bs_response_header response;
+    double *latencies = malloc(sizeof(double) * DAEMON_BENCH_REQUESTS);
+
+    // one request at a time: round trip latency
+    double start = bench_now();
+    for (unsigned int i = 0; i < DAEMON_BENCH_REQUESTS; i++) {
+        double sent = bench_now();
+        bs_buffer_clear(&payload);
+        if (!bs_client_send(fd, i, BS_OP_DECODE, 0, 0, daemon_bench_bin,
+                            sizeof(daemon_bench_bin)) ||
+            !bs_client_recv(fd, &response, &payload) ||
+            response.status != BS_OK) {
+            printf("daemon request %u failed\n", i);
+            exit(1);
+        }
+        latencies[i] = bench_now() - sent;
+    }
+    double elapsed = bench_now() - start;
+    bench_report("daemon/decode sequential", elapsed, DAEMON_BENCH_REQUESTS,
+                 1, "requests");
+
+    qsort(latencies, DAEMON_BENCH_REQUESTS, sizeof(double), compare_doubles);
+    printf("%-32s p50 %.1f us, p99 %.1f us, max %.1f us\n",
+           "daemon/decode latency",
+           latencies[DAEMON_BENCH_REQUESTS / 2] * 1e6,
+           latencies[DAEMON_BENCH_REQUESTS * 99 / 100] * 1e6,
+           latencies[DAEMON_BENCH_REQUESTS - 1] * 1e6);
+
+    // pipelined: keep DAEMON_BENCH_PIPELINE requests in flight
+    start = bench_now();
+    unsigned int sent = 0, received = 0;
+    while (received < DAEMON_BENCH_REQUESTS) {
+        while (sent < DAEMON_BENCH_REQUESTS &&
+               sent - received < DAEMON_BENCH_PIPELINE) {
+            bs_client_send(fd, sent++, BS_OP_DECODE, 0, 0, daemon_bench_bin,
+                           sizeof(daemon_bench_bin));
+        }
+        bs_buffer_clear(&payload);
+        if (!bs_client_recv(fd, &response, &payload) ||
+            response.status != BS_OK) {
+            printf("pipelined daemon request failed\n");
+            exit(1);
+        }
+        received++;
+    }
+    elapsed = bench_now() - start;
+    bench_report("daemon/decode pipelined", elapsed, DAEMON_BENCH_REQUESTS, 1,
+                 "requests");
+
+    close(fd);
+    bs_daemon_stop(d);
+    pthread_join(server, NULL);
+    bs_daemon_free(d);
+
+    free(latencies);
+    bs_buffer_free(&payload);
+    free_lang(&lang);
+}
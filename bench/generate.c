@@ -0,0 +1,204 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "bitbuffer.h"
+#include "convert.h"
+#include "langdef.h"
+#include "util.h"
+
+// xorshift64, so that the same seed generates the same input everywhere
+static uint64_t next_random(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+static uint64_t low_bits(uint64_t value, unsigned int bits) {
+    return bits >= 64 ? value : value & ((1ULL << bits) - 1);
+}
+
+// whether random values of a field can be encoded, and, if
+// `text_safe`, read back from the text they format as
+static bool field_usable(argument_def *arg, bool text_safe) {
+    switch (arg->type) {
+    case INT:
+    case UNSIGNED_INT:
+        return arg->bitwidth > 0 && arg->bitwidth <= 64;
+    case FLOAT:
+        return arg->bitwidth == 32 || arg->bitwidth == 64 ||
+               arg->bitwidth == sizeof(long double) * 8;
+    case HEX:
+        // scripts have no syntax for hex arguments
+        return !text_safe;
+    case STRING:
+        // empty strings format as nothing, and there must be room for
+        // a terminator
+        return arg->bitwidth >= (text_safe ? 16 : 8);
+    case RAW_STRING:
+        return arg->bitwidth > 0;
+    case SKIP:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool function_usable(language_def *l, function_def *fn,
+                            bool text_safe) {
+    // opcode 0 ends null terminated binaries, and the second definition
+    // of a value decodes as the first
+    if (fn->function_binary_value == 0 ||
+        lang_getfn(l, fn->function_binary_value) != fn)
+        return false;
+    for (unsigned int i = 0; i < fn->argc; i++) {
+        if (!field_usable(fn->arguments[i], text_safe))
+            return false;
+    }
+    return true;
+}
+
+static void random_letters(char *out, size_t len, uint64_t *random) {
+    for (size_t i = 0; i < len; i++) {
+        out[i] = 'a' + (char)(next_random(random) % 26);
+    }
+    out[len] = '\0';
+}
+
+static void write_field(bitbuffer *b, language_def *l, argument_def *arg,
+                        bool text_safe, uint64_t *random) {
+    // scripts read integers as 32 bit ints
+    unsigned int value_bits = text_safe ? 31 : 63;
+    uint64_t r = next_random(random);
+    long int i;
+    long double f;
+    char text[256];
+    size_t len;
+
+    switch (arg->type) {
+    case UNSIGNED_INT:
+        i = (long int)low_bits(r, arg->bitwidth < value_bits ? arg->bitwidth
+                                                              : value_bits);
+        arg_write_checked(b, l, arg, &i);
+        break;
+    case INT:
+        // a magnitude below the sign bit
+        i = (long int)low_bits(r >> 1, arg->bitwidth - 1 < value_bits
+                                           ? arg->bitwidth - 1
+                                           : value_bits);
+        if (r & 1)
+            i = -i;
+        arg_write_checked(b, l, arg, &i);
+        break;
+    case FLOAT:
+        // sixty-fourths print exactly with six decimals
+        f = (long double)((long int)(r % 200001) - 100000) / 64;
+        arg_write_checked(b, l, arg, &f);
+        break;
+    case HEX:
+        // raw bits, of any width
+        for (size_t done = 0; done < arg->bitwidth; done += 64) {
+            uint64_t chunk = next_random(random);
+            size_t bits = arg->bitwidth - done < 64 ? arg->bitwidth - done
+                                                     : 64;
+            unsigned char bytes[8];
+            for (int j = 0; j < 8; j++) {
+                bytes[j] = (unsigned char)(chunk >> (56 - 8 * j));
+            }
+            bitbuffer_writeblock(b, bytes, bits);
+        }
+        break;
+    case STRING:
+        // up to a byte short of the field, leaving room for a terminator
+        len = arg->bitwidth / 8 - 1;
+        if (len > sizeof(text) - 1)
+            len = sizeof(text) - 1;
+        len = len == 0 ? 0 : 1 + r % len;
+        random_letters(text, len, random);
+        arg_write_checked(b, l, arg, text);
+        break;
+    case RAW_STRING:
+        // every byte of the field, a scratch text at a time
+        for (size_t left = arg->bitwidth / 8; left > 0; left -= len) {
+            len = left < sizeof(text) - 1 ? left : sizeof(text) - 1;
+            random_letters(text, len, random);
+            bitbuffer_writeblock(b, text, len * 8);
+        }
+        break;
+    default:
+        arg_write_checked(b, l, arg, NULL);
+        break;
+    }
+}
+
+size_t bench_generate_binary(language_def *l, size_t bytes, uint64_t seed,
+                             bool text_safe, bs_buffer *out) {
+    function_def **usable =
+        malloc(sizeof(function_def *) * (l->function_ct + 1));
+    size_t usable_ct = 0, statement_ct = 0;
+    for (unsigned int i = 0; i < l->function_ct; i++) {
+        if (function_usable(l, l->functions[i], text_safe))
+            usable[usable_ct++] = l->functions[i];
+    }
+    if (usable_ct == 0) {
+        printf("no function of the language can be generated\n");
+        exit(1);
+    }
+
+    uint64_t random = seed == 0 ? 1 : seed;
+    while (out->len < bytes) {
+        function_def *fn = usable[next_random(&random) % usable_ct];
+        size_t width = bits2bytes(func_call_width(l, fn));
+        bs_buffer_reserve(out, width);
+        memset(out->data + out->len, 0, width);
+
+        bitbuffer b;
+        bitbuffer_init_from_buffer(&b, out->data + out->len, width);
+        bitbuffer_write_int(&b, fn->function_binary_value,
+                            l->function_name_width);
+        for (unsigned int i = 0; i < fn->argc; i++) {
+            write_field(&b, l, fn->arguments[i], text_safe, &random);
+        }
+        out->len += width;
+        statement_ct++;
+    }
+    free(usable);
+
+    size_t terminator = bits2bytes(l->function_name_width);
+    bs_buffer_reserve(out, terminator + 1);
+    memset(out->data + out->len, 0, terminator + 1);
+    out->len += terminator;
+    return statement_ct;
+}
+
+size_t bench_generate_script(language_def *l, size_t bytes, uint64_t seed,
+                             bs_buffer *out) {
+    bs_buffer bin;
+    bs_buffer_init(&bin);
+
+    // generate a binary, then format it, until the text is large enough
+    size_t statement_ct = 0;
+    while (out->len < bytes) {
+        bs_buffer_clear(&bin);
+        size_t remaining = bytes - out->len;
+        statement_ct += bench_generate_binary(
+            l, remaining / 4 + 1, seed++, true, &bin);
+        binscript_error e = binscript_convert(l, BIN2SCRIPT, NULL_TERMINATED,
+                                              bin.data, bin.len, out, NULL);
+        if (e != BS_OK) {
+            printf("generated binary does not decode (%s)\n",
+                   binscript_error_name(e));
+            exit(1);
+        }
+    }
+    bs_buffer_free(&bin);
+
+    bs_buffer_reserve(out, 1);
+    out->data[out->len] = '\0';
+    return statement_ct;
+}
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "langcache.h"
+#include "langdef.h"
+#include "parsescript.h"
+
+#define LANGLOAD_ITERATIONS 5
+#define LANGLOAD_LOOKUPS 1000000
+#define LANGLOAD_CACHE_PATH "bench_langload.bslc"
+
+// argument types cycled through by the generator. Each entry is a valid
+// type and width for parse_argtype
+static const char *generated_argtypes[] = {
+    "uint8", "int12", "skip4", "float32", "hex24", "uint3", "str64", "int1",
+};
+#define GENERATED_ARGTYPE_CT                                                   \
+    (sizeof(generated_argtypes) / sizeof(generated_argtypes[0]))
+
+// every WIDE_FN_INTERVAL-th function gets WIDE_FN_ARGC arguments, to
+// exercise wide argument lists
+#define WIDE_FN_INTERVAL 1000
+#define WIDE_FN_ARGC 128
+
+/**
+ * Generates the source of a language with `function_ct` functions,
+ * numbered 1 through function_ct. Returns a heap allocated string.
+ **/
+static char *generate_langdef(unsigned int function_ct) {
+    size_t cap = 4096, len = 0;
+    char *out = malloc(cap);
+
+    len += sprintf(out, "meta\n"
+                        "    endianness big\n"
+                        "    namewidth 16\n"
+                        "    nameshift 0\n"
+                        "\n");
+
+    for (unsigned int i = 1; i <= function_ct; i++) {
+        unsigned int argc =
+            (i % WIDE_FN_INTERVAL == 0) ? WIDE_FN_ARGC : 1 + i % 12;
+
+        // worst case line length: 32 bytes of header plus 24 per argument
+        size_t needed = 32 + 24 * (size_t)argc;
+        while (len + needed + 1 > cap) {
+            cap *= 2;
+            out = realloc(out, cap);
+        }
+
+        len += sprintf(out + len, "def 0x%x fn%u", i, i);
+        for (unsigned int j = 0; j < argc; j++) {
+            len += sprintf(out + len, " %s(a%u)",
+                           generated_argtypes[(i + j) % GENERATED_ARGTYPE_CT],
+                           j);
+        }
+        len += sprintf(out + len, "\n");
+    }
+
+    return out;
+}
+
+void bench_langload(unsigned int function_ct) {
+    char *source = generate_langdef(function_ct);
+    size_t source_len = strlen(source);
+    language_def lang;
+    double start, elapsed;
+
+    printf("language load: %u functions, %zu bytes of source\n", function_ct,
+           source_len);
+
+    // parse from text, including finalizing
+    start = bench_now();
+    for (int i = 0; i < LANGLOAD_ITERATIONS; i++) {
+        detailed_parse_error *e =
+            parse_language_from_str(&lang, source, "<bench:langload>");
+        if (e != NULL) {
+            print_err(e);
+            free_err(e);
+            exit(1);
+        }
+        if (i + 1 < LANGLOAD_ITERATIONS)
+            free_lang(&lang);
+    }
+    elapsed = bench_now() - start;
+    bench_report("langload/parse", elapsed, LANGLOAD_ITERATIONS, function_ct,
+                 "functions");
+
+    // load from the binary cache
+    uint64_t hash = lang_source_hash(source, source_len);
+    if (!lang_cache_write(&lang, hash, LANGLOAD_CACHE_PATH)) {
+        printf("could not write cache '%s'\n", LANGLOAD_CACHE_PATH);
+        exit(1);
+    }
+
+    language_def cached;
+    start = bench_now();
+    for (int i = 0; i < LANGLOAD_ITERATIONS; i++) {
+        if (!lang_cache_load(&cached, hash, LANGLOAD_CACHE_PATH)) {
+            printf("could not load cache '%s'\n", LANGLOAD_CACHE_PATH);
+            exit(1);
+        }
+        free_lang(&cached);
+    }
+    elapsed = bench_now() - start;
+    bench_report("langload/cache", elapsed, LANGLOAD_ITERATIONS, function_ct,
+                 "functions");
+    remove(LANGLOAD_CACHE_PATH);
+
+    // lookups by binary value
+    unsigned int found = 0;
+    start = bench_now();
+    for (unsigned int i = 0; i < LANGLOAD_LOOKUPS; i++) {
+        found += lang_getfn(&lang, 1 + (i * 7919) % function_ct) != NULL;
+    }
+    elapsed = bench_now() - start;
+    if (found != LANGLOAD_LOOKUPS) {
+        printf("lookup mismatch: found %u of %u\n", found, LANGLOAD_LOOKUPS);
+        exit(1);
+    }
+    bench_report("langload/lookup", elapsed, 1, LANGLOAD_LOOKUPS, "lookups");
+
+    // the same lookups through a dispatch table
+    found = 0;
+    lang_build_dispatch(&lang);
+    start = bench_now();
+    for (unsigned int i = 0; i < LANGLOAD_LOOKUPS; i++) {
+        found += lang_getfn(&lang, 1 + (i * 7919) % function_ct) != NULL;
+    }
+    elapsed = bench_now() - start;
+    if (found != LANGLOAD_LOOKUPS) {
+        printf("lookup mismatch: found %u of %u\n", found, LANGLOAD_LOOKUPS);
+        exit(1);
+    }
+    bench_report("langload/dispatch", elapsed, 1, LANGLOAD_LOOKUPS,
+                 "lookups");
+
+    free_lang(&lang);
+    free(source);
+}
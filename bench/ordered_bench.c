@@ -0,0 +1,168 @@
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "convert.h"
+#include "langdef.h"
+#include "ordered.h"
+#include "parsescript.h"
+#include "workpool.h"
+
+#define ORDERED_ITERATIONS 5
+#define ORDERED_MERGE_CHUNKS 20000
+#define ORDERED_MERGE_CHUNK_BYTES 4096
+#define ORDERED_SEED 0x0bd3
+
+typedef struct merge_bench {
+    bs_ordered *writer;
+    atomic_size_t next;
+    bs_buffer *buffers; // one per worker
+} merge_bench;
+
+// fills and submits whichever chunk is next, like
+// binscript_convert_parallel does
+static void merge_chunk(void *ctx, size_t item, unsigned int worker) {
+    merge_bench *m = ctx;
+    bs_buffer *out = &m->buffers[worker];
+    (void)item;
+
+    size_t seq = atomic_fetch_add(&m->next, 1);
+    bs_buffer_reserve(out, ORDERED_MERGE_CHUNK_BYTES);
+    memset(out->data, (int)(seq & 0xff), ORDERED_MERGE_CHUNK_BYTES);
+    out->len = ORDERED_MERGE_CHUNK_BYTES;
+    bs_ordered_submit(m->writer, seq, out);
+}
+
+// times the merger alone, with chunks that take no time to format
+static void bench_merge(unsigned int threads, int fd) {
+    char label[128];
+    merge_bench m;
+    m.buffers = malloc(sizeof(bs_buffer) * threads);
+    for (unsigned int i = 0; i < threads; i++) {
+        bs_buffer_init(&m.buffers[i]);
+    }
+
+    double start = bench_now();
+    for (int i = 0; i < ORDERED_ITERATIONS; i++) {
+        m.writer = bs_ordered_start(fd, threads * 4);
+        atomic_init(&m.next, 0);
+        workpool_run(threads, ORDERED_MERGE_CHUNKS, merge_chunk, &m);
+        bs_ordered_finish(m.writer, ORDERED_MERGE_CHUNKS);
+    }
+    double elapsed = bench_now() - start;
+    snprintf(label, sizeof(label), "ordered/merge/%u-threads", threads);
+    bench_report_bytes(label, elapsed, ORDERED_ITERATIONS,
+                       ORDERED_MERGE_CHUNKS, "chunks",
+                       (size_t)ORDERED_MERGE_CHUNKS *
+                           ORDERED_MERGE_CHUNK_BYTES);
+
+    for (unsigned int i = 0; i < threads; i++) {
+        bs_buffer_free(&m.buffers[i]);
+    }
+    free(m.buffers);
+}
+
+// times converting a binary to text on one thread and writing it out,
+// as the parallel conversion is compared against
+static void bench_serial(const char *name, language_def *l, bs_buffer *bin,
+                         size_t statement_ct, int fd) {
+    char label[128];
+    bs_buffer out;
+    bs_buffer_init(&out);
+
+    double start = bench_now();
+    for (int i = 0; i < ORDERED_ITERATIONS; i++) {
+        bs_buffer_clear(&out);
+        binscript_error e = binscript_convert(l, BIN2SCRIPT, NULL_TERMINATED,
+                                              bin->data, bin->len, &out,
+                                              NULL);
+        if (e != BS_OK || out.len != (size_t)write(fd, out.data, out.len)) {
+            printf("%s: serial conversion failed\n", name);
+            exit(1);
+        }
+    }
+    double elapsed = bench_now() - start;
+    snprintf(label, sizeof(label), "ordered/%s/bin2script-serial", name);
+    bench_report_bytes(label, elapsed, ORDERED_ITERATIONS, statement_ct,
+                       "statements", bin->len);
+    bs_buffer_free(&out);
+}
+
+static void bench_parallel(const char *name, language_def *l, bs_buffer *bin,
+                           size_t statement_ct, unsigned int threads,
+                           int fd) {
+    char label[128];
+    double start = bench_now();
+    for (int i = 0; i < ORDERED_ITERATIONS; i++) {
+        binscript_error e = binscript_convert_parallel(
+            l, NULL_TERMINATED, bin->data, bin->len, threads, fd, NULL);
+        if (e != BS_OK) {
+            printf("%s: parallel conversion failed (%s)\n", name,
+                   binscript_error_name(e));
+            exit(1);
+        }
+    }
+    double elapsed = bench_now() - start;
+    snprintf(label, sizeof(label), "ordered/%s/bin2script/%u-threads", name,
+             threads);
+    bench_report_bytes(label, elapsed, ORDERED_ITERATIONS, statement_ct,
+                       "statements", bin->len);
+}
+
+// the next thread count to time after `threads`: doubling up to the
+// CPU count, and then the CPU count itself
+static unsigned int next_thread_ct(unsigned int threads, unsigned int cpus) {
+    if (threads >= cpus)
+        return 0;
+    return threads * 2 < cpus ? threads * 2 : cpus;
+}
+
+void bench_ordered(const char *name, const char *path, size_t bytes) {
+    unsigned int cpus = workpool_cpu_count();
+    printf("ordered output: %s, %zu bytes of input, up to %u threads\n", path,
+           bytes, cpus);
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        printf("could not open '%s', skipping\n", path);
+        return;
+    }
+    language_def l;
+    detailed_parse_error *pe = parse_language_from_file(&l, f, path);
+    fclose(f);
+    if (pe != NULL) {
+        print_err(pe);
+        free_err(pe);
+        exit(1);
+    }
+    lang_build_dispatch(&l);
+
+    // the text is thrown away, so that only formatting and handing it to
+    // the kernel are timed
+    int fd = open("/dev/null", O_WRONLY);
+    if (fd < 0) {
+        printf("could not open /dev/null\n");
+        exit(1);
+    }
+
+    bs_buffer bin;
+    bs_buffer_init(&bin);
+    size_t statement_ct =
+        bench_generate_binary(&l, bytes, ORDERED_SEED, false, &bin);
+
+    for (unsigned int t = 1; t != 0; t = next_thread_ct(t, cpus)) {
+        bench_merge(t, fd);
+    }
+    bench_serial(name, &l, &bin, statement_ct, fd);
+    for (unsigned int t = 1; t != 0; t = next_thread_ct(t, cpus)) {
+        bench_parallel(name, &l, &bin, statement_ct, t, fd);
+    }
+
+    close(fd);
+    bs_buffer_free(&bin);
+    free_lang(&l);
+}
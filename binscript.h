@@ -1,10 +1,27 @@
 #ifndef BINSCRIPTER
 #define BINSCRIPTER
 
+#include "src/alloc.h"
+#include "src/callpool.h"
+#include "src/cfg.h"
+#include "src/convert.h"
+#include "src/daemon.h"
+#include "src/diff.h"
+#include "src/filereader.h"
+#include "src/incremental.h"
 #include "src/langdef.h"
+#include "src/langcache.h"
+#include "src/ordered.h"
 #include "src/parsescript.h"
+#include "src/patch.h"
+#include "src/prefetch.h"
+#include "src/registry.h"
+#include "src/stats.h"
+#include "src/transcode.h"
 #include "src/translator.h"
 #include "src/util.h"
+#include "src/validate.h"
+#include "src/workpool.h"
 
 #endif
 
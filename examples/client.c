@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "convert.h"
+#include "daemon.h"
+#include "langdef.h"
+
+/**
+ * Example client for the scripter daemon (scripter -S SOCKET ...).
+ *
+ * Sends standard input to the daemon as a single request and writes
+ * the response payload to standard output.
+ *
+ *   scripter_client SOCKET decode|encode|validate|langs [LANG]
+ **/
+
+static const char *usage =
+    "usage: %s SOCKET decode|encode|validate|langs [LANG] [-u]\n"
+    "\n"
+    "Sends stdin to the daemon listening on SOCKET, and writes the\n"
+    "result to stdout. LANG is the index of the language, in the order\n"
+    "the daemon loaded them (see 'langs'). -u marks binaries as having\n"
+    "no null terminator.\n";
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        printf(usage, argv[0]);
+        return 2;
+    }
+
+    bs_daemon_op op;
+    if (0 == strcmp(argv[2], "decode")) {
+        op = BS_OP_DECODE;
+    } else if (0 == strcmp(argv[2], "encode")) {
+        op = BS_OP_ENCODE;
+    } else if (0 == strcmp(argv[2], "validate")) {
+        op = BS_OP_VALIDATE;
+    } else if (0 == strcmp(argv[2], "langs")) {
+        op = BS_OP_LANGS;
+    } else {
+        printf(usage, argv[0]);
+        return 2;
+    }
+
+    uint8_t lang = 0, flags = 0;
+    for (int i = 3; i < argc; i++) {
+        if (0 == strcmp(argv[i], "-u")) {
+            flags |= BS_REQUEST_UNTERMINATED;
+        } else {
+            lang = (uint8_t)strtoul(argv[i], NULL, 0);
+        }
+    }
+
+    // read the whole request
+    bs_buffer in, out;
+    bs_buffer_init(&in);
+    bs_buffer_init(&out);
+    if (op != BS_OP_LANGS) {
+        size_t got;
+        do {
+            bs_buffer_reserve(&in, 64 * 1024);
+            got = fread(in.data + in.len, 1, in.capacity - in.len, stdin);
+            in.len += got;
+        } while (got > 0);
+    }
+
+    int fd = bs_client_connect(argv[1]);
+    if (fd < 0) {
+        fprintf(stderr, "could not connect to '%s'\n", argv[1]);
+        return 1;
+    }
+
+    bs_response_header response;
+    if (!bs_client_send(fd, 1, op, lang, flags, in.data, in.len) ||
+        !bs_client_recv(fd, &response, &out)) {
+        fprintf(stderr, "lost connection to '%s'\n", argv[1]);
+        close(fd);
+        return 1;
+    }
+    close(fd);
+
+    fwrite(out.data, 1, out.len, stdout);
+    if (response.status != BS_OK) {
+        fprintf(stderr, "%s at %u\n", binscript_error_name(response.status),
+                response.offset);
+    }
+
+    bs_buffer_free(&in);
+    bs_buffer_free(&out);
+    return response.status == BS_OK ? 0 : 1;
+}
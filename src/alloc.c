@@ -0,0 +1,109 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+
+void *bs_calloc(const bs_allocator *a, size_t ct, size_t size) {
+    if (a == NULL)
+        return calloc(ct, size);
+    if (size != 0 && ct > SIZE_MAX / size)
+        return NULL;
+
+    void *p = a->allocate(a->ctx, ct * size);
+    if (p != NULL)
+        memset(p, 0, ct * size);
+    return p;
+}
+
+////////////////////////
+// COUNTING ALLOCATOR //
+////////////////////////
+
+// the size of a block, kept in front of it. Padded so that the block
+// itself stays aligned for any type.
+typedef union counted_header {
+    size_t size;
+    max_align_t align;
+} counted_header;
+
+static void count_live(bs_counting_allocator *c, size_t added,
+                       size_t removed) {
+    c->bytes = c->bytes - removed + added;
+    if (c->bytes > c->peak_bytes)
+        c->peak_bytes = c->bytes;
+}
+
+static void *counting_allocate(void *ctx, size_t size) {
+    bs_counting_allocator *c = ctx;
+    if (size > SIZE_MAX - sizeof(counted_header))
+        return NULL;
+
+    counted_header *h = bs_malloc(c->parent, sizeof(counted_header) + size);
+    if (h == NULL)
+        return NULL;
+    h->size = size;
+    c->allocations++;
+    count_live(c, size, 0);
+    return h + 1;
+}
+
+static void counting_release(void *ctx, void *ptr) {
+    bs_counting_allocator *c = ctx;
+    counted_header *h = (counted_header *)ptr - 1;
+    c->frees++;
+    count_live(c, 0, h->size);
+    bs_free(c->parent, h);
+}
+
+static void *counting_reallocate(void *ctx, void *ptr, size_t size) {
+    bs_counting_allocator *c = ctx;
+    if (ptr == NULL)
+        return counting_allocate(ctx, size);
+    if (size > SIZE_MAX - sizeof(counted_header))
+        return NULL;
+
+    counted_header *old = (counted_header *)ptr - 1;
+    size_t old_size = old->size;
+    counted_header *h =
+        bs_realloc(c->parent, old, sizeof(counted_header) + size);
+    if (h == NULL)
+        return NULL;
+    if (h != old)
+        c->allocations++;
+    h->size = size;
+    c->reallocations++;
+    count_live(c, size, old_size);
+    return h + 1;
+}
+
+void bs_counting_init(bs_counting_allocator *c, const bs_allocator *parent) {
+    memset(c, 0, sizeof(bs_counting_allocator));
+    c->allocator.allocate = counting_allocate;
+    c->allocator.reallocate = counting_reallocate;
+    c->allocator.release = counting_release;
+    c->allocator.ctx = c;
+    c->parent = parent;
+}
+
+void bs_counting_reset(bs_counting_allocator *c) {
+    c->allocations = 0;
+    c->reallocations = 0;
+    c->frees = 0;
+    c->peak_bytes = c->bytes;
+}
+
+void bs_counting_dump(const bs_counting_allocator *c, uint64_t statements,
+                      FILE *out) {
+    fprintf(out, "allocations   %llu\n", (unsigned long long)c->allocations);
+    fprintf(out, "reallocations %llu\n",
+            (unsigned long long)c->reallocations);
+    fprintf(out, "frees         %llu\n", (unsigned long long)c->frees);
+    fprintf(out, "live bytes    %zu\n", c->bytes);
+    fprintf(out, "peak bytes    %zu\n", c->peak_bytes);
+    if (statements != 0) {
+        fprintf(out, "per statement %.2f allocations\n",
+                (double)c->allocations / (double)statements);
+    }
+}
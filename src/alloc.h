@@ -0,0 +1,89 @@
+#ifndef BINSCRIPT_ALLOC
+#define BINSCRIPT_ALLOC
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * Pluggable allocation for languages, consumers and the calls they
+ * decode.
+ *
+ * A language parsed with an allocator (parse_language_from_file_with,
+ * or lang_cache_load_with for a cached one) parses its definitions and
+ * keeps its function table, finalized definitions, dispatch tables and
+ * flow rules in memory from it, and the consumers created for it
+ * allocate themselves, their read buffers and every call and argument
+ * they decode through it. consumer_set_allocator gives one consumer an
+ * allocator of its own. Each call remembers the allocator it came from,
+ * so free_call releases it correctly whatever made it.
+ *
+ * A NULL allocator stands for malloc, realloc and free everywhere.
+ **/
+
+typedef struct bs_allocator {
+    // all three are required. `ctx` is passed back to each of them.
+    void *(*allocate)(void *ctx, size_t size);
+    void *(*reallocate)(void *ctx, void *ptr, size_t size);
+    void (*release)(void *ctx, void *ptr);
+    void *ctx;
+} bs_allocator;
+
+static inline void *bs_malloc(const bs_allocator *a, size_t size) {
+    return a == NULL ? malloc(size) : a->allocate(a->ctx, size);
+}
+
+static inline void *bs_realloc(const bs_allocator *a, void *ptr,
+                               size_t size) {
+    return a == NULL ? realloc(ptr, size) : a->reallocate(a->ctx, ptr, size);
+}
+
+static inline void bs_free(const bs_allocator *a, void *ptr) {
+    if (a == NULL) {
+        free(ptr);
+    } else if (ptr != NULL) {
+        a->release(a->ctx, ptr);
+    }
+}
+
+// zeroed memory for `ct` elements of `size` bytes, or NULL on overflow
+void *bs_calloc(const bs_allocator *a, size_t ct, size_t size);
+
+/**
+ * An allocator that counts what passes through it on its way to a
+ * parent allocator (NULL for malloc): allocations, reallocations and
+ * frees, and the bytes live at once, now and at most.
+ *
+ * Hand &counter.allocator to the library. Every block carries a small
+ * header recording its size, so blocks from a counting allocator must
+ * be freed through it. Like bs_stats, it is not synchronized: give
+ * consumers on different threads counters of their own.
+ **/
+typedef struct bs_counting_allocator {
+    bs_allocator allocator;
+    const bs_allocator *parent;
+
+    uint64_t allocations; // blocks allocated, counting moving reallocs
+    uint64_t reallocations;
+    uint64_t frees;
+    size_t bytes;      // requested bytes live now
+    size_t peak_bytes; // requested bytes live at once, at most
+} bs_counting_allocator;
+
+void bs_counting_init(bs_counting_allocator *c, const bs_allocator *parent);
+
+/**
+ * zeroes the counts, and restarts the peak from the bytes live now, to
+ * measure one piece of work after another
+ **/
+void bs_counting_reset(bs_counting_allocator *c);
+
+/**
+ * prints the counts, and the allocations per statement if `statements`
+ * is not 0
+ **/
+void bs_counting_dump(const bs_counting_allocator *c, uint64_t statements,
+                      FILE *out);
+
+#endif
@@ -1,26 +1,38 @@
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "bitbuffer.h"
 #include "util.h"
 
-void bitbuffer_advance(bitbuffer *b, size_t bits) {
-    b->head_offset = b->head_offset + (bits % 8);
-    b->buffer += bits / 8;
+size_t bitbuffer_remaining_bits(bitbuffer *b) {
+    size_t total = b->remaining_bytes * 8;
+    return total < (size_t)b->head_offset ? 0 : total - b->head_offset;
+}
 
-    if (b->remaining_bytes < bits / 8) {
-        printf("error trying to advance past the end "
-               "of a bitbuffer");
-        exit(1);
-    }
+bool bitbuffer_try_advance(bitbuffer *b, size_t bits) {
+    if (bits > bitbuffer_remaining_bits(b))
+        return false;
 
+    b->head_offset = b->head_offset + (bits % 8);
+    b->buffer += bits / 8;
     b->remaining_bytes -= bits / 8;
     while (b->head_offset >= 8) {
         b->head_offset -= 8;
         b->buffer++;
         b->remaining_bytes--;
     }
+    return true;
+}
+
+void bitbuffer_advance(bitbuffer *b, size_t bits) {
+    if (!bitbuffer_try_advance(b, bits)) {
+        printf("error trying to advance past the end "
+               "of a bitbuffer");
+        exit(1);
+    }
 }
 
 void bitbuffer_init_from_buffer(bitbuffer *b, char *buffer, size_t bufsize) {
@@ -46,31 +58,14 @@ bool bitbuffer_next(bitbuffer *b) {
     return toRet;
 }
 
-void bitbuffer_pop(void *t, bitbuffer *source, size_t bits) {
-    char *target = (char *)t;
-
-    /*
-    printf("requesting %ld of %ld tracked (offset %d): ",
-            bits,
-            source->remaining_bytes * 8 + (8 - source->head_offset),
-            source->head_offset);
-    bitbuffer_print(source);
-    */
-
-    size_t bytes = bits2bytes(bits);
-    for (size_t i = 0; i < bytes; i++) {
-        if (source->head_offset != 0) {
-            target[i] = source->buffer[i] << source->head_offset;
-            if ((source->buffer + i + 1) >
-                source->buffer_origin + source->buflen_max) {
-                target[i] = target[i] | (source->buffer[i + 1] >>
-                                         (7 - source->head_offset));
-            }
-        } else {
-            target[i] = source->buffer[i];
-        }
-    }
+void bitbuffer_pop(void *target, bitbuffer *source, size_t bits) {
+    // fill whole bytes of the target where the source has the bits
+    size_t fill = bits2bytes(bits) * 8;
+    size_t available = bitbuffer_remaining_bits(source);
+    if (fill > available)
+        fill = available;
 
+    bitbuffer_copybits(target, 0, source->buffer, source->head_offset, fill);
     bitbuffer_advance(source, bits);
 }
 
@@ -149,17 +144,13 @@ void bitbuffer_writebit(bitbuffer *b, bool bit) {
 }
 
 void bitbuffer_writeblock(bitbuffer *b, void *block, size_t bits) {
-    // TODO set in char blocks to be fast 'n junk
-    char *head = block;
-    size_t offset = 0;
-    for (size_t i = 0; i < bits; i++) {
-        bitbuffer_writebit(b, (*head >> (7 - offset)) & 1);
-
-        if (++offset >= 8) {
-            offset -= 8;
-            head++;
-        }
+    if (bits > bitbuffer_remaining_bits(b)) {
+        printf("error trying to write past the end "
+               "of a bitbuffer");
+        exit(1);
     }
+    bitbuffer_copybits(b->buffer, b->head_offset, block, 0, bits);
+    bitbuffer_advance(b, bits);
 }
 
 void bitbuffer_write_int(bitbuffer *b, unsigned int val, size_t bits) {
@@ -167,3 +158,96 @@ void bitbuffer_write_int(bitbuffer *b, unsigned int val, size_t bits) {
         bitbuffer_writebit(b, (val >> i) & 1);
     }
 }
+
+// writes the low `bits` (at most 64) bits of a value at a bit offset,
+// most significant bit first, keeping the bits around them
+static void put_bits(unsigned char *p, size_t offset, uint64_t value,
+                     size_t bits) {
+    unsigned int skip = offset % 8;
+    unsigned int mask;
+    p += offset / 8;
+
+    if (skip + bits <= 8) {
+        mask = ((1U << bits) - 1) << (8 - skip - bits);
+        *p = (*p & ~mask) |
+             ((unsigned int)(value << (8 - skip - bits)) & mask);
+        return;
+    }
+    if (skip != 0) {
+        mask = 0xFF >> skip;
+        bits -= 8 - skip;
+        *p = (*p & ~mask) | ((unsigned int)(value >> bits) & mask);
+        p++;
+    }
+    while (bits >= 8) {
+        bits -= 8;
+        *p++ = (unsigned char)(value >> bits);
+    }
+    if (bits != 0) {
+        mask = (0xFF << (8 - bits)) & 0xFF;
+        *p = (*p & ~mask) | ((unsigned int)(value << (8 - bits)) & mask);
+    }
+}
+
+// bits moved per step when the source and destination are not aligned
+// alike, the most read_bits gathers in one pass
+#define COPY_CHUNK_BITS 56
+
+void bitbuffer_copybits(void *dest, size_t dest_offset, const void *src,
+                        size_t src_offset, size_t bits) {
+    unsigned char *d = (unsigned char *)dest;
+    const unsigned char *s = (const unsigned char *)src;
+
+    if (bits == 0)
+        return;
+
+    if (dest_offset % 8 == src_offset % 8) {
+        // alike alignment: a memmove between the partial first and last
+        // bytes, which are read before anything is written
+        d += dest_offset / 8;
+        s += src_offset / 8;
+        unsigned int skip = dest_offset % 8;
+        size_t head = skip == 0 ? 0 : 8 - skip;
+        if (head > bits)
+            head = bits;
+        size_t body = (bits - head) / 8, tail = (bits - head) % 8;
+        size_t body_start = head == 0 ? 0 : 1;
+
+        uint64_t head_bits = head == 0 ? 0 : read_bits(s, skip, head);
+        uint64_t tail_bits =
+            tail == 0 ? 0 : read_bits(s + body_start + body, 0, tail);
+        if (body != 0)
+            memmove(d + body_start, s + body_start, body);
+        if (head != 0)
+            put_bits(d, skip, head_bits, head);
+        if (tail != 0)
+            put_bits(d + body_start + body, 0, tail_bits, tail);
+        return;
+    }
+
+    // otherwise gather shifted words from the source and store them. Like
+    // memmove, copy from the end when the destination is past the source,
+    // so that overlapping bits are read before they are overwritten.
+    uintptr_t d_byte = (uintptr_t)d + dest_offset / 8;
+    uintptr_t s_byte = (uintptr_t)s + src_offset / 8;
+    if (d_byte < s_byte ||
+        (d_byte == s_byte && dest_offset % 8 < src_offset % 8)) {
+        // align the destination first, so later stores are whole bytes
+        size_t done = 0, n = 8 - dest_offset % 8;
+        while (done < bits) {
+            if (n > bits - done)
+                n = bits - done;
+            put_bits(d, dest_offset + done,
+                     read_bits(s, src_offset + done, n), n);
+            done += n;
+            n = COPY_CHUNK_BITS;
+        }
+    } else {
+        for (size_t left = bits; left > 0;) {
+            size_t n = left < COPY_CHUNK_BITS ? left : COPY_CHUNK_BITS;
+            left -= n;
+            put_bits(d, dest_offset + left, read_bits(s, src_offset + left, n),
+                     n);
+        }
+    }
+}
@@ -36,10 +36,26 @@ bool bitbuffer_next(bitbuffer *buffer);
  **/
 void bitbuffer_advance(bitbuffer *buffer, size_t bits);
 
+/**
+ * steps a bitbuffer forward by a specified amount, if it holds at
+ * least that many bits. Returns false (without moving the bitbuffer)
+ * instead of exiting when it does not.
+ **/
+bool bitbuffer_try_advance(bitbuffer *buffer, size_t bits);
+
+/**
+ * gets the number of bits between the head of a bitbuffer and its end
+ **/
+size_t bitbuffer_remaining_bits(bitbuffer *buffer);
+
 /**
  * copies a block of data from the head of a bitbuffer into
  * a given destination. Advances the bitbuffer past that data.
  *
+ * Whole bytes of the target are written: the bits of the last byte
+ * past `bits` are the ones that follow in the bitbuffer, where it has
+ * any.
+ *
  * target: the destination fro the data
  * source: the bitbuffer to copy from
  * bits: the number of bits to pop
@@ -47,6 +63,22 @@ void bitbuffer_advance(bitbuffer *buffer, size_t bits);
  **/
 void bitbuffer_pop(void *target, bitbuffer *source, size_t bits);
 
+/**
+ * Copies a run of bits between arbitrary bit offsets, most significant
+ * bit first (the bit order of a bitbuffer). The bits around the run in
+ * the destination are kept, and the source and destination may
+ * overlap, as with memmove.
+ *
+ * Runs aligned alike in both buffers are copied with memmove, others a
+ * word of shifted bits at a time.
+ *
+ * dest, dest_offset: the buffer to copy to, and the bit to start at
+ * src, src_offset: the buffer to copy from, and the bit to start at
+ * bits: the number of bits to copy
+ **/
+void bitbuffer_copybits(void *dest, size_t dest_offset, const void *src,
+                        size_t src_offset, size_t bits);
+
 /**
  * prints the remaining contents  of a bitbuffer in blocks of
  * 8 bits, with divisions between the internal bytes of the
@@ -0,0 +1,111 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "callpool.h"
+#include "langdef.h"
+
+// finds the list for calls to a function: the position of the first
+// function with its binary value, or function_ct if the function is
+// not that one, so that calls to it are not pooled
+static size_t pool_slot(bs_call_pool *p, function_def *fn) {
+    language_def *l = p->lang;
+    unsigned int value = fn->function_binary_value;
+    const function_plan *plan = lang_getplan(l, value);
+    size_t slot;
+    if (plan != NULL) {
+        slot = (size_t)(plan - l->plans);
+    } else {
+        size_t lo = 0, hi = l->function_ct;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (l->functions[mid]->function_binary_value < value) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        slot = lo;
+    }
+    if (slot >= p->function_ct || l->functions[slot] != fn)
+        return p->function_ct;
+    return slot;
+}
+
+void bs_call_pool_init(bs_call_pool *p, language_def *lang,
+                       const bs_allocator *alloc) {
+    memset(p, 0, sizeof(bs_call_pool));
+    p->lang = lang;
+    p->alloc = alloc;
+    p->function_ct = lang->function_ct;
+    p->free_lists =
+        bs_calloc(alloc, p->function_ct + 1, sizeof(function_call *));
+}
+
+// allocates a call to `fn` and a buffer for each of its arguments
+static function_call *new_call(bs_call_pool *p, function_def *fn) {
+    function_call *call = bs_malloc(p->alloc, sizeof(function_call));
+    if (call == NULL)
+        return NULL;
+    call->defn = fn;
+    call->borrowed = false;
+    call->alloc = p->alloc;
+    call->pool = NULL;
+    call->pool_next = NULL;
+    call->args = bs_calloc(p->alloc, fn->argc, sizeof(void *));
+    if (call->args == NULL && fn->argc > 0) {
+        bs_free(p->alloc, call);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < fn->argc; i++) {
+        size_t size = arg_value_size(fn->arguments[i]);
+        if (size == 0)
+            continue;
+        call->args[i] = bs_malloc(p->alloc, size);
+        if (call->args[i] == NULL) {
+            free_call(call);
+            return NULL;
+        }
+    }
+    return call;
+}
+
+function_call *bs_call_pool_take(bs_call_pool *p, function_def *fn) {
+    size_t slot = pool_slot(p, fn);
+    if (slot < p->function_ct && p->free_lists[slot] != NULL) {
+        function_call *call = p->free_lists[slot];
+        p->free_lists[slot] = call->pool_next;
+        call->pool_next = NULL;
+        p->pooled--;
+        p->hits++;
+        return call;
+    }
+
+    p->misses++;
+    function_call *call = new_call(p, fn);
+    if (call != NULL && slot < p->function_ct)
+        call->pool = p;
+    return call;
+}
+
+void bs_call_pool_give(bs_call_pool *p, function_call *call) {
+    size_t slot = pool_slot(p, call->defn);
+    call->pool_next = p->free_lists[slot];
+    p->free_lists[slot] = call;
+    p->pooled++;
+}
+
+void bs_call_pool_free(bs_call_pool *p) {
+    for (size_t i = 0; i < p->function_ct; i++) {
+        while (p->free_lists[i] != NULL) {
+            function_call *call = p->free_lists[i];
+            p->free_lists[i] = call->pool_next;
+            call->pool = NULL;
+            free_call(call);
+        }
+    }
+    bs_free(p->alloc, p->free_lists);
+    p->free_lists = NULL;
+    p->function_ct = 0;
+    p->pooled = 0;
+}
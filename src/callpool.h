@@ -0,0 +1,61 @@
+#ifndef BINSCRIPT_CALLPOOL
+#define BINSCRIPT_CALLPOOL
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "alloc.h"
+#include "langdef.h"
+
+/**
+ * Free lists of decoded calls, one per function of a language.
+ *
+ * Every call to a function has the same shape: the call, its argument
+ * array and one buffer per argument, all of fixed sizes. A consumer
+ * with a pool attached (see consumer_set_pool) takes calls for a
+ * function off its list and decodes into their buffers in place, and
+ * free_call puts calls from a pool back on their list instead of
+ * freeing them, so a loop of binscript_next and free_call stops
+ * allocating once every function it sees has a call waiting.
+ *
+ * Calls that borrow their strings from the input (zero-copy consumers)
+ * are not pooled. Calls keep a pointer to their pool, so the pool must
+ * outlive every call taken from it. A pool is not synchronized: calls
+ * taken from it must be freed on the thread that uses it.
+ **/
+
+typedef struct bs_call_pool {
+    language_def *lang;
+    const bs_allocator *alloc; // what pooled calls are allocated with
+
+    // free calls, chained through call->pool_next, indexed like
+    // lang->functions
+    function_call **free_lists;
+    size_t function_ct;
+
+    uint64_t hits;   // calls taken off a list
+    uint64_t misses; // calls allocated because a list was empty
+    size_t pooled;   // calls waiting on the lists
+} bs_call_pool;
+
+/**
+ * Initializes an empty pool for a finalized language, allocating the
+ * calls it hands out with `alloc` (NULL for malloc).
+ **/
+void bs_call_pool_init(bs_call_pool *p, language_def *lang,
+                       const bs_allocator *alloc);
+
+/**
+ * Takes a call to `fn` off the pool with its argument array and
+ * buffers in place, or allocates a new one. The arguments hold the
+ * values of the call's last use. Returns NULL if allocating fails.
+ **/
+function_call *bs_call_pool_take(bs_call_pool *p, function_def *fn);
+
+// puts a call taken from the pool back on its list (see free_call)
+void bs_call_pool_give(bs_call_pool *p, function_call *call);
+
+// frees every call waiting in the pool
+void bs_call_pool_free(bs_call_pool *p);
+
+#endif
@@ -0,0 +1,331 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitbuffer.h"
+#include "cfg.h"
+#include "util.h"
+
+// a statement with a flow rule, as found by the scan
+typedef struct cfg_branch {
+    size_t statement;
+    const bs_flow_rule *rule;
+    // the statement branched to, or BS_CFG_NONE. Jumps and calls hold
+    // their byte offset here until targets are resolved.
+    size_t target;
+    bool has_target;
+} cfg_branch;
+
+// where the target argument of each flow rule sits in its statement
+typedef struct cfg_target_field {
+    argument_def *arg;
+    size_t bit_offset;
+} cfg_target_field;
+
+static void cfg_clear(bs_cfg *cfg) {
+    free(cfg->offsets);
+    free(cfg->blocks);
+    free(cfg->edges);
+    cfg->offsets = NULL;
+    cfg->statement_ct = 0;
+    cfg->blocks = NULL;
+    cfg->block_ct = 0;
+    cfg->edges = NULL;
+    cfg->edge_ct = 0;
+    cfg->unresolved_ct = 0;
+}
+
+static cfg_target_field *locate_targets(language_def *l) {
+    cfg_target_field *fields =
+        calloc(l->flow_ct + 1, sizeof(cfg_target_field));
+    for (unsigned int i = 0; i < l->flow_ct; i++) {
+        function_def *fn = lang_getfn(l, l->flow[i].function_binary_value);
+        if (fn == NULL || l->flow[i].target_arg >= fn->argc)
+            continue;
+
+        size_t offset = l->function_name_width;
+        for (unsigned int j = 0; j < l->flow[i].target_arg; j++) {
+            offset += fn->arguments[j]->bitwidth;
+        }
+        fields[i].arg = fn->arguments[l->flow[i].target_arg];
+        fields[i].bit_offset = offset;
+    }
+    return fields;
+}
+
+// reads the target argument of a branching statement as a signed byte
+// offset. HEX fields are read in binary order, other integers as the
+// decoder reads them.
+static binscript_error read_target(language_def *l,
+                                   const cfg_target_field *field,
+                                   const unsigned char *statement,
+                                   size_t len, long int *out) {
+    if (field->arg->type == HEX) {
+        *out = (long int)read_bits(statement, field->bit_offset,
+                                   field->arg->bitwidth);
+        return BS_OK;
+    }
+
+    bitbuffer b;
+    bitbuffer_init_from_buffer(&b, (char *)statement, len);
+    bitbuffer_advance(&b, field->bit_offset);
+    return arg_read_checked(l, field->arg, &b, out);
+}
+
+// finds the statement starting at a byte offset
+static size_t find_offset(const size_t *offsets, size_t ct, size_t offset) {
+    size_t lo = 0, hi = ct;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (offsets[mid] < offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < ct && offsets[lo] == offset ? lo : BS_CFG_NONE;
+}
+
+static void push_edge(bs_cfg *cfg, size_t *cap, size_t from, size_t to,
+                      bs_cfg_edge_kind kind) {
+    if (cfg->edge_ct == *cap) {
+        *cap *= 2;
+        cfg->edges = realloc(cfg->edges, sizeof(bs_cfg_edge) * *cap);
+    }
+    cfg->edges[cfg->edge_ct].from = from;
+    cfg->edges[cfg->edge_ct].to = to;
+    cfg->edges[cfg->edge_ct].kind = kind;
+    cfg->edge_ct++;
+}
+
+// splits the statements into blocks and links them, once every branch
+// has been resolved to a statement
+static void link_blocks(bs_cfg *cfg, const cfg_branch *branches,
+                        size_t branch_ct) {
+    bool *leader = calloc(cfg->statement_ct + 1, sizeof(bool));
+    if (cfg->statement_ct > 0)
+        leader[0] = true;
+    for (size_t i = 0; i < branch_ct; i++) {
+        leader[branches[i].statement + 1] = true;
+        if (branches[i].target != BS_CFG_NONE)
+            leader[branches[i].target] = true;
+    }
+
+    size_t block_cap = 16;
+    cfg->blocks = malloc(sizeof(bs_cfg_block) * block_cap);
+    for (size_t i = 0; i < cfg->statement_ct; i++) {
+        if (leader[i]) {
+            if (cfg->block_ct == block_cap) {
+                block_cap *= 2;
+                cfg->blocks =
+                    realloc(cfg->blocks, sizeof(bs_cfg_block) * block_cap);
+            }
+            cfg->blocks[cfg->block_ct].first = i;
+            cfg->blocks[cfg->block_ct].count = 0;
+            cfg->block_ct++;
+        }
+        cfg->blocks[cfg->block_ct - 1].count++;
+    }
+    free(leader);
+
+    // a branch always ends its block, so walking the blocks in order
+    // meets the branches in order
+    size_t edge_cap = 16, next_branch = 0;
+    cfg->edges = malloc(sizeof(bs_cfg_edge) * edge_cap);
+    for (size_t i = 0; i < cfg->block_ct; i++) {
+        bs_cfg_block *block = &cfg->blocks[i];
+        size_t last = block->first + block->count - 1;
+        bool falls_through = i + 1 < cfg->block_ct;
+        block->first_edge = cfg->edge_ct;
+
+        if (next_branch < branch_ct &&
+            branches[next_branch].statement == last) {
+            const cfg_branch *branch = &branches[next_branch++];
+            size_t to = branch->target == BS_CFG_NONE
+                            ? BS_CFG_NONE
+                            : bs_cfg_block_of(cfg, branch->target);
+
+            switch (branch->rule->kind) {
+            case BS_FLOW_JUMP:
+                falls_through = false;
+                if (to != BS_CFG_NONE)
+                    push_edge(cfg, &edge_cap, i, to, BS_EDGE_JUMP);
+                break;
+            case BS_FLOW_CALL:
+                if (to != BS_CFG_NONE)
+                    push_edge(cfg, &edge_cap, i, to, BS_EDGE_CALL);
+                break;
+            case BS_FLOW_LOOP_END:
+                if (to != BS_CFG_NONE)
+                    push_edge(cfg, &edge_cap, i, to, BS_EDGE_LOOP);
+                break;
+            case BS_FLOW_RETURN:
+            case BS_FLOW_EXIT:
+                falls_through = false;
+                break;
+            default:
+                break;
+            }
+        }
+
+        if (falls_through)
+            push_edge(cfg, &edge_cap, i, i + 1, BS_EDGE_FALLTHROUGH);
+        block->edge_ct = cfg->edge_ct - block->first_edge;
+    }
+}
+
+binscript_error bs_cfg_build(bs_cfg *cfg, language_def *l, const void *buf,
+                             size_t len, binscript_endmode endmode,
+                             size_t base, size_t *error_offset) {
+    const unsigned char *bytes = (const unsigned char *)buf;
+    size_t name_bytes = bits2bytes(l->function_name_width);
+    size_t offset = 0, statement_cap = 64;
+    size_t branch_ct = 0, branch_cap = 16;
+    size_t open_ct = 0, open_cap = 16;
+    binscript_error e = BS_OK;
+
+    cfg->lang = l;
+    cfg->offsets = malloc(sizeof(size_t) * statement_cap);
+    cfg->statement_ct = 0;
+    cfg->blocks = NULL;
+    cfg->block_ct = 0;
+    cfg->edges = NULL;
+    cfg->edge_ct = 0;
+    cfg->unresolved_ct = 0;
+
+    cfg_branch *branches = malloc(sizeof(cfg_branch) * branch_cap);
+    size_t *open_loops = malloc(sizeof(size_t) * open_cap);
+    cfg_target_field *targets = locate_targets(l);
+
+    while (true) {
+        if (offset == len) {
+            if (endmode == NULL_TERMINATED)
+                e = BS_MISSING_TERMINATOR;
+            break;
+        }
+        if (len - offset < name_bytes) {
+            e = BS_TRUNCATED_STATEMENT;
+            break;
+        }
+
+        unsigned int opcode = (unsigned int)read_bits(
+            bytes, offset * 8, l->function_name_width);
+        bool terminator = opcode == 0 && endmode == NULL_TERMINATED;
+
+        size_t width = name_bytes;
+        const bs_flow_rule *rule = NULL;
+        if (!terminator) {
+            const function_plan *plan = lang_getplan(l, opcode);
+            function_def *fn =
+                plan != NULL ? plan->fn : lang_getfn(l, opcode);
+            if (fn == NULL) {
+                e = BS_UNKNOWN_OPCODE;
+                break;
+            }
+            width = bits2bytes(plan != NULL ? plan->width
+                                            : func_call_width(l, fn));
+            rule = plan != NULL ? plan->flow : lang_getflow(l, opcode);
+            if (width > len - offset) {
+                e = BS_TRUNCATED_STATEMENT;
+                break;
+            }
+        }
+
+        if (cfg->statement_ct == statement_cap) {
+            statement_cap *= 2;
+            cfg->offsets =
+                realloc(cfg->offsets, sizeof(size_t) * statement_cap);
+        }
+        size_t statement = cfg->statement_ct++;
+        cfg->offsets[statement] = offset;
+
+        if (rule != NULL) {
+            if (branch_ct == branch_cap) {
+                branch_cap *= 2;
+                branches = realloc(branches, sizeof(cfg_branch) * branch_cap);
+            }
+            cfg_branch *branch = &branches[branch_ct++];
+            branch->statement = statement;
+            branch->rule = rule;
+            branch->target = BS_CFG_NONE;
+            branch->has_target = false;
+
+            const cfg_target_field *field = &targets[rule - l->flow];
+            if (field->arg != NULL) {
+                long int value;
+                e = read_target(l, field, bytes + offset, width, &value);
+                if (e != BS_OK)
+                    break;
+
+                // targets outside the binary are left unresolved
+                long int target = rule->relative
+                                      ? (long int)offset + value
+                                      : value - (long int)base;
+                branch->has_target = target >= 0 && (size_t)target < len;
+                if (branch->has_target)
+                    branch->target = (size_t)target;
+                else
+                    cfg->unresolved_ct++;
+            } else if (rule->kind == BS_FLOW_LOOP_START) {
+                if (open_ct == open_cap) {
+                    open_cap *= 2;
+                    open_loops =
+                        realloc(open_loops, sizeof(size_t) * open_cap);
+                }
+                open_loops[open_ct++] = statement;
+            } else if (rule->kind == BS_FLOW_LOOP_END) {
+                if (open_ct > 0)
+                    branch->target = open_loops[--open_ct] + 1;
+                else
+                    cfg->unresolved_ct++;
+            }
+        }
+
+        offset += width;
+        if (terminator)
+            break;
+    }
+    free(open_loops);
+    free(targets);
+
+    if (e != BS_OK) {
+        free(branches);
+        cfg_clear(cfg);
+        if (error_offset != NULL)
+            *error_offset = offset;
+        return e;
+    }
+
+    // targets are byte offsets until every statement has been seen
+    for (size_t i = 0; i < branch_ct; i++) {
+        if (!branches[i].has_target)
+            continue;
+        branches[i].target = find_offset(cfg->offsets, cfg->statement_ct,
+                                         branches[i].target);
+        if (branches[i].target == BS_CFG_NONE)
+            cfg->unresolved_ct++;
+    }
+
+    link_blocks(cfg, branches, branch_ct);
+    free(branches);
+    return BS_OK;
+}
+
+size_t bs_cfg_statement_at(const bs_cfg *cfg, size_t offset) {
+    return find_offset(cfg->offsets, cfg->statement_ct, offset);
+}
+
+size_t bs_cfg_block_of(const bs_cfg *cfg, size_t statement) {
+    // the last block starting at or before the statement
+    size_t lo = 0, hi = cfg->block_ct;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (cfg->blocks[mid].first <= statement)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+void bs_cfg_free(bs_cfg *cfg) { cfg_clear(cfg); }
@@ -0,0 +1,109 @@
+#ifndef BINSCRIPT_CFG
+#define BINSCRIPT_CFG
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "langdef.h"
+#include "translator.h"
+
+/**
+ * Control-flow graphs of packed binaries.
+ *
+ * Which functions branch is declared in the language definition, by
+ * root level lines of the form
+ *
+ *     flow <function name> <kind> [<target argument> [relative]]
+ *
+ * after the function's def, where kind is one of jump, call, return,
+ * exit, loop_start or loop_end. Jumps and calls name the integer
+ * argument that holds the byte offset of their target. Targets are
+ * absolute (counted from the `base` passed to bs_cfg_build) unless the
+ * rule is marked relative, in which case they count from the start of
+ * the branching statement.
+ *
+ * A graph is built in one pass over the binary that reads only the
+ * opcode of each statement, and the target argument of the statements
+ * that branch. Nothing else is decoded, so building a graph costs about
+ * as much as indexing the binary (see patch.h).
+ *
+ * Basic blocks start at the first statement, at every branch target and
+ * after every statement with a flow rule. A loop_end loops back to the
+ * statement after the innermost open loop_start.
+ **/
+
+typedef enum bs_cfg_edge_kind {
+    BS_EDGE_FALLTHROUGH, // on to the next block
+    BS_EDGE_JUMP,        // to the target of a jump
+    BS_EDGE_CALL,        // to the target of a call, which returns after it
+    BS_EDGE_LOOP,        // back to the start of a loop body
+} bs_cfg_edge_kind;
+
+typedef struct bs_cfg_edge {
+    size_t from; // block indices
+    size_t to;
+    bs_cfg_edge_kind kind;
+} bs_cfg_edge;
+
+typedef struct bs_cfg_block {
+    // statements[first] up to statements[first + count]
+    size_t first;
+    size_t count;
+
+    // the edges leaving the block are edges[first_edge] up to
+    // edges[first_edge + edge_ct]
+    size_t first_edge;
+    size_t edge_ct;
+} bs_cfg_block;
+
+#define BS_CFG_NONE ((size_t)-1)
+
+typedef struct bs_cfg {
+    language_def *lang;
+
+    // byte offset of every statement, in binary order. The terminator
+    // of a NULL_TERMINATED binary is its last statement.
+    size_t *offsets;
+    size_t statement_ct;
+
+    bs_cfg_block *blocks;
+    size_t block_ct;
+
+    // every edge, grouped by the block it leaves
+    bs_cfg_edge *edges;
+    size_t edge_ct;
+
+    // jumps and calls whose target is not the start of a statement, and
+    // loop ends with no open loop. These get no edge.
+    size_t unresolved_ct;
+} bs_cfg;
+
+/**
+ * Builds the control-flow graph of a packed binary.
+ *
+ * endmode: NULL_TERMINATED binaries end at their terminator, for any
+ *      other mode every byte of the binary is statements
+ * base: the value an absolute target has for the first byte of `buf`
+ *
+ * returns BS_OK, or the error that stopped the scan, with the byte
+ * offset of the offending statement in *error_offset (if not NULL). The
+ * graph is empty on failure.
+ **/
+binscript_error bs_cfg_build(bs_cfg *cfg, language_def *lang, const void *buf,
+                             size_t len, binscript_endmode endmode,
+                             size_t base, size_t *error_offset);
+
+/**
+ * gets the index of the statement starting at a byte offset, or
+ * BS_CFG_NONE if no statement starts there
+ **/
+size_t bs_cfg_statement_at(const bs_cfg *cfg, size_t offset);
+
+/**
+ * gets the index of the block holding a statement
+ **/
+size_t bs_cfg_block_of(const bs_cfg *cfg, size_t statement);
+
+void bs_cfg_free(bs_cfg *cfg);
+
+#endif
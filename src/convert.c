@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "convert.h"
+#include "langdef.h"
+#include "translator.h"
+#include "util.h"
+
+void bs_buffer_init(bs_buffer *b) {
+    b->data = NULL;
+    b->len = 0;
+    b->capacity = 0;
+}
+
+void bs_buffer_reserve(bs_buffer *b, size_t extra) {
+    if (b->len + extra <= b->capacity)
+        return;
+
+    size_t capacity = b->capacity < 256 ? 256 : b->capacity;
+    while (capacity < b->len + extra) {
+        capacity *= 2;
+    }
+
+    b->data = realloc(b->data, capacity);
+    if (b->data == NULL) {
+        printf("error growing output buffer to %zu bytes\n", capacity);
+        exit(1);
+    }
+    b->capacity = capacity;
+}
+
+void bs_buffer_clear(bs_buffer *b) { b->len = 0; }
+
+void bs_buffer_free(bs_buffer *b) {
+    free(b->data);
+    bs_buffer_init(b);
+}
+
+// counts the time since `start` as spent formatting a call
+static void count_format(bs_stats *stats, function_call *call,
+                         uint64_t start) {
+    uint64_t ns = bs_stats_clock() - start;
+    bs_stats_opcode(stats, call->defn->function_binary_value)->format_ns += ns;
+    stats->ns[BS_STATS_FORMAT] += ns;
+}
+
+static binscript_error convert_bin2script(binscript_consumer *c,
+                                          bs_buffer *out) {
+    function_call *call;
+    binscript_error e;
+
+    // calls only live until they are printed, so strings can be
+    // formatted straight out of the input
+    consumer_set_zero_copy(c, true);
+    bs_stats *stats = bs_stats_active(c->stats);
+    while (BS_OK == (e = binscript_next_checked(c, &call)) && call != NULL) {
+        uint64_t start = stats != NULL ? bs_stats_clock() : 0;
+        bs_buffer_reserve(out, call_text_bound(call) + 1);
+        out->len += string_encode_function_call(out->data + out->len, call);
+        out->data[out->len++] = '\n';
+        if (stats != NULL)
+            count_format(stats, call, start);
+        free_call(call);
+    }
+    return e;
+}
+
+static binscript_error convert_script2bin(binscript_consumer *c,
+                                          binscript_endmode endmode,
+                                          bs_buffer *out) {
+    language_def *l = c->lang;
+    function_call *call;
+    binscript_error e;
+    size_t written;
+    bs_stats *stats = bs_stats_active(c->stats);
+
+    while (BS_OK == (e = binscript_next_checked(c, &call)) && call != NULL) {
+        uint64_t start = stats != NULL ? bs_stats_clock() : 0;
+
+        // statements are padded out to a whole number of bytes
+        size_t width = bits2bytes(func_call_width(l, call->defn));
+        bs_buffer_reserve(out, width);
+        memset(out->data + out->len, 0, width);
+
+        e = binary_encode_function_call_checked(out->data + out->len, width,
+                                                l, call, &written);
+        if (stats != NULL)
+            count_format(stats, call, start);
+        free_call(call);
+        if (e != BS_OK) {
+            c->error = e;
+            c->error_offset = c->offset - 1;
+            return e;
+        }
+        out->len += width;
+    }
+
+    if (e == BS_OK && endmode == NULL_TERMINATED) {
+        size_t terminator = bits2bytes(l->function_name_width);
+        bs_buffer_reserve(out, terminator);
+        memset(out->data + out->len, 0, terminator);
+        out->len += terminator;
+    }
+    return e;
+}
+
+binscript_error binscript_convert(language_def *l,
+                                  binscript_parser_direction direction,
+                                  binscript_endmode endmode, char *in,
+                                  size_t len, bs_buffer *out,
+                                  size_t *error_offset) {
+    return binscript_convert_counted(l, direction, endmode, in, len, out,
+                                     error_offset, NULL, NULL);
+}
+
+binscript_error binscript_convert_counted(language_def *l,
+                                          binscript_parser_direction direction,
+                                          binscript_endmode endmode, char *in,
+                                          size_t len, bs_buffer *out,
+                                          size_t *error_offset,
+                                          bs_stats *stats,
+                                          bs_call_pool *pool) {
+    binscript_consumer *c =
+        binscript_mem_consumer(l, in, "<convert>", direction);
+    binscript_error e;
+    consumer_set_stats(c, stats);
+
+    if (direction == BIN2SCRIPT) {
+        // without a terminator, the whole input is statements
+        consumer_set_size(c, endmode == NULL_TERMINATED ? NULL_TERMINATED
+                                                        : MANUAL_CUTOFF,
+                          0);
+        consumer_set_source_len(c, len);
+        consumer_set_pool(c, pool);
+        e = convert_bin2script(c, out);
+    } else {
+        e = convert_script2bin(c, endmode, out);
+    }
+
+    if (e != BS_OK && error_offset != NULL)
+        *error_offset = c->error_offset;
+
+    binscript_free(c);
+    return e;
+}
@@ -0,0 +1,83 @@
+#ifndef BINSCRIPT_CONVERT
+#define BINSCRIPT_CONVERT
+
+#include <stddef.h>
+
+#include "langdef.h"
+#include "translator.h"
+
+/**
+ * Whole-buffer conversion between packed binaries and textual scripts.
+ *
+ * binscript_convert runs a consumer over an input held in memory and
+ * appends the converted statements to a growable output buffer. The
+ * output buffer is only ever grown, so callers converting many inputs
+ * can reuse one buffer (per thread) and stop allocating once it has
+ * reached the size of the largest output.
+ **/
+
+// a growable byte buffer
+typedef struct bs_buffer {
+    char *data;
+    size_t len;
+    size_t capacity;
+} bs_buffer;
+
+void bs_buffer_init(bs_buffer *b);
+
+/**
+ * makes room for at least `extra` more bytes after b->len
+ **/
+void bs_buffer_reserve(bs_buffer *b, size_t extra);
+
+/**
+ * empties a buffer, keeping its storage for reuse
+ **/
+void bs_buffer_clear(bs_buffer *b);
+
+void bs_buffer_free(bs_buffer *b);
+
+/**
+ * Converts a whole input, appending the result to `out`.
+ *
+ * BIN2SCRIPT inputs are packed binaries of `len` bytes, and produce
+ * one statement per line. If endmode is NULL_TERMINATED the input
+ * must contain a terminator, otherwise the whole input is statements.
+ *
+ * SCRIPT2BIN inputs are scripts of `len` bytes, and must be followed
+ * by a null byte (in[len] == '\0'). They produce packed statements,
+ * followed by a terminator if endmode is NULL_TERMINATED.
+ *
+ * On failure, `out` holds the statements converted before the failing
+ * one, and *error_offset (if not NULL) holds the byte offset
+ * (BIN2SCRIPT) or statement index (SCRIPT2BIN) of the failing
+ * statement.
+ *
+ * returns BS_OK, or the error of the first statement that could not be
+ * converted.
+ **/
+binscript_error binscript_convert(language_def *l,
+                                  binscript_parser_direction direction,
+                                  binscript_endmode endmode, char *in,
+                                  size_t len, bs_buffer *out,
+                                  size_t *error_offset);
+
+/**
+ * Converts a whole input like binscript_convert, counting the work done
+ * into `stats` (see stats.h). Formatting calls as text or binary is
+ * timed as BS_STATS_FORMAT.
+ *
+ * If `pool` is not NULL, BIN2SCRIPT calls are decoded into calls taken
+ * from it (see consumer_set_pool), so a thread converting many inputs
+ * with one pool stops allocating calls once the pool holds one for
+ * each function it sees. The pool must be for `l`.
+ **/
+binscript_error binscript_convert_counted(language_def *l,
+                                          binscript_parser_direction direction,
+                                          binscript_endmode endmode, char *in,
+                                          size_t len, bs_buffer *out,
+                                          size_t *error_offset,
+                                          bs_stats *stats,
+                                          bs_call_pool *pool);
+
+#endif
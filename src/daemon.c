@@ -0,0 +1,574 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "convert.h"
+#include "daemon.h"
+#include "langdef.h"
+#include "translator.h"
+#include "validate.h"
+#include "workpool.h"
+
+// problems reported in detail by BS_OP_VALIDATE
+#define DAEMON_VALIDATE_PROBLEMS 64
+
+// how long a stopping daemon waits for its clients to read the
+// responses they are owed
+#define DAEMON_STOP_GRACE_SECONDS 1
+
+// a response waiting to be sent by its connection's writer
+typedef struct bs_reply {
+    bs_response_header header;
+    bs_buffer payload;
+    size_t request_len; // payload bytes of the request it answers
+    struct bs_reply *next;
+} bs_reply;
+
+typedef struct bs_conn {
+    int fd;
+    bs_daemon *daemon;
+
+    // requests read and not yet answered, and the bytes of their
+    // payloads, which the reader keeps under the BS_DAEMON_MAX_IN_FLIGHT
+    // limits. Workers queue responses for the writer instead of sending
+    // them, so a client that does not read only ever stalls its own
+    // writer.
+    pthread_mutex_t lock;
+    pthread_cond_t answered; // a response was sent
+    pthread_cond_t replied;  // a response was queued, or reading stopped
+    unsigned int in_flight;
+    size_t in_flight_bytes;
+    bool reading;
+    bs_reply *replies_head, *replies_tail;
+
+    // the reader, the writer and every queued request hold a reference,
+    // guarded by the daemon's lock. The last one closes the connection.
+    unsigned int refs;
+    struct bs_conn *prev, *next;
+} bs_conn;
+
+typedef struct bs_job {
+    bs_conn *conn;
+    bs_request_header header;
+    char *payload; // header.len bytes, followed by a null byte
+    struct bs_job *next;
+} bs_job;
+
+struct bs_daemon {
+    int listen_fd;
+    char *socket_path;
+    // set by bs_daemon_stop, which may run in a signal handler
+    atomic_int stopping;
+
+    language_def **langs;
+    const char **names;
+    size_t lang_ct;
+
+    pthread_mutex_t lock;
+    pthread_cond_t job_ready;
+    pthread_cond_t conns_closed;
+    bs_job *queue_head, *queue_tail;
+    bs_conn *conns;
+    size_t conn_ct;
+    bool workers_exit;
+
+    pthread_t *workers;
+    unsigned int worker_ct;
+};
+
+////////////////////
+// SOCKET HELPERS //
+////////////////////
+
+static bool read_full(int fd, void *buf, size_t len) {
+    char *at = buf;
+    while (len > 0) {
+        ssize_t got = read(fd, at, len);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return false;
+        at += got;
+        len -= got;
+    }
+    return true;
+}
+
+// sends a header and a payload as one message, without raising
+// SIGPIPE if the other end has gone away
+static bool send_frame(int fd, const void *header, size_t header_len,
+                       const void *payload, size_t len) {
+    struct iovec iov[2] = {
+        { .iov_base = (void *)header, .iov_len = header_len },
+        { .iov_base = (void *)payload, .iov_len = len },
+    };
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = len > 0 ? 2 : 1 };
+
+    while (msg.msg_iovlen > 0) {
+        ssize_t sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent < 0)
+            return false;
+
+        // skip over whatever was sent
+        while (msg.msg_iovlen > 0 && (size_t)sent >= msg.msg_iov->iov_len) {
+            sent -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen > 0) {
+            msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + sent;
+            msg.msg_iov->iov_len -= sent;
+        }
+    }
+    return true;
+}
+
+static bool unix_address(struct sockaddr_un *addr, const char *path) {
+    if (strlen(path) >= sizeof(addr->sun_path))
+        return false;
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+    return true;
+}
+
+/////////////////
+// CONNECTIONS //
+/////////////////
+
+static void conn_release(bs_conn *c) {
+    bs_daemon *d = c->daemon;
+    bool last;
+
+    pthread_mutex_lock(&d->lock);
+    last = --c->refs == 0;
+    if (last) {
+        if (c->prev != NULL)
+            c->prev->next = c->next;
+        else
+            d->conns = c->next;
+        if (c->next != NULL)
+            c->next->prev = c->prev;
+        if (--d->conn_ct == 0)
+            pthread_cond_broadcast(&d->conns_closed);
+    }
+    pthread_mutex_unlock(&d->lock);
+
+    if (last) {
+        close(c->fd);
+        pthread_cond_destroy(&c->answered);
+        pthread_cond_destroy(&c->replied);
+        pthread_mutex_destroy(&c->lock);
+        free(c);
+    }
+}
+
+// lets the writer exit once every request read has been answered
+static void conn_stop_reading(bs_conn *c) {
+    pthread_mutex_lock(&c->lock);
+    c->reading = false;
+    pthread_cond_signal(&c->replied);
+    pthread_mutex_unlock(&c->lock);
+}
+
+// reads requests off a connection and queues them for the workers
+static void *conn_reader_main(void *arg) {
+    bs_conn *c = arg;
+    bs_daemon *d = c->daemon;
+    bs_request_header header;
+
+    while (true) {
+        // wait for the client to read some responses if it is too far
+        // ahead. A single request is always let through, however large.
+        pthread_mutex_lock(&c->lock);
+        while (c->in_flight >= BS_DAEMON_MAX_IN_FLIGHT ||
+               (c->in_flight > 0 &&
+                c->in_flight_bytes >= BS_DAEMON_MAX_IN_FLIGHT_BYTES)) {
+            pthread_cond_wait(&c->answered, &c->lock);
+        }
+        pthread_mutex_unlock(&c->lock);
+
+        if (!read_full(c->fd, &header, sizeof(header)))
+            break;
+
+        // a frame this large is not a request, so the rest of the
+        // stream cannot be trusted either
+        if (header.len > BS_DAEMON_MAX_PAYLOAD)
+            break;
+
+        bs_job *job = malloc(sizeof(bs_job));
+        job->conn = c;
+        job->header = header;
+        job->payload = malloc(header.len + 1);
+        job->next = NULL;
+        if (!read_full(c->fd, job->payload, header.len)) {
+            free(job->payload);
+            free(job);
+            break;
+        }
+        job->payload[header.len] = '\0';
+
+        pthread_mutex_lock(&c->lock);
+        c->in_flight++;
+        c->in_flight_bytes += header.len;
+        pthread_mutex_unlock(&c->lock);
+
+        pthread_mutex_lock(&d->lock);
+        c->refs++;
+        if (d->queue_tail != NULL)
+            d->queue_tail->next = job;
+        else
+            d->queue_head = job;
+        d->queue_tail = job;
+        pthread_cond_signal(&d->job_ready);
+        pthread_mutex_unlock(&d->lock);
+    }
+
+    conn_stop_reading(c);
+    conn_release(c);
+    return NULL;
+}
+
+// sends the responses of a connection as the workers queue them
+static void *conn_writer_main(void *arg) {
+    bs_conn *c = arg;
+    bool open = true;
+
+    pthread_mutex_lock(&c->lock);
+    while (true) {
+        while (c->replies_head == NULL && (c->reading || c->in_flight > 0))
+            pthread_cond_wait(&c->replied, &c->lock);
+
+        bs_reply *reply = c->replies_head;
+        if (reply == NULL)
+            break;
+        c->replies_head = reply->next;
+        if (c->replies_head == NULL)
+            c->replies_tail = NULL;
+        pthread_mutex_unlock(&c->lock);
+
+        // a client that has gone away just misses its responses
+        if (open) {
+            open = send_frame(c->fd, &reply->header, sizeof(reply->header),
+                              reply->payload.data, reply->payload.len);
+        }
+        size_t request_len = reply->request_len;
+        bs_buffer_free(&reply->payload);
+        free(reply);
+
+        pthread_mutex_lock(&c->lock);
+        c->in_flight--;
+        c->in_flight_bytes -= request_len;
+        pthread_cond_signal(&c->answered);
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    conn_release(c);
+    return NULL;
+}
+
+/////////////
+// WORKERS //
+/////////////
+
+static binscript_error run_validate(language_def *l, bs_job *job,
+                                    bs_buffer *out, size_t *offset) {
+    binscript_problem problems[DAEMON_VALIDATE_PROBLEMS];
+    binscript_report r;
+    binscript_report_init(&r, problems, DAEMON_VALIDATE_PROBLEMS,
+                          job->header.flags & BS_REQUEST_UNTERMINATED
+                              ? MANUAL_CUTOFF
+                              : NULL_TERMINATED);
+
+    if (binscript_validate(l, job->payload, job->header.len, &r))
+        return BS_OK;
+
+    size_t shown = r.problem_ct < r.max_problems ? r.problem_ct
+                                                 : r.max_problems;
+    for (size_t i = 0; i < shown; i++) {
+        binscript_problem *p = &problems[i];
+        bs_buffer_reserve(out, 128);
+        out->len += sprintf(out->data + out->len,
+                            "%s statement %zu byte %zu bit %zu opcode 0x%x\n",
+                            binscript_error_name(p->error), p->statement,
+                            p->offset, p->bit_offset, p->opcode);
+    }
+    *offset = problems[0].offset;
+    return problems[0].error;
+}
+
+static void run_job(bs_daemon *d, bs_job *job, bs_buffer *out) {
+    bs_request_header *h = &job->header;
+    binscript_error status = BS_OK;
+    size_t offset = 0;
+    binscript_endmode endmode =
+        h->flags & BS_REQUEST_UNTERMINATED ? MANUAL_CUTOFF : NULL_TERMINATED;
+
+    bs_buffer_clear(out);
+    if (h->op != BS_OP_LANGS && h->lang >= d->lang_ct) {
+        status = BS_BAD_REQUEST;
+    } else {
+        switch (h->op) {
+        case BS_OP_DECODE:
+            status = binscript_convert(d->langs[h->lang], BIN2SCRIPT, endmode,
+                                       job->payload, h->len, out, &offset);
+            break;
+        case BS_OP_ENCODE:
+            status = binscript_convert(d->langs[h->lang], SCRIPT2BIN, endmode,
+                                       job->payload, h->len, out, &offset);
+            break;
+        case BS_OP_VALIDATE:
+            status = run_validate(d->langs[h->lang], job, out, &offset);
+            break;
+        case BS_OP_LANGS:
+            for (size_t i = 0; i < d->lang_ct; i++) {
+                bs_buffer_reserve(out, strlen(d->names[i]) + 16);
+                out->len += sprintf(out->data + out->len, "%zu %s\n", i,
+                                    d->names[i]);
+            }
+            break;
+        default:
+            status = BS_BAD_REQUEST;
+            break;
+        }
+    }
+
+    // hand the response to the connection's writer, along with the
+    // storage of `out`
+    bs_reply *reply = malloc(sizeof(bs_reply));
+    reply->header.len = (uint32_t)out->len;
+    reply->header.id = h->id;
+    reply->header.status = status;
+    reply->header.offset = (uint32_t)offset;
+    reply->payload = *out;
+    reply->request_len = h->len;
+    reply->next = NULL;
+    bs_buffer_init(out);
+
+    bs_conn *c = job->conn;
+    pthread_mutex_lock(&c->lock);
+    if (c->replies_tail != NULL)
+        c->replies_tail->next = reply;
+    else
+        c->replies_head = reply;
+    c->replies_tail = reply;
+    pthread_cond_signal(&c->replied);
+    pthread_mutex_unlock(&c->lock);
+}
+
+static void *worker_main(void *arg) {
+    bs_daemon *d = arg;
+    bs_buffer out;
+    bs_buffer_init(&out);
+
+    while (true) {
+        pthread_mutex_lock(&d->lock);
+        while (d->queue_head == NULL && !d->workers_exit)
+            pthread_cond_wait(&d->job_ready, &d->lock);
+
+        bs_job *job = d->queue_head;
+        if (job == NULL) {
+            pthread_mutex_unlock(&d->lock);
+            break;
+        }
+        d->queue_head = job->next;
+        if (d->queue_head == NULL)
+            d->queue_tail = NULL;
+        pthread_mutex_unlock(&d->lock);
+
+        run_job(d, job, &out);
+        conn_release(job->conn);
+        free(job->payload);
+        free(job);
+    }
+
+    bs_buffer_free(&out);
+    return NULL;
+}
+
+////////////
+// DAEMON //
+////////////
+
+bs_daemon *bs_daemon_create(const char *socket_path, language_def **langs,
+                            const char **names, size_t lang_ct,
+                            unsigned int threads) {
+    struct sockaddr_un addr;
+    if (lang_ct > 256 || !unix_address(&addr, socket_path))
+        return NULL;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return NULL;
+
+    unlink(socket_path);
+    if (0 != bind(fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+        0 != listen(fd, 128)) {
+        close(fd);
+        return NULL;
+    }
+
+    bs_daemon *d = calloc(1, sizeof(bs_daemon));
+    atomic_init(&d->stopping, 0);
+    d->listen_fd = fd;
+    d->socket_path = strdup(socket_path);
+    d->langs = langs;
+    d->names = names;
+    d->lang_ct = lang_ct;
+    d->worker_ct = threads == 0 ? workpool_cpu_count() : threads;
+    pthread_mutex_init(&d->lock, NULL);
+    pthread_cond_init(&d->job_ready, NULL);
+    pthread_cond_init(&d->conns_closed, NULL);
+    return d;
+}
+
+void bs_daemon_run(bs_daemon *d) {
+    d->workers = malloc(sizeof(pthread_t) * d->worker_ct);
+    d->workers_exit = false;
+    for (unsigned int i = 0; i < d->worker_ct; i++) {
+        pthread_create(&d->workers[i], NULL, worker_main, d);
+    }
+
+    while (!atomic_load(&d->stopping)) {
+        int fd = accept(d->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;
+        }
+
+        bs_conn *c = malloc(sizeof(bs_conn));
+        c->fd = fd;
+        c->daemon = d;
+        c->refs = 2; // the reader's and the writer's
+        c->prev = NULL;
+        c->in_flight = 0;
+        c->in_flight_bytes = 0;
+        c->reading = true;
+        c->replies_head = c->replies_tail = NULL;
+        pthread_mutex_init(&c->lock, NULL);
+        pthread_cond_init(&c->answered, NULL);
+        pthread_cond_init(&c->replied, NULL);
+
+        pthread_mutex_lock(&d->lock);
+        c->next = d->conns;
+        if (d->conns != NULL)
+            d->conns->prev = c;
+        d->conns = c;
+        d->conn_ct++;
+        pthread_mutex_unlock(&d->lock);
+
+        pthread_t reader, writer;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (0 != pthread_create(&writer, &attr, conn_writer_main, c)) {
+            conn_release(c);
+            conn_release(c);
+        } else if (0 != pthread_create(&reader, &attr, conn_reader_main, c)) {
+            conn_stop_reading(c);
+            conn_release(c);
+        }
+        pthread_attr_destroy(&attr);
+    }
+
+    // stop reading new requests, and give every connection a while to
+    // finish the requests it already sent
+    struct timespec grace;
+    clock_gettime(CLOCK_REALTIME, &grace);
+    grace.tv_sec += DAEMON_STOP_GRACE_SECONDS;
+
+    pthread_mutex_lock(&d->lock);
+    for (bs_conn *c = d->conns; c != NULL; c = c->next) {
+        shutdown(c->fd, SHUT_RD);
+    }
+    int waited = 0;
+    while (d->conn_ct > 0 && waited != ETIMEDOUT)
+        waited = pthread_cond_timedwait(&d->conns_closed, &d->lock, &grace);
+
+    // a client that is not reading keeps its writer blocked in sendmsg,
+    // and its reader waiting for answers. Shutting the rest down for
+    // writing fails those sends, and their responses are dropped.
+    for (bs_conn *c = d->conns; c != NULL; c = c->next) {
+        shutdown(c->fd, SHUT_RDWR);
+    }
+    while (d->conn_ct > 0)
+        pthread_cond_wait(&d->conns_closed, &d->lock);
+    d->workers_exit = true;
+    pthread_cond_broadcast(&d->job_ready);
+    pthread_mutex_unlock(&d->lock);
+
+    for (unsigned int i = 0; i < d->worker_ct; i++) {
+        pthread_join(d->workers[i], NULL);
+    }
+    free(d->workers);
+    d->workers = NULL;
+}
+
+void bs_daemon_stop(bs_daemon *d) {
+    atomic_store(&d->stopping, 1);
+    // wakes up accept()
+    shutdown(d->listen_fd, SHUT_RDWR);
+}
+
+void bs_daemon_free(bs_daemon *d) {
+    close(d->listen_fd);
+    unlink(d->socket_path);
+    free(d->socket_path);
+    pthread_mutex_destroy(&d->lock);
+    pthread_cond_destroy(&d->job_ready);
+    pthread_cond_destroy(&d->conns_closed);
+    free(d);
+}
+
+////////////
+// CLIENT //
+////////////
+
+int bs_client_connect(const char *socket_path) {
+    struct sockaddr_un addr;
+    if (!unix_address(&addr, socket_path))
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (0 != connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool bs_client_send(int fd, uint32_t id, bs_daemon_op op, uint8_t lang,
+                    uint8_t flags, const void *payload, size_t len) {
+    if (len > BS_DAEMON_MAX_PAYLOAD)
+        return false;
+
+    bs_request_header header = {
+        .len = (uint32_t)len, .id = id, .op = op, .lang = lang, .flags = flags
+    };
+    return send_frame(fd, &header, sizeof(header), payload, len);
+}
+
+bool bs_client_recv(int fd, bs_response_header *header, bs_buffer *payload) {
+    if (!read_full(fd, header, sizeof(*header)))
+        return false;
+
+    bs_buffer_reserve(payload, header->len + 1);
+    if (!read_full(fd, payload->data + payload->len, header->len))
+        return false;
+    payload->len += header->len;
+    payload->data[payload->len] = '\0';
+    return true;
+}
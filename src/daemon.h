@@ -0,0 +1,119 @@
+#ifndef BINSCRIPT_DAEMON
+#define BINSCRIPT_DAEMON
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "convert.h"
+#include "langdef.h"
+
+/**
+ * A resident conversion server on a Unix domain socket.
+ *
+ * The daemon holds a set of finalized languages, and serves decode,
+ * encode and validate requests for any of them. Each connection may
+ * pipeline requests: a reader thread per connection queues requests as
+ * they arrive, a pool of workers converts them, and a writer thread per
+ * connection sends the responses. Responses are tagged with the id of
+ * their request and are sent as soon as they are ready, so they may
+ * arrive out of order.
+ *
+ * A connection may have at most BS_DAEMON_MAX_IN_FLIGHT requests, or
+ * BS_DAEMON_MAX_IN_FLIGHT_BYTES of request payload, read and not yet
+ * answered. Past that the daemon stops reading from it until its client
+ * reads some responses, so a client that never reads holds neither
+ * memory nor workers.
+ *
+ * Frames are a fixed header followed by `len` bytes of payload. All
+ * header fields are in host byte order, since both ends are on the same
+ * machine.
+ **/
+
+#define BS_DAEMON_MAX_PAYLOAD (64u * 1024 * 1024)
+#define BS_DAEMON_MAX_IN_FLIGHT 64
+#define BS_DAEMON_MAX_IN_FLIGHT_BYTES BS_DAEMON_MAX_PAYLOAD
+
+typedef enum bs_daemon_op {
+    BS_OP_DECODE = 1,   // packed binary -> script, one statement per line
+    BS_OP_ENCODE = 2,   // script -> packed binary
+    BS_OP_VALIDATE = 3, // packed binary -> one line per problem found
+    BS_OP_LANGS = 4,    // no payload -> "<index> <name>" per language
+} bs_daemon_op;
+
+// set in bs_request_header.flags for binaries without a terminator
+#define BS_REQUEST_UNTERMINATED 0x01
+
+typedef struct bs_request_header {
+    uint32_t len; // bytes of payload following the header
+    uint32_t id;  // echoed in the response
+    uint8_t op;   // a bs_daemon_op
+    uint8_t lang; // index of the language, in the order they were loaded
+    uint8_t flags;
+    uint8_t reserved;
+} bs_request_header;
+
+typedef struct bs_response_header {
+    uint32_t len; // bytes of payload following the header
+    uint32_t id;  // id of the request this answers
+    uint32_t status; // a binscript_error
+    uint32_t offset; // error offset, as reported by binscript_convert
+} bs_response_header;
+
+typedef struct bs_daemon bs_daemon;
+
+/**
+ * Creates a daemon listening on a Unix socket at `socket_path`. Any
+ * existing file at that path is replaced.
+ *
+ * langs: the languages to serve. They must be finalized, and must
+ *      outlive the daemon.
+ * names: a name for each language, reported by BS_OP_LANGS
+ * lang_ct: the number of languages (at most 256)
+ * threads: the number of worker threads (0 for one per online CPU)
+ *
+ * returns NULL if the socket could not be created.
+ **/
+bs_daemon *bs_daemon_create(const char *socket_path, language_def **langs,
+                            const char **names, size_t lang_ct,
+                            unsigned int threads);
+
+/**
+ * Accepts and serves connections until bs_daemon_stop is called.
+ **/
+void bs_daemon_run(bs_daemon *d);
+
+/**
+ * Makes bs_daemon_run return once the requests it has already read are
+ * answered. Clients that have not read their responses within a second
+ * are disconnected, and what they were owed is dropped. Safe to call
+ * from another thread or from a signal handler.
+ **/
+void bs_daemon_stop(bs_daemon *d);
+
+/**
+ * Closes the socket and frees a daemon that is no longer running.
+ **/
+void bs_daemon_free(bs_daemon *d);
+
+/**
+ * Connects to a daemon. Returns a socket, or -1 on failure.
+ **/
+int bs_client_connect(const char *socket_path);
+
+/**
+ * Sends a request without waiting for its response.
+ *
+ * returns false if the request could not be sent.
+ **/
+bool bs_client_send(int fd, uint32_t id, bs_daemon_op op, uint8_t lang,
+                    uint8_t flags, const void *payload, size_t len);
+
+/**
+ * Reads the next response, appending its payload to `payload`.
+ *
+ * returns false if the connection failed or was closed.
+ **/
+bool bs_client_recv(int fd, bs_response_header *header, bs_buffer *payload);
+
+#endif
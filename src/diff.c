@@ -0,0 +1,467 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "diff.h"
+#include "langcache.h"
+#include "langdef.h"
+#include "patch.h"
+#include "translator.h"
+#include "util.h"
+
+// one step of an edit script
+typedef enum diff_op_kind { OP_EQUAL, OP_DELETE, OP_INSERT } diff_op_kind;
+
+typedef struct diff_op {
+    diff_op_kind kind;
+    size_t a; // statement of `a` kept or deleted
+    size_t b; // statement of `b` kept or inserted
+} diff_op;
+
+typedef struct diff_ops {
+    diff_op *ops;
+    size_t ct;
+    size_t cap;
+} diff_ops;
+
+// a statement as the search sees it
+typedef struct diff_statement {
+    const char *data;
+    function_def *fn;
+    size_t bits; // width of the statement, without padding
+    uint64_t hash;
+} diff_statement;
+
+static size_t statement_bits(language_def *l, function_def *fn) {
+    const function_plan *plan = lang_getplan(l, fn->function_binary_value);
+    return plan != NULL ? plan->width : func_call_width(l, fn);
+}
+
+// compares `bits` bits of two statements, starting `offset` bits in
+static bool bits_equal(const char *a, const char *b, size_t offset,
+                       size_t bits) {
+    // read up to a byte boundary, then let memcmp_bits take the rest
+    size_t lead = (8 - offset % 8) % 8;
+    if (lead > bits)
+        lead = bits;
+    if (lead > 0 && read_bits(a, offset, lead) != read_bits(b, offset, lead))
+        return false;
+    offset += lead;
+    bits -= lead;
+    return bits == 0 || 0 == memcmp_bits((void *)(a + offset / 8),
+                                         (void *)(b + offset / 8), bits);
+}
+
+static diff_statement *load_statements(language_def *l, const char *buf,
+                                       bs_index *index) {
+    diff_statement *s =
+        malloc(sizeof(diff_statement) * (index->statement_ct + 1));
+    for (size_t i = 0; i < index->statement_ct; i++) {
+        s[i].data = buf + index->statements[i].offset;
+        s[i].fn = index->statements[i].fn;
+        s[i].bits = statement_bits(l, s[i].fn);
+
+        // hash the whole bytes, then the bits of the last partial byte
+        s[i].hash = lang_source_hash(s[i].data, s[i].bits / 8);
+        if (s[i].bits % 8 != 0) {
+            s[i].hash ^= read_bits(s[i].data, s[i].bits / 8 * 8, s[i].bits % 8);
+            s[i].hash *= 0x100000001b3ULL;
+        }
+    }
+    return s;
+}
+
+static bool statements_equal(const diff_statement *a,
+                             const diff_statement *b) {
+    return a->hash == b->hash && a->fn == b->fn &&
+           bits_equal(a->data, b->data, 0, a->bits);
+}
+
+static void push_op(diff_ops *ops, diff_op_kind kind, size_t a, size_t b) {
+    if (ops->ct == ops->cap) {
+        ops->cap = ops->cap == 0 ? 64 : ops->cap * 2;
+        ops->ops = realloc(ops->ops, sizeof(diff_op) * ops->cap);
+    }
+    ops->ops[ops->ct].kind = kind;
+    ops->ops[ops->ct].a = a;
+    ops->ops[ops->ct].b = b;
+    ops->ct++;
+}
+
+////////////////////
+// EDIT SCRIPTING //
+////////////////////
+
+// finds a shortest edit script turning a[alo, ahi) into b[blo, bhi),
+// appending it to `ops`. The furthest reaching x of every diagonal k
+// after d edits is kept in trace[d * d + d + k], so that the path can be
+// walked back once the end is reached.
+static void myers(diff_statement *a, size_t alo, size_t ahi,
+                  diff_statement *b, size_t blo, size_t bhi, diff_ops *ops) {
+    long n = (long)(ahi - alo), m = (long)(bhi - blo);
+    long max = n + m < BS_DIFF_MAX_EDITS ? n + m : BS_DIFF_MAX_EDITS;
+    long *trace = NULL;
+    size_t trace_cap = 0;
+    long found = -1;
+
+    // v[k] for the diagonals of the step being computed
+    long *v = calloc(2 * max + 3, sizeof(long));
+    long *vk = v + max + 1;
+
+    for (long d = 0; d <= max && found < 0; d++) {
+        for (long k = -d; k <= d; k += 2) {
+            long x;
+            if (k == -d || (k != d && vk[k - 1] < vk[k + 1])) {
+                x = vk[k + 1];
+            } else {
+                x = vk[k - 1] + 1;
+            }
+            long y = x - k;
+            while (x < n && y < m &&
+                   statements_equal(&a[alo + x], &b[blo + y])) {
+                x++;
+                y++;
+            }
+            vk[k] = x;
+            if (x >= n && y >= m) {
+                found = d;
+            }
+        }
+
+        size_t need = (size_t)(d + 1) * (d + 1);
+        if (need > trace_cap) {
+            trace_cap = need * 2;
+            trace = realloc(trace, sizeof(long) * trace_cap);
+        }
+        memcpy(trace + d * d, vk - d, sizeof(long) * (2 * d + 1));
+    }
+    free(v);
+
+    // too many differences: replace everything in between
+    if (found < 0) {
+        for (size_t i = alo; i < ahi; i++)
+            push_op(ops, OP_DELETE, i, BS_DIFF_NONE);
+        for (size_t i = blo; i < bhi; i++)
+            push_op(ops, OP_INSERT, BS_DIFF_NONE, i);
+        free(trace);
+        return;
+    }
+
+    // walk back from the end, collecting the script in reverse
+    diff_ops reversed = { 0 };
+    long x = n, y = m;
+    for (long d = found; d > 0; d--) {
+        long *prev = trace + (d - 1) * (d - 1) + (d - 1);
+        long k = x - y;
+        long prev_k = (k == -d || (k != d && prev[k - 1] < prev[k + 1]))
+                          ? k + 1
+                          : k - 1;
+        long prev_x = prev[prev_k];
+        long prev_y = prev_x - prev_k;
+        long mid_x = prev_k == k + 1 ? prev_x : prev_x + 1;
+
+        // the snake after the edit
+        while (x > mid_x) {
+            x--;
+            y--;
+            push_op(&reversed, OP_EQUAL, alo + x, blo + y);
+        }
+        if (prev_k == k + 1) {
+            push_op(&reversed, OP_INSERT, BS_DIFF_NONE, blo + prev_y);
+        } else {
+            push_op(&reversed, OP_DELETE, alo + prev_x, BS_DIFF_NONE);
+        }
+        x = prev_x;
+        y = prev_y;
+    }
+    // the snake before the first edit
+    while (x > 0 && y > 0) {
+        x--;
+        y--;
+        push_op(&reversed, OP_EQUAL, alo + x, blo + y);
+    }
+
+    for (size_t i = reversed.ct; i-- > 0;) {
+        diff_op *op = &reversed.ops[i];
+        push_op(ops, op->kind, op->a, op->b);
+    }
+    free(reversed.ops);
+    free(trace);
+}
+
+/////////////
+// RESULTS //
+/////////////
+
+static bs_diff_entry *push_entry(bs_diff *d, bs_diff_kind kind, size_t a,
+                                 size_t b) {
+    if (d->entry_ct == d->entry_cap) {
+        d->entry_cap = d->entry_cap == 0 ? 16 : d->entry_cap * 2;
+        d->entries = realloc(d->entries, sizeof(bs_diff_entry) * d->entry_cap);
+    }
+    bs_diff_entry *e = &d->entries[d->entry_ct++];
+    e->kind = kind;
+    e->a_statement = a;
+    e->b_statement = b;
+    e->first_field = d->field_ct;
+    e->field_ct = 0;
+    return e;
+}
+
+static void push_change(bs_diff *d, diff_statement *a, size_t ai,
+                        diff_statement *b, size_t bi) {
+    bs_diff_entry *e = push_entry(d, BS_DIFF_CHANGE, ai, bi);
+    function_def *fn = a[ai].fn;
+    size_t offset = d->lang->function_name_width;
+
+    for (size_t i = 0; i < fn->argc; i++) {
+        argument_def *arg = fn->arguments[i];
+        if (arg->type != SKIP &&
+            !bits_equal(a[ai].data, b[bi].data, offset, arg->bitwidth)) {
+            if (d->field_ct == d->field_cap) {
+                d->field_cap = d->field_cap == 0 ? 16 : d->field_cap * 2;
+                d->fields = realloc(d->fields, sizeof(size_t) * d->field_cap);
+            }
+            d->fields[d->field_ct++] = i;
+            e->field_ct++;
+        }
+        offset += arg->bitwidth;
+    }
+}
+
+// an insert of a hunk, waiting to be paired with a delete
+typedef struct pending_insert {
+    uintptr_t fn;
+    size_t op; // position in the hunk
+} pending_insert;
+
+static int compare_pending(const void *x, const void *y) {
+    const pending_insert *a = x, *b = y;
+    if (a->fn != b->fn)
+        return a->fn < b->fn ? -1 : 1;
+    return a->op < b->op ? -1 : a->op > b->op;
+}
+
+// finds the first pending insert of a function, or returns ct if the
+// hunk inserts none
+static size_t find_pending(pending_insert *pending, size_t ct,
+                           uintptr_t fn) {
+    size_t lo = 0, hi = ct;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (pending[mid].fn < fn) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < ct && pending[lo].fn == fn ? lo : ct;
+}
+
+// turns a run of deletes and inserts into entries, pairing each deleted
+// statement with the next inserted statement of the same function
+static void flush_hunk(bs_diff *d, diff_statement *a, diff_statement *b,
+                       diff_op *ops, size_t ct) {
+    // the inserts grouped by function, in hunk order within a function,
+    // so that finding the next insert of a function only passes over
+    // inserts of that function, and each of them only once. This keeps
+    // the hunk linear when the search gives up and one hunk holds both
+    // binaries. head[g], for the first insert g of a group, is the
+    // first insert of the group not yet paired or passed.
+    pending_insert *pending = malloc(sizeof(pending_insert) * (ct + 1));
+    size_t *head = malloc(sizeof(size_t) * (ct + 1));
+    size_t pending_ct = 0;
+    for (size_t i = 0; i < ct; i++) {
+        if (ops[i].kind == OP_INSERT) {
+            pending[pending_ct].fn = (uintptr_t)b[ops[i].b].fn;
+            pending[pending_ct].op = i;
+            head[pending_ct] = pending_ct;
+            pending_ct++;
+        }
+    }
+    qsort(pending, pending_ct, sizeof(pending_insert), compare_pending);
+
+    size_t next_insert = 0;
+    for (size_t i = 0; i < ct; i++) {
+        if (ops[i].kind != OP_DELETE)
+            continue;
+
+        uintptr_t fn = (uintptr_t)a[ops[i].a].fn;
+        size_t group = find_pending(pending, pending_ct, fn), match = ct;
+        if (group < pending_ct) {
+            size_t *g = &head[group];
+            while (*g < pending_ct && pending[*g].fn == fn &&
+                   pending[*g].op < next_insert) {
+                (*g)++;
+            }
+            if (*g < pending_ct && pending[*g].fn == fn)
+                match = pending[(*g)++].op;
+        }
+        if (match == ct) {
+            push_entry(d, BS_DIFF_DELETE, ops[i].a, BS_DIFF_NONE);
+            continue;
+        }
+
+        for (; next_insert < match; next_insert++) {
+            if (ops[next_insert].kind == OP_INSERT)
+                push_entry(d, BS_DIFF_INSERT, BS_DIFF_NONE,
+                           ops[next_insert].b);
+        }
+        push_change(d, a, ops[i].a, b, ops[match].b);
+        next_insert = match + 1;
+    }
+    for (; next_insert < ct; next_insert++) {
+        if (ops[next_insert].kind == OP_INSERT)
+            push_entry(d, BS_DIFF_INSERT, BS_DIFF_NONE, ops[next_insert].b);
+    }
+    free(pending);
+    free(head);
+}
+
+binscript_error bs_diff_binaries(bs_diff *d, language_def *l, const void *a,
+                                 size_t a_len, const void *b, size_t b_len,
+                                 binscript_endmode endmode) {
+    memset(d, 0, sizeof(bs_diff));
+    d->lang = l;
+    d->a = a;
+    d->b = b;
+
+    binscript_error e = bs_index_build(&d->a_index, l, a, a_len, endmode,
+                                       &d->error_offset);
+    if (e != BS_OK)
+        return e;
+    e = bs_index_build(&d->b_index, l, b, b_len, endmode, &d->error_offset);
+    if (e != BS_OK) {
+        d->error_in_b = true;
+        return e;
+    }
+
+    diff_statement *as = load_statements(l, d->a, &d->a_index);
+    diff_statement *bs = load_statements(l, d->b, &d->b_index);
+    size_t alo = 0, ahi = d->a_index.statement_ct;
+    size_t blo = 0, bhi = d->b_index.statement_ct;
+
+    // unchanged statements at either end need no search
+    while (alo < ahi && blo < bhi && statements_equal(&as[alo], &bs[blo])) {
+        alo++;
+        blo++;
+    }
+    while (ahi > alo && bhi > blo &&
+           statements_equal(&as[ahi - 1], &bs[bhi - 1])) {
+        ahi--;
+        bhi--;
+    }
+    d->unchanged_ct = alo + (d->a_index.statement_ct - ahi);
+
+    diff_ops ops = { 0 };
+    myers(as, alo, ahi, bs, blo, bhi, &ops);
+
+    size_t hunk = 0;
+    for (size_t i = 0; i <= ops.ct; i++) {
+        if (i < ops.ct && ops.ops[i].kind != OP_EQUAL)
+            continue;
+        flush_hunk(d, as, bs, ops.ops + hunk, i - hunk);
+        if (i < ops.ct)
+            d->unchanged_ct++;
+        hunk = i + 1;
+    }
+
+    free(ops.ops);
+    free(as);
+    free(bs);
+    return BS_OK;
+}
+
+// decodes a statement of one of the binaries, or returns NULL and
+// prints why it could not be decoded
+static function_call *decode_statement(bs_diff *d, const char *buf,
+                                       bs_index *index, size_t statement,
+                                       FILE *out) {
+    const bs_statement *s = &index->statements[statement];
+    size_t bytes = bits2bytes(statement_bits(d->lang, s->fn));
+    function_call *call;
+    binscript_error e = decode_function_call_checked(
+        d->lang, (char *)buf + s->offset, bytes, &call);
+    if (e != BS_OK) {
+        fprintf(out, "<%s: %s>", s->fn->name, binscript_error_name(e));
+        return NULL;
+    }
+    return call;
+}
+
+static void print_call(bs_diff *d, const char *buf, bs_index *index,
+                       size_t statement, FILE *out) {
+    function_call *call = decode_statement(d, buf, index, statement, out);
+    if (call == NULL)
+        return;
+    char *text = malloc(call_text_bound(call));
+    string_encode_function_call(text, call);
+    fputs(text, out);
+    free(text);
+    free_call(call);
+}
+
+static void print_change(bs_diff *d, bs_diff_entry *e, FILE *out) {
+    function_call *a =
+        decode_statement(d, d->a, &d->a_index, e->a_statement, out);
+    function_call *b =
+        decode_statement(d, d->b, &d->b_index, e->b_statement, out);
+    if (a == NULL || b == NULL) {
+        // either side may have failed to decode on its own
+        if (a != NULL)
+            free_call(a);
+        if (b != NULL)
+            free_call(b);
+        return;
+    }
+
+    fputs(a->defn->name, out);
+    for (size_t i = 0; i < e->field_ct; i++) {
+        size_t arg = d->fields[e->first_field + i];
+        char *text = malloc(arg_text_bound(a->defn->arguments[arg]) + 1);
+
+        fprintf(out, "%s %s: ", i == 0 ? "" : ",",
+                a->defn->arguments[arg]->name);
+        string_encode_arg(text, a, arg);
+        fprintf(out, "%s -> ", text);
+        string_encode_arg(text, b, arg);
+        fputs(text, out);
+        free(text);
+    }
+    free_call(a);
+    free_call(b);
+}
+
+void bs_diff_print(bs_diff *d, FILE *out) {
+    for (size_t i = 0; i < d->entry_ct; i++) {
+        bs_diff_entry *e = &d->entries[i];
+        switch (e->kind) {
+        case BS_DIFF_DELETE:
+            fprintf(out, "- a:%zu ", e->a_statement);
+            print_call(d, d->a, &d->a_index, e->a_statement, out);
+            break;
+        case BS_DIFF_INSERT:
+            fprintf(out, "+ b:%zu ", e->b_statement);
+            print_call(d, d->b, &d->b_index, e->b_statement, out);
+            break;
+        case BS_DIFF_CHANGE:
+            fprintf(out, "~ a:%zu b:%zu ", e->a_statement, e->b_statement);
+            print_change(d, e, out);
+            break;
+        }
+        fputc('\n', out);
+    }
+}
+
+void bs_diff_free(bs_diff *d) {
+    bs_index_free(&d->a_index);
+    bs_index_free(&d->b_index);
+    free(d->entries);
+    free(d->fields);
+    d->entries = NULL;
+    d->fields = NULL;
+    d->entry_ct = 0;
+    d->field_ct = 0;
+}
@@ -0,0 +1,97 @@
+#ifndef BINSCRIPT_DIFF
+#define BINSCRIPT_DIFF
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "langdef.h"
+#include "patch.h"
+#include "translator.h"
+
+/**
+ * Statement level comparison of two packed binaries of one language.
+ *
+ * Both binaries are indexed (see patch.h), and statements are compared
+ * as raw bits with memcmp_bits, ignoring the padding after the last
+ * field. The unchanged statements at either end are skipped, and the
+ * remaining statements are matched with a shortest edit script (Myers'
+ * algorithm) over statement hashes. A deleted statement followed by an
+ * inserted statement of the same function is reported as a change,
+ * along with the arguments whose bits differ.
+ *
+ * Nothing is decoded while diffing. bs_diff_print decodes only the
+ * statements that differ.
+ **/
+
+typedef enum bs_diff_kind {
+    BS_DIFF_DELETE, // a statement of `a` that is not in `b`
+    BS_DIFF_INSERT, // a statement of `b` that is not in `a`
+    BS_DIFF_CHANGE, // a statement of `a` with different arguments in `b`
+} bs_diff_kind;
+
+#define BS_DIFF_NONE ((size_t)-1)
+
+typedef struct bs_diff_entry {
+    bs_diff_kind kind;
+
+    // index of the statement in each binary's index, or BS_DIFF_NONE for
+    // the side an insert or delete is not in
+    size_t a_statement;
+    size_t b_statement;
+
+    // for changes, the arguments that differ are
+    // diff->fields[first_field] up to diff->fields[first_field + field_ct]
+    size_t first_field;
+    size_t field_ct;
+} bs_diff_entry;
+
+// above this many edits the remaining statements are reported as
+// deleted and inserted wholesale, to bound the memory of the search
+#define BS_DIFF_MAX_EDITS 1024
+
+typedef struct bs_diff {
+    language_def *lang;
+    const char *a;
+    const char *b;
+    bs_index a_index;
+    bs_index b_index;
+
+    // differences, in the order of the statements they affect
+    bs_diff_entry *entries;
+    size_t entry_ct;
+    size_t entry_cap;
+
+    size_t *fields;
+    size_t field_ct;
+    size_t field_cap;
+
+    size_t unchanged_ct; // statements found in both binaries
+
+    // set when indexing a binary fails
+    bool error_in_b;
+    size_t error_offset;
+} bs_diff;
+
+/**
+ * Compares two binaries. Both must stay alive until the diff is freed.
+ *
+ * returns BS_OK, or the error found indexing `a` or `b` (error_in_b
+ * tells which), at error_offset.
+ **/
+binscript_error bs_diff_binaries(bs_diff *diff, language_def *lang,
+                                 const void *a, size_t a_len, const void *b,
+                                 size_t b_len, binscript_endmode endmode);
+
+/**
+ * Prints one line per difference:
+ *
+ *     - a:3 wait(5)                     a deleted statement
+ *     + b:4 wait(6)                     an inserted statement
+ *     ~ a:7 b:8 hitbox dmg: 2 -> 9      changed arguments
+ **/
+void bs_diff_print(bs_diff *diff, FILE *out);
+
+void bs_diff_free(bs_diff *diff);
+
+#endif
@@ -0,0 +1,563 @@
+// syscall(2) and MAP_POPULATE, for io_uring
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "filereader.h"
+
+#if defined(__linux__) && !defined(BINSCRIPT_NO_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+// IORING_OP_READ is an enum, so look for a macro from the same headers
+#if defined(__NR_io_uring_setup) && defined(IO_URING_OP_SUPPORTED)
+#define BS_HAVE_IO_URING
+#endif
+#endif
+
+#define READER_DEFAULT_DEPTH 32
+#define READER_MAX_THREADS 16
+#define READER_CHUNK (64 * 1024)
+// reads larger than this are split, to stay within an sqe's length
+#define READER_MAX_SUBMIT (1U << 30)
+
+typedef struct read_slot {
+    bs_read read; // first, so that handed out reads lead to their slot
+    size_t capacity;
+    size_t want; // the size of the file being read through io_uring
+    int fd;
+    struct read_slot *next; // on the free or done list
+} read_slot;
+
+#ifdef BS_HAVE_IO_URING
+typedef struct uring {
+    int fd;
+    unsigned int entries;
+    unsigned int *sq_tail, *sq_mask, *sq_array;
+    unsigned int *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+} uring;
+#endif
+
+struct bs_file_reader {
+    const char *const *paths;
+    size_t path_ct;
+    bs_read_backend backend;
+
+    pthread_mutex_t lock;
+    pthread_cond_t ready; // a read is done, or every file was handed out
+    pthread_cond_t space; // a slot was released, or the reader stops
+    read_slot *slots;
+    unsigned int slot_ct;
+    read_slot *free_slots;
+    read_slot *done; // reads waiting to be taken, oldest first
+    read_slot **done_tail;
+    size_t next_item; // the next path to start reading
+    size_t handed;    // reads taken with bs_file_reader_next
+    bool stopping;
+
+    pthread_t *threads;
+    unsigned int thread_ct;
+#ifdef BS_HAVE_IO_URING
+    uring ring;
+#endif
+};
+
+///////////
+// SLOTS //
+///////////
+
+// makes room for `size` bytes in a slot's buffer
+static bool slot_reserve(read_slot *slot, size_t size) {
+    if (size <= slot->capacity)
+        return true;
+    size_t capacity = slot->capacity < READER_CHUNK ? READER_CHUNK
+                                                    : slot->capacity;
+    while (capacity < size) {
+        capacity *= 2;
+    }
+    char *data = realloc(slot->read.data, capacity);
+    if (data == NULL)
+        return false;
+    slot->read.data = data;
+    slot->capacity = capacity;
+    return true;
+}
+
+// reads an open file to its end
+static void slot_read_fd(read_slot *slot, int fd) {
+    for (;;) {
+        if (!slot_reserve(slot, slot->read.len + READER_CHUNK + 1)) {
+            slot->read.sys_errno = ENOMEM;
+            return;
+        }
+        ssize_t got = read(fd, slot->read.data + slot->read.len,
+                           slot->capacity - slot->read.len - 1);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got < 0) {
+            slot->read.sys_errno = errno;
+            return;
+        }
+        if (got == 0)
+            return;
+        slot->read.len += (size_t)got;
+    }
+}
+
+static void slot_read_path(read_slot *slot, const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        slot->read.sys_errno = errno;
+        return;
+    }
+    slot_read_fd(slot, fd);
+    close(fd);
+}
+
+// takes a free slot and the next path to read into it, waiting for a
+// slot if `wait` is set. Returns NULL once every path has been started,
+// when the reader stops, or if no slot is free and `wait` is not set.
+static read_slot *claim_slot(bs_file_reader *r, bool wait) {
+    read_slot *slot = NULL;
+    pthread_mutex_lock(&r->lock);
+    while (wait && r->free_slots == NULL && !r->stopping &&
+           r->next_item < r->path_ct) {
+        pthread_cond_wait(&r->space, &r->lock);
+    }
+    if (r->free_slots != NULL && !r->stopping && r->next_item < r->path_ct) {
+        slot = r->free_slots;
+        r->free_slots = slot->next;
+        slot->read.item = r->next_item++;
+    }
+    pthread_mutex_unlock(&r->lock);
+
+    if (slot != NULL) {
+        slot->read.len = 0;
+        slot->read.sys_errno = 0;
+        slot->fd = -1;
+    }
+    return slot;
+}
+
+// puts a read on the done list, for bs_file_reader_next
+static void finish_slot(bs_file_reader *r, read_slot *slot) {
+    if (slot->read.sys_errno != 0)
+        slot->read.len = 0;
+    if (slot->read.data != NULL)
+        slot->read.data[slot->read.len] = '\0';
+
+    pthread_mutex_lock(&r->lock);
+    slot->next = NULL;
+    *r->done_tail = slot;
+    r->done_tail = &slot->next;
+    pthread_cond_signal(&r->ready);
+    pthread_mutex_unlock(&r->lock);
+}
+
+/////////////
+// THREADS //
+/////////////
+
+static void *read_thread_main(void *arg) {
+    bs_file_reader *r = arg;
+    read_slot *slot;
+    while ((slot = claim_slot(r, true)) != NULL) {
+        slot_read_path(slot, r->paths[slot->read.item]);
+        finish_slot(r, slot);
+    }
+    return NULL;
+}
+
+static bool start_threads(bs_file_reader *r) {
+    unsigned int ct = r->slot_ct < READER_MAX_THREADS ? r->slot_ct
+                                                      : READER_MAX_THREADS;
+    if (ct > r->path_ct)
+        ct = r->path_ct > 0 ? (unsigned int)r->path_ct : 1;
+
+    r->threads = malloc(sizeof(pthread_t) * ct);
+    if (r->threads == NULL)
+        return false;
+    for (r->thread_ct = 0; r->thread_ct < ct; r->thread_ct++) {
+        if (0 != pthread_create(&r->threads[r->thread_ct], NULL,
+                                read_thread_main, r))
+            break;
+    }
+    r->backend = BS_READ_THREADS;
+    return r->thread_ct > 0;
+}
+
+//////////////
+// IO_URING //
+//////////////
+
+#ifdef BS_HAVE_IO_URING
+
+// whether the kernel knows IORING_OP_READ, which came after io_uring
+static bool uring_can_read(int fd) {
+    size_t op_ct = IORING_OP_READ + 1;
+    struct io_uring_probe *probe = calloc(
+        1, sizeof(struct io_uring_probe) +
+               op_ct * sizeof(struct io_uring_probe_op));
+    if (probe == NULL)
+        return false;
+    bool ok = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE,
+                      probe, op_ct) >= 0 &&
+              probe->last_op >= IORING_OP_READ &&
+              (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return ok;
+}
+
+static void uring_free(uring *ring) {
+    if (ring->sqes != NULL)
+        munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring)
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring != NULL)
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->fd >= 0)
+        close(ring->fd);
+    memset(ring, 0, sizeof(uring));
+    ring->fd = -1;
+}
+
+static void *uring_map(int fd, size_t size, off_t offset) {
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, offset);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+static bool uring_init(uring *ring, unsigned int entries) {
+    struct io_uring_params p;
+    memset(ring, 0, sizeof(uring));
+    memset(&p, 0, sizeof(p));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (ring->fd < 0 || !uring_can_read(ring->fd)) {
+        uring_free(ring);
+        return false;
+    }
+    ring->entries = p.sq_entries < entries ? p.sq_entries : entries;
+
+    ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    ring->cq_ring_size =
+        p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size)
+            ring->sq_ring_size = ring->cq_ring_size;
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+    ring->sq_ring = uring_map(ring->fd, ring->sq_ring_size, IORING_OFF_SQ_RING);
+    ring->cq_ring = (p.features & IORING_FEAT_SINGLE_MMAP)
+                        ? ring->sq_ring
+                        : uring_map(ring->fd, ring->cq_ring_size,
+                                    IORING_OFF_CQ_RING);
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = uring_map(ring->fd, ring->sqes_size, IORING_OFF_SQES);
+    if (ring->sq_ring == NULL || ring->cq_ring == NULL || ring->sqes == NULL) {
+        uring_free(ring);
+        return false;
+    }
+
+    char *sq = ring->sq_ring, *cq = ring->cq_ring;
+    ring->sq_tail = (unsigned int *)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned int *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned int *)(sq + p.sq_off.array);
+    ring->cq_head = (unsigned int *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned int *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned int *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return true;
+}
+
+// queues a read of the rest of a slot's file. Only the reader thread
+// touches the submission queue, so its tail needs no lock.
+static void uring_queue_read(uring *ring, read_slot *slot) {
+    unsigned int tail = *ring->sq_tail;
+    unsigned int index = tail & *ring->sq_mask;
+    size_t left = slot->want - slot->read.len;
+
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = slot->fd;
+    sqe->addr = (uintptr_t)(slot->read.data + slot->read.len);
+    sqe->len = left < READER_MAX_SUBMIT ? (unsigned int)left
+                                        : READER_MAX_SUBMIT;
+    sqe->off = slot->read.len;
+    sqe->user_data = (uintptr_t)slot;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// opens a slot's file and queues a read of all of it. Files that are
+// empty or not regular files (whose size cannot be known) are read
+// right away instead, and false returned.
+static bool uring_start_read(bs_file_reader *r, read_slot *slot) {
+    int fd = open(r->paths[slot->read.item], O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        slot->read.sys_errno = errno;
+        return false;
+    }
+
+    struct stat st;
+    if (0 != fstat(fd, &st)) {
+        slot->read.sys_errno = errno;
+    } else if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+        slot_read_fd(slot, fd);
+    } else if (!slot_reserve(slot, (size_t)st.st_size + 1)) {
+        slot->read.sys_errno = ENOMEM;
+    } else {
+        slot->fd = fd;
+        slot->want = (size_t)st.st_size;
+        uring_queue_read(&r->ring, slot);
+        return true;
+    }
+    close(fd);
+    return false;
+}
+
+static void uring_finish_read(bs_file_reader *r, read_slot *slot) {
+    close(slot->fd);
+    slot->fd = -1;
+    finish_slot(r, slot);
+}
+
+// handles completed reads, returning how many files were finished and
+// counting reads queued again for the rest of a file in *queued
+static unsigned int uring_reap(bs_file_reader *r, unsigned int *queued) {
+    uring *ring = &r->ring;
+    unsigned int head = *ring->cq_head;
+    unsigned int tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    unsigned int finished = 0;
+
+    for (; head != tail; head++) {
+        struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        read_slot *slot = (read_slot *)(uintptr_t)cqe->user_data;
+        int res = cqe->res;
+
+        if (res == -EINTR || res == -EAGAIN) {
+            uring_queue_read(ring, slot);
+            (*queued)++;
+            continue;
+        }
+        if (res < 0) {
+            slot->read.sys_errno = -res;
+        } else {
+            slot->read.len += (size_t)res;
+            // a short read that is not at the end of the file (the file
+            // shrank if it is) is followed by a read of the rest
+            if (res > 0 && slot->read.len < slot->want) {
+                uring_queue_read(ring, slot);
+                (*queued)++;
+                continue;
+            }
+        }
+        uring_finish_read(r, slot);
+        finished++;
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    return finished;
+}
+
+static void *uring_thread_main(void *arg) {
+    bs_file_reader *r = arg;
+    uring *ring = &r->ring;
+    unsigned int in_flight = 0; // files with reads queued or submitted
+    unsigned int queued = 0;    // reads not yet submitted
+    read_slot *slot;
+
+    for (;;) {
+        // start reading into every free slot, only waiting for one if
+        // nothing is in flight
+        while (in_flight < ring->entries &&
+               (slot = claim_slot(r, in_flight == 0)) != NULL) {
+            if (uring_start_read(r, slot)) {
+                in_flight++;
+                queued++;
+            } else {
+                finish_slot(r, slot);
+            }
+        }
+        if (in_flight == 0)
+            break;
+
+        int submitted = (int)syscall(__NR_io_uring_enter, ring->fd, queued, 1,
+                                     IORING_ENTER_GETEVENTS, NULL, 0);
+        if (submitted < 0 && errno != EINTR && errno != EAGAIN &&
+            errno != EBUSY) {
+            // the ring is broken: fail what it holds, and read the rest
+            // of the files on this thread
+            int error = errno;
+            for (unsigned int i = 0; i < r->slot_ct; i++) {
+                if (r->slots[i].fd >= 0) {
+                    r->slots[i].read.sys_errno = error;
+                    uring_finish_read(r, &r->slots[i]);
+                }
+            }
+            while ((slot = claim_slot(r, true)) != NULL) {
+                slot_read_path(slot, r->paths[slot->read.item]);
+                finish_slot(r, slot);
+            }
+            break;
+        }
+        if (submitted > 0)
+            queued -= (unsigned int)submitted;
+        in_flight -= uring_reap(r, &queued);
+    }
+    return NULL;
+}
+
+static bool start_uring(bs_file_reader *r) {
+    if (!uring_init(&r->ring, r->slot_ct))
+        return false;
+    r->threads = malloc(sizeof(pthread_t));
+    if (r->threads == NULL ||
+        0 != pthread_create(&r->threads[0], NULL, uring_thread_main, r)) {
+        free(r->threads);
+        r->threads = NULL;
+        uring_free(&r->ring);
+        return false;
+    }
+    r->thread_ct = 1;
+    r->backend = BS_READ_IO_URING;
+    return true;
+}
+
+#else
+
+static bool start_uring(bs_file_reader *r) {
+    (void)r;
+    return false;
+}
+
+#endif
+
+////////////
+// READER //
+////////////
+
+bs_file_reader *bs_file_reader_start(const char *const *paths,
+                                     size_t path_ct, unsigned int depth,
+                                     bs_read_backend backend) {
+    if (depth == 0)
+        depth = READER_DEFAULT_DEPTH;
+
+    bs_file_reader *r = calloc(1, sizeof(bs_file_reader));
+    if (r == NULL)
+        return NULL;
+    r->paths = paths;
+    r->path_ct = path_ct;
+    r->slot_ct = depth;
+    r->slots = calloc(depth, sizeof(read_slot));
+    if (r->slots == NULL) {
+        free(r);
+        return NULL;
+    }
+    for (unsigned int i = 0; i < depth; i++) {
+        r->slots[i].fd = -1;
+        r->slots[i].next = i + 1 < depth ? &r->slots[i + 1] : NULL;
+    }
+    r->free_slots = &r->slots[0];
+    r->done_tail = &r->done;
+#ifdef BS_HAVE_IO_URING
+    r->ring.fd = -1;
+#endif
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->ready, NULL);
+    pthread_cond_init(&r->space, NULL);
+
+    bool started = false;
+    if (backend != BS_READ_THREADS)
+        started = start_uring(r);
+    if (!started && backend != BS_READ_IO_URING)
+        started = start_threads(r);
+    if (!started) {
+        bs_file_reader_free(r);
+        return NULL;
+    }
+    return r;
+}
+
+bs_read *bs_file_reader_next(bs_file_reader *r) {
+    read_slot *slot = NULL;
+    pthread_mutex_lock(&r->lock);
+    while (r->done == NULL && r->handed < r->path_ct && !r->stopping) {
+        pthread_cond_wait(&r->ready, &r->lock);
+    }
+    if (r->done != NULL) {
+        slot = r->done;
+        r->done = slot->next;
+        if (r->done == NULL)
+            r->done_tail = &r->done;
+        r->handed++;
+        // wake the threads still waiting, who will find nothing left
+        if (r->handed == r->path_ct)
+            pthread_cond_broadcast(&r->ready);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return slot == NULL ? NULL : &slot->read;
+}
+
+void bs_file_reader_release(bs_file_reader *r, bs_read *read) {
+    read_slot *slot = (read_slot *)read;
+    pthread_mutex_lock(&r->lock);
+    slot->next = r->free_slots;
+    r->free_slots = slot;
+    pthread_cond_signal(&r->space);
+    pthread_mutex_unlock(&r->lock);
+}
+
+bs_read_backend bs_file_reader_backend(const bs_file_reader *r) {
+    return r->backend;
+}
+
+const char *bs_read_backend_name(bs_read_backend backend) {
+    switch (backend) {
+    case BS_READ_AUTO:
+        return "auto";
+    case BS_READ_IO_URING:
+        return "io_uring";
+    case BS_READ_THREADS:
+        return "threads";
+    }
+    return "unknown";
+}
+
+void bs_file_reader_free(bs_file_reader *r) {
+    pthread_mutex_lock(&r->lock);
+    r->stopping = true;
+    pthread_cond_broadcast(&r->space);
+    pthread_cond_broadcast(&r->ready);
+    pthread_mutex_unlock(&r->lock);
+
+    for (unsigned int i = 0; i < r->thread_ct; i++) {
+        pthread_join(r->threads[i], NULL);
+    }
+    free(r->threads);
+#ifdef BS_HAVE_IO_URING
+    if (r->ring.fd >= 0)
+        uring_free(&r->ring);
+#endif
+
+    for (unsigned int i = 0; i < r->slot_ct; i++) {
+        free(r->slots[i].read.data);
+    }
+    free(r->slots);
+    pthread_cond_destroy(&r->space);
+    pthread_cond_destroy(&r->ready);
+    pthread_mutex_destroy(&r->lock);
+    free(r);
+}
@@ -0,0 +1,76 @@
+#ifndef BINSCRIPT_FILEREADER
+#define BINSCRIPT_FILEREADER
+
+#include <stddef.h>
+
+/**
+ * Reads a list of files ahead of the threads that convert them.
+ *
+ * A reader keeps up to `depth` files in flight or waiting to be taken,
+ * and hands each one over as soon as it has been read, in whatever
+ * order the reads complete. Converting threads take files with
+ * bs_file_reader_next and give them back with bs_file_reader_release,
+ * so the disk stays busy while they decode, instead of every thread
+ * stopping in fread for each of its files.
+ *
+ * On Linux the reads go through io_uring, submitted and reaped by a
+ * single thread. Where io_uring is not available (kernels older than
+ * 5.6, seccomp filters, builds with BINSCRIPT_NO_IO_URING), a pool of
+ * threads reads with read(2) instead.
+ **/
+
+typedef enum bs_read_backend {
+    BS_READ_AUTO, // io_uring if it works, threads otherwise
+    BS_READ_IO_URING,
+    BS_READ_THREADS
+} bs_read_backend;
+
+// a file that has been read
+typedef struct bs_read {
+    size_t item;   // the index of its path
+    char *data;    // its contents, followed by a null byte
+    size_t len;
+    int sys_errno; // why it could not be read, in which case len is 0
+} bs_read;
+
+typedef struct bs_file_reader bs_file_reader;
+
+/**
+ * Starts reading `paths` in the background, keeping up to `depth` files
+ * (0 for 32) in flight or waiting to be taken. The paths must outlive
+ * the reader.
+ *
+ * returns NULL if the backend cannot be started, which for
+ * BS_READ_AUTO only happens if threads cannot be created.
+ **/
+bs_file_reader *bs_file_reader_start(const char *const *paths,
+                                     size_t path_ct, unsigned int depth,
+                                     bs_read_backend backend);
+
+/**
+ * Waits for the next file to be read. Any number of threads can take
+ * files at once, but each should release what it took before taking
+ * more: the reader stops once `depth` files are waiting or taken.
+ *
+ * returns NULL once every file has been handed out.
+ **/
+bs_read *bs_file_reader_next(bs_file_reader *r);
+
+/**
+ * gives a file taken with bs_file_reader_next back, so that its buffer
+ * can be reused for another read
+ **/
+void bs_file_reader_release(bs_file_reader *r, bs_read *read);
+
+// the backend a reader runs on, never BS_READ_AUTO
+bs_read_backend bs_file_reader_backend(const bs_file_reader *r);
+
+const char *bs_read_backend_name(bs_read_backend backend);
+
+/**
+ * Stops a reader, waiting for reads in flight, and frees it along with
+ * every buffer it handed out.
+ **/
+void bs_file_reader_free(bs_file_reader *r);
+
+#endif
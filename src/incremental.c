@@ -0,0 +1,206 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "incremental.h"
+#include "langcache.h"
+#include "util.h"
+
+void bs_incremental_init(bs_incremental *inc, language_def *lang,
+                         binscript_endmode endmode) {
+    inc->lang = lang;
+    inc->endmode = endmode;
+    inc->spans = NULL;
+    inc->span_ct = 0;
+    inc->reparsed_ct = 0;
+    bs_buffer_init(&inc->text);
+    bs_buffer_init(&inc->out);
+
+    // the empty script is just a terminator
+    if (endmode == NULL_TERMINATED) {
+        size_t terminator = bits2bytes(lang->function_name_width);
+        bs_buffer_reserve(&inc->out, terminator);
+        memset(inc->out.data, 0, terminator);
+        inc->out.len = terminator;
+    }
+}
+
+static bool starts_statement(char c) {
+    return c != ' ' && c != '\t' && c != '\r' && c != '\n' && c != ';';
+}
+
+// splits a script into statements, returning the number found. Output
+// positions are left for the caller.
+static size_t split_statements(const char *text, size_t len,
+                               bs_script_span **out) {
+    size_t cap = 64, ct = 0;
+    bs_script_span *spans = malloc(sizeof(bs_script_span) * cap);
+
+    for (size_t line = 0; line < len;) {
+        const char *newline = memchr(text + line, '\n', len - line);
+        size_t next = newline == NULL ? len : (size_t)(newline - text) + 1;
+
+        if (starts_statement(text[line])) {
+            if (ct > 0)
+                spans[ct - 1].text_len = line - spans[ct - 1].text_offset;
+            if (ct == cap) {
+                cap *= 2;
+                spans = realloc(spans, sizeof(bs_script_span) * cap);
+            }
+            spans[ct++].text_offset = line;
+        }
+        line = next;
+    }
+    if (ct > 0)
+        spans[ct - 1].text_len = len - spans[ct - 1].text_offset;
+
+    for (size_t i = 0; i < ct; i++) {
+        spans[i].hash =
+            lang_source_hash(text + spans[i].text_offset, spans[i].text_len);
+    }
+    *out = spans;
+    return ct;
+}
+
+static bool same_text(const char *a_text, const bs_script_span *a,
+                      const char *b_text, const bs_script_span *b) {
+    return a->hash == b->hash && a->text_len == b->text_len &&
+           0 == memcmp(a_text + a->text_offset, b_text + b->text_offset,
+                       a->text_len);
+}
+
+// parses and encodes the one call in a statement's text, appending it
+// to `out`. `scratch` holds the null terminated copy the parser needs.
+static binscript_error encode_statement(language_def *l, const char *text,
+                                        size_t len, bs_buffer *scratch,
+                                        bs_buffer *out) {
+    bs_buffer_clear(scratch);
+    bs_buffer_reserve(scratch, len + 1);
+    memcpy(scratch->data, text, len);
+    scratch->data[len] = '\0';
+
+    binscript_consumer *c =
+        binscript_mem_consumer(l, scratch->data, "<incremental>", SCRIPT2BIN);
+    function_call *call, *extra = NULL;
+    binscript_error e = binscript_next_checked(c, &call);
+    if (e == BS_OK && call == NULL)
+        e = BS_BAD_SCRIPT;
+    if (e == BS_OK) {
+        e = binscript_next_checked(c, &extra);
+        if (e == BS_OK && extra != NULL)
+            e = BS_BAD_SCRIPT;
+        if (extra != NULL)
+            free_call(extra);
+    }
+    binscript_free(c);
+    if (e != BS_OK) {
+        if (call != NULL)
+            free_call(call);
+        return e;
+    }
+
+    // statements are padded out to a whole number of bytes
+    size_t width = bits2bytes(func_call_width(l, call->defn));
+    size_t written;
+    bs_buffer_reserve(out, width);
+    memset(out->data + out->len, 0, width);
+    e = binary_encode_function_call_checked(out->data + out->len, width, l,
+                                            call, &written);
+    free_call(call);
+    if (e == BS_OK)
+        out->len += width;
+    return e;
+}
+
+static size_t spans_end(const bs_script_span *spans, size_t ct) {
+    return ct == 0 ? 0 : spans[ct - 1].out_offset + spans[ct - 1].out_len;
+}
+
+binscript_error bs_incremental_update(bs_incremental *inc, const char *text,
+                                      size_t len, size_t *error_statement) {
+    bs_script_span *old = inc->spans, *spans;
+    size_t old_ct = inc->span_ct;
+    size_t ct = split_statements(text, len, &spans);
+
+    // the statements unchanged at either end keep their encoding
+    size_t prefix = 0, suffix = 0;
+    while (prefix < old_ct && prefix < ct &&
+           same_text(inc->text.data, &old[prefix], text, &spans[prefix])) {
+        prefix++;
+    }
+    while (suffix < old_ct - prefix && suffix < ct - prefix &&
+           same_text(inc->text.data, &old[old_ct - 1 - suffix], text,
+                     &spans[ct - 1 - suffix])) {
+        suffix++;
+    }
+
+    // encode the statements in between on their own first, so that a
+    // failure leaves the output as it was
+    bs_buffer fresh, scratch;
+    bs_buffer_init(&fresh);
+    bs_buffer_init(&scratch);
+    for (size_t i = prefix; i < ct - suffix; i++) {
+        spans[i].out_offset = fresh.len;
+        binscript_error e =
+            encode_statement(inc->lang, text + spans[i].text_offset,
+                             spans[i].text_len, &scratch, &fresh);
+        if (e != BS_OK) {
+            if (error_statement != NULL)
+                *error_statement = i;
+            bs_buffer_free(&fresh);
+            bs_buffer_free(&scratch);
+            free(spans);
+            return e;
+        }
+        spans[i].out_len = fresh.len - spans[i].out_offset;
+    }
+    bs_buffer_free(&scratch);
+
+    // replace the old encodings of the changed statements, moving the
+    // rest of the output if the width changed
+    size_t start = spans_end(old, prefix);
+    size_t end = suffix == 0 ? spans_end(old, old_ct)
+                             : old[old_ct - suffix].out_offset;
+    size_t tail = inc->out.len - end, moved_to = start + fresh.len;
+    if (fresh.len > end - start)
+        bs_buffer_reserve(&inc->out, fresh.len - (end - start));
+    if (tail > 0 && moved_to != end)
+        memmove(inc->out.data + moved_to, inc->out.data + end, tail);
+    if (fresh.len > 0)
+        memcpy(inc->out.data + start, fresh.data, fresh.len);
+    inc->out.len = moved_to + tail;
+    bs_buffer_free(&fresh);
+
+    for (size_t i = 0; i < prefix; i++) {
+        spans[i].out_offset = old[i].out_offset;
+        spans[i].out_len = old[i].out_len;
+    }
+    for (size_t i = prefix; i < ct - suffix; i++) {
+        spans[i].out_offset += start;
+    }
+    for (size_t i = ct - suffix; i < ct; i++) {
+        bs_script_span *was = &old[old_ct - ct + i];
+        spans[i].out_offset = was->out_offset - end + moved_to;
+        spans[i].out_len = was->out_len;
+    }
+
+    bs_buffer_clear(&inc->text);
+    bs_buffer_reserve(&inc->text, len);
+    if (len > 0)
+        memcpy(inc->text.data, text, len);
+    inc->text.len = len;
+
+    free(old);
+    inc->spans = spans;
+    inc->span_ct = ct;
+    inc->reparsed_ct = ct - suffix - prefix;
+    return BS_OK;
+}
+
+void bs_incremental_free(bs_incremental *inc) {
+    bs_buffer_free(&inc->text);
+    bs_buffer_free(&inc->out);
+    free(inc->spans);
+    inc->spans = NULL;
+    inc->span_ct = 0;
+}
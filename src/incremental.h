@@ -0,0 +1,77 @@
+#ifndef BINSCRIPT_INCREMENTAL
+#define BINSCRIPT_INCREMENTAL
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "convert.h"
+#include "langdef.h"
+#include "translator.h"
+
+/**
+ * Incremental SCRIPT2BIN conversion of a script that is edited over
+ * time, e.g. by an editor rebuilding on every change.
+ *
+ * Every update splits the script into statements, which is a scan of
+ * the text rather than a parse. A statement starts at each line that
+ * begins with something other than whitespace or a ';' comment, and
+ * runs until the next one, so the indented lines of a multi-line
+ * statement (and blank and comment lines) belong to the statement
+ * above them. Statements whose text is unchanged from the last update
+ * at the start and at the end of the script keep their encoding, and
+ * only the statements in between are parsed and encoded again.
+ *
+ * Statements are padded to whole bytes, so when the re-encoded
+ * statements are wider or narrower than the ones they replace, the
+ * rest of the output is moved with a single memmove.
+ *
+ * An update that fails leaves the state of the last successful update
+ * untouched.
+ **/
+
+// a statement of the script, and where its encoding is in the output
+typedef struct bs_script_span {
+    size_t text_offset;
+    size_t text_len;
+    uint64_t hash; // of the text
+    size_t out_offset;
+    size_t out_len;
+} bs_script_span;
+
+typedef struct bs_incremental {
+    language_def *lang;
+    binscript_endmode endmode;
+
+    // the script of the last successful update, and its statements
+    bs_buffer text;
+    bs_script_span *spans;
+    size_t span_ct;
+
+    // the packed binary, with a terminator if endmode is NULL_TERMINATED
+    bs_buffer out;
+
+    // statements parsed by the last update
+    size_t reparsed_ct;
+} bs_incremental;
+
+/**
+ * starts with an empty script
+ **/
+void bs_incremental_init(bs_incremental *inc, language_def *lang,
+                         binscript_endmode endmode);
+
+/**
+ * Brings inc->out up to date with the `len` bytes of script at `text`,
+ * which need not be null terminated.
+ *
+ * returns BS_OK, or BS_BAD_SCRIPT or an encoding error for the first
+ * changed statement that could not be converted, with its index in the
+ * new script in *error_statement (if not NULL). A statement whose text
+ * holds more or less than one call is BS_BAD_SCRIPT.
+ **/
+binscript_error bs_incremental_update(bs_incremental *inc, const char *text,
+                                      size_t len, size_t *error_statement);
+
+void bs_incremental_free(bs_incremental *inc);
+
+#endif
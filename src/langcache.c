@@ -0,0 +1,362 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "langcache.h"
+#include "langdef.h"
+#include "parsescript.h"
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+uint64_t lang_source_hash(const char *text, size_t len) {
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+///////////////////////
+// WRITING THE CACHE //
+///////////////////////
+
+// appends a name to the string table and returns its offset
+static uint32_t strtab_push(char **strtab, size_t *len, size_t *cap,
+                            const char *name) {
+    if (name == NULL)
+        return LANGCACHE_NO_NAME;
+
+    size_t namelen = strlen(name) + 1;
+    while (*len + namelen > *cap) {
+        *cap = (*cap == 0) ? 256 : *cap * 2;
+        *strtab = realloc(*strtab, *cap);
+        if (*strtab == NULL) {
+            printf("error in realloc\n");
+            exit(1);
+        }
+    }
+
+    uint32_t offset = (uint32_t)*len;
+    memcpy(*strtab + *len, name, namelen);
+    *len += namelen;
+    return offset;
+}
+
+bool lang_cache_write(language_def *l, uint64_t source_hash,
+                      const char *path) {
+    size_t argument_ct = 0;
+    for (unsigned int i = 0; i < l->function_ct; i++) {
+        argument_ct += l->functions[i]->argc;
+    }
+
+    langcache_function *functions =
+        malloc(sizeof(langcache_function) * (l->function_ct + 1));
+    langcache_argument *arguments =
+        malloc(sizeof(langcache_argument) * (argument_ct + 1));
+    char *strtab = NULL;
+    size_t strtab_len = 0, strtab_cap = 0;
+
+    // flatten the functions and their arguments into the record tables
+    size_t arg_index = 0;
+    for (unsigned int i = 0; i < l->function_ct; i++) {
+        function_def *fn = l->functions[i];
+        functions[i].function_binary_value = fn->function_binary_value;
+        functions[i].name_offset =
+            strtab_push(&strtab, &strtab_len, &strtab_cap, fn->name);
+        functions[i].argc = fn->argc;
+        functions[i].first_argument = arg_index;
+
+        for (unsigned int j = 0; j < fn->argc; j++) {
+            argument_def *arg = fn->arguments[j];
+            arguments[arg_index].type = arg->type;
+            arguments[arg_index].bitwidth = arg->bitwidth;
+            arguments[arg_index].name_offset =
+                strtab_push(&strtab, &strtab_len, &strtab_cap, arg->name);
+            arg_index++;
+        }
+    }
+
+    langcache_flow *flow = malloc(sizeof(langcache_flow) * (l->flow_ct + 1));
+    for (unsigned int i = 0; i < l->flow_ct; i++) {
+        flow[i].function_binary_value = l->flow[i].function_binary_value;
+        flow[i].kind = l->flow[i].kind;
+        flow[i].target_arg = l->flow[i].target_arg;
+        flow[i].relative = l->flow[i].relative;
+    }
+
+    langcache_header header;
+    memset(&header, 0, sizeof(langcache_header));
+    header.magic = LANGCACHE_MAGIC;
+    header.version = LANGCACHE_VERSION;
+    header.byte_order = LANGCACHE_BYTE_ORDER_MARK;
+    header.header_size = sizeof(langcache_header);
+    header.source_hash = source_hash;
+    header.target_endianness = l->target_endianness;
+    header.function_name_width = l->function_name_width;
+    header.function_name_bitshift = l->function_name_bitshift;
+    header.byte_aligned_functions = l->byte_aligned_functions;
+    header.function_ct = l->function_ct;
+    header.argument_ct = argument_ct;
+    header.strings_len = strtab_len;
+    header.flow_ct = l->flow_ct;
+
+    // write to a temporary file and move it into place once complete
+    size_t tmp_path_len = strlen(path) + 32;
+    char *tmp_path = malloc(tmp_path_len);
+    snprintf(tmp_path, tmp_path_len, "%s.tmp.%ld", path, (long)getpid());
+
+    bool ok = false;
+    FILE *out = fopen(tmp_path, "wb");
+    if (out != NULL) {
+        ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+             fwrite(functions, sizeof(langcache_function), l->function_ct,
+                    out) == l->function_ct &&
+             fwrite(arguments, sizeof(langcache_argument), argument_ct,
+                    out) == argument_ct &&
+             fwrite(flow, sizeof(langcache_flow), l->flow_ct, out) ==
+                 l->flow_ct &&
+             fwrite(strtab, 1, strtab_len, out) == strtab_len;
+        ok = (0 == fclose(out)) && ok;
+        ok = ok && (0 == rename(tmp_path, path));
+        if (!ok)
+            remove(tmp_path);
+    }
+
+    free(tmp_path);
+    free(strtab);
+    free(flow);
+    free(arguments);
+    free(functions);
+    return ok;
+}
+
+///////////////////////
+// READING THE CACHE //
+///////////////////////
+
+// checks that the header of a mapped cache file is consistent with
+// the file's size and with this build of the library
+static bool header_valid(langcache_header *h, size_t file_len,
+                         uint64_t source_hash) {
+    if (file_len < sizeof(langcache_header))
+        return false;
+
+    if (h->magic != LANGCACHE_MAGIC || h->version != LANGCACHE_VERSION ||
+        h->byte_order != LANGCACHE_BYTE_ORDER_MARK ||
+        h->header_size != sizeof(langcache_header) ||
+        h->source_hash != source_hash)
+        return false;
+
+    size_t expected_len = sizeof(langcache_header) +
+                          (size_t)h->function_ct * sizeof(langcache_function) +
+                          (size_t)h->argument_ct * sizeof(langcache_argument) +
+                          (size_t)h->flow_ct * sizeof(langcache_flow) +
+                          h->strings_len;
+    return expected_len == file_len;
+}
+
+static bool name_valid(const char *strtab, uint32_t strtab_len,
+                       uint32_t offset, bool nullable) {
+    if (offset == LANGCACHE_NO_NAME)
+        return nullable;
+    // the table is checked to end in a terminator, so any in-bounds
+    // offset refers to a terminated string
+    return offset < strtab_len;
+}
+
+bool lang_cache_load(language_def *l, uint64_t source_hash,
+                     const char *path) {
+    return lang_cache_load_with(l, source_hash, path, NULL);
+}
+
+bool lang_cache_load_with(language_def *l, uint64_t source_hash,
+                          const char *path, const bs_allocator *alloc) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(langcache_header)) {
+        close(fd);
+        return false;
+    }
+
+    size_t map_len = st.st_size;
+    char *map = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    langcache_header *header = (langcache_header *)map;
+    if (!header_valid(header, map_len, source_hash)) {
+        munmap(map, map_len);
+        return false;
+    }
+
+    langcache_function *cached_fns =
+        (langcache_function *)(map + sizeof(langcache_header));
+    langcache_argument *cached_args =
+        (langcache_argument *)(cached_fns + header->function_ct);
+    langcache_flow *cached_flow =
+        (langcache_flow *)(cached_args + header->argument_ct);
+    const char *strtab = (const char *)(cached_flow + header->flow_ct);
+
+    // validate every reference in the tables before building anything
+    bool valid = header->strings_len == 0 ||
+                 strtab[header->strings_len - 1] == '\0';
+    for (uint32_t i = 0; valid && i < header->function_ct; i++) {
+        langcache_function *fn = &cached_fns[i];
+        valid = name_valid(strtab, header->strings_len, fn->name_offset,
+                           false) &&
+                fn->first_argument <= header->argument_ct &&
+                fn->argc <= header->argument_ct - fn->first_argument;
+    }
+    for (uint32_t i = 0; valid && i < header->argument_ct; i++) {
+        valid = cached_args[i].type < __ARG_TYPE_CT &&
+                name_valid(strtab, header->strings_len,
+                           cached_args[i].name_offset, true);
+    }
+    if (!valid) {
+        munmap(map, map_len);
+        return false;
+    }
+
+    // allocate all of the language's structures in a single block:
+    // [function_def *][argument_def *][function_def][argument_def]
+    size_t fn_ct = header->function_ct, arg_ct = header->argument_ct;
+    char *block = bs_malloc(alloc, sizeof(function_def *) * fn_ct +
+                                       sizeof(argument_def *) * arg_ct +
+                                       sizeof(function_def) * fn_ct +
+                                       sizeof(argument_def) * arg_ct + 1);
+    if (block == NULL) {
+        munmap(map, map_len);
+        return false;
+    }
+
+    function_def **fn_ptrs = (function_def **)block;
+    argument_def **arg_ptrs = (argument_def **)(fn_ptrs + fn_ct);
+    function_def *fns = (function_def *)(arg_ptrs + arg_ct);
+    argument_def *args = (argument_def *)(fns + fn_ct);
+
+    for (size_t i = 0; i < arg_ct; i++) {
+        args[i].type = (arg_type)cached_args[i].type;
+        args[i].bitwidth = cached_args[i].bitwidth;
+        args[i].name = (cached_args[i].name_offset == LANGCACHE_NO_NAME)
+                           ? NULL
+                           : (char *)strtab + cached_args[i].name_offset;
+        arg_ptrs[i] = &args[i];
+    }
+
+    for (size_t i = 0; i < fn_ct; i++) {
+        fns[i].function_binary_value = cached_fns[i].function_binary_value;
+        fns[i].name = (char *)strtab + cached_fns[i].name_offset;
+        fns[i].argc = cached_fns[i].argc;
+        fns[i].arguments = (cached_fns[i].argc == 0)
+                               ? NULL
+                               : arg_ptrs + cached_fns[i].first_argument;
+        fn_ptrs[i] = &fns[i];
+    }
+
+    lang_init(l);
+    l->alloc = alloc;
+    l->target_endianness = (endianness)header->target_endianness;
+    l->function_name_width = header->function_name_width;
+    l->function_name_bitshift = header->function_name_bitshift;
+    l->byte_aligned_functions = header->byte_aligned_functions;
+    l->function_ct = fn_ct;
+    l->function_capacity = fn_ct;
+    l->functions = fn_ptrs;
+    l->arena = block;
+    l->cache_map = map;
+    l->cache_map_len = map_len;
+
+    // flow rules are few, and copied out so they can be freed alike
+    // for cached and parsed languages
+    if (header->flow_ct > 0) {
+        l->flow = bs_malloc(alloc, sizeof(bs_flow_rule) * header->flow_ct);
+        for (uint32_t i = 0; i < header->flow_ct; i++) {
+            l->flow[i].function_binary_value =
+                cached_flow[i].function_binary_value;
+            l->flow[i].kind = (bs_flow_kind)cached_flow[i].kind;
+            l->flow[i].target_arg = cached_flow[i].target_arg;
+            l->flow[i].relative = cached_flow[i].relative != 0;
+        }
+        l->flow_ct = header->flow_ct;
+    }
+
+    // caches written from finalized languages are already in the
+    // finalized layout. Anything else is compacted on load.
+    bool sorted = true;
+    for (size_t i = 1; sorted && i < fn_ct; i++) {
+        sorted = fns[i - 1].function_binary_value <=
+                 fns[i].function_binary_value;
+    }
+    if (sorted) {
+        l->finalized = true;
+    } else {
+        lang_finalize(l);
+    }
+
+    return true;
+}
+
+// reads the remaining contents of a stream into a null-terminated
+// heap buffer
+static char *read_stream(FILE *f, size_t *len) {
+    size_t cap = 4096, used = 0, got;
+    char *buf = malloc(cap);
+
+    while (buf != NULL && (got = fread(buf + used, 1, cap - used - 1, f)) > 0) {
+        used += got;
+        if (cap - used <= 1) {
+            cap *= 2;
+            buf = realloc(buf, cap);
+        }
+    }
+
+    if (buf == NULL) {
+        printf("error reading language definition into memory\n");
+        exit(1);
+    }
+
+    buf[used] = '\0';
+    *len = used;
+    return buf;
+}
+
+detailed_parse_error *parse_language_cached(language_def *language, FILE *f,
+                                            const char *name,
+                                            const char *cache_path) {
+    return parse_language_cached_with(language, f, name, cache_path, NULL);
+}
+
+detailed_parse_error *
+parse_language_cached_with(language_def *language, FILE *f, const char *name,
+                           const char *cache_path,
+                           const bs_allocator *alloc) {
+    size_t source_len;
+    char *source = read_stream(f, &source_len);
+    uint64_t hash = lang_source_hash(source, source_len);
+
+    if (lang_cache_load_with(language, hash, cache_path, alloc)) {
+        free(source);
+        return NULL;
+    }
+
+    detailed_parse_error *e =
+        parse_language_from_str_with(language, source, name, alloc);
+    if (e == NULL) {
+        lang_cache_write(language, hash, cache_path);
+    }
+
+    free(source);
+    return e;
+}
@@ -0,0 +1,141 @@
+#ifndef BINSCRIPT_LANGCACHE
+#define BINSCRIPT_LANGCACHE
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "langdef.h"
+#include "parsescript.h"
+
+/**
+ * Binary serialization of a parsed language_def.
+ *
+ * A cache file is a fixed header followed by flat tables of function
+ * records, argument records, flow records and a string table. Records
+ * refer to each other by index and to names by offset into the string
+ * table, so a cache can be mmapped and turned into a language_def
+ * without touching libsweetparse or any of the textual parsers.
+ *
+ * Caches are written in host byte order and are only meant to be read
+ * back on the machine that wrote them. Each cache is keyed by a hash of
+ * the .langdef source text it was built from.
+ **/
+
+#define LANGCACHE_MAGIC 0x4c534243 // "CBSL" when read little-endian
+#define LANGCACHE_VERSION 2
+#define LANGCACHE_BYTE_ORDER_MARK 0x01020304
+
+#define LANGCACHE_NO_NAME UINT32_MAX
+
+typedef struct langcache_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t header_size;
+    uint64_t source_hash;
+
+    // language metadata
+    uint32_t target_endianness;
+    uint32_t function_name_width;
+    uint32_t function_name_bitshift;
+    uint32_t byte_aligned_functions;
+
+    // table sizes
+    uint32_t function_ct;
+    uint32_t argument_ct;
+    uint32_t strings_len;
+    uint32_t flow_ct;
+} langcache_header;
+
+typedef struct langcache_function {
+    uint32_t function_binary_value;
+    uint32_t name_offset;
+    uint32_t argc;
+    uint32_t first_argument; // index into the argument table
+} langcache_function;
+
+typedef struct langcache_argument {
+    uint32_t type;
+    uint32_t bitwidth;
+    uint32_t name_offset; // LANGCACHE_NO_NAME for unnamed arguments
+} langcache_argument;
+
+typedef struct langcache_flow {
+    uint32_t function_binary_value;
+    uint32_t kind;
+    uint32_t target_arg; // BS_FLOW_NO_TARGET for rules without a target
+    uint32_t relative;
+} langcache_flow;
+
+/**
+ * Hashes the source text of a language definition (64 bit FNV-1a).
+ * Used as the key that ties a cache file to the text it was built from.
+ *
+ * text: the source text of the language definition
+ * len: the length of the source text in bytes
+ **/
+uint64_t lang_source_hash(const char *text, size_t len);
+
+/**
+ * Serializes a language into a cache file at `path`. The file is
+ * written to a temporary name first and renamed into place, so
+ * concurrent readers never observe a partially written cache.
+ *
+ * returns false if the cache could not be written.
+ **/
+bool lang_cache_write(language_def *l, uint64_t source_hash,
+                      const char *path);
+
+/**
+ * Loads a language from a cache file written by lang_cache_write.
+ *
+ * The file is mmapped, and function and argument names point directly
+ * into the mapping. All of the function and argument structures are
+ * allocated in a single block, and the loaded language is finalized
+ * (see lang_finalize). free_lang() releases both.
+ *
+ * returns false (leaving `l` untouched) if the file does not exist, is
+ * malformed, was written by an incompatible version, or was built from
+ * source text with a different hash.
+ **/
+bool lang_cache_load(language_def *l, uint64_t source_hash, const char *path);
+
+/**
+ * Loads a language from a cache file like lang_cache_load, allocating
+ * its block and flow rules with `alloc` (NULL for malloc). The language
+ * keeps `alloc` for everything allocated for it later, as if it had
+ * been parsed with parse_language_from_file_with.
+ **/
+bool lang_cache_load_with(language_def *l, uint64_t source_hash,
+                          const char *path, const bs_allocator *alloc);
+
+/**
+ * Parses a language definition out of a file, going through a binary
+ * cache at `cache_path`.
+ *
+ * If the cache exists and matches the hash of the contents of `f`, the
+ * language is loaded from the cache. Otherwise the language is parsed
+ * as in parse_language_from_file and the cache is (re)written. Failing
+ * to write the cache is not an error.
+ *
+ * language: pointer to the language to be initialized
+ * f: a FILE containing the textual language definition
+ * name: the name of the source, used in error messages
+ * cache_path: path of the binary cache file
+ **/
+detailed_parse_error *parse_language_cached(language_def *language, FILE *f,
+                                            const char *name,
+                                            const char *cache_path);
+
+/**
+ * Parses a language through a binary cache like parse_language_cached,
+ * allocating everything the language keeps with `alloc` (NULL for
+ * malloc) whether it is loaded from the cache or parsed.
+ **/
+detailed_parse_error *
+parse_language_cached_with(language_def *language, FILE *f, const char *name,
+                           const char *cache_path, const bs_allocator *alloc);
+
+#endif
@@ -4,18 +4,53 @@
 #include <math.h>
 #include <string.h>
 #include <limits.h>
+#include <sys/mman.h>
 
 #include "parsescript.h"
+#include "callpool.h"
 #include "langdef.h"
 #include "translator.h"
 #include "util.h"
 #include "bitbuffer.h"
 
+const char *flow_kind_names[] = {
+    [BS_FLOW_JUMP] = "jump",
+    [BS_FLOW_CALL] = "call",
+    [BS_FLOW_RETURN] = "return",
+    [BS_FLOW_EXIT] = "exit",
+    [BS_FLOW_LOOP_START] = "loop_start",
+    [BS_FLOW_LOOP_END] = "loop_end",
+};
+
 const char *typenames[] = {[RAW_STRING] = "raw_str", [HEX] = "hex",
                            [STRING] = "str",         [INT] = "int",
                            [UNSIGNED_INT] = "uint",  [FLOAT] = "float",
                            [SKIP] = "skip" };
 
+static const char *binscript_error_names[] = {
+        [BS_OK] = "BS_OK",
+        [BS_UNKNOWN_OPCODE] = "BS_UNKNOWN_OPCODE",
+        [BS_TRUNCATED_STATEMENT] = "BS_TRUNCATED_STATEMENT",
+        [BS_MISSING_TERMINATOR] = "BS_MISSING_TERMINATOR",
+        [BS_UNTERMINATED_STRING] = "BS_UNTERMINATED_STRING",
+        [BS_BAD_FLOAT_WIDTH] = "BS_BAD_FLOAT_WIDTH",
+        [BS_BAD_ARGTYPE] = "BS_BAD_ARGTYPE",
+        [BS_OUT_OF_SPACE] = "BS_OUT_OF_SPACE",
+        [BS_IO_ERROR] = "BS_IO_ERROR",
+        [BS_BAD_SCRIPT] = "BS_BAD_SCRIPT",
+        [BS_BAD_REQUEST] = "BS_BAD_REQUEST",
+        [BS_UNMAPPED] = "BS_UNMAPPED",
+        [BS_OUT_OF_RANGE] = "BS_OUT_OF_RANGE",
+};
+
+const char *binscript_error_name(binscript_error e) {
+    int ie = (int)e;
+    if (ie < 0 || ie >= __BS_ERROR_CT || binscript_error_names[ie] == NULL) {
+        return "unknown_error";
+    }
+    return binscript_error_names[ie];
+}
+
 bool check_size(arg_type type, unsigned int space, unsigned int value) {
     // check that the value provided can fit into the
     // space of the argument type defined
@@ -95,33 +130,45 @@ void print_fn_call(function_call *call) {
     printf("%s\n", out);
 }
 
-void *arg_init(language_def *l, argument_def *argdef, bitbuffer *buffer) {
+binscript_error arg_read_checked(language_def *l, argument_def *argdef,
+                                 bitbuffer *buffer, void *dest) {
     size_t buffer_len;
     int sign = 1;
 
     float f;
     double d;
-    long double *ld;
+
+    if (bitbuffer_remaining_bits(buffer) < argdef->bitwidth) {
+        return BS_TRUNCATED_STATEMENT;
+    }
 
     switch (argdef->type) {
     case RAW_STRING:
     case STRING:
-        if (argdef->type == STRING)
-            buffer_len = bits2bytes(argdef->bitwidth);
-        else
-            buffer_len = bits2bytes(argdef->bitwidth) + 1;
+        // always leave room for a terminator, so that owned strings
+        // can be handed to the C string functions
+        buffer_len = argdef->bitwidth / 8;
 
-        char *strbuffer = malloc(buffer_len);
-        bitbuffer_pop(strbuffer, buffer, buffer_len - 1);
-        return strbuffer;
+        char *strbuffer = (char *)dest;
+        bitbuffer_pop(strbuffer, buffer, argdef->bitwidth);
+        strbuffer[buffer_len] = '\0';
+        return BS_OK;
 
     case INT:
     case HEX:
     case UNSIGNED_INT:
         buffer_len = argdef->bitwidth;
+        if (buffer_len > sizeof(long int) * 8) {
+            if (argdef->type != HEX)
+                return BS_BAD_ARGTYPE;
+            // wider hex is only ever handled as raw bytes
+            memset(dest, 0, bits2bytes(buffer_len));
+            bitbuffer_pop(dest, buffer, buffer_len);
+            return BS_OK;
+        }
 
         // put the data at the front of the int
-        long int *int_internal = (long int *)malloc(sizeof(long int));
+        long int *int_internal = (long int *)dest;
         memset(int_internal, 0, sizeof(long int));
         bitbuffer_pop(int_internal, buffer, buffer_len);
         // move to the least significant bits of the long
@@ -131,86 +178,178 @@ void *arg_init(language_def *l, argument_def *argdef, bitbuffer *buffer) {
         }
 
         // swap the endianness to match host endianness
-        // unless we are parsing raw hex data
+        // unless we are parsing raw hex data. The popped bits are at
+        // the top of their last byte, so move them down after swapping
         if (BS_ENDIAN_MATCH(l) && argdef->type != HEX) {
-            swap_endian_on_field(int_internal, bits2bytes(buffer_len));
+            swap_endian_fixed(int_internal, bits2bytes(buffer_len));
+            *int_internal = (unsigned long)*int_internal >>
+                            (bits2bytes(buffer_len) * 8 - buffer_len);
         }
 
         // apply signdedness
         if (INT == argdef->type) {
             sign = *int_internal >> (buffer_len - 1);
             if (sign) {
-                *int_internal = *int_internal & (~(1 << (buffer_len - 1)));
+                *int_internal = *int_internal & (~(1UL << (buffer_len - 1)));
                 *int_internal = -*int_internal;
             }
         }
-
-        return int_internal;
+        return BS_OK;
 
     case FLOAT:
         buffer_len = argdef->bitwidth;
-        ld = (long double *)malloc(sizeof(long double));
+        long double *ld = (long double *)dest;
         switch (buffer_len) {
         case sizeof(float) * 8:
             bitbuffer_pop(&f, buffer, buffer_len);
             if (BS_ENDIAN_MATCH(l)) {
-                swap_endian_on_field(&f, sizeof(float));
+                swap_endian_fixed(&f, sizeof(float));
             }
             *ld = f;
-            break;
+            return BS_OK;
         case sizeof(double) * 8:
             bitbuffer_pop(&d, buffer, buffer_len);
             if (BS_ENDIAN_MATCH(l)) {
-                swap_endian_on_field(&d, sizeof(double));
+                swap_endian_fixed(&d, sizeof(double));
             }
             *ld = d;
-            break;
+            return BS_OK;
         case sizeof(long double) * 8:
             bitbuffer_pop(ld, buffer, buffer_len);
             if (BS_ENDIAN_MATCH(l)) {
-                swap_endian_on_field(ld, sizeof(long double));
+                swap_endian_fixed(ld, sizeof(long double));
             }
-            break;
+            return BS_OK;
         default:
-            printf("no known decoding for float of length %d\n",
-                   (int)buffer_len);
-            exit(1);
+            return BS_BAD_FLOAT_WIDTH;
         }
 
-        return ld;
-
     case SKIP:
         bitbuffer_advance(buffer, argdef->bitwidth);
-        return NULL;
+        return BS_OK;
+
+    default:
+        return BS_BAD_ARGTYPE;
+    }
+}
 
+binscript_error arg_init_checked(language_def *l, argument_def *argdef,
+                                 bitbuffer *buffer, void **out) {
+    return arg_init_with(l, l->alloc, argdef, buffer, out);
+}
+
+size_t arg_value_size(argument_def *argdef) {
+    size_t size;
+    switch (argdef->type) {
+    case RAW_STRING:
+    case STRING:
+        return argdef->bitwidth / 8 + 1;
+    case INT:
+    case HEX:
+    case UNSIGNED_INT:
+        size = sizeof(long int);
+        if (bits2bytes(argdef->bitwidth) > size)
+            size = bits2bytes(argdef->bitwidth);
+        return size;
+    case FLOAT:
+        return sizeof(long double);
     default:
-        printf("error trying to initialize unknown argtpye "
-               "%d",
-               argdef->type);
+        return 0;
+    }
+}
+
+binscript_error arg_init_with(language_def *l, const bs_allocator *alloc,
+                              argument_def *argdef, bitbuffer *buffer,
+                              void **out) {
+    size_t size = arg_value_size(argdef);
+
+    // SKIP has no value, and anything else is an error
+    *out = NULL;
+    if (size == 0)
+        return arg_read_checked(l, argdef, buffer, NULL);
+
+    // check before allocating, so that errors leave nothing behind
+    if (bitbuffer_remaining_bits(buffer) < argdef->bitwidth)
+        return BS_TRUNCATED_STATEMENT;
+    if (argdef->type == FLOAT && argdef->bitwidth != sizeof(float) * 8 &&
+        argdef->bitwidth != sizeof(double) * 8 &&
+        argdef->bitwidth != sizeof(long double) * 8)
+        return BS_BAD_FLOAT_WIDTH;
+
+    void *value = bs_malloc(alloc, size);
+    binscript_error e = arg_read_checked(l, argdef, buffer, value);
+    if (e != BS_OK) {
+        bs_free(alloc, value);
+        return e;
+    }
+    *out = value;
+    return BS_OK;
+}
+
+void *arg_init(language_def *l, argument_def *argdef, bitbuffer *buffer) {
+    void *arg;
+    binscript_error e = arg_init_checked(l, argdef, buffer, &arg);
+    if (e != BS_OK) {
+        printf("error initializing %s argument of width %u (%s)\n",
+               type_name(argdef->type), argdef->bitwidth,
+               binscript_error_name(e));
         exit(1);
     }
+    return arg;
 }
 
-void arg_write(bitbuffer *out_buffer, language_def *l, argument_def *argdef,
-               void *argval) {
+static void write_zeros(bitbuffer *out_buffer, size_t bits) {
+    static const uint64_t zeros;
+    while (bits > 0) {
+        size_t n = bits < 64 ? bits : 64;
+        bitbuffer_writeblock(out_buffer, (void *)&zeros, n);
+        bits -= n;
+    }
+}
+
+binscript_error arg_write_checked(bitbuffer *out_buffer, language_def *l,
+                                  argument_def *argdef, void *argval) {
     float f;
     double d;
     long double ld;
+    size_t bytes;
+    char *end;
+
+    if (bitbuffer_remaining_bits(out_buffer) < argdef->bitwidth) {
+        return BS_OUT_OF_SPACE;
+    }
 
     long int *argval_longint = (long int *)argval;
     long double *argval_longdouble = (long double *)argval;
     switch (argdef->type) {
     case INT:
-        bitbuffer_writebit(out_buffer, *argval_longint < 0);
-        for (int i = argdef->bitwidth - 2; i >= 0; i--) {
-            bitbuffer_writebit(out_buffer, (*argval_longint >> i) & 1);
-        }
-        return;
+    case HEX:
     case UNSIGNED_INT:
+        if (argdef->bitwidth > sizeof(long int) * 8)
+            return BS_BAD_ARGTYPE;
+
+        unsigned long bits = (unsigned long)*argval_longint;
+        if (argdef->type == INT) {
+            // a sign bit above the magnitude, as arg_init reads it
+            unsigned long magnitude = *argval_longint < 0
+                                          ? -(unsigned long)*argval_longint
+                                          : (unsigned long)*argval_longint;
+            unsigned long sign = 1UL << (argdef->bitwidth - 1);
+            bits = (magnitude & (sign - 1)) | (*argval_longint < 0 ? sign : 0);
+        }
+
+        // arg_init takes fields it does not swap straight from memory,
+        // so write those back from memory, and the rest most
+        // significant bit first
+        if (!BS_IS_BIG_ENDIAN &&
+            (argdef->type == HEX || !BS_ENDIAN_MATCH(l))) {
+            bitbuffer_writeblock(out_buffer, &bits, argdef->bitwidth);
+            return BS_OK;
+        }
         for (int i = argdef->bitwidth - 1; i >= 0; i--) {
-            bitbuffer_writebit(out_buffer, (*argval_longint >> i) & 1);
+            bitbuffer_writebit(out_buffer, (bits >> i) & 1);
         }
-        return;
+        return BS_OK;
     case FLOAT:
         // printf("out buffer: %d %d -> ",
         //         out_buffer->buffer - out_buffer->buffer_origin,
@@ -219,37 +358,70 @@ void arg_write(bitbuffer *out_buffer, language_def *l, argument_def *argdef,
         case sizeof(long double) * 8:
             ld = *argval_longdouble;
             if (BS_ENDIAN_MATCH(l))
-                swap_endian_on_field(&ld, sizeof(long double));
+                swap_endian_fixed(&ld, sizeof(long double));
             bitbuffer_writeblock(out_buffer, &ld, 8 * sizeof(long double));
-            return;
+            return BS_OK;
         case sizeof(double) * 8:
             d = *argval_longdouble;
             if (BS_ENDIAN_MATCH(l))
-                swap_endian_on_field(&d, sizeof(double));
+                swap_endian_fixed(&d, sizeof(double));
             bitbuffer_writeblock(out_buffer, &d, 8 * sizeof(double));
-            return;
+            return BS_OK;
         case sizeof(float) * 8:
             f = *argval_longdouble;
             if (BS_ENDIAN_MATCH(l))
-                swap_endian_on_field(&f, sizeof(float));
+                swap_endian_fixed(&f, sizeof(float));
             bitbuffer_writeblock(out_buffer, &f, 8 * sizeof(float));
-            return;
+            return BS_OK;
         default:
-            printf("tried to switch on unhandled float bitwidth %u",
-                   argdef->bitwidth);
-            exit(1);
+            return BS_BAD_FLOAT_WIDTH;
         }
-        return;
+    case RAW_STRING:
+        bitbuffer_writeblock(out_buffer, argval, argdef->bitwidth);
+        return BS_OK;
+    case STRING:
+        // the string, then zeros up to the width of the field, so that
+        // shorter buffers than arg_init's may be passed
+        end = memchr(argval, '\0', argdef->bitwidth / 8);
+        bytes = end != NULL ? (size_t)(end - (char *)argval)
+                            : argdef->bitwidth / 8;
+        bitbuffer_writeblock(out_buffer, argval, bytes * 8);
+        write_zeros(out_buffer, argdef->bitwidth - bytes * 8);
+        return BS_OK;
     case SKIP:
-        for (size_t i = 0; i < argdef->bitwidth; i++) {
-            bitbuffer_writebit(out_buffer, 0);
-        }
-        return;
+        write_zeros(out_buffer, argdef->bitwidth);
+        return BS_OK;
+    default:
+        return BS_BAD_ARGTYPE;
+    }
+}
+
+bool arg_fits_int(argument_def *argdef, long int value) {
+    unsigned int width = argdef->bitwidth;
+    switch (argdef->type) {
+    case UNSIGNED_INT:
+        return value >= 0 && (width >= 63 || value < (1L << width));
+    case INT:
+        // a sign bit and a magnitude, compared without negating, which
+        // would overflow for LONG_MIN
+        if (width >= 64)
+            return value != LONG_MIN;
+        long int limit = (1L << (width - 1)) - 1;
+        return value >= -limit && value <= limit;
+    case HEX:
+        return width >= 64 || (unsigned long)value < (1UL << width);
     default:
-        printf("error trying to write unknown argtype "
-               "%s",
-               typenames[argdef->type]);
+        return false;
+    }
+}
 
+void arg_write(bitbuffer *out_buffer, language_def *l, argument_def *argdef,
+               void *argval) {
+    binscript_error e = arg_write_checked(out_buffer, l, argdef, argval);
+    if (e != BS_OK) {
+        printf("error writing %s argument of width %u (%s)\n",
+               type_name(argdef->type), argdef->bitwidth,
+               binscript_error_name(e));
         exit(1);
     }
 }
@@ -262,10 +434,48 @@ void lang_init(language_def *lang) {
     lang->function_ct = 0;
     lang->function_capacity = 0;
     lang->functions = NULL;
+    lang->finalized = false;
+    lang->arena = NULL;
+    lang->cache_map = NULL;
+    lang->cache_map_len = 0;
+    lang->plans = NULL;
+    lang->dispatch = NULL;
+    lang->dispatch_len = 0;
+    lang->flow = NULL;
+    lang->flow_ct = 0;
+    lang->alloc = NULL;
 }
 
 function_def *lang_getfn(language_def *l, unsigned int binary_value) {
     unsigned int i;
+
+    // finalized languages are sorted by binary value. Find the first
+    // function with the value, to match the linear scan below when a
+    // value is defined more than once.
+    if (l->finalized) {
+        if (l->dispatch != NULL) {
+            if (binary_value >= l->dispatch_len ||
+                l->dispatch[binary_value] == NULL)
+                return NULL;
+            return l->dispatch[binary_value]->fn;
+        }
+
+        unsigned int lo = 0, hi = l->function_ct;
+        while (lo < hi) {
+            unsigned int mid = lo + (hi - lo) / 2;
+            if (l->functions[mid]->function_binary_value < binary_value) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo < l->function_ct &&
+            l->functions[lo]->function_binary_value == binary_value) {
+            return l->functions[lo];
+        }
+        return NULL;
+    }
+
     for (i = 0; i < l->function_ct; i++) {
         // printf("%d 0x%x ", i, l->functions[i]->function_binary_value);
         // printf("%s \n", l->functions[i]->name);
@@ -286,39 +496,310 @@ function_def *lang_getfnbyname(language_def *l, char *name) {
     return NULL;
 }
 
-void _free_lang(language_def *l, bool controlled) {
-    if (controlled) {
-        for (size_t i = 0; i < l->function_ct; i++) {
-            free_fn(l->functions[i]);
-            free(l->functions[i]);
+// orders functions by binary value, then by definition order
+struct finalize_entry {
+    function_def *fn;
+    unsigned int position;
+};
+
+static int finalize_entry_cmp(const void *a, const void *b) {
+    const struct finalize_entry *ea = a, *eb = b;
+    if (ea->fn->function_binary_value != eb->fn->function_binary_value) {
+        return ea->fn->function_binary_value < eb->fn->function_binary_value
+                   ? -1
+                   : 1;
+    }
+    return (int)ea->position - (int)eb->position;
+}
+
+// releases the storage of a language's functions, without touching
+// the language's metadata
+static void free_lang_storage(language_def *l, bool controlled) {
+    if (l->arena != NULL) {
+        // everything, including l->functions, lives in the arena
+        bs_free(l->alloc, l->arena);
+    } else {
+        // functions added one at a time were made with the language's
+        // allocator by whoever added them
+        if (controlled) {
+            for (size_t i = 0; i < l->function_ct; i++) {
+                free_fn_with(l->functions[i], l->alloc);
+                bs_free(l->alloc, l->functions[i]);
+            }
+        }
+        bs_free(l->alloc, l->functions);
+    }
+
+    if (l->cache_map != NULL) {
+        munmap(l->cache_map, l->cache_map_len);
+    }
+
+    bs_free(l->alloc, l->plans);
+    bs_free(l->alloc, l->dispatch);
+    l->plans = NULL;
+    l->dispatch = NULL;
+    l->dispatch_len = 0;
+
+    l->functions = NULL;
+    l->arena = NULL;
+    l->cache_map = NULL;
+    l->cache_map_len = 0;
+}
+
+void lang_finalize(language_def *l) {
+    if (l->finalized)
+        return;
+
+    // size the block
+    size_t fn_ct = l->function_ct, arg_ct = 0, names_len = 0;
+    for (size_t i = 0; i < fn_ct; i++) {
+        function_def *fn = l->functions[i];
+        names_len += strlen(fn->name) + 1;
+        arg_ct += fn->argc;
+        for (size_t j = 0; j < fn->argc; j++) {
+            if (fn->arguments[j]->name != NULL)
+                names_len += strlen(fn->arguments[j]->name) + 1;
+        }
+    }
+
+    char *block = bs_malloc(l->alloc, sizeof(function_def *) * fn_ct +
+                                          sizeof(argument_def *) * arg_ct +
+                                          sizeof(function_def) * fn_ct +
+                                          sizeof(argument_def) * arg_ct +
+                                          names_len + 1);
+    struct finalize_entry *order =
+        bs_malloc(l->alloc, sizeof(struct finalize_entry) * (fn_ct + 1));
+    if (block == NULL || order == NULL) {
+        printf("error allocating language arena\n");
+        exit(1);
+    }
+
+    function_def **fn_ptrs = (function_def **)block;
+    argument_def **arg_ptrs = (argument_def **)(fn_ptrs + fn_ct);
+    function_def *fns = (function_def *)(arg_ptrs + arg_ct);
+    argument_def *args = (argument_def *)(fns + fn_ct);
+    char *names = (char *)(args + arg_ct);
+
+    for (size_t i = 0; i < fn_ct; i++) {
+        order[i].fn = l->functions[i];
+        order[i].position = i;
+    }
+    qsort(order, fn_ct, sizeof(struct finalize_entry), finalize_entry_cmp);
+
+    // copy each function, its arguments and their names into the block
+    size_t arg_index = 0;
+    for (size_t i = 0; i < fn_ct; i++) {
+        function_def *src = order[i].fn, *dst = &fns[i];
+
+        dst->function_binary_value = src->function_binary_value;
+        dst->argc = src->argc;
+        dst->name = strcpy(names, src->name);
+        names += strlen(src->name) + 1;
+        dst->arguments = (src->argc == 0) ? NULL : &arg_ptrs[arg_index];
+
+        for (size_t j = 0; j < src->argc; j++) {
+            argument_def *srcarg = src->arguments[j];
+            argument_def *dstarg = &args[arg_index];
+            dstarg->type = srcarg->type;
+            dstarg->bitwidth = srcarg->bitwidth;
+            dstarg->name = NULL;
+            if (srcarg->name != NULL) {
+                dstarg->name = strcpy(names, srcarg->name);
+                names += strlen(srcarg->name) + 1;
+            }
+            arg_ptrs[arg_index] = dstarg;
+            arg_index++;
+        }
+
+        fn_ptrs[i] = dst;
+    }
+    bs_free(l->alloc, order);
+
+    // drop the old storage and switch over to the block
+    free_lang_storage(l, true);
+    l->functions = fn_ptrs;
+    l->function_capacity = fn_ct;
+    l->arena = block;
+    l->finalized = true;
+}
+
+bool func_strings_aligned(language_def *l, function_def *fn) {
+    size_t offset = l->function_name_width;
+    bool has_strings = false;
+    for (size_t i = 0; i < fn->argc; i++) {
+        argument_def *arg = fn->arguments[i];
+        if (arg->type == STRING || arg->type == RAW_STRING) {
+            if (offset % 8 != 0)
+                return false;
+            has_strings = true;
+        }
+        offset += arg->bitwidth;
+    }
+    return has_strings;
+}
+
+void lang_build_dispatch(language_def *l) {
+    if (l->plans != NULL)
+        return;
+    if (!l->finalized) {
+        printf("lang_build_dispatch called on a language that is not "
+               "finalized\n");
+        exit(1);
+    }
+
+    l->plans =
+        bs_malloc(l->alloc, sizeof(function_plan) * (l->function_ct + 1));
+    for (size_t i = 0; i < l->function_ct; i++) {
+        function_def *fn = l->functions[i];
+        l->plans[i].fn = fn;
+        l->plans[i].width = func_call_width(l, fn);
+        l->plans[i].strings_aligned = func_strings_aligned(l, fn);
+        l->plans[i].flow = lang_getflow(l, fn->function_binary_value);
+    }
+
+    // the table must hold every defined value, so that lang_getfn
+    // answers the same with and without it. Functions are sorted, so
+    // the last one has the largest value.
+    size_t len = (size_t)1 << l->function_name_width;
+    if (l->function_name_width > LANG_DISPATCH_MAX_WIDTH ||
+        (l->function_ct > 0 &&
+         l->functions[l->function_ct - 1]->function_binary_value >= len))
+        return;
+
+    l->dispatch_len = len;
+    l->dispatch =
+        bs_calloc(l->alloc, l->dispatch_len, sizeof(function_plan *));
+
+    // walking backwards leaves the first definition of a duplicated
+    // value in the table
+    for (size_t i = l->function_ct; i-- > 0;) {
+        l->dispatch[l->functions[i]->function_binary_value] = &l->plans[i];
+    }
+}
+
+const function_plan *lang_getplan(language_def *l,
+                                  unsigned int binary_value) {
+    if (l->plans == NULL)
+        return NULL;
+    if (l->dispatch != NULL) {
+        return binary_value < l->dispatch_len ? l->dispatch[binary_value]
+                                              : NULL;
+    }
+
+    // plans are in the order of the functions, so the index of the
+    // function is the index of its plan
+    unsigned int lo = 0, hi = l->function_ct;
+    while (lo < hi) {
+        unsigned int mid = lo + (hi - lo) / 2;
+        if (l->functions[mid]->function_binary_value < binary_value) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
         }
     }
-    free(l->functions);
+    if (lo == l->function_ct ||
+        l->functions[lo]->function_binary_value != binary_value)
+        return NULL;
+    return &l->plans[lo];
+}
+
+const bs_flow_rule *lang_getflow(language_def *l, unsigned int binary_value) {
+    // languages branch through a handful of functions at most
+    for (unsigned int i = 0; i < l->flow_ct; i++) {
+        if (l->flow[i].function_binary_value == binary_value)
+            return &l->flow[i];
+    }
+    return NULL;
+}
+
+bool lang_add_flow(language_def *l, const bs_flow_rule *rule) {
+    if (lang_getflow(l, rule->function_binary_value) != NULL)
+        return false;
+
+    l->flow = bs_realloc(l->alloc, l->flow,
+                         sizeof(bs_flow_rule) * (l->flow_ct + 1));
+    l->flow[l->flow_ct++] = *rule;
+    return true;
+}
+
+void _free_lang(language_def *l, bool controlled) {
+    free_lang_storage(l, controlled);
+
+    // flow rules are kept apart from the functions, so that compacting
+    // a language leaves them be
+    bs_free(l->alloc, l->flow);
+    l->flow = NULL;
+    l->flow_ct = 0;
 }
 
 void free_lang(language_def *l) { _free_lang(l, true); }
 
+static bool arg_is_string(argument_def *argdef) {
+    return argdef->type == STRING || argdef->type == RAW_STRING;
+}
+
+bs_slice call_arg_slice(function_call *call, size_t index) {
+    argument_def *argdef = call->defn->arguments[index];
+    bs_slice slice = { .data = call->args[index],
+                       .len = argdef->bitwidth / 8 };
+
+    if (argdef->type == STRING) {
+        const char *end = memchr(slice.data, '\0', slice.len);
+        if (end != NULL)
+            slice.len = end - slice.data;
+    }
+    return slice;
+}
+
+void call_escape(function_call *call) {
+    if (!call->borrowed)
+        return;
+
+    for (size_t i = 0; i < call->defn->argc; i++) {
+        argument_def *argdef = call->defn->arguments[i];
+        if (arg_is_string(argdef)) {
+            size_t len = argdef->bitwidth / 8;
+            char *owned = bs_malloc(call->alloc, len + 1);
+            memcpy(owned, call->args[i], len);
+            owned[len] = '\0';
+            call->args[i] = owned;
+        }
+    }
+    call->borrowed = false;
+}
+
 void free_call(function_call *call) {
+    if (call->pool != NULL) {
+        bs_call_pool_give(call->pool, call);
+        return;
+    }
     for (size_t i = 0; i < call->defn->argc; i++) {
-        free(call->args[i]);
+        // borrowed strings belong to the input buffer
+        if (call->borrowed && arg_is_string(call->defn->arguments[i]))
+            continue;
+        bs_free(call->alloc, call->args[i]);
     }
-    free(call->args);
-    free(call);
+    bs_free(call->alloc, call->args);
+    bs_free(call->alloc, call);
 }
 
-void free_fn(function_def *fn) {
+void free_fn(function_def *fn) { free_fn_with(fn, NULL); }
+
+void free_fn_with(function_def *fn, const bs_allocator *alloc) {
     for (size_t i = 0; i < fn->argc; i++) {
-        free_arg(fn->arguments[i]);
+        free_arg_with(fn->arguments[i], alloc);
     }
 
     if (fn->name != NULL)
-        free(fn->name);
+        bs_free(alloc, fn->name);
 
     if (fn->arguments != NULL)
-        free(fn->arguments);
+        bs_free(alloc, fn->arguments);
 }
 
-void free_arg(argument_def *argdef) {
-    free(argdef->name);
-    free(argdef);
+void free_arg(argument_def *argdef) { free_arg_with(argdef, NULL); }
+
+void free_arg_with(argument_def *argdef, const bs_allocator *alloc) {
+    bs_free(alloc, argdef->name);
+    bs_free(alloc, argdef);
 }
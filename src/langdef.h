@@ -1,8 +1,10 @@
 #ifndef BINSCRIPTER_LANGDEF
 #define BINSCRIPTER_LANGDEF
 
+#include <limits.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include "alloc.h"
 #include "bitbuffer.h"
 
 typedef enum arg_type {
@@ -20,6 +22,26 @@ extern const char *typenames[];
 
 typedef enum endianness { BS_BIG_ENDIAN, BS_LITTLE_ENDIAN } endianness;
 
+// problems found while decoding or encoding scripts
+typedef enum binscript_error {
+    BS_OK = 0,
+    BS_UNKNOWN_OPCODE = 1,      // no function with the statement's name
+    BS_TRUNCATED_STATEMENT = 2, // statement runs past the end of input
+    BS_MISSING_TERMINATOR = 3,  // input ended before a null terminator
+    BS_UNTERMINATED_STRING = 4, // STRING field with no null byte
+    BS_BAD_FLOAT_WIDTH = 5,     // FLOAT field with no known decoding
+    BS_BAD_ARGTYPE = 6,         // argument type with no binary encoding
+    BS_OUT_OF_SPACE = 7,        // output buffer too small for a statement
+    BS_IO_ERROR = 8,            // reading the input failed
+    BS_BAD_SCRIPT = 9,          // statement of a textual script is invalid
+    BS_BAD_REQUEST = 10,        // daemon request for an unknown op or lang
+    BS_UNMAPPED = 11,           // no counterpart in the target language
+    BS_OUT_OF_RANGE = 12,       // value does not fit its target field
+    __BS_ERROR_CT
+} binscript_error;
+
+const char *binscript_error_name(binscript_error e);
+
 typedef struct argument_def {
     arg_type type;
     unsigned int bitwidth;
@@ -41,8 +63,78 @@ typedef struct function_def {
 typedef struct function_call {
     function_def *defn;
     void **args;
+
+    // when set, the STRING and RAW_STRING arguments of the call point
+    // directly into the buffer the call was decoded from, and are not
+    // owned by the call (see call_escape)
+    bool borrowed;
+
+    // what the call and its arguments were allocated with, NULL for
+    // malloc (see alloc.h)
+    const bs_allocator *alloc;
+
+    // the pool free_call returns the call to, or NULL (see callpool.h),
+    // and the next call waiting in the pool
+    struct bs_call_pool *pool;
+    struct function_call *pool_next;
 } function_call;
 
+// a view of the bytes of a string argument
+typedef struct bs_slice {
+    const char *data;
+    size_t len;
+} bs_slice;
+
+/**
+ * Thread safety
+ *
+ * A finalized language is never written to by the library: decoding,
+ * encoding, validation and lookups (lang_getfn, lang_getfnbyname,
+ * func_call_width) only read it. Any lookup structure the library
+ * keeps for a language is built by lang_finalize or lang_build_dispatch,
+ * not on first use, so a finalized language may be shared between any
+ * number of threads without locking.
+ *
+ * Building a language (parsing, lang_finalize, lang_build_dispatch,
+ * lang_cache_load) and free_lang must happen before the language is
+ * shared and after every thread is done with it, respectively. A
+ * registry (see registry.h) does the building once, on first use, and
+ * only hands out languages that are fully built.
+ **/
+// how a statement moves control through a script, as declared by the
+// `flow` lines of a language definition (see cfg.h)
+typedef enum bs_flow_kind {
+    BS_FLOW_JUMP,       // continues at its target, and only there
+    BS_FLOW_CALL,       // runs its target, then continues after itself
+    BS_FLOW_RETURN,     // returns from a call
+    BS_FLOW_EXIT,       // ends the script
+    BS_FLOW_LOOP_START, // starts a loop, whose body follows it
+    BS_FLOW_LOOP_END,   // repeats the innermost open loop, or continues
+    __BS_FLOW_CT
+} bs_flow_kind;
+
+extern const char *flow_kind_names[];
+
+#define BS_FLOW_NO_TARGET UINT_MAX
+
+typedef struct bs_flow_rule {
+    unsigned int function_binary_value;
+    bs_flow_kind kind;
+    // the argument holding the byte offset of the target of a jump or
+    // call, or BS_FLOW_NO_TARGET
+    unsigned int target_arg;
+    bool relative; // the offset counts from the start of the statement
+} bs_flow_rule;
+
+// facts about a function that decoding would otherwise recompute for
+// every statement
+typedef struct function_plan {
+    function_def *fn;
+    size_t width;         // func_call_width of the function, in bits
+    bool strings_aligned; // every string argument starts on a byte
+    const bs_flow_rule *flow; // NULL for statements that do not branch
+} function_plan;
+
 typedef struct language_def {
     enum endianness target_endianness;
     unsigned int function_name_width;
@@ -51,6 +143,36 @@ typedef struct language_def {
     unsigned int function_capacity;
     bool byte_aligned_functions;
     function_def **functions;
+
+    // set by lang_finalize. Finalized languages keep their functions
+    // sorted by binary value and must not be modified afterwards.
+    bool finalized;
+
+    // single block holding every function_def and argument_def of the
+    // language (and the pointer arrays that refer to them), or NULL if
+    // they were allocated individually
+    void *arena;
+
+    // mapping backing the names of a language loaded from a binary
+    // cache (see langcache.h). NULL for languages parsed from text.
+    void *cache_map;
+    size_t cache_map_len;
+
+    // built by lang_build_dispatch. `plans` holds one plan per
+    // function, in the order of `functions`. `dispatch` maps every
+    // binary value below dispatch_len to its plan (or NULL), and is
+    // NULL if the name width is too wide for a dense table.
+    function_plan *plans;
+    function_plan **dispatch;
+    size_t dispatch_len;
+
+    // branching functions, in the order they were declared
+    bs_flow_rule *flow;
+    unsigned int flow_ct;
+
+    // what the tables above are allocated with, and what consumers of
+    // the language allocate with by default. NULL for malloc.
+    const bs_allocator *alloc;
 } language_def;
 
 bool validate_size(arg_type type, size_t bits);
@@ -66,17 +188,152 @@ function_def *lang_getfnbyname(language_def *l, char *name);
 function_call *func_getcall(function_def *d, void *call);
 
 void *arg_init(language_def *l, argument_def *def, bitbuffer *buffer);
+
+/**
+ * Decodes an argument like arg_init, but reports bad input instead of
+ * exiting. On success *out holds the decoded value (NULL for SKIP
+ * arguments). On failure *out is NULL and the buffer is not advanced.
+ *
+ * returns BS_TRUNCATED_STATEMENT if the buffer holds fewer than
+ * def->bitwidth bits, BS_BAD_FLOAT_WIDTH or BS_BAD_ARGTYPE if the
+ * argument has no decoding.
+ **/
+binscript_error arg_init_checked(language_def *l, argument_def *def,
+                                 bitbuffer *buffer, void **out);
+
+// arg_init_checked, allocating the value with `alloc` instead of the
+// language's allocator
+binscript_error arg_init_with(language_def *l, const bs_allocator *alloc,
+                              argument_def *def, bitbuffer *buffer,
+                              void **out);
+
+// the bytes arg_init_checked allocates for an argument's value, or 0
+// for arguments that have none
+size_t arg_value_size(argument_def *def);
+
+/**
+ * Decodes an argument like arg_init_checked, into caller supplied
+ * storage instead of a new allocation: a long int for INT, HEX and
+ * UNSIGNED_INT, a long double for FLOAT, and def->bitwidth / 8 + 1
+ * bytes for strings. HEX arguments wider than a long int take
+ * bits2bytes(def->bitwidth) bytes, in binary order. `dest` is not used
+ * for SKIP arguments. Used to decode many statements without allocating
+ * for each one.
+ **/
+binscript_error arg_read_checked(language_def *l, argument_def *def,
+                                 bitbuffer *buffer, void *dest);
+
+/**
+ * Gets the bytes of a STRING or RAW_STRING argument of a call, whether
+ * the call owns them or borrows them from its input. RAW_STRING slices
+ * span the whole width of the argument, STRING slices stop at the first
+ * null byte.
+ *
+ * call: the call holding the argument
+ * index: the index of the argument in call->defn
+ **/
+bs_slice call_arg_slice(function_call *call, size_t index);
+
+/**
+ * Copies any string arguments a call borrows from its input buffer
+ * into memory owned by the call, so that the call may outlive the
+ * buffer. Does nothing to calls that own all of their arguments.
+ **/
+void call_escape(function_call *call);
 void arg_write(bitbuffer *out_buffer, language_def *l, argument_def *def,
                void *arg);
 
+/**
+ * Encodes an argument like arg_write, but reports problems instead of
+ * exiting. Nothing is written on failure.
+ *
+ * STRING arguments are written up to their first null byte and padded
+ * with zeros to the width of the field. RAW_STRING arguments are
+ * written as the first def->bitwidth bits of their buffer.
+ *
+ * returns BS_OUT_OF_SPACE if the buffer has fewer than def->bitwidth
+ * bits left, BS_BAD_FLOAT_WIDTH or BS_BAD_ARGTYPE if the argument has
+ * no encoding.
+ **/
+binscript_error arg_write_checked(bitbuffer *out_buffer, language_def *l,
+                                  argument_def *def, void *arg);
+
+/**
+ * checks that an integer can be written to an INT, UNSIGNED_INT or HEX
+ * argument without losing bits
+ **/
+bool arg_fits_int(argument_def *def, long int value);
+
 void lang_init(language_def *lang);
 
+/**
+ * Compacts a language into a single contiguous block, so that it can
+ * be freed with a single call and so that the metadata touched while
+ * decoding is laid out sequentially:
+ *
+ *   [function_def *][argument_def *][function_def][argument_def][names]
+ *
+ * Functions are stored in order of their binary value (ties keep their
+ * definition order), and the arguments of each function are stored
+ * inline after those of the previous function. Lookups by binary value
+ * on a finalized language are a binary search.
+ *
+ * The language must own its functions (as it does after parsing).
+ * After finalizing, functions may no longer be added to the language.
+ **/
+void lang_finalize(language_def *lang);
+
+/**
+ * Builds the decode plans of a finalized language, and a dense table
+ * from binary value to plan when the name width is at most
+ * LANG_DISPATCH_MAX_WIDTH bits. Lookups with lang_getfn and
+ * lang_getplan are then a single index. Does nothing if the plans are
+ * already built.
+ *
+ * Like lang_finalize, this must happen before the language is shared.
+ **/
+#define LANG_DISPATCH_MAX_WIDTH 16
+void lang_build_dispatch(language_def *lang);
+
+/**
+ * Gets the plan of the function with a binary value, or NULL if there
+ * is no such function or the language has no plans.
+ **/
+const function_plan *lang_getplan(language_def *l, unsigned int binary_value);
+
+/**
+ * Gets the flow rule of the function with a binary value, or NULL if
+ * statements calling it do not branch.
+ **/
+const bs_flow_rule *lang_getflow(language_def *l, unsigned int binary_value);
+
+/**
+ * Declares that calls to a function branch. Returns false if the
+ * language already has a rule for the function.
+ **/
+bool lang_add_flow(language_def *l, const bs_flow_rule *rule);
+
 size_t func_call_width(language_def *l, function_def *def);
 
+/**
+ * Checks that a function has string arguments, and that every one of
+ * them starts on a byte boundary, so that all of them can be borrowed
+ * from the input.
+ **/
+bool func_strings_aligned(language_def *l, function_def *def);
+
 void free_lang(language_def *l);
 void _free_lang(language_def *l, bool managed);
 void free_fn(function_def *fn);
 void free_call(function_call *call);
 void free_arg(argument_def *argdef);
 
+/**
+ * Like free_fn and free_arg, for definitions allocated with `alloc`
+ * (NULL for malloc), such as those parse_fn makes with the allocator
+ * of its language.
+ **/
+void free_fn_with(function_def *fn, const bs_allocator *alloc);
+void free_arg_with(argument_def *argdef, const bs_allocator *alloc);
+
 #endif
@@ -1,14 +1,31 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <stdint.h>
+#include <unistd.h>
 
+#include "convert.h"
+#include "daemon.h"
+#include "diff.h"
+#include "filereader.h"
+#include "langcache.h"
 #include "langdef.h"
+#include "ordered.h"
 #include "parsescript.h"
+#include "registry.h"
+#include "stats.h"
+#include "transcode.h"
 #include "translator.h"
+#include "workpool.h"
 
-int main(int argc, char **argv) {
+// converts example.hex with example.langdef, from both a file and memory
+static void run_demo(void) {
 
     ////////////////////////////////////
     // Open the File & Parse Language //
@@ -38,9 +55,15 @@ int main(int argc, char **argv) {
         exit(1);
     }
 
+    // calls are freed as soon as they are printed, so both consumers
+    // below recycle them through one pool
+    bs_call_pool pool;
+    bs_call_pool_init(&pool, l, NULL);
+
     binscript_consumer *consumer =
         binscript_file_consumer(l, packed_file, "example.hex", BIN2SCRIPT);
     consumer_set_size(consumer, NULL_TERMINATED, 0);
+    consumer_set_pool(consumer, &pool);
 
     printf("\nHex file contents: \n");
     function_call *call;
@@ -74,6 +97,7 @@ int main(int argc, char **argv) {
     // create a script translator and translate it
     binscript_consumer *mem_consumer =
         binscript_mem_consumer(l, map_origin, "anon_mem", BIN2SCRIPT);
+    consumer_set_pool(mem_consumer, &pool);
 
     printf("\nHex file contents: \n");
     while ((call = binscript_next(mem_consumer)) != NULL) {
@@ -83,6 +107,7 @@ int main(int argc, char **argv) {
 
     fclose(packed_file);
     binscript_free(mem_consumer);
+    bs_call_pool_free(&pool);
     free_lang(l);
     free(l);
 
@@ -90,3 +115,701 @@ int main(int argc, char **argv) {
     // Test encoding a language //
     //////////////////////////////
 }
+
+////////////////
+// BATCH MODE //
+////////////////
+
+static const char *usage =
+    "usage: %s [options] LANGDEF INPUT...\n"
+    "       %s [-j THREADS] -S SOCKET LANGDEF...\n"
+    "       %s [-u] -D LANGDEF OLD NEW\n"
+    "\n"
+    "Converts every INPUT with the language defined in LANGDEF. An INPUT\n"
+    "may be a file, a directory (searched recursively), or '-' to read\n"
+    "input paths from stdin, one per line. Run with no arguments to\n"
+    "convert example.hex with example.langdef.\n"
+    "\n"
+    "With -S, serves decode, encode and validate requests for each\n"
+    "LANGDEF on the Unix socket SOCKET until interrupted (see daemon.h).\n"
+    "\n"
+    "With -D, prints the statements that differ between the binaries OLD\n"
+    "and NEW (see diff.h), and exits with 1 if there are any.\n"
+    "\n"
+    "  -d DIRECTION  bin2script (default) or script2bin\n"
+    "  -t LANGDEF    transcode binaries into the language defined in\n"
+    "                LANGDEF instead (see transcode.h)\n"
+    "  -m MAP        function and argument renames for -t\n"
+    "  -j THREADS    number of worker threads (default: one per CPU)\n"
+    "  -q DEPTH      read up to DEPTH files ahead of the workers, through\n"
+    "                io_uring where the kernel has it (see filereader.h)\n"
+    "  -P            convert one binary at a time, split across the\n"
+    "                threads, writing its text in order (see ordered.h)\n"
+    "  -o DIR        write outputs under DIR, mirroring the input tree\n"
+    "                (default: next to each input)\n"
+    "  -s SUFFIX     suffix appended to output names\n"
+    "                (default: .txt for bin2script, .bin otherwise)\n"
+    "  -x SUFFIX     only convert files ending in SUFFIX when searching\n"
+    "                directories\n"
+    "  -u            binaries have no null terminator\n"
+    "  -c PATH       cache the parsed language at PATH\n"
+    "  -S SOCKET     run as a daemon on SOCKET\n"
+    "  -D            compare two binaries\n"
+    "  -T            print statement counts and timings to stderr when\n"
+    "                done (see stats.h)\n";
+
+typedef struct batch_input {
+    char *path;
+    const char *rel; // path relative to the root it was found under
+} batch_input;
+
+typedef struct batch_result {
+    binscript_error error;
+    size_t offset;
+    int sys_errno; // set for BS_IO_ERROR
+} batch_result;
+
+// buffers and calls reused by a worker from one file to the next
+typedef struct batch_worker {
+    bs_buffer in;
+    bs_buffer out;
+    bs_buffer path;
+    bs_call_pool pool; // decoded calls, when converting to text
+    bs_stats stats;    // used with -T
+} batch_worker;
+
+typedef struct batch {
+    language_def *lang;
+    bs_transcoder *transcoder; // set when transcoding
+    binscript_parser_direction direction;
+    binscript_endmode endmode;
+    const char *out_dir;
+    const char *out_suffix;
+    const char *filter_suffix;
+    bool count; // keep stats per worker
+    bs_file_reader *reader; // reads inputs ahead of the workers, with -q
+    bool split; // convert each input on every thread, with -P
+
+    batch_input *inputs;
+    size_t input_ct;
+    size_t input_cap;
+
+    batch_result *results;
+    batch_worker *workers;
+} batch;
+
+static bool has_suffix(const char *s, const char *suffix) {
+    size_t len = strlen(s), suffix_len = strlen(suffix);
+    return len >= suffix_len && 0 == strcmp(s + len - suffix_len, suffix);
+}
+
+static void batch_add_input(batch *b, char *path, size_t root_len) {
+    if (b->input_ct == b->input_cap) {
+        b->input_cap = b->input_cap < 64 ? 64 : b->input_cap * 2;
+        b->inputs = realloc(b->inputs, sizeof(batch_input) * b->input_cap);
+        if (b->inputs == NULL) {
+            printf("error growing input list\n");
+            exit(1);
+        }
+    }
+
+    const char *rel = path + root_len;
+    while (*rel == '/')
+        rel++;
+    b->inputs[b->input_ct].path = path;
+    b->inputs[b->input_ct].rel = rel;
+    b->input_ct++;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// adds every file under a directory, in sorted order so that batches
+// are reproducible
+static void batch_add_dir(batch *b, const char *dir, size_t root_len) {
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        printf("%s: could not open directory (%s)\n", dir, strerror(errno));
+        return;
+    }
+
+    char **names = NULL;
+    size_t name_ct = 0, name_cap = 0;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        if (0 == strcmp(ent->d_name, ".") || 0 == strcmp(ent->d_name, ".."))
+            continue;
+        if (name_ct == name_cap) {
+            name_cap = name_cap < 16 ? 16 : name_cap * 2;
+            names = realloc(names, sizeof(char *) * name_cap);
+        }
+        names[name_ct++] = strdup(ent->d_name);
+    }
+    closedir(d);
+    qsort(names, name_ct, sizeof(char *), compare_names);
+
+    for (size_t i = 0; i < name_ct; i++) {
+        char *path = malloc(strlen(dir) + strlen(names[i]) + 2);
+        sprintf(path, "%s/%s", dir, names[i]);
+        free(names[i]);
+
+        struct stat st;
+        if (0 != stat(path, &st)) {
+            free(path);
+        } else if (S_ISDIR(st.st_mode)) {
+            batch_add_dir(b, path, root_len);
+            free(path);
+        } else if (b->filter_suffix == NULL ||
+                   has_suffix(path, b->filter_suffix)) {
+            batch_add_input(b, path, root_len);
+        } else {
+            free(path);
+        }
+    }
+    free(names);
+}
+
+static void batch_add_path(batch *b, const char *arg) {
+    struct stat st;
+    if (0 == stat(arg, &st) && S_ISDIR(st.st_mode)) {
+        batch_add_dir(b, arg, strlen(arg));
+        return;
+    }
+
+    // files named directly mirror to their base name
+    const char *base = strrchr(arg, '/');
+    char *path = strdup(arg);
+    batch_add_input(b, path, base == NULL ? 0 : base + 1 - arg);
+}
+
+// creates every missing parent directory of a path
+static void make_parent_dirs(char *path) {
+    for (char *p = path + 1; *p != '\0'; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            mkdir(path, 0777);
+            *p = '/';
+        }
+    }
+}
+
+// reads a whole file into a buffer, followed by a null byte
+static bool read_file(const char *path, bs_buffer *buf) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+        return false;
+
+    bs_buffer_clear(buf);
+    size_t got;
+    do {
+        bs_buffer_reserve(buf, 64 * 1024);
+        got = fread(buf->data + buf->len, 1, buf->capacity - buf->len - 1, f);
+        buf->len += got;
+    } while (got > 0);
+
+    bool ok = !ferror(f);
+    fclose(f);
+    buf->data[buf->len] = '\0';
+    return ok;
+}
+
+// builds the path of the output of an input into `path`, creating its
+// parent directories under the output directory
+static const char *batch_output_path(batch *b, batch_input *input,
+                                     bs_buffer *path) {
+    bs_buffer_clear(path);
+    bs_buffer_reserve(path, strlen(input->path) + strlen(b->out_suffix) +
+                                (b->out_dir ? strlen(b->out_dir) : 0) + 2);
+    if (b->out_dir != NULL) {
+        sprintf(path->data, "%s/%s%s", b->out_dir, input->rel,
+                b->out_suffix);
+        make_parent_dirs(path->data);
+    } else {
+        sprintf(path->data, "%s%s", input->path, b->out_suffix);
+    }
+    return path->data;
+}
+
+// converts an input that has been read into `in`, followed by a null
+// byte, and writes the output
+static void batch_convert_read(batch *b, size_t item, batch_worker *w,
+                               char *in, size_t in_len, bs_stats *stats) {
+    batch_input *input = &b->inputs[item];
+    batch_result *result = &b->results[item];
+
+    bs_buffer_clear(&w->out);
+    if (b->transcoder != NULL) {
+        result->error = bs_transcode_buffer(b->transcoder, in, in_len,
+                                            b->endmode, &w->out,
+                                            &result->offset);
+    } else {
+        result->error = binscript_convert_counted(
+            b->lang, b->direction, b->endmode, in, in_len, &w->out,
+            &result->offset, stats, &w->pool);
+    }
+    if (result->error != BS_OK)
+        return;
+
+    FILE *f = fopen(batch_output_path(b, input, &w->path), "wb");
+    if (f == NULL || w->out.len != fwrite(w->out.data, 1, w->out.len, f)) {
+        result->error = BS_IO_ERROR;
+        result->sys_errno = errno;
+    }
+    if (f != NULL && 0 != fclose(f) && result->error == BS_OK) {
+        result->error = BS_IO_ERROR;
+        result->sys_errno = errno;
+    }
+}
+
+static void batch_convert_one(void *ctx, size_t item, unsigned int worker) {
+    batch *b = ctx;
+    batch_result *result = &b->results[item];
+    batch_worker *w = &b->workers[worker];
+
+    result->error = BS_OK;
+    result->offset = 0;
+    result->sys_errno = 0;
+
+    bs_stats *stats = b->count ? bs_stats_active(&w->stats) : NULL;
+    uint64_t start = stats != NULL ? bs_stats_clock() : 0;
+    if (!read_file(b->inputs[item].path, &w->in)) {
+        result->error = BS_IO_ERROR;
+        result->sys_errno = errno;
+        return;
+    }
+    if (stats != NULL) {
+        stats->refills++;
+        stats->ns[BS_STATS_IO] += bs_stats_clock() - start;
+    }
+    batch_convert_read(b, item, w, w->in.data, w->in.len, stats);
+}
+
+// converts whichever input the reader finishes next. Runs once per
+// input like batch_convert_one, but ignores which item it was given.
+static void batch_convert_next(void *ctx, size_t item, unsigned int worker) {
+    batch *b = ctx;
+    batch_worker *w = &b->workers[worker];
+    (void)item;
+
+    bs_stats *stats = b->count ? bs_stats_active(&w->stats) : NULL;
+    uint64_t start = stats != NULL ? bs_stats_clock() : 0;
+    bs_read *read = bs_file_reader_next(b->reader);
+    if (read == NULL)
+        return;
+    if (stats != NULL) {
+        stats->refills++;
+        stats->ns[BS_STATS_IO] += bs_stats_clock() - start;
+    }
+
+    batch_result *result = &b->results[read->item];
+    result->error = BS_OK;
+    result->offset = 0;
+    result->sys_errno = read->sys_errno;
+    if (read->sys_errno != 0) {
+        result->error = BS_IO_ERROR;
+    } else {
+        batch_convert_read(b, read->item, w, read->data, read->len, stats);
+    }
+    bs_file_reader_release(b->reader, read);
+}
+
+// converts one input on all of the threads at once, for -P. The text
+// is written as it is formatted, so it is removed again on failure.
+static void batch_convert_split(batch *b, size_t item,
+                                unsigned int threads) {
+    batch_input *input = &b->inputs[item];
+    batch_result *result = &b->results[item];
+    batch_worker *w = &b->workers[0];
+
+    result->error = BS_OK;
+    result->offset = 0;
+    result->sys_errno = 0;
+    if (!read_file(input->path, &w->in)) {
+        result->error = BS_IO_ERROR;
+        result->sys_errno = errno;
+        return;
+    }
+
+    const char *path = batch_output_path(b, input, &w->path);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        result->error = BS_IO_ERROR;
+        result->sys_errno = errno;
+        return;
+    }
+    result->error = binscript_convert_parallel(b->lang, b->endmode,
+                                               w->in.data, w->in.len,
+                                               threads, fd, &result->offset);
+    if (result->error == BS_IO_ERROR)
+        result->sys_errno = errno;
+    if (0 != close(fd) && result->error == BS_OK) {
+        result->error = BS_IO_ERROR;
+        result->sys_errno = errno;
+    }
+    if (result->error != BS_OK)
+        unlink(path);
+}
+
+static int run_daemon(const char *socket_path, unsigned int threads,
+                      int lang_ct, char **lang_paths);
+
+// parses a language definition, through a binary cache if one is given
+static bool load_language(language_def *lang, const char *path,
+                          const char *cache_path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        printf("could not open file '%s'\n", path);
+        return false;
+    }
+
+    detailed_parse_error *e =
+        cache_path != NULL ? parse_language_cached(lang, f, path, cache_path)
+                           : parse_language_from_file(lang, f, path);
+    fclose(f);
+    if (e != NULL) {
+        print_err(e);
+        free_err(e);
+        return false;
+    }
+    return true;
+}
+
+// prints the differences between two binaries, returning 1 if there
+// are any, like diff(1)
+static int run_diff(const char *lang_path, const char *a_path,
+                    const char *b_path, binscript_endmode endmode,
+                    const char *cache_path) {
+    language_def lang;
+    if (!load_language(&lang, lang_path, cache_path))
+        return 2;
+    lang_build_dispatch(&lang);
+
+    bs_buffer a, b;
+    bs_buffer_init(&a);
+    bs_buffer_init(&b);
+    int status = 2;
+    if (!read_file(a_path, &a)) {
+        printf("could not read '%s'\n", a_path);
+        goto done;
+    }
+    if (!read_file(b_path, &b)) {
+        printf("could not read '%s'\n", b_path);
+        goto done;
+    }
+
+    bs_diff d;
+    binscript_error e = bs_diff_binaries(&d, &lang, a.data, a.len, b.data,
+                                         b.len, endmode);
+    if (e != BS_OK) {
+        printf("%s: %s at byte %zu\n", d.error_in_b ? b_path : a_path,
+               binscript_error_name(e), d.error_offset);
+    } else {
+        bs_diff_print(&d, stdout);
+        status = d.entry_ct > 0 ? 1 : 0;
+    }
+    bs_diff_free(&d);
+
+done:
+    bs_buffer_free(&a);
+    bs_buffer_free(&b);
+    free_lang(&lang);
+    return status;
+}
+
+static int run_batch(int argc, char **argv) {
+    batch b = { .direction = BIN2SCRIPT, .endmode = NULL_TERMINATED };
+    const char *cache_path = NULL, *socket_path = NULL;
+    const char *target_path = NULL, *map_path = NULL;
+    unsigned int threads = 0, read_depth = 0;
+    bool diff = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:t:m:j:q:Po:s:x:uc:S:DTh")) != -1) {
+        switch (opt) {
+        case 'd':
+            if (0 == strcmp(optarg, "bin2script")) {
+                b.direction = BIN2SCRIPT;
+            } else if (0 == strcmp(optarg, "script2bin")) {
+                b.direction = SCRIPT2BIN;
+            } else {
+                printf("unknown direction '%s'\n", optarg);
+                return 2;
+            }
+            break;
+        case 't':
+            target_path = optarg;
+            break;
+        case 'm':
+            map_path = optarg;
+            break;
+        case 'j':
+            threads = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+        case 'q':
+            read_depth = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+        case 'P':
+            b.split = true;
+            break;
+        case 'o':
+            b.out_dir = optarg;
+            break;
+        case 's':
+            b.out_suffix = optarg;
+            break;
+        case 'x':
+            b.filter_suffix = optarg;
+            break;
+        case 'u':
+            b.endmode = MANUAL_CUTOFF;
+            break;
+        case 'c':
+            cache_path = optarg;
+            break;
+        case 'S':
+            socket_path = optarg;
+            break;
+        case 'D':
+            diff = true;
+            break;
+        case 'T':
+            b.count = true;
+            break;
+        default:
+            printf(usage, argv[0], argv[0], argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (socket_path != NULL && argc - optind >= 1) {
+        return run_daemon(socket_path, threads, argc - optind, argv + optind);
+    }
+    if (diff) {
+        if (argc - optind != 3) {
+            printf(usage, argv[0], argv[0], argv[0]);
+            return 2;
+        }
+        return run_diff(argv[optind], argv[optind + 1], argv[optind + 2],
+                        b.endmode, cache_path);
+    }
+    if (argc - optind < 2) {
+        printf(usage, argv[0], argv[0], argv[0]);
+        return 2;
+    }
+    if (b.split && (b.direction != BIN2SCRIPT || target_path != NULL)) {
+        printf("-P only converts binaries to text\n");
+        return 2;
+    }
+    if (b.out_suffix == NULL)
+        b.out_suffix =
+            b.direction == BIN2SCRIPT && target_path == NULL ? ".txt" : ".bin";
+
+    // load the language once, to be shared by every worker
+    language_def lang;
+    if (!load_language(&lang, argv[optind++], cache_path))
+        return 1;
+    lang_build_dispatch(&lang);
+    b.lang = &lang;
+
+    // transcoding compiles its routes once, to be shared by every worker
+    language_def target;
+    if (target_path != NULL) {
+        if (!load_language(&target, target_path, NULL))
+            return 1;
+        b.transcoder = bs_transcoder_create(&lang, &target);
+
+        bs_buffer map;
+        bs_buffer_init(&map);
+        if (map_path != NULL && !read_file(map_path, &map)) {
+            printf("could not read map '%s'\n", map_path);
+            return 1;
+        }
+        binscript_error e =
+            map_path != NULL ? bs_transcoder_load_map(b.transcoder, map.data)
+                             : BS_OK;
+        if (e == BS_OK)
+            e = bs_transcoder_compile(b.transcoder);
+        bs_buffer_free(&map);
+        if (e != BS_OK) {
+            printf("%s: %s\n", binscript_error_name(e),
+                   bs_transcoder_problem(b.transcoder));
+            return 1;
+        }
+    }
+
+    // collect the inputs
+    for (int i = optind; i < argc; i++) {
+        if (0 != strcmp(argv[i], "-")) {
+            batch_add_path(&b, argv[i]);
+            continue;
+        }
+
+        char *line = NULL;
+        size_t line_cap = 0;
+        ssize_t line_len;
+        while ((line_len = getline(&line, &line_cap, stdin)) > 0) {
+            if (line[line_len - 1] == '\n')
+                line[--line_len] = '\0';
+            if (line_len > 0)
+                batch_add_path(&b, line);
+        }
+        free(line);
+    }
+
+    if (threads == 0)
+        threads = workpool_cpu_count();
+    b.results = calloc(b.input_ct + 1, sizeof(batch_result));
+    b.workers = malloc(sizeof(batch_worker) * threads);
+    for (unsigned int i = 0; i < threads; i++) {
+        bs_buffer_init(&b.workers[i].in);
+        bs_buffer_init(&b.workers[i].out);
+        bs_buffer_init(&b.workers[i].path);
+        bs_call_pool_init(&b.workers[i].pool, &lang, NULL);
+        bs_stats_init(&b.workers[i].stats, &lang);
+    }
+
+    // with -q, the inputs are read in the background, and each worker
+    // converts whichever one is read next
+    const char **paths = NULL;
+    if (read_depth > 0 && !b.split) {
+        paths = malloc(sizeof(char *) * (b.input_ct + 1));
+        for (size_t i = 0; i < b.input_ct; i++) {
+            paths[i] = b.inputs[i].path;
+        }
+        b.reader = bs_file_reader_start(paths, b.input_ct, read_depth,
+                                        BS_READ_AUTO);
+        if (b.reader == NULL) {
+            printf("could not start reading ahead\n");
+            return 1;
+        }
+        if (b.count) {
+            fprintf(stderr, "reading through %s\n",
+                    bs_read_backend_name(bs_file_reader_backend(b.reader)));
+        }
+    }
+
+    unsigned int used = threads;
+    if (b.split) {
+        for (size_t i = 0; i < b.input_ct; i++) {
+            batch_convert_split(&b, i, threads);
+        }
+    } else {
+        used = workpool_run(
+            threads, b.input_ct,
+            b.reader != NULL ? batch_convert_next : batch_convert_one, &b);
+    }
+    if (b.reader != NULL)
+        bs_file_reader_free(b.reader);
+    free(paths);
+
+    // report per-file errors in input order
+    size_t failed = 0;
+    for (size_t i = 0; i < b.input_ct; i++) {
+        batch_result *r = &b.results[i];
+        if (r->error == BS_IO_ERROR) {
+            printf("%s: %s (%s)\n", b.inputs[i].path,
+                   binscript_error_name(r->error), strerror(r->sys_errno));
+        } else if (r->error != BS_OK) {
+            printf("%s: %s at %s %zu\n", b.inputs[i].path,
+                   binscript_error_name(r->error),
+                   b.direction == BIN2SCRIPT || b.transcoder != NULL
+                       ? "byte"
+                       : "statement",
+                   r->offset);
+        }
+        failed += r->error != BS_OK;
+        free(b.inputs[i].path);
+    }
+    printf("converted %zu of %zu files on %u threads\n", b.input_ct - failed,
+           b.input_ct, used);
+
+    // the time of each phase is summed over the workers
+    if (b.count) {
+        for (unsigned int i = 1; i < threads; i++) {
+            bs_stats_merge(&b.workers[0].stats, &b.workers[i].stats);
+        }
+        bs_stats_dump(&b.workers[0].stats, stderr);
+    }
+
+    for (unsigned int i = 0; i < threads; i++) {
+        bs_buffer_free(&b.workers[i].in);
+        bs_buffer_free(&b.workers[i].out);
+        bs_buffer_free(&b.workers[i].path);
+        bs_call_pool_free(&b.workers[i].pool);
+        bs_stats_free(&b.workers[i].stats);
+    }
+    free(b.workers);
+    free(b.results);
+    free(b.inputs);
+    if (b.transcoder != NULL) {
+        bs_transcoder_free(b.transcoder);
+        free_lang(&target);
+    }
+    free_lang(&lang);
+    return failed == 0 ? 0 : 1;
+}
+
+/////////////////
+// DAEMON MODE //
+/////////////////
+
+static bs_daemon *running_daemon;
+
+static void stop_daemon(int sig) {
+    (void)sig;
+    bs_daemon_stop(running_daemon);
+}
+
+// serves the given languages on a Unix socket until interrupted
+static int run_daemon(const char *socket_path, unsigned int threads,
+                      int lang_ct, char **lang_paths) {
+    if (lang_ct > 256) {
+        printf("at most 256 languages can be served\n");
+        return 2;
+    }
+
+    // languages come from a registry, so that the same definition
+    // listed twice is only loaded once, and every language has its
+    // dispatch table built before the workers start
+    bs_registry *registry = bs_registry_create();
+    language_def **lang_ptrs = malloc(sizeof(language_def *) * lang_ct);
+    for (int i = 0; i < lang_ct; i++) {
+        lang_ptrs[i] = bs_registry_get(registry, lang_paths[i]);
+        if (lang_ptrs[i] == NULL)
+            return 1;
+    }
+
+    running_daemon = bs_daemon_create(socket_path, lang_ptrs,
+                                      (const char **)lang_paths, lang_ct,
+                                      threads);
+    if (running_daemon == NULL) {
+        printf("could not listen on '%s' (%s)\n", socket_path,
+               strerror(errno));
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_daemon;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    printf("serving %d languages on %s\n", lang_ct, socket_path);
+    fflush(stdout);
+    bs_daemon_run(running_daemon);
+    bs_daemon_free(running_daemon);
+
+    free(lang_ptrs);
+    bs_registry_free(registry);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        return run_batch(argc, argv);
+    }
+
+    run_demo();
+    return 0;
+}
@@ -0,0 +1,398 @@
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "ordered.h"
+#include "util.h"
+#include "workpool.h"
+
+#define ORDERED_DEFAULT_WINDOW 64
+
+// the input bytes converted as one chunk by binscript_convert_parallel
+#define PARALLEL_CHUNK_BYTES (64 * 1024)
+// and the chunks each thread may be ahead of the writer
+#define PARALLEL_WINDOW_PER_THREAD 4
+
+// the most chunks written by one writev
+#ifdef IOV_MAX
+#define ORDERED_MAX_IOV IOV_MAX
+#else
+#define ORDERED_MAX_IOV 16
+#endif
+
+typedef struct ordered_slot {
+    // the sequence number of the chunk in the slot plus one, stored by
+    // the producer once `buf` holds the chunk
+    atomic_size_t ready;
+    bs_buffer buf;
+} __attribute__((aligned(64))) ordered_slot;
+
+struct bs_ordered {
+    int fd;
+    ordered_slot *slots; // chunk i waits in slots[i % window]
+    unsigned int window;
+    struct iovec *iov;
+
+    // chunks written (or dropped), only stored by the writer. A slot is
+    // free for chunk i once i < written + window.
+    atomic_size_t written;
+    // chunks to write before stopping, SIZE_MAX until finishing
+    atomic_size_t end;
+    // chunks after this one are dropped
+    atomic_size_t last;
+
+    // sleepers announce themselves before sleeping, and are only woken
+    // (under the lock) if they have. See prefetch.c for the argument.
+    atomic_bool writer_waiting;
+    atomic_uint producers_waiting;
+    pthread_mutex_t lock;
+    pthread_cond_t chunk_ready;
+    pthread_cond_t slot_free;
+
+    int error; // errno of the first failed write, 0 if none
+    pthread_t thread;
+};
+
+static bool chunk_ready(bs_ordered *o, size_t seq) {
+    return atomic_load(&o->slots[seq % o->window].ready) == seq + 1;
+}
+
+// writes all of `ct` buffers, retrying after short writes
+static int write_all(int fd, struct iovec *iov, int ct) {
+    while (ct > 0) {
+        ssize_t wrote = writev(fd, iov, ct);
+        if (wrote < 0 && errno == EINTR)
+            continue;
+        if (wrote < 0)
+            return errno;
+
+        size_t left = (size_t)wrote;
+        while (ct > 0 && left >= iov->iov_len) {
+            left -= iov->iov_len;
+            iov++;
+            ct--;
+        }
+        if (ct > 0) {
+            iov->iov_base = (char *)iov->iov_base + left;
+            iov->iov_len -= left;
+        }
+    }
+    return 0;
+}
+
+static void *ordered_main(void *arg) {
+    bs_ordered *o = arg;
+    size_t next = 0;
+
+    while (next < atomic_load(&o->end)) {
+        // the run of consecutive chunks that are ready
+        size_t end = atomic_load(&o->end), run = 0;
+        while (run < o->window && next + run < end &&
+               chunk_ready(o, next + run)) {
+            run++;
+        }
+        if (run == 0) {
+            pthread_mutex_lock(&o->lock);
+            atomic_store(&o->writer_waiting, true);
+            while (next < atomic_load(&o->end) && !chunk_ready(o, next)) {
+                pthread_cond_wait(&o->chunk_ready, &o->lock);
+            }
+            atomic_store(&o->writer_waiting, false);
+            pthread_mutex_unlock(&o->lock);
+            continue;
+        }
+
+        // write them in batches of as many buffers as writev takes
+        size_t last = atomic_load(&o->last);
+        int ct = 0;
+        for (size_t i = 0; i < run; i++) {
+            bs_buffer *buf = &o->slots[(next + i) % o->window].buf;
+            if (o->error == 0 && next + i <= last && buf->len > 0) {
+                o->iov[ct].iov_base = buf->data;
+                o->iov[ct].iov_len = buf->len;
+                ct++;
+            }
+            if (ct == ORDERED_MAX_IOV || (i + 1 == run && ct > 0)) {
+                o->error = write_all(o->fd, o->iov, ct);
+                ct = 0;
+            }
+        }
+
+        next += run;
+        atomic_store(&o->written, next);
+        if (atomic_load(&o->producers_waiting) > 0) {
+            pthread_mutex_lock(&o->lock);
+            pthread_cond_broadcast(&o->slot_free);
+            pthread_mutex_unlock(&o->lock);
+        }
+    }
+    return NULL;
+}
+
+bs_ordered *bs_ordered_start(int fd, unsigned int window) {
+    if (window == 0)
+        window = ORDERED_DEFAULT_WINDOW;
+
+    bs_ordered *o = calloc(1, sizeof(bs_ordered));
+    if (o == NULL)
+        return NULL;
+    o->fd = fd;
+    o->window = window;
+    o->slots = aligned_alloc(64, sizeof(ordered_slot) * window);
+    o->iov = malloc(sizeof(struct iovec) *
+                    (window < ORDERED_MAX_IOV ? window : ORDERED_MAX_IOV));
+    if (o->slots == NULL || o->iov == NULL) {
+        free(o->slots);
+        free(o->iov);
+        free(o);
+        return NULL;
+    }
+    for (unsigned int i = 0; i < window; i++) {
+        atomic_init(&o->slots[i].ready, 0);
+        bs_buffer_init(&o->slots[i].buf);
+    }
+    atomic_init(&o->written, 0);
+    atomic_init(&o->end, SIZE_MAX);
+    atomic_init(&o->last, SIZE_MAX);
+    atomic_init(&o->writer_waiting, false);
+    atomic_init(&o->producers_waiting, 0);
+    pthread_mutex_init(&o->lock, NULL);
+    pthread_cond_init(&o->chunk_ready, NULL);
+    pthread_cond_init(&o->slot_free, NULL);
+
+    int e = pthread_create(&o->thread, NULL, ordered_main, o);
+    if (e != 0) {
+        errno = e;
+        pthread_cond_destroy(&o->slot_free);
+        pthread_cond_destroy(&o->chunk_ready);
+        pthread_mutex_destroy(&o->lock);
+        free(o->slots);
+        free(o->iov);
+        free(o);
+        return NULL;
+    }
+    return o;
+}
+
+void bs_ordered_submit(bs_ordered *o, size_t seq, bs_buffer *out) {
+    // wait for the chunk a window behind this one to be written
+    if (seq >= atomic_load(&o->written) + o->window) {
+        pthread_mutex_lock(&o->lock);
+        atomic_fetch_add(&o->producers_waiting, 1);
+        while (seq >= atomic_load(&o->written) + o->window) {
+            pthread_cond_wait(&o->slot_free, &o->lock);
+        }
+        atomic_fetch_sub(&o->producers_waiting, 1);
+        pthread_mutex_unlock(&o->lock);
+    }
+
+    ordered_slot *slot = &o->slots[seq % o->window];
+    bs_buffer written = slot->buf;
+    slot->buf = *out;
+    *out = written;
+    bs_buffer_clear(out);
+    atomic_store(&slot->ready, seq + 1);
+
+    if (atomic_load(&o->writer_waiting)) {
+        pthread_mutex_lock(&o->lock);
+        pthread_cond_signal(&o->chunk_ready);
+        pthread_mutex_unlock(&o->lock);
+    }
+}
+
+void bs_ordered_stop_after(bs_ordered *o, size_t seq) {
+    size_t last = atomic_load(&o->last);
+    while (seq < last && !atomic_compare_exchange_weak(&o->last, &last, seq))
+        ;
+}
+
+int bs_ordered_finish(bs_ordered *o, size_t chunk_ct) {
+    pthread_mutex_lock(&o->lock);
+    atomic_store(&o->end, chunk_ct);
+    pthread_cond_signal(&o->chunk_ready);
+    pthread_mutex_unlock(&o->lock);
+    pthread_join(o->thread, NULL);
+
+    int error = o->error;
+    for (unsigned int i = 0; i < o->window; i++) {
+        bs_buffer_free(&o->slots[i].buf);
+    }
+    pthread_cond_destroy(&o->slot_free);
+    pthread_cond_destroy(&o->chunk_ready);
+    pthread_mutex_destroy(&o->lock);
+    free(o->slots);
+    free(o->iov);
+    free(o);
+    return error;
+}
+
+/////////////////////////
+// PARALLEL CONVERSION //
+/////////////////////////
+
+typedef struct parallel_chunk {
+    size_t start, end;
+    binscript_error error;
+    size_t error_offset; // from the start of the chunk
+} parallel_chunk;
+
+typedef struct parallel_convert {
+    language_def *l;
+    char *in;
+    parallel_chunk *chunks;
+    size_t chunk_ct;
+    atomic_size_t next;   // the next chunk to be converted
+    atomic_size_t failed; // the first chunk that failed, or chunk_ct
+    bs_buffer *buffers;   // one per worker
+    bs_ordered *writer;
+} parallel_convert;
+
+// splits the statements of a binary into chunks of about
+// PARALLEL_CHUNK_BYTES, stopping at the terminator or at the first
+// statement that cannot be measured, whose error and offset are stored.
+// Returns the chunk count.
+static size_t split_chunks(language_def *l, const char *in, size_t len,
+                           binscript_endmode endmode,
+                           parallel_chunk **chunks, binscript_error *e,
+                           size_t *error_offset) {
+    const unsigned char *bytes = (const unsigned char *)in;
+    size_t name_bytes = bits2bytes(l->function_name_width);
+    size_t offset = 0, start = 0, ct = 0;
+
+    // every chunk but the last holds at least PARALLEL_CHUNK_BYTES
+    *chunks = malloc(sizeof(parallel_chunk) *
+                     (len / PARALLEL_CHUNK_BYTES + 1));
+    if (*chunks == NULL) {
+        printf("error allocating chunks\n");
+        exit(1);
+    }
+
+    *e = BS_OK;
+    while (true) {
+        if (offset == len) {
+            if (endmode == NULL_TERMINATED)
+                *e = BS_MISSING_TERMINATOR;
+            break;
+        }
+        if (len - offset < name_bytes) {
+            *e = BS_TRUNCATED_STATEMENT;
+            break;
+        }
+
+        unsigned int opcode = (unsigned int)read_bits(
+            bytes, offset * 8, l->function_name_width);
+        if (opcode == 0 && endmode == NULL_TERMINATED)
+            break;
+
+        function_def *fn = lang_getfn(l, opcode);
+        if (fn == NULL) {
+            *e = BS_UNKNOWN_OPCODE;
+            break;
+        }
+        const function_plan *plan = lang_getplan(l, opcode);
+        size_t width = bits2bytes(plan != NULL ? plan->width
+                                               : func_call_width(l, fn));
+        if (width > len - offset) {
+            *e = BS_TRUNCATED_STATEMENT;
+            break;
+        }
+
+        offset += width;
+        if (offset - start >= PARALLEL_CHUNK_BYTES) {
+            (*chunks)[ct++] = (parallel_chunk){ start, offset, BS_OK, 0 };
+            start = offset;
+        }
+    }
+    if (offset > start)
+        (*chunks)[ct++] = (parallel_chunk){ start, offset, BS_OK, 0 };
+
+    *error_offset = offset;
+    return ct;
+}
+
+// converts whichever chunk is next. Runs once per chunk, but ignores
+// which item it was given, so that chunks are taken in order and a
+// worker is never a whole window ahead of the others for long.
+static void parallel_convert_next(void *ctx, size_t item,
+                                  unsigned int worker) {
+    parallel_convert *p = ctx;
+    bs_buffer *out = &p->buffers[worker];
+    (void)item;
+
+    size_t seq = atomic_fetch_add(&p->next, 1);
+    parallel_chunk *chunk = &p->chunks[seq];
+
+    // the output stops at the first failure, so later chunks are only
+    // passed through
+    if (seq < atomic_load(&p->failed)) {
+        chunk->error = binscript_convert(p->l, BIN2SCRIPT, MANUAL_CUTOFF,
+                                         p->in + chunk->start,
+                                         chunk->end - chunk->start, out,
+                                         &chunk->error_offset);
+    }
+    if (chunk->error != BS_OK) {
+        size_t failed = atomic_load(&p->failed);
+        while (seq < failed &&
+               !atomic_compare_exchange_weak(&p->failed, &failed, seq))
+            ;
+        bs_ordered_stop_after(p->writer, seq);
+    }
+    bs_ordered_submit(p->writer, seq, out);
+}
+
+binscript_error binscript_convert_parallel(language_def *l,
+                                           binscript_endmode endmode,
+                                           char *in, size_t len,
+                                           unsigned int threads, int fd,
+                                           size_t *error_offset) {
+    parallel_convert p;
+    binscript_error e;
+    size_t offset;
+
+    if (threads == 0)
+        threads = workpool_cpu_count();
+    p.l = l;
+    p.in = in;
+    p.chunk_ct = split_chunks(l, in, len, endmode, &p.chunks, &e, &offset);
+    p.writer = bs_ordered_start(fd, threads * PARALLEL_WINDOW_PER_THREAD);
+    if (p.writer == NULL) {
+        free(p.chunks);
+        return BS_IO_ERROR;
+    }
+    atomic_init(&p.next, 0);
+    atomic_init(&p.failed, p.chunk_ct);
+    p.buffers = malloc(sizeof(bs_buffer) * threads);
+    for (unsigned int i = 0; i < threads; i++) {
+        bs_buffer_init(&p.buffers[i]);
+    }
+
+    workpool_run(threads, p.chunk_ct, parallel_convert_next, &p);
+    int write_errno = bs_ordered_finish(p.writer, p.chunk_ct);
+
+    // a failed chunk comes before anything the split stopped at
+    size_t failed = atomic_load(&p.failed);
+    if (failed < p.chunk_ct) {
+        e = p.chunks[failed].error;
+        offset = p.chunks[failed].start + p.chunks[failed].error_offset;
+    }
+    for (unsigned int i = 0; i < threads; i++) {
+        bs_buffer_free(&p.buffers[i]);
+    }
+    free(p.buffers);
+    free(p.chunks);
+
+    if (write_errno != 0) {
+        errno = write_errno;
+        return BS_IO_ERROR;
+    }
+    if (e != BS_OK && error_offset != NULL)
+        *error_offset = offset;
+    return e;
+}
@@ -0,0 +1,84 @@
+#ifndef BINSCRIPT_ORDERED
+#define BINSCRIPT_ORDERED
+
+#include <stddef.h>
+
+#include "convert.h"
+
+/**
+ * Writes chunks of output that many threads format out of order to a
+ * file descriptor, in order.
+ *
+ * Producers number their chunks from 0 and hand each one over with
+ * bs_ordered_submit as soon as it is formatted. A writer thread owned
+ * by the merger takes the chunks in sequence, and writes every run of
+ * consecutive chunks that are ready with a single writev.
+ *
+ * Chunks wait in a window of slots indexed by sequence number. A
+ * producer hands a slot to the writer by storing the sequence number
+ * of its chunk in it, and the writer hands slots back by publishing how
+ * many chunks it has written, so submitting takes no lock. A producer
+ * only sleeps when its chunk is a whole window ahead of the oldest
+ * unwritten one, and the writer only when the next chunk is not ready.
+ *
+ * Buffers are swapped rather than copied: a submitted buffer moves into
+ * its slot, and the producer gets back the storage of the chunk the slot
+ * held before, so producers stop allocating once every slot has been
+ * used.
+ **/
+
+typedef struct bs_ordered bs_ordered;
+
+/**
+ * Starts a writer for `fd`, with a window of `window` chunks (0 for
+ * 64).
+ *
+ * returns NULL if the writer thread cannot be started.
+ **/
+bs_ordered *bs_ordered_start(int fd, unsigned int window);
+
+/**
+ * Hands chunk `seq` to the writer, waiting while it is a whole window
+ * ahead of the oldest chunk not yet written. `out` is replaced with an
+ * empty buffer for the producer to reuse. Every chunk from 0 up to the
+ * count given to bs_ordered_finish must be submitted exactly once.
+ **/
+void bs_ordered_submit(bs_ordered *o, size_t seq, bs_buffer *out);
+
+/**
+ * Makes the writer drop the chunks after `seq` instead of writing them,
+ * as when chunk `seq` ends the output early. Must be called before
+ * chunk `seq` is submitted. The chunks must still be submitted.
+ **/
+void bs_ordered_stop_after(bs_ordered *o, size_t seq);
+
+/**
+ * Waits until the first `chunk_ct` chunks have been written, then stops
+ * the writer and frees the merger.
+ *
+ * returns 0, or the errno of the first write that failed, after which
+ * nothing more was written.
+ **/
+int bs_ordered_finish(bs_ordered *o, size_t chunk_ct);
+
+/**
+ * Converts a packed binary to text like binscript_convert, on `threads`
+ * threads (0 for one per CPU), writing the text to `fd`.
+ *
+ * The input is split into chunks of whole statements, which the
+ * threads take in order, decode and format into buffers of their own,
+ * and hand to an ordered writer, so the text is the same as converting
+ * on one thread. Output stops after the statements before the first
+ * one that fails.
+ *
+ * returns BS_OK, the error of the first statement that could not be
+ * converted (with its byte offset in *error_offset), or BS_IO_ERROR
+ * with errno set if writing failed.
+ **/
+binscript_error binscript_convert_parallel(language_def *l,
+                                           binscript_endmode endmode,
+                                           char *in, size_t len,
+                                           unsigned int threads, int fd,
+                                           size_t *error_offset);
+
+#endif
@@ -35,6 +35,7 @@ static const char *errnames[] = {
         [ARG_VALUE_PARSE_ERROR] = "ARG_VALUE_PARSE_ERROR",
         [MISSING_ARG] = "MISSING_ARG", [LEFTOVER_ARG] = "LEFTOVER_ARG",
         [ATOM_AT_ROOT] = "ATOM_AT_ROOT", [UNKNOWN_ROOT] = "UNKNOWN_ROOT",
+        [MALFORMED_FLOW_DECL] = "MALFORMED_FLOW_DECL",
 };
 
 detailed_parse_error *err(swexp_list_node *source, PARSE_ERROR primitive_err,
@@ -229,19 +230,47 @@ PARSE_ERROR parse_argtype(argument_def *argument, char *name) {
     return NO_ERROR;
 }
 
+void lang_reserve(language_def *l, unsigned int capacity) {
+    if (capacity <= l->function_capacity)
+        return;
+
+    l->functions =
+        bs_realloc(l->alloc, l->functions, sizeof(function_def *) * capacity);
+    if (l->functions == NULL) {
+        printf("error in realloc\n");
+        exit(1);
+    }
+    l->function_capacity = capacity;
+}
+
 void add_fn_to_lang(language_def *l, function_def *def) {
-    if (l->function_ct + 1 >= l->function_capacity) {
-        l->functions = realloc(l->functions,
-                               sizeof(function_def *) * (l->function_ct + 1));
-        if (l->functions == NULL) {
-            printf("error in realloc\n");
-            exit(1);
-        }
+    if (l->finalized) {
+        printf("tried to add function '%s' to a finalized language\n",
+               def->name);
+        exit(1);
+    }
+
+    // grow geometrically so that building a language is linear in the
+    // number of functions
+    if (l->function_ct + 1 > l->function_capacity) {
+        unsigned int capacity = l->function_capacity * 2;
+        lang_reserve(l, capacity > 8 ? capacity : 8);
     }
     l->functions[l->function_ct] = def;
     l->function_ct++;
 }
 
+// releases the name of a function that failed to parse, and the first
+// `argc` of its arguments
+static void discard_fn(function_def *f, argument_def **arguments,
+                       size_t argc, const bs_allocator *alloc) {
+    for (size_t i = 0; i < argc; i++) {
+        free_arg_with(arguments[i], alloc);
+    }
+    bs_free(alloc, arguments);
+    bs_free(alloc, f->name);
+}
+
 // parses a function of the form
 // (def <bytesymbol> <function name> ...args...)
 detailed_parse_error *parse_fn(function_def *f, language_def *l,
@@ -298,7 +327,7 @@ detailed_parse_error *parse_fn(function_def *f, language_def *l,
         return err(list_head(node), MISSING_NAME,
                    "no function text name specifid");
 
-    f->name = malloc(sizeof(char) * (strlen(head->content) + 1));
+    f->name = bs_malloc(l->alloc, strlen(head->content) + 1);
     strcpy(f->name, head->content);
 
     ///////////////////////
@@ -308,18 +337,24 @@ detailed_parse_error *parse_fn(function_def *f, language_def *l,
     // step to the first argument
     head = head->next;
 
-    // allocate a pointer to an argument_def on the heap
-    argument_def **arguments = malloc(sizeof(argument_def *));
+    // size the argument array up front, so that wide argument lists
+    // are not grown one element at a time
+    size_t arg_capacity = 0;
+    for (swexp_list_node *n = head; n != NULL; n = n->next) {
+        arg_capacity++;
+    }
+
+    argument_def **arguments = bs_malloc(
+        l->alloc,
+        sizeof(argument_def *) * (arg_capacity > 0 ? arg_capacity : 1));
+    if (arguments == NULL) {
+        perror("unrecoverable error when allocating argument array\n");
+        exit(1);
+    }
     size_t argc = 0;
 
     for (; head != NULL; head = head->next) {
-        arguments = realloc(arguments, sizeof(argument_def *) * (argc + 1));
-        if (arguments == NULL) {
-            perror("unrecoverable error when reallocing argument array\n");
-            exit(1);
-        }
-
-        argument_def *argument = malloc(sizeof(argument_def));
+        argument_def *argument = bs_malloc(l->alloc, sizeof(argument_def));
         argument->name = NULL;
 
         arguments[argc] = argument;
@@ -331,16 +366,14 @@ detailed_parse_error *parse_fn(function_def *f, language_def *l,
             // handle the case of a type without a name
             e = parse_argtype(argument, (char *)head->content);
             if (NO_ERROR != e) {
-                free_sequence(arguments, argc);
-                free(arguments);
+                discard_fn(f, arguments, argc, l->alloc);
                 return err(head, e, "error parsing argument declaration");
             }
         } else if (head->type == LIST) {
             // handle the case of a type/name pair
             if (list_len(head) != 2) {
                 // printf("tried to parse an argdef w/ !=2 elems\n");
-                free_sequence(arguments, argc);
-                free(arguments);
+                discard_fn(f, arguments, argc, l->alloc);
                 return err(head, MALFORMED_ARGUMENT_DECLARATION,
                            "argument declaration is not al ist of length 2");
             }
@@ -348,13 +381,11 @@ detailed_parse_error *parse_fn(function_def *f, language_def *l,
             swexp_list_node *lnode = list_head(head);
             e = parse_argtype(argument, (char *)lnode->content);
             if (NO_ERROR != e) {
-                free_sequence(arguments, argc);
-                free(arguments);
-                free(f->name);
+                discard_fn(f, arguments, argc, l->alloc);
                 return err(lnode, e, "errr parsing argument");
             }
             char *arg_name = (char *)lnode->next->content;
-            argument->name = malloc((strlen(arg_name) + 1) * sizeof(char));
+            argument->name = bs_malloc(l->alloc, strlen(arg_name) + 1);
             strcpy(argument->name, arg_name);
 
             // printf("    %s\n", arg_name);
@@ -365,7 +396,7 @@ detailed_parse_error *parse_fn(function_def *f, language_def *l,
 
     f->function_binary_value = cont >> l->function_name_bitshift;
     if (argc == 0) {
-        free(arguments);
+        bs_free(l->alloc, arguments);
         arguments = NULL;
     }
 
@@ -374,10 +405,8 @@ detailed_parse_error *parse_fn(function_def *f, language_def *l,
 
     // check that it is byte aligned
     if (l->byte_aligned_functions && func_call_width(l, f) % 8 != 0) {
-        free_sequence(arguments, argc);
-        free(arguments);
-        free(f);
         printf("found width: %zu\n", func_call_width(l, f));
+        free_fn_with(f, l->alloc);
         return err(list_head(node), NON_BYTEALIGNED_FUNCTION,
                    "non-bytealigned function");
     }
@@ -387,6 +416,12 @@ detailed_parse_error *parse_fn(function_def *f, language_def *l,
 
 detailed_parse_error *parse_fn_call(function_call *call, language_def *l,
                                     swexp_list_node *node) {
+    return parse_fn_call_with(call, l, l->alloc, node);
+}
+
+detailed_parse_error *parse_fn_call_with(function_call *call, language_def *l,
+                                         const bs_allocator *alloc,
+                                         swexp_list_node *node) {
     if (node->type != LIST) {
         return err(node, MALFORMED_FUNCTION_DECL,
                    "parse_fn_call called on non-list swexpr node\n");
@@ -403,25 +438,25 @@ detailed_parse_error *parse_fn_call(function_call *call, language_def *l,
     if (fndef == NULL)
         return err(head, UNKNOWN_FUNCTION_NAME, "unknown function name");
 
-    void **arguments = malloc(sizeof(void *) * fndef->argc);
+    void **arguments = bs_malloc(alloc, sizeof(void *) * fndef->argc);
     for (size_t i = 0; i < fndef->argc; i++) {
         if (fndef->arguments[i]->type != SKIP) {
             if (head == NULL) {
                 for (size_t j = 0; j < i; j++) {
-                    free(arguments[j]);
+                    bs_free(alloc, arguments[j]);
                 }
-                free(arguments);
+                bs_free(alloc, arguments);
                 return err(function, MISSING_NAME, "no function name supplied");
             }
 
-            PARSE_ERROR p = parse_arg(&arguments[i], fndef->arguments[i],
-                                      (char *)head->content);
+            PARSE_ERROR p = parse_arg_with(&arguments[i], fndef->arguments[i],
+                                           (char *)head->content, alloc);
 
             if (p != NO_ERROR) {
                 for (size_t j = 0; j < i; j++) {
-                    free(arguments[j]);
+                    bs_free(alloc, arguments[j]);
                 }
-                free(arguments);
+                bs_free(alloc, arguments);
                 return err(head, p, "error parsing argument");
             }
 
@@ -438,59 +473,63 @@ detailed_parse_error *parse_fn_call(function_call *call, language_def *l,
         printf("\n");
         for (size_t j = 0; j < fndef->argc; j++) {
             if (arguments[j] != NULL) {
-                free(arguments[j]);
+                bs_free(alloc, arguments[j]);
             }
         }
-        free(arguments);
+        bs_free(alloc, arguments);
         return err(head, LEFTOVER_ARG, "extra arguments passed to function");
     }
 
     // no error, set the fields
     call->args = arguments;
     call->defn = fndef;
+    call->borrowed = false;
+    call->alloc = alloc;
+    call->pool = NULL;
+    call->pool_next = NULL;
     return NULL;
 }
 
 #define checkerrdata(a)                                                        \
     if (NO_ERROR != (err = a)) {                                               \
-        free(data);                                                            \
+        bs_free(alloc, data);                                                  \
         return err;                                                            \
     }
 
 PARSE_ERROR parse_arg(void **result, argument_def *arg, char *str_repr) {
+    return parse_arg_with(result, arg, str_repr, NULL);
+}
+
+PARSE_ERROR parse_arg_with(void **result, argument_def *arg, char *str_repr,
+                           const bs_allocator *alloc) {
     void *data;
     PARSE_ERROR err;
 
     switch (arg->type) {
     case RAW_STRING:
-        if (strlen(str_repr) > arg->bitwidth / 8)
-            return DISALLOWED_SIZE;
-
-        data = malloc((arg->bitwidth / 8 + 1) * sizeof(char));
-        memcpy(data, str_repr, arg->bitwidth / 8);
-        ((char *)data)[arg->bitwidth / 8] = '\0';
-        break;
     case STRING:
         if (strlen(str_repr) > arg->bitwidth / 8)
             return DISALLOWED_SIZE;
 
-        data = malloc(arg->bitwidth / 8 * sizeof(char));
-        memcpy(data, str_repr, arg->bitwidth / 8);
+        // zero-pad to the width of the argument, with room for a
+        // terminator past the end
+        data = bs_calloc(alloc, arg->bitwidth / 8 + 1, sizeof(char));
+        memcpy(data, str_repr, strlen(str_repr));
         break;
     case UNSIGNED_INT:
-        data = malloc(sizeof(long long int));
+        data = bs_malloc(alloc, sizeof(long long int));
         unsigned int temp_uint;
         checkerrdata(parse_uint(&temp_uint, str_repr));
         *((long long *)data) = temp_uint;
         break;
     case INT:
-        data = malloc(sizeof(long long int));
+        data = bs_malloc(alloc, sizeof(long long int));
         int temp_int;
         checkerrdata(parse_int(&temp_int, str_repr));
         *((long long *)data) = temp_int;
         break;
     case FLOAT:
-        data = malloc(sizeof(long double));
+        data = bs_malloc(alloc, sizeof(long double));
         sscanf(str_repr, "%Lf", (long double *)data);
         break;
     case SKIP:
@@ -613,11 +652,96 @@ detailed_parse_error *parse_metadata(language_def *l,
     return NULL;
 }
 
+// parses a flow declaration of the form
+// (flow <function name> <kind> [<target argument> [relative]])
+// naming a function defined above it
+static detailed_parse_error *parse_flow(language_def *l,
+                                        swexp_list_node *node) {
+    swexp_list_node *head = list_head(node);
+    bs_flow_rule rule = { .target_arg = BS_FLOW_NO_TARGET,
+                          .relative = false };
+
+    if (!(head = head->next) || head->type != ATOM)
+        return err(list_head(node), MALFORMED_FLOW_DECL,
+                   "no function name in flow decl");
+    function_def *fn = lang_getfnbyname(l, head->content);
+    if (fn == NULL)
+        return err(head, UNKNOWN_FUNCTION_NAME,
+                   "flow decl names a function not defined above it");
+    rule.function_binary_value = fn->function_binary_value;
+
+    if (!(head = head->next) || head->type != ATOM)
+        return err(list_head(node), MALFORMED_FLOW_DECL,
+                   "no kind in flow decl");
+    int kind;
+    for (kind = 0; kind < __BS_FLOW_CT; kind++) {
+        if (strcmp(head->content, flow_kind_names[kind]) == 0)
+            break;
+    }
+    if (kind == __BS_FLOW_CT)
+        return err(head, MALFORMED_FLOW_DECL, "unknown kind in flow decl");
+    rule.kind = (bs_flow_kind)kind;
+
+    if ((head = head->next) != NULL) {
+        if (head->type != ATOM)
+            return err(head, MALFORMED_FLOW_DECL,
+                       "malformed target in flow decl");
+        for (unsigned int i = 0; i < fn->argc; i++) {
+            char *name = fn->arguments[i]->name;
+            if (name != NULL && strcmp(name, head->content) == 0) {
+                rule.target_arg = i;
+                break;
+            }
+        }
+        if (rule.target_arg == BS_FLOW_NO_TARGET)
+            return err(head, UNKNOWN_FUNCTION_NAME,
+                       "flow decl names an argument the function lacks");
+
+        // targets are byte offsets, read as integers
+        argument_def *target = fn->arguments[rule.target_arg];
+        if ((target->type != INT && target->type != UNSIGNED_INT &&
+             target->type != HEX) ||
+            target->bitwidth > 64)
+            return err(head, MALFORMED_FLOW_DECL,
+                       "flow target is not an integer of at most 64 bits");
+
+        if ((head = head->next) != NULL) {
+            if (head->type != ATOM || strcmp(head->content, "relative") != 0)
+                return err(head, MALFORMED_FLOW_DECL,
+                           "expected 'relative' after flow target");
+            rule.relative = true;
+            head = head->next;
+        }
+        if (head != NULL)
+            return err(head, MALFORMED_FLOW_DECL,
+                       "trailing tokens in flow decl");
+    }
+
+    bool has_target = rule.target_arg != BS_FLOW_NO_TARGET;
+    bool needs_target = rule.kind == BS_FLOW_JUMP || rule.kind == BS_FLOW_CALL;
+    if (has_target != needs_target)
+        return err(list_head(node), MALFORMED_FLOW_DECL,
+                   needs_target ? "jumps and calls need a target argument"
+                                : "only jumps and calls take a target");
+
+    if (!lang_add_flow(l, &rule))
+        return err(list_head(node), MALFORMED_FLOW_DECL,
+                   "function already has a flow decl");
+    return NULL;
+}
+
 detailed_parse_error *parse_language(language_def *language,
                                      swexp_list_node *head) {
+    return parse_language_with(language, head, NULL);
+}
+
+detailed_parse_error *parse_language_with(language_def *language,
+                                          swexp_list_node *head,
+                                          const bs_allocator *alloc) {
     // initialie the language to holding no funcions
     // and give attributes for metadata;
     lang_init(language);
+    language->alloc = alloc;
 
     // parse a metadata block as the first block if it exists
     swexp_list_node *current = list_head(head);
@@ -630,19 +754,32 @@ detailed_parse_error *parse_language(language_def *language,
         current = current->next;
     }
 
+    // nearly every remaining root node should be a function definition,
+    // so use their count as a size hint for the function table
+    unsigned int fn_hint = 0;
+    for (swexp_list_node *n = current; n != NULL; n = n->next) {
+        fn_hint++;
+    }
+    lang_reserve(language, fn_hint);
+
     for (; current != NULL; current = current->next) {
         if (current->type == LIST) {
             char *content = list_head(current)->content;
             if (strcmp(content, "def") == 0) {
                 // parse a function definition
-                function_def *f = malloc(sizeof(function_def));
+                function_def *f =
+                    bs_malloc(language->alloc, sizeof(function_def));
                 detailed_parse_error *fn_parse_err =
                     parse_fn(f, language, current);
                 if (fn_parse_err != NULL) {
-                    free(f);
+                    bs_free(language->alloc, f);
                     return fn_parse_err;
                 }
                 add_fn_to_lang(language, f);
+            } else if (strcmp(content, "flow") == 0) {
+                detailed_parse_error *flow_err = parse_flow(language, current);
+                if (flow_err != NULL)
+                    return flow_err;
             } else if (strcmp(content, "meta") == 0) {
                 // throw an error if we encounter a metadatablock
                 // at the first block
@@ -662,17 +799,33 @@ detailed_parse_error *parse_language(language_def *language,
 
 detailed_parse_error *parse_language_from_file(language_def *language, FILE *f,
                                                const char *name) {
+    return parse_language_from_file_with(language, f, name, NULL);
+}
+
+detailed_parse_error *parse_language_from_file_with(language_def *language,
+                                                    FILE *f, const char *name,
+                                                    const bs_allocator *alloc) {
     swexp_list_node *nodes = parse_file_to_atoms(f, name, 255);
-    detailed_parse_error *p = parse_language(language, nodes);
+    detailed_parse_error *p = parse_language_with(language, nodes, alloc);
     free_list(nodes);
+    if (p == NULL)
+        lang_finalize(language);
     return p;
 }
 
 detailed_parse_error *parse_language_from_str(language_def *language, char *c,
                                               const char *name) {
+    return parse_language_from_str_with(language, c, name, NULL);
+}
+
+detailed_parse_error *parse_language_from_str_with(language_def *language,
+                                                   char *c, const char *name,
+                                                   const bs_allocator *alloc) {
     swexp_list_node *nodes = parse_string_to_atoms(c, name, 255);
-    detailed_parse_error *p = parse_language(language, nodes);
+    detailed_parse_error *p = parse_language_with(language, nodes, alloc);
     // printf("lang parse error %d\n", p);
     free_list(nodes);
+    if (p == NULL)
+        lang_finalize(language);
     return p;
 }
@@ -47,6 +47,7 @@ typedef enum PARSE_ERROR {
     // language parsing errors
     ATOM_AT_ROOT = 26,
     UNKNOWN_ROOT = 27,
+    MALFORMED_FLOW_DECL = 28,
 } PARSE_ERROR;
 
 typedef struct detailed_parse_error {
@@ -98,19 +99,35 @@ PARSE_ERROR parse_argtype(argument_def *argument, char *name);
  * language_def: The language who's metadata will be used to
  *      evaluate the thing
  * description: The definition of the function as a swexp list node
+ *
+ * The name and arguments are allocated with the language's allocator,
+ * and can be released with free_fn_with.
  **/
 detailed_parse_error *parse_fn(function_def *function, language_def *language,
                                swexp_list_node *description);
 
 /** Adds a function to a language
  * languages "own" functions added to them:- freeing the language with
- * free_lang() will free all of the added functions.
+ * free_lang() will free all of the added functions, through the
+ * language's allocator.
+ *
+ * The function table grows geometrically. Call lang_reserve first when
+ * the number of functions is known ahead of time.
  *
  * language: the language that `def` is added to
  * def: the function to add to `lanugage`
  */
 void add_fn_to_lang(language_def *language, function_def *def);
 
+/**
+ * Grows the function table of a language so that it can hold at least
+ * `capacity` functions without reallocating. Never shrinks the table.
+ *
+ * language: the language being built
+ * capacity: the number of functions the language is expected to hold
+ **/
+void lang_reserve(language_def *language, unsigned int capacity);
+
 /**
  * Parses a function call from a textual s-expression and a
  * corresponding language definiton,and returns a function_call
@@ -123,6 +140,14 @@ detailed_parse_error *parse_fn_call(function_call *call, language_def *l,
                                     swexp_list_node *nodes);
 PARSE_ERROR parse_arg(void **result, argument_def *arg, char *str_repr);
 
+// parse_fn_call and parse_arg, allocating the arguments with `alloc`
+// instead of the language's allocator (see alloc.h)
+detailed_parse_error *parse_fn_call_with(function_call *call, language_def *l,
+                                         const bs_allocator *alloc,
+                                         swexp_list_node *nodes);
+PARSE_ERROR parse_arg_with(void **result, argument_def *arg, char *str_repr,
+                           const bs_allocator *alloc);
+
 /**
  * Parses a language definition out of a file into a language_def
  * object
@@ -133,17 +158,39 @@ PARSE_ERROR parse_arg(void **result, argument_def *arg, char *str_repr);
  **/
 detailed_parse_error *parse_language(language_def *language,
                                      swexp_list_node *list);
+detailed_parse_error *parse_language_with(language_def *language,
+                                          swexp_list_node *list,
+                                          const bs_allocator *alloc);
 
 // TODO document these
 
 void lang_init(language_def *lang);
 
+// parse_language_from_file and parse_language_from_str finalize the
+// language (see lang_finalize) when it parses without error
+
 detailed_parse_error *parse_language_from_file(language_def *language, FILE *f,
                                                const char *name);
 
 detailed_parse_error *parse_language_from_str(language_def *language, char *c,
                                               const char *name);
 
+/**
+ * Parse a language like the functions above, keeping its tables in
+ * memory from `alloc`, which the consumers of the language also
+ * allocate with unless given their own (see alloc.h). The allocator
+ * must outlive the language and everything decoded with it.
+ *
+ * Definitions are parsed one at a time with malloc, and only move into
+ * memory from `alloc` when the language is finalized.
+ **/
+detailed_parse_error *parse_language_from_file_with(language_def *language,
+                                                    FILE *f, const char *name,
+                                                    const bs_allocator *alloc);
+detailed_parse_error *parse_language_from_str_with(language_def *language,
+                                                   char *c, const char *name,
+                                                   const bs_allocator *alloc);
+
 /**
  * parses a metadata block from a language definition and sets the
  * appropriate parameters of the language definition to their
@@ -0,0 +1,190 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitbuffer.h"
+#include "langdef.h"
+#include "patch.h"
+#include "util.h"
+
+// finds the position of the first function with a binary value in a
+// finalized language, or returns function_ct if there is none
+static size_t function_index(language_def *l, unsigned int value) {
+    const function_plan *plan = lang_getplan(l, value);
+    if (plan != NULL)
+        return (size_t)(plan - l->plans);
+
+    size_t lo = 0, hi = l->function_ct;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (l->functions[mid]->function_binary_value < value) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < l->function_ct &&
+        l->functions[lo]->function_binary_value == value)
+        return lo;
+    return l->function_ct;
+}
+
+static void index_clear(bs_index *index) {
+    free(index->statements);
+    free(index->by_function);
+    free(index->first);
+    index->statements = NULL;
+    index->by_function = NULL;
+    index->first = NULL;
+    index->statement_ct = 0;
+}
+
+binscript_error bs_index_build(bs_index *index, language_def *l,
+                               const void *buf, size_t len,
+                               binscript_endmode endmode,
+                               size_t *error_offset) {
+    const unsigned char *bytes = (const unsigned char *)buf;
+    size_t name_bytes = bits2bytes(l->function_name_width);
+    size_t offset = 0, cap = 64;
+    binscript_error e = BS_OK;
+
+    index->lang = l;
+    index->statement_ct = 0;
+    index->statements = malloc(sizeof(bs_statement) * cap);
+    index->by_function = NULL;
+    index->first = calloc(l->function_ct + 1, sizeof(size_t));
+
+    // the position in l->functions of the function of each statement,
+    // kept until the statements are grouped
+    size_t *fn_of = malloc(sizeof(size_t) * cap);
+
+    while (true) {
+        if (offset == len) {
+            if (endmode == NULL_TERMINATED)
+                e = BS_MISSING_TERMINATOR;
+            break;
+        }
+        if (len - offset < name_bytes) {
+            e = BS_TRUNCATED_STATEMENT;
+            break;
+        }
+
+        unsigned int opcode = (unsigned int)read_bits(
+            bytes, offset * 8, l->function_name_width);
+        if (opcode == 0 && endmode == NULL_TERMINATED)
+            break;
+
+        size_t fn = function_index(l, opcode);
+        if (fn == l->function_ct) {
+            e = BS_UNKNOWN_OPCODE;
+            break;
+        }
+
+        size_t width = bits2bytes(l->plans != NULL
+                                      ? l->plans[fn].width
+                                      : func_call_width(l, l->functions[fn]));
+        if (width > len - offset) {
+            e = BS_TRUNCATED_STATEMENT;
+            break;
+        }
+
+        if (index->statement_ct == cap) {
+            cap *= 2;
+            index->statements =
+                realloc(index->statements, sizeof(bs_statement) * cap);
+            fn_of = realloc(fn_of, sizeof(size_t) * cap);
+        }
+        index->statements[index->statement_ct].offset = offset;
+        index->statements[index->statement_ct].fn = l->functions[fn];
+        fn_of[index->statement_ct] = fn;
+        index->statement_ct++;
+        index->first[fn + 1]++;
+
+        offset += width;
+    }
+
+    if (e != BS_OK) {
+        free(fn_of);
+        index_clear(index);
+        if (error_offset != NULL)
+            *error_offset = offset;
+        return e;
+    }
+
+    // group the statements by function with a counting sort, which
+    // keeps them in binary order within each function
+    for (size_t i = 0; i < l->function_ct; i++) {
+        index->first[i + 1] += index->first[i];
+    }
+    size_t *next = malloc(sizeof(size_t) * (l->function_ct + 1));
+    memcpy(next, index->first, sizeof(size_t) * (l->function_ct + 1));
+    index->by_function = malloc(sizeof(size_t) * (index->statement_ct + 1));
+    for (size_t i = 0; i < index->statement_ct; i++) {
+        index->by_function[next[fn_of[i]]++] = i;
+    }
+
+    free(next);
+    free(fn_of);
+    return BS_OK;
+}
+
+const bs_statement *bs_index_nth(bs_index *index, function_def *fn,
+                                 size_t n) {
+    size_t i = function_index(index->lang, fn->function_binary_value);
+    if (i == index->lang->function_ct ||
+        index->first[i] + n >= index->first[i + 1])
+        return NULL;
+    return &index->statements[index->by_function[index->first[i] + n]];
+}
+
+size_t bs_index_count(bs_index *index, function_def *fn) {
+    size_t i = function_index(index->lang, fn->function_binary_value);
+    if (i == index->lang->function_ct)
+        return 0;
+    return index->first[i + 1] - index->first[i];
+}
+
+void bs_index_free(bs_index *index) { index_clear(index); }
+
+binscript_error bs_patch_arg(language_def *l, void *buf, size_t len,
+                             const bs_statement *statement, size_t arg_index,
+                             void *value) {
+    function_def *fn = statement->fn;
+    if (arg_index >= fn->argc)
+        return BS_UNMAPPED;
+
+    // find the argument within the statement
+    size_t bit_offset = statement->offset * 8 + l->function_name_width;
+    for (size_t i = 0; i < arg_index; i++) {
+        bit_offset += fn->arguments[i]->bitwidth;
+    }
+    argument_def *arg = fn->arguments[arg_index];
+    if (bit_offset + arg->bitwidth > len * 8)
+        return BS_TRUNCATED_STATEMENT;
+
+    if ((arg->type == INT || arg->type == UNSIGNED_INT || arg->type == HEX) &&
+        !arg_fits_int(arg, *(long int *)value))
+        return BS_OUT_OF_RANGE;
+
+    // a bitbuffer over just the bytes the argument touches. Bits are
+    // written one at a time, so the neighbouring fields sharing its
+    // first and last bytes are left as they were.
+    bitbuffer out;
+    size_t skip = bit_offset % 8;
+    bitbuffer_init_from_buffer(&out, (char *)buf + bit_offset / 8,
+                               bits2bytes(arg->bitwidth + skip));
+    bitbuffer_advance(&out, skip);
+    return arg_write_checked(&out, l, arg, value);
+}
+
+binscript_error bs_patch_arg_by_name(language_def *l, void *buf, size_t len,
+                                     const bs_statement *statement,
+                                     const char *arg_name, void *value) {
+    function_def *fn = statement->fn;
+    for (size_t i = 0; i < fn->argc; i++) {
+        const char *name = fn->arguments[i]->name;
+        if (name != NULL && 0 == strcmp(name, arg_name))
+            return bs_patch_arg(l, buf, len, statement, i, value);
+    }
+    return BS_UNMAPPED;
+}
@@ -0,0 +1,103 @@
+#ifndef BINSCRIPT_PATCH
+#define BINSCRIPT_PATCH
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "langdef.h"
+#include "translator.h"
+
+/**
+ * In-place editing of packed binaries.
+ *
+ * A statement index records where every statement of a binary starts
+ * and which function it calls, and groups the statements of each
+ * function, so that "the 12th call to hitbox" is found without walking
+ * the binary. bs_patch_arg then overwrites a single argument of a
+ * statement, writing only the bits of that argument. The rest of the
+ * binary is never read or re-encoded, so a batch of edits costs time in
+ * proportion to the number of edits rather than to the size of the
+ * binary.
+ *
+ * The binary may be any writable memory, including a MAP_SHARED mapping
+ * of a file, in which case the edits go straight to the file.
+ * Patching never moves a statement, so an index stays valid across any
+ * number of patches to the binary it was built from.
+ **/
+
+typedef struct bs_statement {
+    size_t offset;    // byte offset of the statement in the binary
+    function_def *fn; // the function the statement calls
+} bs_statement;
+
+typedef struct bs_index {
+    language_def *lang;
+
+    // every statement, in the order they appear in the binary
+    bs_statement *statements;
+    size_t statement_ct;
+
+    // indices into `statements`, grouped by function in the order of
+    // lang->functions, and in binary order within a function. The calls
+    // to lang->functions[i] are by_function[first[i]] up to
+    // by_function[first[i + 1]].
+    size_t *by_function;
+    size_t *first;
+} bs_index;
+
+/**
+ * Indexes the statements of a packed binary.
+ *
+ * endmode: NULL_TERMINATED binaries end at their terminator, for any
+ *      other mode every byte of the binary is statements
+ *
+ * returns BS_OK, or the error that stopped the walk, with the byte
+ * offset of the offending statement in *error_offset (if not NULL). The
+ * index is empty on failure.
+ **/
+binscript_error bs_index_build(bs_index *index, language_def *lang,
+                               const void *buf, size_t len,
+                               binscript_endmode endmode,
+                               size_t *error_offset);
+
+/**
+ * Gets the nth (from 0) call to a function in the binary, or NULL if
+ * the binary has no more than n calls to it.
+ **/
+const bs_statement *bs_index_nth(bs_index *index, function_def *fn,
+                                 size_t n);
+
+/**
+ * gets the number of calls to a function in the binary
+ **/
+size_t bs_index_count(bs_index *index, function_def *fn);
+
+void bs_index_free(bs_index *index);
+
+/**
+ * Overwrites one argument of one statement in place.
+ *
+ * buf, len: the binary the statement was indexed from
+ * statement: the statement to edit
+ * arg_index: the index of the argument in statement->fn
+ * value: the new value, in the representation arg_init gives it (a
+ *      long int for integers, a long double for floats)
+ *
+ * returns BS_OUT_OF_RANGE if an integer does not fit the argument,
+ * BS_TRUNCATED_STATEMENT if the statement does not fit in `len`, or an
+ * error of arg_write_checked. Nothing is written on failure.
+ **/
+binscript_error bs_patch_arg(language_def *lang, void *buf, size_t len,
+                             const bs_statement *statement, size_t arg_index,
+                             void *value);
+
+/**
+ * Like bs_patch_arg, with the argument given by name.
+ *
+ * returns BS_UNMAPPED if the function has no argument with that name.
+ **/
+binscript_error bs_patch_arg_by_name(language_def *lang, void *buf, size_t len,
+                                     const bs_statement *statement,
+                                     const char *arg_name, void *value);
+
+#endif
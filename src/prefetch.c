@@ -0,0 +1,204 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "prefetch.h"
+
+#define PREFETCH_DEFAULT_CHUNK (1024 * 1024)
+#define PREFETCH_MIN_CHUNK 64
+
+typedef struct prefetch_chunk {
+    char *data;
+    size_t len; // less than the chunk size only for the last chunk
+    bool error; // fread failed after `len` bytes
+} prefetch_chunk;
+
+struct bs_prefetch {
+    FILE *f;
+    const bs_allocator *alloc;
+    prefetch_chunk *chunks; // chunk i of the file is chunks[i % chunk_ct]
+    unsigned int chunk_ct;
+    size_t chunk_size;
+
+    // chunks filled, only stored by the reader thread, and chunks
+    // released, only stored by the consumer. Chunks in [released,
+    // filled) belong to the consumer, all others to the reader.
+    atomic_size_t filled;
+    atomic_size_t released;
+    size_t pos; // bytes consumed of the oldest unreleased chunk
+
+    // each side sets its flag before sleeping on its condition, and the
+    // other side only takes the lock to wake it if the flag is set
+    atomic_bool reader_waiting;
+    atomic_bool consumer_waiting;
+    atomic_bool stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t chunk_filled;
+    pthread_cond_t chunk_released;
+
+    pthread_t thread;
+    bool started;
+};
+
+// wakes the other side of the ring if it went to sleep. The flag and
+// the counts are sequentially consistent, so either the sleeper sees
+// the new count before sleeping, or this sees its flag.
+static void prefetch_wake(bs_prefetch *p, atomic_bool *waiting,
+                          pthread_cond_t *cond) {
+    if (atomic_load(waiting)) {
+        pthread_mutex_lock(&p->lock);
+        pthread_cond_signal(cond);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+static void *prefetch_main(void *arg) {
+    bs_prefetch *p = arg;
+    size_t filled = atomic_load(&p->filled);
+
+    while (!atomic_load(&p->stopping)) {
+        // wait for the chunk to be filled next to be released
+        if (filled - atomic_load(&p->released) == p->chunk_ct) {
+            pthread_mutex_lock(&p->lock);
+            atomic_store(&p->reader_waiting, true);
+            while (filled - atomic_load(&p->released) == p->chunk_ct &&
+                   !atomic_load(&p->stopping)) {
+                pthread_cond_wait(&p->chunk_released, &p->lock);
+            }
+            atomic_store(&p->reader_waiting, false);
+            pthread_mutex_unlock(&p->lock);
+            continue;
+        }
+
+        prefetch_chunk *chunk = &p->chunks[filled % p->chunk_ct];
+        chunk->len = fread(chunk->data, 1, p->chunk_size, p->f);
+        chunk->error = chunk->len < p->chunk_size && ferror(p->f);
+        atomic_store(&p->filled, ++filled);
+        prefetch_wake(p, &p->consumer_waiting, &p->chunk_filled);
+
+        // a short chunk is the last one
+        if (chunk->len < p->chunk_size)
+            break;
+    }
+    return NULL;
+}
+
+// waits for the reader to fill chunk `index`
+static prefetch_chunk *prefetch_wait(bs_prefetch *p, size_t index) {
+    if (atomic_load(&p->filled) <= index) {
+        pthread_mutex_lock(&p->lock);
+        atomic_store(&p->consumer_waiting, true);
+        while (atomic_load(&p->filled) <= index) {
+            pthread_cond_wait(&p->chunk_filled, &p->lock);
+        }
+        atomic_store(&p->consumer_waiting, false);
+        pthread_mutex_unlock(&p->lock);
+    }
+    return &p->chunks[index % p->chunk_ct];
+}
+
+// hands the oldest unreleased chunk back to the reader
+static void prefetch_release(bs_prefetch *p) {
+    atomic_store(&p->released, atomic_load(&p->released) + 1);
+    prefetch_wake(p, &p->reader_waiting, &p->chunk_released);
+}
+
+binscript_error bs_prefetch_read(bs_prefetch *p, void *buffer, size_t bytes,
+                                 bool advance, size_t *got) {
+    size_t index = atomic_load(&p->released), pos = p->pos;
+    char *out = buffer;
+
+    *got = 0;
+    while (*got < bytes) {
+        prefetch_chunk *chunk = prefetch_wait(p, index);
+        size_t n = chunk->len - pos;
+        if (n > bytes - *got)
+            n = bytes - *got;
+        memcpy(out + *got, chunk->data + pos, n);
+        *got += n;
+        pos += n;
+        if (pos < chunk->len)
+            break;
+
+        // the end of a chunk: stop at the end of the file, or go on to
+        // the next chunk, giving this one back if the bytes are consumed
+        if (chunk->len < p->chunk_size) {
+            if (chunk->error && *got < bytes)
+                return BS_IO_ERROR;
+            break;
+        }
+        index++;
+        pos = 0;
+        if (advance)
+            prefetch_release(p);
+    }
+
+    if (advance)
+        p->pos = pos;
+    return BS_OK;
+}
+
+bs_prefetch *bs_prefetch_start(FILE *f, size_t chunk_size,
+                               unsigned int chunk_ct,
+                               const bs_allocator *alloc) {
+    if (chunk_size == 0)
+        chunk_size = PREFETCH_DEFAULT_CHUNK;
+    if (chunk_size < PREFETCH_MIN_CHUNK)
+        chunk_size = PREFETCH_MIN_CHUNK;
+    if (chunk_ct < 2)
+        chunk_ct = 2;
+
+    bs_prefetch *p = bs_malloc(alloc, sizeof(bs_prefetch));
+    if (p == NULL)
+        return NULL;
+    memset(p, 0, sizeof(bs_prefetch));
+    p->f = f;
+    p->alloc = alloc;
+    p->chunk_size = chunk_size;
+    p->chunk_ct = chunk_ct;
+    atomic_init(&p->filled, 0);
+    atomic_init(&p->released, 0);
+    atomic_init(&p->reader_waiting, false);
+    atomic_init(&p->consumer_waiting, false);
+    atomic_init(&p->stopping, false);
+
+    p->chunks = bs_calloc(alloc, chunk_ct, sizeof(prefetch_chunk));
+    bool ok = p->chunks != NULL;
+    for (unsigned int i = 0; ok && i < chunk_ct; i++) {
+        p->chunks[i].data = bs_malloc(alloc, chunk_size);
+        ok = p->chunks[i].data != NULL;
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->chunk_filled, NULL);
+    pthread_cond_init(&p->chunk_released, NULL);
+    p->started =
+        ok && 0 == pthread_create(&p->thread, NULL, prefetch_main, p);
+    if (!p->started) {
+        bs_prefetch_free(p);
+        return NULL;
+    }
+    return p;
+}
+
+void bs_prefetch_free(bs_prefetch *p) {
+    if (p->started) {
+        pthread_mutex_lock(&p->lock);
+        atomic_store(&p->stopping, true);
+        pthread_cond_signal(&p->chunk_released);
+        pthread_mutex_unlock(&p->lock);
+        pthread_join(p->thread, NULL);
+    }
+
+    if (p->chunks != NULL) {
+        for (unsigned int i = 0; i < p->chunk_ct; i++) {
+            bs_free(p->alloc, p->chunks[i].data);
+        }
+    }
+    bs_free(p->alloc, p->chunks);
+    pthread_cond_destroy(&p->chunk_released);
+    pthread_cond_destroy(&p->chunk_filled);
+    pthread_mutex_destroy(&p->lock);
+    bs_free(p->alloc, p);
+}
@@ -0,0 +1,58 @@
+#ifndef BINSCRIPT_PREFETCH
+#define BINSCRIPT_PREFETCH
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "alloc.h"
+#include "langdef.h"
+
+/**
+ * Reads a file ahead of the thread consuming it.
+ *
+ * A background thread freads the file in chunks into a ring of
+ * buffers, while the consuming thread copies statements out of the
+ * chunks already read, so reading the next chunk overlaps with
+ * decoding the current one. Two chunks double buffer; more absorb
+ * uneven reads.
+ *
+ * The ring has a single reader and a single consumer, which hand
+ * chunks to each other by publishing the count of chunks filled and
+ * released with atomic stores. Neither side takes a lock while the
+ * other keeps up; a side only sleeps when the ring is full or empty.
+ *
+ * The file belongs to the reader thread until bs_prefetch_free, and is
+ * left wherever that thread stopped reading.
+ **/
+
+typedef struct bs_prefetch bs_prefetch;
+
+/**
+ * Starts reading `f` on a background thread, into `chunk_ct` chunks of
+ * `chunk_size` bytes allocated with `alloc` (NULL for malloc). A size of
+ * 0 uses 1 MiB, and a count of 0 (or 1) uses 2.
+ *
+ * returns NULL if the chunks cannot be allocated or the thread cannot
+ * be started.
+ **/
+bs_prefetch *bs_prefetch_start(FILE *f, size_t chunk_size,
+                               unsigned int chunk_ct,
+                               const bs_allocator *alloc);
+
+/**
+ * Copies up to `bytes` bytes from the head of the file into `buffer`,
+ * waiting for them to be read, and stores how many there were in
+ * *got, which is less than `bytes` only at the end of the file. Unless
+ * `advance` is set the bytes are left to be read again, and `bytes`
+ * must be at most the chunk size.
+ *
+ * returns BS_IO_ERROR if reading the file failed before `bytes` bytes.
+ **/
+binscript_error bs_prefetch_read(bs_prefetch *p, void *buffer, size_t bytes,
+                                 bool advance, size_t *got);
+
+// stops the reader thread, and frees the prefetcher and its chunks
+void bs_prefetch_free(bs_prefetch *p);
+
+#endif
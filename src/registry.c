@@ -0,0 +1,225 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "langcache.h"
+#include "langdef.h"
+#include "parsescript.h"
+#include "registry.h"
+
+#define REGISTRY_SUFFIX ".langdef"
+
+// one distinct language, with the source it was parsed from
+typedef struct registry_entry {
+    uint64_t hash;
+    char *source;
+    size_t source_len;
+    language_def *lang;
+} registry_entry;
+
+// a name or path that has been asked for, and the language it resolved to
+typedef struct registry_key {
+    char *name;
+    registry_entry *entry;
+} registry_key;
+
+struct bs_registry {
+    pthread_mutex_t lock;
+
+    char **search_paths;
+    size_t search_path_ct;
+
+    registry_entry **entries;
+    size_t entry_ct;
+
+    registry_key *keys;
+    size_t key_ct;
+    size_t key_cap;
+};
+
+bs_registry *bs_registry_create(void) {
+    bs_registry *reg = calloc(1, sizeof(bs_registry));
+    pthread_mutex_init(&reg->lock, NULL);
+    return reg;
+}
+
+static char *registry_strdup(const char *s) {
+    size_t len = strlen(s) + 1;
+    char *copy = malloc(len);
+    memcpy(copy, s, len);
+    return copy;
+}
+
+void bs_registry_add_search_path(bs_registry *reg, const char *dir) {
+    pthread_mutex_lock(&reg->lock);
+    reg->search_paths = realloc(reg->search_paths,
+                                sizeof(char *) * (reg->search_path_ct + 1));
+    reg->search_paths[reg->search_path_ct++] = registry_strdup(dir);
+    pthread_mutex_unlock(&reg->lock);
+}
+
+// reads a whole file into a null terminated buffer, or returns NULL
+static char *read_source(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+        return NULL;
+
+    size_t cap = 4096, used = 0, got;
+    char *text = malloc(cap);
+    while ((got = fread(text + used, 1, cap - used - 1, f)) > 0) {
+        used += got;
+        if (cap - used == 1) {
+            cap *= 2;
+            text = realloc(text, cap);
+        }
+    }
+    fclose(f);
+
+    text[used] = '\0';
+    *len = used;
+    return text;
+}
+
+// finds and reads the definition a name refers to. Called with the
+// registry locked, since it reads the search paths.
+static char *find_source(bs_registry *reg, const char *name, size_t *len) {
+    for (size_t i = 0; i < reg->search_path_ct; i++) {
+        const char *dir = reg->search_paths[i];
+        size_t path_len = strlen(dir) + 1 + strlen(name) +
+                          strlen(REGISTRY_SUFFIX) + 1;
+        char *path = malloc(path_len);
+        snprintf(path, path_len, "%s/%s%s", dir, name, REGISTRY_SUFFIX);
+        char *text = read_source(path, len);
+        free(path);
+        if (text != NULL)
+            return text;
+    }
+    return read_source(name, len);
+}
+
+static registry_entry *find_key(bs_registry *reg, const char *name) {
+    for (size_t i = 0; i < reg->key_ct; i++) {
+        if (0 == strcmp(reg->keys[i].name, name))
+            return reg->keys[i].entry;
+    }
+    return NULL;
+}
+
+static void add_key(bs_registry *reg, const char *name,
+                    registry_entry *entry) {
+    if (reg->key_ct == reg->key_cap) {
+        reg->key_cap = reg->key_cap == 0 ? 8 : reg->key_cap * 2;
+        reg->keys = realloc(reg->keys, sizeof(registry_key) * reg->key_cap);
+    }
+    reg->keys[reg->key_ct].name = registry_strdup(name);
+    reg->keys[reg->key_ct].entry = entry;
+    reg->key_ct++;
+}
+
+// parses and fully builds a language from its source
+static language_def *build_language(char *source, size_t len,
+                                    const char *name) {
+    // the parser may modify the text it is given, and the original is
+    // kept to recognise the same definition under another name
+    char *scratch = malloc(len + 1);
+    memcpy(scratch, source, len + 1);
+
+    language_def *lang = malloc(sizeof(language_def));
+    detailed_parse_error *e = parse_language_from_str(lang, scratch, name);
+    free(scratch);
+    if (e != NULL) {
+        print_err(e);
+        free_err(e);
+        free(lang);
+        return NULL;
+    }
+
+    lang_build_dispatch(lang);
+    return lang;
+}
+
+language_def *bs_registry_get(bs_registry *reg, const char *name) {
+    language_def *lang = NULL;
+
+    // the language parser is not known to be reentrant, so loading is
+    // serialized along with the lookup. Once loaded, a language is only
+    // ever read, so holding the lock is brief for everyone after the
+    // first caller.
+    pthread_mutex_lock(&reg->lock);
+
+    registry_entry *entry = find_key(reg, name);
+    if (entry != NULL) {
+        lang = entry->lang;
+        goto done;
+    }
+
+    size_t len;
+    char *source = find_source(reg, name, &len);
+    if (source == NULL) {
+        printf("could not find language '%s'\n", name);
+        goto done;
+    }
+
+    // reuse a language with the same definition
+    uint64_t hash = lang_source_hash(source, len);
+    for (size_t i = 0; i < reg->entry_ct; i++) {
+        registry_entry *e = reg->entries[i];
+        if (e->hash == hash && e->source_len == len &&
+            0 == memcmp(e->source, source, len)) {
+            free(source);
+            add_key(reg, name, e);
+            lang = e->lang;
+            goto done;
+        }
+    }
+
+    lang = build_language(source, len, name);
+    if (lang == NULL) {
+        free(source);
+        goto done;
+    }
+
+    entry = malloc(sizeof(registry_entry));
+    entry->hash = hash;
+    entry->source = source;
+    entry->source_len = len;
+    entry->lang = lang;
+    reg->entries = realloc(reg->entries,
+                           sizeof(registry_entry *) * (reg->entry_ct + 1));
+    reg->entries[reg->entry_ct++] = entry;
+    add_key(reg, name, entry);
+
+done:
+    pthread_mutex_unlock(&reg->lock);
+    return lang;
+}
+
+size_t bs_registry_language_ct(bs_registry *reg) {
+    pthread_mutex_lock(&reg->lock);
+    size_t ct = reg->entry_ct;
+    pthread_mutex_unlock(&reg->lock);
+    return ct;
+}
+
+void bs_registry_free(bs_registry *reg) {
+    for (size_t i = 0; i < reg->entry_ct; i++) {
+        free_lang(reg->entries[i]->lang);
+        free(reg->entries[i]->lang);
+        free(reg->entries[i]->source);
+        free(reg->entries[i]);
+    }
+    for (size_t i = 0; i < reg->key_ct; i++) {
+        free(reg->keys[i].name);
+    }
+    for (size_t i = 0; i < reg->search_path_ct; i++) {
+        free(reg->search_paths[i]);
+    }
+    free(reg->entries);
+    free(reg->keys);
+    free(reg->search_paths);
+    pthread_mutex_destroy(&reg->lock);
+    free(reg);
+}
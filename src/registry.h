@@ -0,0 +1,59 @@
+#ifndef BINSCRIPT_REGISTRY
+#define BINSCRIPT_REGISTRY
+
+#include <stddef.h>
+
+#include "langdef.h"
+
+/**
+ * A process-wide set of loaded languages, shared by every consumer and
+ * thread that asks for them.
+ *
+ * A language is loaded the first time it is asked for, by name or by
+ * path. Its definition is parsed, finalized and given its dispatch
+ * table (see lang_build_dispatch) before it is handed out, so every
+ * caller gets a language that is already fully built and may use it
+ * from any thread without locking. Definitions with identical source
+ * text share one language, even when they are reached through
+ * different names or paths.
+ *
+ * Every function of a registry may be called from any thread.
+ **/
+
+typedef struct bs_registry bs_registry;
+
+/**
+ * creates an empty registry
+ **/
+bs_registry *bs_registry_create(void);
+
+/**
+ * Adds a directory to search for languages by name. Directories are
+ * searched in the order they were added.
+ **/
+void bs_registry_add_search_path(bs_registry *reg, const char *dir);
+
+/**
+ * Gets a language, loading it on first use.
+ *
+ * `name` is first looked up as NAME.langdef in each search path, and
+ * otherwise taken as the path of a language definition.
+ *
+ * returns the shared language, or NULL if no definition was found or
+ * it did not parse (the parse errors are printed). The language is
+ * owned by the registry and lives until bs_registry_free.
+ **/
+language_def *bs_registry_get(bs_registry *reg, const char *name);
+
+/**
+ * gets the number of distinct languages the registry has loaded
+ **/
+size_t bs_registry_language_ct(bs_registry *reg);
+
+/**
+ * Frees a registry and every language it loaded. No language from the
+ * registry may be in use.
+ **/
+void bs_registry_free(bs_registry *reg);
+
+#endif
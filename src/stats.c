@@ -0,0 +1,111 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+
+void bs_stats_init(bs_stats *s, language_def *lang) {
+    unsigned int width = lang->function_name_width;
+    if (width > BS_STATS_OPCODE_WIDTH)
+        width = BS_STATS_OPCODE_WIDTH;
+
+    memset(s, 0, sizeof(bs_stats));
+    s->lang = lang;
+    s->opcode_ct = (size_t)1 << width;
+    s->opcodes = calloc(s->opcode_ct, sizeof(bs_opcode_stats));
+}
+
+void bs_stats_merge(bs_stats *into, const bs_stats *from) {
+    into->statements += from->statements;
+    into->bytes += from->bytes;
+    into->bits += from->bits;
+    into->allocations += from->allocations;
+    into->refills += from->refills;
+    for (int i = 0; i < __BS_STATS_PHASE_CT; i++) {
+        into->ns[i] += from->ns[i];
+    }
+    for (size_t i = 0; i < into->opcode_ct && i < from->opcode_ct; i++) {
+        into->opcodes[i].statements += from->opcodes[i].statements;
+        into->opcodes[i].decode_ns += from->opcodes[i].decode_ns;
+        into->opcodes[i].format_ns += from->opcodes[i].format_ns;
+    }
+}
+
+#ifndef BINSCRIPT_NO_STATS
+// an opcode seen, as the dump sorts them
+typedef struct seen_opcode {
+    size_t value;
+    uint64_t ns;
+    uint64_t statements;
+} seen_opcode;
+
+// orders opcodes by the time spent on them, most first
+static int compare_opcodes(const void *a, const void *b) {
+    const seen_opcode *oa = a, *ob = b;
+    if (oa->ns != ob->ns)
+        return oa->ns < ob->ns ? 1 : -1;
+    if (oa->statements != ob->statements)
+        return oa->statements < ob->statements ? 1 : -1;
+    return oa->value < ob->value ? -1 : 1;
+}
+
+static double per_statement(uint64_t ns, uint64_t statements) {
+    return statements == 0 ? 0.0 : (double)ns / (double)statements;
+}
+#endif
+
+void bs_stats_dump(const bs_stats *s, FILE *out) {
+#ifdef BINSCRIPT_NO_STATS
+    (void)s;
+    fprintf(out, "statistics were compiled out (BINSCRIPT_NO_STATS)\n");
+#else
+    fprintf(out, "statements  %llu\n", (unsigned long long)s->statements);
+    fprintf(out, "bytes       %llu\n", (unsigned long long)s->bytes);
+    fprintf(out, "bits        %llu\n", (unsigned long long)s->bits);
+    fprintf(out, "allocations %llu\n", (unsigned long long)s->allocations);
+    fprintf(out, "refills     %llu\n", (unsigned long long)s->refills);
+    fprintf(out, "decode      %.3f ms\n", s->ns[BS_STATS_DECODE] / 1e6);
+    fprintf(out, "format      %.3f ms\n", s->ns[BS_STATS_FORMAT] / 1e6);
+    fprintf(out, "io          %.3f ms\n", s->ns[BS_STATS_IO] / 1e6);
+
+    seen_opcode *seen = malloc(sizeof(seen_opcode) * (s->opcode_ct + 1));
+    size_t seen_ct = 0;
+    for (size_t i = 0; i < s->opcode_ct; i++) {
+        const bs_opcode_stats *o = &s->opcodes[i];
+        if (o->statements == 0)
+            continue;
+        seen[seen_ct].value = i;
+        seen[seen_ct].ns = o->decode_ns + o->format_ns;
+        seen[seen_ct].statements = o->statements;
+        seen_ct++;
+    }
+    qsort(seen, seen_ct, sizeof(seen_opcode), compare_opcodes);
+
+    if (seen_ct > 0) {
+        fprintf(out, "\n%-8s %-24s %12s %14s %14s\n", "opcode", "name",
+                "statements", "decode ns/st", "format ns/st");
+    }
+    for (size_t i = 0; i < seen_ct; i++) {
+        size_t value = seen[i].value;
+        const bs_opcode_stats *o = &s->opcodes[value];
+        function_def *fn = lang_getfn(s->lang, (unsigned int)value);
+        const char *name = fn != NULL ? fn->name : "?";
+        if (value == s->opcode_ct - 1 &&
+            s->lang->function_name_width > BS_STATS_OPCODE_WIDTH)
+            name = "(wider opcodes)";
+
+        fprintf(out, "0x%-6zx %-24s %12llu %14.1f %14.1f\n", value, name,
+                (unsigned long long)o->statements,
+                per_statement(o->decode_ns, o->statements),
+                per_statement(o->format_ns, o->statements));
+    }
+    free(seen);
+#endif
+}
+
+void bs_stats_free(bs_stats *s) {
+    free(s->opcodes);
+    s->opcodes = NULL;
+    s->opcode_ct = 0;
+}
@@ -0,0 +1,101 @@
+#ifndef BINSCRIPT_STATS
+#define BINSCRIPT_STATS
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "langdef.h"
+
+/**
+ * Counters for the work a consumer does, for finding out where time
+ * goes on real inputs.
+ *
+ * A bs_stats attached to a consumer (see consumer_set_stats) counts the
+ * statements it decodes per opcode, the bytes and bits they span, the
+ * allocations made for the calls, and the reads of file consumers, and
+ * times decoding, formatting and I/O with the monotonic clock. Consumers
+ * without stats attached pay one branch per statement.
+ *
+ * Building with BINSCRIPT_NO_STATS defined compiles the counting out of
+ * the library entirely. The functions below still exist, and the stats
+ * stay zero.
+ *
+ * A bs_stats is not synchronized: give each thread its own and combine
+ * them with bs_stats_merge.
+ **/
+
+typedef enum bs_stats_phase {
+    BS_STATS_DECODE, // binary or script text to calls
+    BS_STATS_FORMAT, // calls to script text or binary
+    BS_STATS_IO,     // reading file consumers
+    __BS_STATS_PHASE_CT
+} bs_stats_phase;
+
+typedef struct bs_opcode_stats {
+    uint64_t statements;
+    uint64_t decode_ns;
+    uint64_t format_ns;
+} bs_opcode_stats;
+
+// opcodes are counted in a table of at most 2^BS_STATS_OPCODE_WIDTH
+// entries. Wider opcodes past the table share its last entry.
+#define BS_STATS_OPCODE_WIDTH 16
+
+typedef struct bs_stats {
+    language_def *lang;
+
+    bs_opcode_stats *opcodes; // indexed by function binary value
+    size_t opcode_ct;
+
+    uint64_t statements;
+    uint64_t bytes;       // statement bytes consumed, with padding
+    uint64_t bits;        // statement bits consumed, without padding
+    uint64_t allocations; // made to hold calls and their arguments
+    uint64_t refills;     // reads of a file consumer's input
+    uint64_t ns[__BS_STATS_PHASE_CT];
+} bs_stats;
+
+void bs_stats_init(bs_stats *s, language_def *lang);
+
+/**
+ * adds the counts of `from` to `into`. Both must count the same
+ * language.
+ **/
+void bs_stats_merge(bs_stats *into, const bs_stats *from);
+
+/**
+ * prints the totals, then every opcode seen, the most time consuming
+ * first
+ **/
+void bs_stats_dump(const bs_stats *s, FILE *out);
+
+void bs_stats_free(bs_stats *s);
+
+/**
+ * the stats to count into, or NULL when they are compiled out, so that
+ * the counting code after a NULL check is dropped
+ **/
+static inline bs_stats *bs_stats_active(bs_stats *s) {
+#ifdef BINSCRIPT_NO_STATS
+    (void)s;
+    return NULL;
+#else
+    return s;
+#endif
+}
+
+// reads the monotonic clock in nanoseconds
+static inline uint64_t bs_stats_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static inline bs_opcode_stats *bs_stats_opcode(bs_stats *s,
+                                               unsigned int value) {
+    return &s->opcodes[value < s->opcode_ct ? value : s->opcode_ct - 1];
+}
+
+#endif
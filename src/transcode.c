@@ -0,0 +1,569 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitbuffer.h"
+#include "langdef.h"
+#include "transcode.h"
+#include "translator.h"
+#include "util.h"
+
+// how a target field gets its value
+typedef enum transcode_op {
+    FIELD_ZERO,  // no source field, written as zero
+    FIELD_VALUE, // decoded into a register and encoded again
+    FIELD_BITS,  // copied bit for bit
+} transcode_op;
+
+typedef struct transcode_field {
+    transcode_op op;
+    argument_def *src; // NULL for FIELD_ZERO
+    size_t src_offset; // bit offset of src in a source statement
+    argument_def *dst;
+} transcode_field;
+
+// everything needed to rewrite the statements of one source function
+typedef struct transcode_route {
+    function_def *from;
+    function_def *to; // NULL if the statements are dropped
+    size_t from_bytes;
+    size_t to_bytes;
+    transcode_field *fields; // one per argument of `to`
+} transcode_route;
+
+typedef enum transcode_mapping_kind {
+    MAP_FUNCTION,
+    MAP_ARGUMENT,
+} transcode_mapping_kind;
+
+typedef struct transcode_mapping {
+    transcode_mapping_kind kind;
+    char *function; // the source function of an argument mapping
+    char *from;
+    char *to; // NULL for dropped functions
+} transcode_mapping;
+
+struct bs_transcoder {
+    language_def *from;
+    language_def *to;
+
+    transcode_mapping *mappings;
+    size_t mapping_ct;
+
+    // one route per function of `from`, in the same (sorted) order, and
+    // a table from binary value to route when the name width allows
+    transcode_route *routes;
+    transcode_route **by_value;
+    size_t by_value_len;
+
+    size_t max_from_bytes;
+    size_t max_to_bytes;
+
+    char problem[256];
+};
+
+// a decoded field, in the representation arg_read_checked gives it
+typedef union transcode_register {
+    long int i;
+    long double f;
+} transcode_register;
+
+bs_transcoder *bs_transcoder_create(language_def *from, language_def *to) {
+    bs_transcoder *t = calloc(1, sizeof(bs_transcoder));
+    t->from = from;
+    t->to = to;
+    return t;
+}
+
+static char *transcode_strdup(const char *s) {
+    if (s == NULL)
+        return NULL;
+    size_t len = strlen(s) + 1;
+    char *copy = malloc(len);
+    memcpy(copy, s, len);
+    return copy;
+}
+
+static void add_mapping(bs_transcoder *t, transcode_mapping_kind kind,
+                        const char *function, const char *from,
+                        const char *to) {
+    t->mappings = realloc(t->mappings,
+                          sizeof(transcode_mapping) * (t->mapping_ct + 1));
+    transcode_mapping *m = &t->mappings[t->mapping_ct++];
+    m->kind = kind;
+    m->function = transcode_strdup(function);
+    m->from = transcode_strdup(from);
+    m->to = transcode_strdup(to);
+}
+
+void bs_transcoder_map_function(bs_transcoder *t, const char *from,
+                                const char *to) {
+    add_mapping(t, MAP_FUNCTION, NULL, from, to);
+}
+
+void bs_transcoder_map_argument(bs_transcoder *t, const char *function,
+                                const char *from, const char *to) {
+    add_mapping(t, MAP_ARGUMENT, function, from, to);
+}
+
+binscript_error bs_transcoder_load_map(bs_transcoder *t, const char *text) {
+    size_t lineno = 0;
+    t->problem[0] = '\0';
+
+    while (*text != '\0') {
+        const char *end = strchr(text, '\n');
+        size_t len = end == NULL ? strlen(text) : (size_t)(end - text);
+        lineno++;
+
+        char line[256], kind[16], a[80], b[80], c[80];
+        if (len >= sizeof(line)) {
+            snprintf(t->problem, sizeof(t->problem),
+                     "line %zu of the map is too long", lineno);
+            return BS_BAD_SCRIPT;
+        }
+        memcpy(line, text, len);
+        line[len] = '\0';
+        text += end == NULL ? len : len + 1;
+
+        int fields = sscanf(line, " %15s %79s %79s %79s", kind, a, b, c);
+        if (fields <= 0 || kind[0] == '#')
+            continue;
+
+        if (0 == strcmp(kind, "function") && fields == 3) {
+            bs_transcoder_map_function(t, a, 0 == strcmp(b, "-") ? NULL : b);
+        } else if (0 == strcmp(kind, "argument") && fields == 4) {
+            bs_transcoder_map_argument(t, a, b, c);
+        } else {
+            snprintf(t->problem, sizeof(t->problem),
+                     "line %zu of the map is not a mapping", lineno);
+            return BS_BAD_SCRIPT;
+        }
+    }
+    return BS_OK;
+}
+
+const char *bs_transcoder_problem(bs_transcoder *t) { return t->problem; }
+
+//////////////////////
+// COMPILING ROUTES //
+//////////////////////
+
+static bool is_integer(arg_type type) {
+    return type == INT || type == UNSIGNED_INT;
+}
+
+static bool is_raw(arg_type type) {
+    return type == STRING || type == RAW_STRING || type == HEX;
+}
+
+static transcode_mapping *find_mapping(bs_transcoder *t,
+                                       transcode_mapping_kind kind,
+                                       const char *function,
+                                       const char *to) {
+    for (size_t i = 0; i < t->mapping_ct; i++) {
+        transcode_mapping *m = &t->mappings[i];
+        if (m->kind != kind)
+            continue;
+        if (kind == MAP_FUNCTION && 0 == strcmp(m->from, function))
+            return m;
+        if (kind == MAP_ARGUMENT && 0 == strcmp(m->function, function) &&
+            0 == strcmp(m->to, to))
+            return m;
+    }
+    return NULL;
+}
+
+// finds a named argument of a function, and its bit offset in a
+// statement
+static argument_def *find_argument(language_def *l, function_def *fn,
+                                   const char *name, size_t *offset) {
+    size_t bits = l->function_name_width;
+    for (size_t i = 0; i < fn->argc; i++) {
+        argument_def *arg = fn->arguments[i];
+        if (arg->type != SKIP && arg->name != NULL &&
+            0 == strcmp(arg->name, name)) {
+            *offset = bits;
+            return arg;
+        }
+        bits += arg->bitwidth;
+    }
+    return NULL;
+}
+
+// checks that every mapping names something that exists
+static binscript_error check_mappings(bs_transcoder *t) {
+    for (size_t i = 0; i < t->mapping_ct; i++) {
+        transcode_mapping *m = &t->mappings[i];
+        const char *fn_name = m->kind == MAP_FUNCTION ? m->from : m->function;
+        function_def *fn = lang_getfnbyname(t->from, (char *)fn_name);
+        if (fn == NULL) {
+            snprintf(t->problem, sizeof(t->problem),
+                     "mapped function '%s' is not in the source language",
+                     fn_name);
+            return BS_UNMAPPED;
+        }
+
+        size_t offset;
+        if (m->kind == MAP_ARGUMENT &&
+            find_argument(t->from, fn, m->from, &offset) == NULL) {
+            snprintf(t->problem, sizeof(t->problem),
+                     "mapped argument '%s' is not an argument of '%s'",
+                     m->from, fn_name);
+            return BS_UNMAPPED;
+        }
+    }
+    return BS_OK;
+}
+
+static binscript_error compile_field(bs_transcoder *t, function_def *from,
+                                     function_def *to, transcode_field *field) {
+    argument_def *dst = field->dst;
+    field->op = FIELD_ZERO;
+    field->src = NULL;
+    if (dst->type == SKIP || dst->name == NULL)
+        return BS_OK;
+
+    const char *name = dst->name;
+    transcode_mapping *m = find_mapping(t, MAP_ARGUMENT, from->name, name);
+    if (m != NULL)
+        name = m->from;
+
+    argument_def *src = find_argument(t->from, from, name, &field->src_offset);
+    if (src == NULL)
+        return BS_OK;
+
+    if (is_raw(src->type) && is_raw(dst->type)) {
+        field->op = FIELD_BITS;
+    } else if ((is_integer(src->type) &&
+                (is_integer(dst->type) || dst->type == FLOAT)) ||
+               (src->type == FLOAT && dst->type == FLOAT)) {
+        field->op = FIELD_VALUE;
+    } else {
+        snprintf(t->problem, sizeof(t->problem),
+                 "%s argument '%s' of '%s' cannot become %s argument '%s' "
+                 "of '%s'",
+                 type_name(src->type), src->name, from->name,
+                 type_name(dst->type), dst->name, to->name);
+        return BS_BAD_ARGTYPE;
+    }
+    field->src = src;
+    return BS_OK;
+}
+
+static binscript_error compile_route(bs_transcoder *t, function_def *from,
+                                     transcode_route *r) {
+    r->from = from;
+    r->from_bytes = bits2bytes(func_call_width(t->from, from));
+    if (r->from_bytes > t->max_from_bytes)
+        t->max_from_bytes = r->from_bytes;
+
+    const char *name = from->name;
+    transcode_mapping *m = find_mapping(t, MAP_FUNCTION, from->name, NULL);
+    if (m != NULL && m->to == NULL)
+        return BS_OK;
+    if (m != NULL)
+        name = m->to;
+
+    r->to = lang_getfnbyname(t->to, (char *)name);
+    if (r->to == NULL) {
+        snprintf(t->problem, sizeof(t->problem),
+                 "function '%s' is not in the target language", name);
+        return BS_UNMAPPED;
+    }
+    r->to_bytes = bits2bytes(func_call_width(t->to, r->to));
+    if (r->to_bytes > t->max_to_bytes)
+        t->max_to_bytes = r->to_bytes;
+
+    r->fields = calloc(r->to->argc, sizeof(transcode_field));
+    for (size_t i = 0; i < r->to->argc; i++) {
+        r->fields[i].dst = r->to->arguments[i];
+        binscript_error e = compile_field(t, from, r->to, &r->fields[i]);
+        if (e != BS_OK)
+            return e;
+    }
+
+    // every argument mapping of the function must land somewhere
+    for (size_t i = 0; i < t->mapping_ct; i++) {
+        m = &t->mappings[i];
+        size_t offset;
+        if (m->kind == MAP_ARGUMENT && 0 == strcmp(m->function, from->name) &&
+            find_argument(t->to, r->to, m->to, &offset) == NULL) {
+            snprintf(t->problem, sizeof(t->problem),
+                     "mapped argument '%s' is not an argument of '%s'",
+                     m->to, r->to->name);
+            return BS_UNMAPPED;
+        }
+    }
+    return BS_OK;
+}
+
+binscript_error bs_transcoder_compile(bs_transcoder *t) {
+    language_def *from = t->from;
+    t->problem[0] = '\0';
+
+    binscript_error e = check_mappings(t);
+    if (e != BS_OK)
+        return e;
+
+    t->max_from_bytes = bits2bytes(from->function_name_width);
+    t->max_to_bytes = bits2bytes(t->to->function_name_width);
+    t->routes = calloc(from->function_ct + 1, sizeof(transcode_route));
+    for (size_t i = 0; i < from->function_ct; i++) {
+        e = compile_route(t, from->functions[i], &t->routes[i]);
+        if (e != BS_OK)
+            return e;
+    }
+
+    // index the routes like lang_build_dispatch indexes functions
+    size_t len = (size_t)1 << from->function_name_width;
+    if (from->function_name_width > LANG_DISPATCH_MAX_WIDTH ||
+        (from->function_ct > 0 &&
+         from->functions[from->function_ct - 1]->function_binary_value >=
+             len))
+        return BS_OK;
+
+    t->by_value_len = len;
+    t->by_value = calloc(len, sizeof(transcode_route *));
+    for (size_t i = from->function_ct; i-- > 0;) {
+        t->by_value[from->functions[i]->function_binary_value] = &t->routes[i];
+    }
+    return BS_OK;
+}
+
+static const transcode_route *find_route(bs_transcoder *t,
+                                         unsigned int value) {
+    if (t->by_value != NULL)
+        return value < t->by_value_len ? t->by_value[value] : NULL;
+
+    unsigned int lo = 0, hi = t->from->function_ct;
+    while (lo < hi) {
+        unsigned int mid = lo + (hi - lo) / 2;
+        if (t->from->functions[mid]->function_binary_value < value) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == t->from->function_ct ||
+        t->from->functions[lo]->function_binary_value != value)
+        return NULL;
+    return &t->routes[lo];
+}
+
+//////////////////////////
+// REWRITING STATEMENTS //
+//////////////////////////
+
+static binscript_error copy_field_bits(const transcode_field *field,
+                                       const char *in, bitbuffer *out) {
+    size_t bits = field->src->bitwidth < field->dst->bitwidth
+                      ? field->src->bitwidth
+                      : field->dst->bitwidth;
+
+    // a narrowed STRING must keep a terminator
+    if (field->dst->type == STRING &&
+        field->src->bitwidth > field->dst->bitwidth) {
+        bool terminated = false;
+        for (size_t i = 0; i + 8 <= bits && !terminated; i += 8) {
+            terminated = read_bits(in, field->src_offset + i, 8) == 0;
+        }
+        if (!terminated)
+            return BS_OUT_OF_RANGE;
+    }
+
+    // the output starts zeroed, so padding only needs skipping
+    bitbuffer_copybits(out->buffer, out->head_offset, in, field->src_offset,
+                       bits);
+    bitbuffer_advance(out, field->dst->bitwidth);
+    return BS_OK;
+}
+
+static binscript_error convert_field_value(bs_transcoder *t,
+                                           const transcode_field *field,
+                                           const char *in, bitbuffer *out) {
+    // decode from a buffer laid out the way the decoder lays it out, so
+    // that both read the same value
+    bitbuffer argbuffer;
+    size_t skip = field->src_offset % 8;
+    bitbuffer_init_from_buffer(&argbuffer,
+                               (char *)in + field->src_offset / 8,
+                               bits2bytes(field->src->bitwidth + skip));
+    bitbuffer_advance(&argbuffer, skip);
+
+    transcode_register reg;
+    binscript_error e = arg_read_checked(t->from, field->src, &argbuffer, &reg);
+    if (e != BS_OK)
+        return e;
+
+    if (field->dst->type == FLOAT) {
+        long double value =
+            field->src->type == FLOAT ? reg.f : (long double)reg.i;
+        return arg_write_checked(out, t->to, field->dst, &value);
+    }
+    if (!arg_fits_int(field->dst, reg.i))
+        return BS_OUT_OF_RANGE;
+    return arg_write_checked(out, t->to, field->dst, &reg.i);
+}
+
+// rewrites one statement of `in` into r->to_bytes bytes of `out`
+static binscript_error transcode_statement(bs_transcoder *t,
+                                           const transcode_route *r,
+                                           const char *in, char *out) {
+    bitbuffer outbuffer;
+    memset(out, 0, r->to_bytes);
+    bitbuffer_init_from_buffer(&outbuffer, out, r->to_bytes);
+    bitbuffer_write_int(&outbuffer, r->to->function_binary_value,
+                        t->to->function_name_width);
+
+    for (size_t i = 0; i < r->to->argc; i++) {
+        const transcode_field *field = &r->fields[i];
+        binscript_error e = BS_OK;
+
+        switch (field->op) {
+        case FIELD_ZERO:
+            bitbuffer_advance(&outbuffer, field->dst->bitwidth);
+            break;
+        case FIELD_BITS:
+            e = copy_field_bits(field, in, &outbuffer);
+            break;
+        case FIELD_VALUE:
+            e = convert_field_value(t, field, in, &outbuffer);
+            break;
+        }
+        if (e != BS_OK)
+            return e;
+    }
+    return BS_OK;
+}
+
+binscript_error bs_transcode_buffer(bs_transcoder *t, const char *in,
+                                    size_t len, binscript_endmode endmode,
+                                    bs_buffer *out, size_t *error_offset) {
+    size_t name_bytes = bits2bytes(t->from->function_name_width);
+    size_t offset = 0;
+    binscript_error e = BS_OK;
+
+    while (true) {
+        if (offset == len) {
+            if (endmode == NULL_TERMINATED)
+                e = BS_MISSING_TERMINATOR;
+            break;
+        }
+        if (len - offset < name_bytes) {
+            e = BS_TRUNCATED_STATEMENT;
+            break;
+        }
+
+        unsigned int id = funcname_from_buffer(t->from, (char *)in + offset);
+        if (id == 0 && endmode == NULL_TERMINATED) {
+            size_t end_bytes = bits2bytes(t->to->function_name_width);
+            bs_buffer_reserve(out, end_bytes);
+            memset(out->data + out->len, 0, end_bytes);
+            out->len += end_bytes;
+            break;
+        }
+
+        const transcode_route *r = find_route(t, id);
+        if (r == NULL) {
+            e = BS_UNKNOWN_OPCODE;
+            break;
+        }
+        if (len - offset < r->from_bytes) {
+            e = BS_TRUNCATED_STATEMENT;
+            break;
+        }
+
+        if (r->to != NULL) {
+            bs_buffer_reserve(out, r->to_bytes);
+            e = transcode_statement(t, r, in + offset, out->data + out->len);
+            if (e != BS_OK)
+                break;
+            out->len += r->to_bytes;
+        }
+        offset += r->from_bytes;
+    }
+
+    if (e != BS_OK && error_offset != NULL)
+        *error_offset = offset;
+    return e;
+}
+
+binscript_error bs_transcode_stream(bs_transcoder *t, FILE *in, FILE *out,
+                                    binscript_endmode endmode,
+                                    size_t *error_offset) {
+    size_t name_bytes = bits2bytes(t->from->function_name_width);
+    size_t offset = 0;
+    binscript_error e = BS_OK;
+
+    // one statement of each language at a time
+    char *inbuf = malloc(t->max_from_bytes);
+    char *outbuf = malloc(t->max_to_bytes);
+
+    while (true) {
+        size_t got = fread(inbuf, 1, name_bytes, in);
+        if (got == 0 && !ferror(in)) {
+            if (endmode == NULL_TERMINATED)
+                e = BS_MISSING_TERMINATOR;
+            break;
+        }
+        if (got < name_bytes) {
+            e = ferror(in) ? BS_IO_ERROR : BS_TRUNCATED_STATEMENT;
+            break;
+        }
+
+        unsigned int id = funcname_from_buffer(t->from, inbuf);
+        if (id == 0 && endmode == NULL_TERMINATED) {
+            size_t end_bytes = bits2bytes(t->to->function_name_width);
+            memset(outbuf, 0, end_bytes);
+            if (end_bytes != fwrite(outbuf, 1, end_bytes, out))
+                e = BS_IO_ERROR;
+            break;
+        }
+
+        const transcode_route *r = find_route(t, id);
+        if (r == NULL) {
+            e = BS_UNKNOWN_OPCODE;
+            break;
+        }
+        size_t rest = r->from_bytes - name_bytes;
+        if (rest != fread(inbuf + name_bytes, 1, rest, in)) {
+            e = ferror(in) ? BS_IO_ERROR : BS_TRUNCATED_STATEMENT;
+            break;
+        }
+
+        if (r->to != NULL) {
+            e = transcode_statement(t, r, inbuf, outbuf);
+            if (e != BS_OK)
+                break;
+            if (r->to_bytes != fwrite(outbuf, 1, r->to_bytes, out)) {
+                e = BS_IO_ERROR;
+                break;
+            }
+        }
+        offset += r->from_bytes;
+    }
+
+    free(inbuf);
+    free(outbuf);
+    if (e != BS_OK && error_offset != NULL)
+        *error_offset = offset;
+    return e;
+}
+
+void bs_transcoder_free(bs_transcoder *t) {
+    for (size_t i = 0; i < t->mapping_ct; i++) {
+        free(t->mappings[i].function);
+        free(t->mappings[i].from);
+        free(t->mappings[i].to);
+    }
+    if (t->routes != NULL) {
+        for (size_t i = 0; i < t->from->function_ct; i++) {
+            free(t->routes[i].fields);
+        }
+    }
+    free(t->mappings);
+    free(t->routes);
+    free(t->by_value);
+    free(t);
+}
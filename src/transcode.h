@@ -0,0 +1,126 @@
+#ifndef BINSCRIPT_TRANSCODE
+#define BINSCRIPT_TRANSCODE
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "convert.h"
+#include "langdef.h"
+#include "translator.h"
+
+/**
+ * Binary to binary conversion between two revisions of a language.
+ *
+ * A transcoder rewrites packed statements of a source language as
+ * packed statements of a target language, without going through text.
+ * Functions and arguments are matched by name. By default a function
+ * keeps its name, and each argument of the target function is read from
+ * the source argument with the same name; bs_transcoder_map_function and
+ * bs_transcoder_map_argument record renames.
+ *
+ * bs_transcoder_compile resolves every mapping once into a route per
+ * source function: the bit offset of each source field and the target
+ * field it lands in. Transcoding a statement then reads each field
+ * into a value register and writes it straight into the target layout,
+ * so opcode renumbering, widened or narrowed fields, reordered, added
+ * and removed arguments and endianness changes are all handled without
+ * creating function_calls.
+ *
+ * Fields are converted as follows:
+ *   - INT and UNSIGNED_INT fields convert to INT, UNSIGNED_INT or
+ *     FLOAT fields. A value that does not fit its target field is an
+ *     error (BS_OUT_OF_RANGE) rather than being truncated.
+ *   - FLOAT fields convert to FLOAT fields of any supported width.
+ *   - STRING, RAW_STRING and HEX fields are copied bit for bit between
+ *     any of those types, zero padded when widened. A narrowed STRING
+ *     must still hold its terminator.
+ *   - target fields with no source field are written as zero, and
+ *     source fields with no target field are dropped.
+ * Any other pairing fails to compile with BS_BAD_ARGTYPE.
+ *
+ * A compiled transcoder is only read while transcoding, so it may be
+ * shared between threads like a finalized language.
+ **/
+
+typedef struct bs_transcoder bs_transcoder;
+
+/**
+ * Creates a transcoder between two finalized languages. Both languages
+ * must outlive the transcoder.
+ **/
+bs_transcoder *bs_transcoder_create(language_def *from, language_def *to);
+
+/**
+ * Maps a source function onto a target function with another name. A
+ * `to` of NULL drops every statement of the function from the output.
+ **/
+void bs_transcoder_map_function(bs_transcoder *t, const char *from,
+                                const char *to);
+
+/**
+ * Maps an argument of a source function onto an argument with another
+ * name in the function it maps to.
+ *
+ * function: the name of the function in the source language
+ **/
+void bs_transcoder_map_argument(bs_transcoder *t, const char *function,
+                                const char *from, const char *to);
+
+/**
+ * Adds the mappings of a mapping file, given as text. Each non-empty
+ * line that does not start with '#' is one of:
+ *
+ *     function FROM TO       map a function onto another name
+ *     function FROM -        drop a function
+ *     argument FN FROM TO    map an argument of FN onto another name
+ *
+ * returns BS_BAD_SCRIPT if a line is malformed. The problem is
+ * described by bs_transcoder_problem.
+ **/
+binscript_error bs_transcoder_load_map(bs_transcoder *t, const char *text);
+
+/**
+ * Resolves the mappings into routes. Must be called once, after all
+ * mappings are added and before transcoding.
+ *
+ * returns BS_UNMAPPED if a function or argument has no counterpart in
+ * the target language, or BS_BAD_ARGTYPE if a field cannot be
+ * converted to the type of its target. The problem is described by
+ * bs_transcoder_problem.
+ **/
+binscript_error bs_transcoder_compile(bs_transcoder *t);
+
+/**
+ * describes the last problem found by bs_transcoder_load_map or
+ * bs_transcoder_compile, or returns an empty string
+ **/
+const char *bs_transcoder_problem(bs_transcoder *t);
+
+/**
+ * Transcodes a packed binary held in memory, appending the output to
+ * `out`. With a NULL_TERMINATED endmode the input must end in a
+ * terminator and the output gets one, otherwise every byte of the
+ * input is statements.
+ *
+ * On failure `out` holds the statements transcoded before the failing
+ * one, and *error_offset (if not NULL) holds its byte offset.
+ **/
+binscript_error bs_transcode_buffer(bs_transcoder *t, const char *in,
+                                    size_t len, binscript_endmode endmode,
+                                    bs_buffer *out, size_t *error_offset);
+
+/**
+ * Transcodes a packed binary from one stream to another, one statement
+ * at a time. Memory use is bounded by the widest statement of either
+ * language, whatever the length of the input.
+ *
+ * Like bs_transcode_buffer, except that a stream ending cleanly between
+ * statements is not an error for endmodes other than NULL_TERMINATED.
+ **/
+binscript_error bs_transcode_stream(bs_transcoder *t, FILE *in, FILE *out,
+                                    binscript_endmode endmode,
+                                    size_t *error_offset);
+
+void bs_transcoder_free(bs_transcoder *t);
+
+#endif
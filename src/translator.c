@@ -1,3 +1,4 @@
+#include <float.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -10,23 +11,35 @@
 #include "sweetexpressions.h"
 #include "parsescript.h"
 
+static binscript_error decode_fn_call(language_def *l,
+                                      const bs_allocator *alloc,
+                                      bs_call_pool *pool, function_def *fn,
+                                      char *databuffer, size_t databuffer_len,
+                                      bool borrow, function_call **out);
+
 /**
  * Initialize everything about a consumer except for the source
  **/
 static binscript_consumer *
 binscript_undef_consumer(language_def *lang,
                          binscript_parser_direction direction) {
-    binscript_consumer *c =
-        (binscript_consumer *)malloc(sizeof(binscript_consumer));
+    binscript_consumer *c = (binscript_consumer *)bs_malloc(
+        lang->alloc, sizeof(binscript_consumer));
     c->lang = lang;
     c->endmode = NULL_TERMINATED;
     c->direction = direction;
     c->nodes = NULL;
-
-    if (direction == BIN2SCRIPT) {
-        c->internal_buf_len = 1;
-        bitbuffer_init(&(c->internal_buf), c->internal_buf_len);
-    }
+    c->zero_copy = false;
+    c->offset = 0;
+    c->source_remaining = SIZE_MAX;
+    c->error = BS_OK;
+    c->error_offset = 0;
+    c->stats = NULL;
+    c->alloc = lang->alloc;
+    c->pool = NULL;
+    c->read_buf = NULL;
+    c->read_buf_len = 0;
+    c->prefetch = NULL;
 
     return c;
 }
@@ -79,65 +92,108 @@ void consumer_set_size(binscript_consumer *c, binscript_endmode endmode,
     c->remaining_size = remaining;
 }
 
-// put the first <bytes> available bytes in <consumer> into <buffer>,
-// without changing the position of the consumer
-void binscript_peek_head(binscript_consumer *consumer, void *buffer,
-                         size_t bytes) {
-    switch (consumer->parser_source) {
-    case FROM_FILE:
-        if (0 >= fread(buffer, 1, bytes, (FILE *)consumer->source)) {
-            printf("error trying to read from file (%p) in peek_head\n",
-                   consumer->source);
-            exit(1);
-        }
-        // step back
-        if (0 > fseek((FILE *)consumer->source, -bytes, SEEK_CUR)) {
-            perror("fseek");
-            exit(1);
-        }
-        break;
-    case FROM_MEMORY:
-        // printf("%p <- %p\n", buffer, consumer->source);
-        memcpy(buffer, consumer->source, bytes);
-        break;
-    }
+void consumer_set_source_len(binscript_consumer *c, size_t len) {
+    c->source_remaining = len;
 }
 
-// put the first <bytes> available bytes in <consumer> into <buffer>,
-// and advance the consumer past those bytes.
-void binscript_pop_head(binscript_consumer *consumer, void *buffer,
-                        size_t bytes) {
-    switch (consumer->parser_source) {
-    case FROM_FILE:
-        if (0 >= fread(buffer, 1, bytes, (FILE *)consumer->source)) {
-            printf("error trying to read from file (%p) in pop_head\n",
-                   consumer->source);
-            exit(1);
-        }
-        break;
-    case FROM_MEMORY:
-        memcpy(buffer, consumer->source, bytes);
-        consumer->source = (void *)((char *)consumer->source + bytes);
-        break;
+void consumer_set_zero_copy(binscript_consumer *c, bool zero_copy) {
+    c->zero_copy = zero_copy;
+}
+
+void consumer_set_stats(binscript_consumer *c, bs_stats *stats) {
+    c->stats = stats;
+}
+
+void consumer_set_allocator(binscript_consumer *c, const bs_allocator *alloc) {
+    bs_free(c->alloc, c->read_buf);
+    c->read_buf = NULL;
+    c->read_buf_len = 0;
+    c->alloc = alloc;
+}
+
+void consumer_set_pool(binscript_consumer *c, bs_call_pool *pool) {
+    c->pool = pool;
+}
+
+bool consumer_set_prefetch(binscript_consumer *c, size_t chunk_size,
+                           unsigned int chunk_ct) {
+    if (c->direction != BIN2SCRIPT || c->parser_source != FROM_FILE ||
+        c->prefetch != NULL)
+        return false;
+    c->prefetch = bs_prefetch_start((FILE *)c->source, chunk_size, chunk_ct,
+                                    c->alloc);
+    return c->prefetch != NULL;
+}
+
+// counts the allocations holding a decoded call and its arguments
+static uint64_t call_allocations(function_call *call) {
+    uint64_t ct = 2;
+    for (size_t i = 0; i < call->defn->argc; i++) {
+        arg_type type = call->defn->arguments[i]->type;
+        bool borrowed =
+            call->borrowed && (type == STRING || type == RAW_STRING);
+        ct += call->args[i] != NULL && !borrowed;
     }
+    return ct;
 }
 
-// peek a function name from the top of a consumer
-unsigned int binscript_peek_fn(binscript_consumer *consumer) {
+// the allocations a call was decoded into: none if it was taken off the
+// consumer's pool, which had `pool_hits` hits before
+static uint64_t decoded_allocations(binscript_consumer *consumer,
+                                    function_call *call, uint64_t pool_hits) {
+    if (consumer->pool != NULL && consumer->pool->hits != pool_hits)
+        return 0;
+    return call_allocations(call);
+}
 
-    // get the width of the function name in bytes
-    size_t fname_size_bits = consumer->lang->function_name_width,
-           fname_size_bytes = bits2bytes(fname_size_bits);
+// counts a statement of `fn` consumed, which took `allocations`
+// allocations to hold
+static void count_statement(bs_stats *stats, language_def *l,
+                            function_def *fn, size_t bytes,
+                            uint64_t allocations, uint64_t decode_ns) {
+    unsigned int value = fn->function_binary_value;
+    const function_plan *plan = lang_getplan(l, value);
+    bs_opcode_stats *o = bs_stats_opcode(stats, value);
+    o->statements++;
+    o->decode_ns += decode_ns;
+    stats->statements++;
+    stats->bytes += bytes;
+    stats->bits += plan != NULL ? plan->width : func_call_width(l, fn);
+    stats->allocations += allocations;
+    stats->ns[BS_STATS_DECODE] += decode_ns;
+}
 
-    // get the head of the buffer
-    char *fname_buffer = (char *)malloc(sizeof(char) * fname_size_bytes);
-    binscript_peek_head(consumer, fname_buffer, fname_size_bytes);
+// read up to <bytes> bytes from the head of a file consumer into
+// <buffer>, storing the number of bytes read in <got>. Unless <advance>
+// is set, the file is stepped back over the bytes that were read.
+static binscript_error read_file_head(binscript_consumer *consumer,
+                                      void *buffer, size_t bytes,
+                                      bool advance, size_t *got) {
+    FILE *f = (FILE *)consumer->source;
+    bs_stats *stats = bs_stats_active(consumer->stats);
+    uint64_t start = stats != NULL ? bs_stats_clock() : 0;
+    binscript_error e = BS_OK;
+
+    if (consumer->prefetch != NULL) {
+        e = bs_prefetch_read(consumer->prefetch, buffer, bytes, advance, got);
+    } else {
+        *got = fread(buffer, 1, bytes, f);
+        if (*got < bytes && ferror(f)) {
+            e = BS_IO_ERROR;
+        }
 
-    unsigned int fn_name = funcname_from_buffer(consumer->lang, fname_buffer);
+        // step back
+        if (e == BS_OK && !advance && *got > 0 &&
+            0 > fseek(f, -(long)*got, SEEK_CUR)) {
+            e = BS_IO_ERROR;
+        }
+    }
 
-    // free the file name buffer and then clear it
-    free(fname_buffer);
-    return fn_name;
+    if (stats != NULL) {
+        stats->refills++;
+        stats->ns[BS_STATS_IO] += bs_stats_clock() - start;
+    }
+    return e;
 }
 
 function_call *binscript_next(binscript_consumer *consumer) {
@@ -148,104 +204,632 @@ function_call *binscript_next(binscript_consumer *consumer) {
     }
 }
 
-function_call *binscript_next_fromscript(binscript_consumer *consumer) {
+// pops the next statement of a SCRIPT2BIN consumer into <out>. Leaves
+// <out> NULL at the end of the script or if the statement is invalid
+static detailed_parse_error *next_script_call(binscript_consumer *consumer,
+                                              function_call **out) {
+    *out = NULL;
+
     // pop first node off list
     swexp_list_node *node = consumer->nodes;
     if (node == NULL)
         return NULL;
 
     consumer->nodes = node->next;
-    function_call *call = malloc(sizeof(function_call));
+    bs_stats *stats = bs_stats_active(consumer->stats);
+    uint64_t start = stats != NULL ? bs_stats_clock() : 0;
+    function_call *call = bs_malloc(consumer->alloc, sizeof(function_call));
 
     detailed_parse_error *e;
-    if (NULL != (e = parse_fn_call(call, consumer->lang, node))) {
+    if (NULL != (e = parse_fn_call_with(call, consumer->lang, consumer->alloc,
+                                        node))) {
+        bs_free(consumer->alloc, call);
+        free_node(node);
+        return e;
+    }
+
+    free_node(node);
+    if (stats != NULL) {
+        // scripts have no bytes of their own to count
+        count_statement(stats, consumer->lang, call->defn, 0,
+                        call_allocations(call), bs_stats_clock() - start);
+    }
+    *out = call;
+    return NULL;
+}
+
+function_call *binscript_next_fromscript(binscript_consumer *consumer) {
+    function_call *call;
+    detailed_parse_error *e = next_script_call(consumer, &call);
+    if (e != NULL) {
         print_err(e);
         free_err(e);
-        free(call);
         return NULL;
     }
-
-    free_node(node);
     return call;
 }
 
-#define MAX_FN_BUFFER_SIZE 255
-function_call *binscript_next_frombin(binscript_consumer *consumer) {
-    // The id of the function being called
-    unsigned int function_id = binscript_peek_fn(consumer);
+// finds the next statement of a BIN2SCRIPT consumer: its function in
+// <fn>, and its <width> bytes in <data>, which point into the source
+// of memory consumers and into the consumer's read buffer for files.
+// Leaves <fn> NULL at the end of the input. Memory consumers are left
+// at the statement until advance_bin_statement.
+static binscript_error next_bin_statement(binscript_consumer *consumer,
+                                          function_def **fn, char **data,
+                                          size_t *width) {
+    language_def *l = consumer->lang;
+    size_t name_bytes = bits2bytes(l->function_name_width), got;
+    binscript_error e;
+    *fn = NULL;
+
+    // sized inputs end when their size runs out
+    if ((consumer->endmode == SIZE_STATEMENTS ||
+         consumer->endmode == SIZE_BYTES) &&
+        consumer->remaining_size == 0) {
+        return BS_OK;
+    }
+    if (consumer->endmode == SIZE_BYTES &&
+        consumer->remaining_size < name_bytes) {
+        return BS_TRUNCATED_STATEMENT;
+    }
+
+    // The id of the function being called. Memory sources can be read
+    // in place, and names are at most as wide as an unsigned int, so
+    // they fit in a small stack buffer
+    char fname_buffer[sizeof(unsigned int) + 1];
+    char *fname = consumer->source;
+    if (consumer->parser_source == FROM_MEMORY) {
+        if (consumer->source_remaining == 0) {
+            return consumer->endmode == NULL_TERMINATED
+                       ? BS_MISSING_TERMINATOR
+                       : BS_OK;
+        }
+        if (consumer->source_remaining < name_bytes)
+            return BS_TRUNCATED_STATEMENT;
+    } else {
+        e = read_file_head(consumer, fname_buffer, name_bytes, false, &got);
+        if (e != BS_OK)
+            return e;
+
+        // a file that ends cleanly between statements is only an
+        // error if it was supposed to hold a terminator
+        if (got == 0) {
+            return consumer->endmode == NULL_TERMINATED
+                       ? BS_MISSING_TERMINATOR
+                       : BS_OK;
+        }
+        if (got < name_bytes)
+            return BS_TRUNCATED_STATEMENT;
+        fname = fname_buffer;
+    }
+    unsigned int function_id = funcname_from_buffer(l, fname);
 
     if (function_id == 0 && consumer->endmode == NULL_TERMINATED)
-        return NULL;
+        return BS_OK;
 
     // get the body of the function based on the width
-    function_def *funcdef = lang_getfn(consumer->lang, function_id);
+    // languages with a dispatch table already know the width of each
+    // function
+    const function_plan *plan = lang_getplan(l, function_id);
+    function_def *funcdef =
+        plan != NULL ? plan->fn : lang_getfn(l, function_id);
+    if (funcdef == NULL)
+        return BS_UNKNOWN_OPCODE;
+
+    size_t func_width = bits2bytes(plan != NULL ? plan->width
+                                                : func_call_width(l, funcdef));
+    if (consumer->endmode == SIZE_BYTES &&
+        consumer->remaining_size < func_width) {
+        return BS_TRUNCATED_STATEMENT;
+    }
 
-    if (funcdef == NULL) {
-        printf("could not look up function with id 0x%x\n", function_id);
-        exit(1);
+    // decode memory sources in place rather than copying each call out
+    if (consumer->parser_source == FROM_MEMORY) {
+        if (consumer->source_remaining < func_width)
+            return BS_TRUNCATED_STATEMENT;
+        *data = consumer->source;
+    } else {
+        if (consumer->read_buf_len < func_width) {
+            bs_stats *stats = bs_stats_active(consumer->stats);
+            bs_free(consumer->alloc, consumer->read_buf);
+            consumer->read_buf = bs_malloc(consumer->alloc, func_width);
+            consumer->read_buf_len = func_width;
+            if (stats != NULL)
+                stats->allocations++;
+        }
+        e = read_file_head(consumer, consumer->read_buf, func_width, true,
+                           &got);
+        if (e == BS_OK && got < func_width)
+            e = BS_TRUNCATED_STATEMENT;
+        if (e != BS_OK)
+            return e;
+        *data = consumer->read_buf;
     }
 
-    size_t func_width = bits2bytes(func_call_width(consumer->lang, funcdef));
-    char *funcBuffer = (char *)malloc(sizeof(char) * func_width);
-    binscript_pop_head(consumer, funcBuffer, func_width);
+    *fn = funcdef;
+    *width = func_width;
+    return BS_OK;
+}
 
-    // printf("function buffer contents: ");
-    // print_hex(funcBuffer, func_width);
+// steps a BIN2SCRIPT consumer past a statement of <width> bytes found
+// by next_bin_statement
+static void advance_bin_statement(binscript_consumer *consumer,
+                                  size_t width) {
+    if (consumer->parser_source == FROM_MEMORY) {
+        consumer->source = (void *)((char *)consumer->source + width);
+        if (consumer->source_remaining != SIZE_MAX)
+            consumer->source_remaining -= width;
+    }
 
-    function_call *call =
-        decode_function_call(consumer->lang, funcBuffer, func_width);
-    free(funcBuffer);
+    consumer->offset += width;
+    if (consumer->endmode == SIZE_BYTES) {
+        consumer->remaining_size -= width;
+    } else if (consumer->endmode == SIZE_STATEMENTS) {
+        consumer->remaining_size--;
+    }
+}
+
+// decodes the next statement of a BIN2SCRIPT consumer into <out>.
+// Leaves <out> NULL at the end of the input.
+static binscript_error next_bin_call(binscript_consumer *consumer,
+                                     function_call **out) {
+    language_def *l = consumer->lang;
+    function_def *fn;
+    char *data;
+    size_t width;
+    *out = NULL;
+
+    binscript_error e = next_bin_statement(consumer, &fn, &data, &width);
+    if (e != BS_OK || fn == NULL)
+        return e;
+
+    bs_stats *stats = bs_stats_active(consumer->stats);
+    uint64_t start = stats != NULL ? bs_stats_clock() : 0;
+    uint64_t pool_hits = consumer->pool != NULL ? consumer->pool->hits : 0;
+
+    // only memory sources outlive the statement, so only they are
+    // borrowed from
+    bool borrow =
+        consumer->zero_copy && consumer->parser_source == FROM_MEMORY;
+    e = decode_fn_call(l, consumer->alloc, consumer->pool, fn, data, width,
+                       borrow, out);
+    if (e != BS_OK)
+        return e;
+    if (stats != NULL)
+        count_statement(stats, l, fn, width,
+                        decoded_allocations(consumer, *out, pool_hits),
+                        bs_stats_clock() - start);
+
+    advance_bin_statement(consumer, width);
+    return BS_OK;
+}
+
+function_call *binscript_next_frombin(binscript_consumer *consumer) {
+    function_call *call;
+    binscript_error e = next_bin_call(consumer, &call);
+    if (e != BS_OK) {
+        printf("error decoding statement at byte %zu (%s)\n",
+               consumer->offset, binscript_error_name(e));
+        exit(1);
+    }
     return call;
 }
 
+binscript_error binscript_next_checked(binscript_consumer *consumer,
+                                       function_call **out) {
+    binscript_error e = BS_OK;
+
+    if (consumer->direction == BIN2SCRIPT) {
+        e = next_bin_call(consumer, out);
+    } else {
+        detailed_parse_error *parse_error = next_script_call(consumer, out);
+        if (parse_error != NULL) {
+            free_err(parse_error);
+            e = BS_BAD_SCRIPT;
+        } else if (*out != NULL) {
+            consumer->offset++;
+        }
+    }
+
+    if (e != BS_OK) {
+        consumer->error = e;
+        consumer->error_offset = consumer->offset;
+    }
+    return e;
+}
+
+// storage for visited values that cannot point into the input: a
+// small stack buffer, replaced by a heap one if a value needs more
+typedef struct visit_scratch {
+    char stack[256];
+    char *data;
+    size_t len;
+    const bs_allocator *alloc;
+} visit_scratch;
+
+static char *scratch_reserve(visit_scratch *s, size_t len) {
+    if (len > s->len) {
+        if (s->data != s->stack)
+            bs_free(s->alloc, s->data);
+        s->data = bs_malloc(s->alloc, len);
+        if (s->data == NULL) {
+            printf("error allocating %zu bytes to visit a value\n", len);
+            exit(1);
+        }
+        s->len = len;
+    }
+    return s->data;
+}
+
+// decodes an argument into <value>, pointing byte aligned strings at
+// the input and decoding other bytes into <scratch>
+static binscript_error visit_value(language_def *l, argument_def *def,
+                                   bitbuffer *argbuffer,
+                                   visit_scratch *scratch, bs_value *value) {
+    binscript_error e;
+    value->def = def;
+    switch (def->type) {
+    case STRING:
+    case RAW_STRING:
+        value->bytes.len = def->bitwidth / 8;
+        if (argbuffer->head_offset == 0) {
+            value->bytes.data = argbuffer->buffer;
+        } else {
+            char *text = scratch_reserve(scratch, value->bytes.len + 1);
+            if (BS_OK != (e = arg_read_checked(l, def, argbuffer, text)))
+                return e;
+            value->bytes.data = text;
+        }
+        if (def->type == STRING) {
+            const char *end = memchr(value->bytes.data, '\0', value->bytes.len);
+            if (end != NULL)
+                value->bytes.len = end - value->bytes.data;
+        }
+        return BS_OK;
+    case HEX:
+        if (def->bitwidth > sizeof(long int) * 8) {
+            value->bytes.len = bits2bytes(def->bitwidth);
+            value->bytes.data = scratch_reserve(scratch, value->bytes.len);
+            return arg_read_checked(l, def, argbuffer,
+                                    (char *)value->bytes.data);
+        }
+        return arg_read_checked(l, def, argbuffer, &value->i);
+    case INT:
+    case UNSIGNED_INT:
+        return arg_read_checked(l, def, argbuffer, &value->i);
+    case FLOAT:
+        return arg_read_checked(l, def, argbuffer, &value->f);
+    default:
+        return arg_read_checked(l, def, argbuffer, NULL);
+    }
+}
+
+// hands a statement of <width> bytes at <data> to a visitor. Returns
+// whether to go on visiting, storing bad input in <error>.
+static bool visit_statement(binscript_consumer *consumer,
+                            const bs_visitor *visitor, void *user,
+                            function_def *fn, char *data, size_t width,
+                            visit_scratch *scratch, binscript_error *error) {
+    language_def *l = consumer->lang;
+    bitbuffer callbuffer, argbuffer;
+    bs_value value;
+
+    *error = BS_OK;
+    if (visitor->statement != NULL &&
+        !visitor->statement(user, fn, consumer->offset))
+        return false;
+
+    bitbuffer_init_from_buffer(&callbuffer, data, width);
+    if (!bitbuffer_try_advance(&callbuffer, l->function_name_width)) {
+        *error = BS_TRUNCATED_STATEMENT;
+        return false;
+    }
+    for (unsigned int i = 0; i < fn->argc; i++) {
+        argument_def *def = fn->arguments[i];
+        if (bitbuffer_remaining_bits(&callbuffer) < def->bitwidth) {
+            *error = BS_TRUNCATED_STATEMENT;
+            return false;
+        }
+        bitbuffer_init_from_buffer(
+            &argbuffer, callbuffer.buffer,
+            bits2bytes(def->bitwidth + callbuffer.head_offset));
+        bitbuffer_advance(&argbuffer, callbuffer.head_offset);
+
+        *error = visit_value(l, def, &argbuffer, scratch, &value);
+        if (*error != BS_OK)
+            return false;
+        if (def->type != SKIP && visitor->argument != NULL &&
+            !visitor->argument(user, fn, i, &value))
+            return false;
+        bitbuffer_advance(&callbuffer, def->bitwidth);
+    }
+    return visitor->end == NULL || visitor->end(user, fn);
+}
+
+static binscript_error visit_bin(binscript_consumer *consumer,
+                                 const bs_visitor *visitor, void *user) {
+    bs_stats *stats = bs_stats_active(consumer->stats);
+    visit_scratch scratch;
+    scratch.data = scratch.stack;
+    scratch.len = sizeof(scratch.stack);
+    scratch.alloc = consumer->alloc;
+
+    function_def *fn;
+    char *data;
+    size_t width;
+    binscript_error e;
+    while (BS_OK == (e = next_bin_statement(consumer, &fn, &data, &width)) &&
+           fn != NULL) {
+        uint64_t start = stats != NULL ? bs_stats_clock() : 0;
+        bool go_on = visit_statement(consumer, visitor, user, fn, data, width,
+                                     &scratch, &e);
+        if (e != BS_OK)
+            break;
+        if (stats != NULL)
+            count_statement(stats, consumer->lang, fn, width, 0,
+                            bs_stats_clock() - start);
+        advance_bin_statement(consumer, width);
+        if (!go_on)
+            break;
+    }
+
+    if (scratch.data != scratch.stack)
+        bs_free(scratch.alloc, scratch.data);
+    return e;
+}
+
+// hands a call parsed from a script to a visitor
+static bool visit_call(const bs_visitor *visitor, void *user,
+                       function_call *call, size_t offset) {
+    function_def *fn = call->defn;
+    bs_value value;
+
+    if (visitor->statement != NULL && !visitor->statement(user, fn, offset))
+        return false;
+    for (unsigned int i = 0; i < fn->argc; i++) {
+        argument_def *def = fn->arguments[i];
+        value.def = def;
+        switch (def->type) {
+        case STRING:
+        case RAW_STRING:
+            value.bytes = call_arg_slice(call, i);
+            break;
+        case HEX:
+            if (def->bitwidth > sizeof(long int) * 8) {
+                value.bytes.data = call->args[i];
+                value.bytes.len = bits2bytes(def->bitwidth);
+                break;
+            }
+            value.i = *(long int *)call->args[i];
+            break;
+        case INT:
+        case UNSIGNED_INT:
+            value.i = (long int)*(long long *)call->args[i];
+            break;
+        case FLOAT:
+            value.f = *(long double *)call->args[i];
+            break;
+        default:
+            continue;
+        }
+        if (visitor->argument != NULL &&
+            !visitor->argument(user, fn, i, &value))
+            return false;
+    }
+    return visitor->end == NULL || visitor->end(user, fn);
+}
+
+static binscript_error visit_script(binscript_consumer *consumer,
+                                    const bs_visitor *visitor, void *user) {
+    function_call *call;
+    binscript_error e;
+    size_t offset = consumer->offset;
+    while (BS_OK == (e = binscript_next_checked(consumer, &call)) &&
+           call != NULL) {
+        bool go_on = visit_call(visitor, user, call, offset);
+        free_call(call);
+        if (!go_on)
+            break;
+        offset = consumer->offset;
+    }
+    return e;
+}
+
+binscript_error binscript_visit(binscript_consumer *consumer,
+                                const bs_visitor *visitor, void *user) {
+    binscript_error e = consumer->direction == BIN2SCRIPT
+                            ? visit_bin(consumer, visitor, user)
+                            : visit_script(consumer, visitor, user);
+    if (e != BS_OK) {
+        consumer->error = e;
+        consumer->error_offset = consumer->offset;
+    }
+    return e;
+}
+
 function_call *decode_function_call(language_def *l, char *databuffer,
                                     size_t databuffer_len) {
+    function_call *call;
+    binscript_error e =
+        decode_function_call_checked(l, databuffer, databuffer_len, &call);
+    if (e != BS_OK) {
+        printf("error decoding function call (%s)\n", binscript_error_name(e));
+        exit(1);
+    }
+    return call;
+}
+
+function_call *decode_function_call_borrowed(language_def *l,
+                                             char *databuffer,
+                                             size_t databuffer_len) {
+    unsigned int fn_name = funcname_from_buffer(l, databuffer);
+    function_def *fn = lang_getfn(l, fn_name);
+    function_call *call;
+    binscript_error e = fn == NULL ? BS_UNKNOWN_OPCODE
+                                   : decode_fn_call(l, l->alloc, NULL, fn,
+                                                    databuffer, databuffer_len,
+                                                    true, &call);
+    if (e != BS_OK) {
+        printf("error decoding function call (%s)\n", binscript_error_name(e));
+        exit(1);
+    }
+    return call;
+}
+
+binscript_error decode_function_call_checked(language_def *l,
+                                             char *databuffer,
+                                             size_t databuffer_len,
+                                             function_call **out) {
+    *out = NULL;
+    if (databuffer_len < bits2bytes(l->function_name_width))
+        return BS_TRUNCATED_STATEMENT;
+
     // get the function name from a buffer
-    // print_hex(databuffer, databuffer_len);
     unsigned int fn_name = funcname_from_buffer(l, databuffer);
     function_def *fn = lang_getfn(l, fn_name);
+    if (fn == NULL)
+        return BS_UNKNOWN_OPCODE;
+
+    return decode_fn_call(l, l->alloc, NULL, fn, databuffer, databuffer_len,
+                          false, out);
+}
+
+// decodes the arguments of a call into the buffers of a pooled call
+static binscript_error decode_pooled_call(language_def *l, function_call *call,
+                                          bitbuffer *callbuffer) {
+    function_def *fn = call->defn;
+    bitbuffer argbuffer;
+    for (size_t i = 0; i < fn->argc; i++) {
+        size_t arg_bits = fn->arguments[i]->bitwidth;
+        if (bitbuffer_remaining_bits(callbuffer) < arg_bits)
+            return BS_TRUNCATED_STATEMENT;
 
+        bitbuffer_init_from_buffer(
+            &argbuffer, callbuffer->buffer,
+            bits2bytes(arg_bits + callbuffer->head_offset));
+        bitbuffer_advance(&argbuffer, callbuffer->head_offset);
+        binscript_error e =
+            arg_read_checked(l, fn->arguments[i], &argbuffer, call->args[i]);
+        if (e != BS_OK)
+            return e;
+        bitbuffer_advance(callbuffer, arg_bits);
+    }
+    return BS_OK;
+}
+
+static binscript_error decode_fn_call(language_def *l,
+                                      const bs_allocator *alloc,
+                                      bs_call_pool *pool, function_def *fn,
+                                      char *databuffer, size_t databuffer_len,
+                                      bool borrow, function_call **out) {
     // make a bitbuffer wrapper for the data buffer
     bitbuffer callbuffer, argbuffer;
     bitbuffer_init_from_buffer(&callbuffer, databuffer, databuffer_len);
-    bitbuffer_advance(&callbuffer, l->function_name_width);
+
+    *out = NULL;
+    if (!bitbuffer_try_advance(&callbuffer, l->function_name_width))
+        return BS_TRUNCATED_STATEMENT;
 
     // printf("function %d -> %s\n", fn_name, fn->name);
     // bitbuffer_print(&callbuffer);
 
+    const function_plan *plan = lang_getplan(l, fn->function_binary_value);
+    bool borrowed = borrow && (plan != NULL ? plan->strings_aligned
+                                            : func_strings_aligned(l, fn));
+
+    // calls that own all of their arguments can be reused whole
+    if (pool != NULL && !borrowed) {
+        function_call *call = bs_call_pool_take(pool, fn);
+        if (call == NULL) {
+            printf("error allocating call to %s\n", fn->name);
+            exit(1);
+        }
+        binscript_error e = decode_pooled_call(l, call, &callbuffer);
+        if (e != BS_OK) {
+            free_call(call);
+            return e;
+        }
+        *out = call;
+        return BS_OK;
+    }
+
     // create the function call object
-    function_call *call = (function_call *)malloc(sizeof(function_call));
+    function_call *call =
+        (function_call *)bs_malloc(alloc, sizeof(function_call));
     call->defn = fn;
-    // allocate an array to hold pointers to each argument
-    call->args = (void **)malloc(sizeof(char *) * fn->argc);
+    call->alloc = alloc;
+    call->pool = NULL;
+    call->pool_next = NULL;
+    call->borrowed = borrowed;
+    // allocate an array to hold pointers to each argument. Arguments
+    // that are never decoded stay NULL, so a partially decoded call
+    // can be released with free_call
+    call->args = (void **)bs_calloc(alloc, fn->argc, sizeof(char *));
 
     for (size_t i = 0; i < fn->argc; i++) {
         // make a bitbuffer for the current argument
         size_t arg_bits = fn->arguments[i]->bitwidth;
-        bitbuffer_init_from_buffer(
-            &argbuffer, callbuffer.buffer,
-            bits2bytes(arg_bits + callbuffer.head_offset));
-        bitbuffer_advance(&argbuffer, callbuffer.head_offset);
+        binscript_error e = BS_TRUNCATED_STATEMENT;
+
+        // borrowed strings point straight at the input
+        if (call->borrowed && (fn->arguments[i]->type == STRING ||
+                               fn->arguments[i]->type == RAW_STRING)) {
+            call->args[i] = callbuffer.buffer;
+            if (!bitbuffer_try_advance(&callbuffer, arg_bits)) {
+                free_call(call);
+                return e;
+            }
+            continue;
+        }
+
+        if (bitbuffer_remaining_bits(&callbuffer) >= arg_bits) {
+            bitbuffer_init_from_buffer(
+                &argbuffer, callbuffer.buffer,
+                bits2bytes(arg_bits + callbuffer.head_offset));
+            bitbuffer_advance(&argbuffer, callbuffer.head_offset);
 
-        // initialize the current argument from that bitbuffer
-        call->args[i] = arg_init(l, fn->arguments[i], &argbuffer);
+            // initialize the current argument from that bitbuffer
+            e = arg_init_with(l, alloc, fn->arguments[i], &argbuffer,
+                              &call->args[i]);
+        }
+        if (e != BS_OK) {
+            free_call(call);
+            return e;
+        }
 
         // advance the global buffer to the next argument;
         bitbuffer_advance(&callbuffer, arg_bits);
     }
 
-    return call;
+    *out = call;
+    return BS_OK;
 }
 
-void encode_function_call(bitbuffer *out_buffer, language_def *l,
-                          function_call *call) {
+static binscript_error encode_fn_call(bitbuffer *out_buffer, language_def *l,
+                                      function_call *call) {
     // write the name of the function to the buffer
     unsigned int name = call->defn->function_binary_value;
+    if (bitbuffer_remaining_bits(out_buffer) < l->function_name_width)
+        return BS_OUT_OF_SPACE;
     bitbuffer_write_int(out_buffer, name, l->function_name_width);
 
     // write each of the arguments
     for (size_t i = 0; i < call->defn->argc; i++) {
-        arg_write(out_buffer, l, call->defn->arguments[i], call->args[i]);
+        binscript_error e = arg_write_checked(
+            out_buffer, l, call->defn->arguments[i], call->args[i]);
+        if (e != BS_OK)
+            return e;
+    }
+    return BS_OK;
+}
+
+void encode_function_call(bitbuffer *out_buffer, language_def *l,
+                          function_call *call) {
+    binscript_error e = encode_fn_call(out_buffer, l, call);
+    if (e != BS_OK) {
+        printf("error encoding call to %s (%s)\n", call->defn->name,
+               binscript_error_name(e));
+        exit(1);
     }
 }
 
@@ -260,7 +844,7 @@ unsigned int funcname_from_buffer(language_def *lang, char *fname_buffer) {
 
     // do all the bytes
     for (size_t i = 0; i < fname_size_bytes; i++) {
-        fn_name = fn_name << 8 | fname_buffer[i];
+        fn_name = fn_name << 8 | (unsigned char)fname_buffer[i];
     }
 
     for (size_t i = 0; i < fname_remainder_bits; i++) {
@@ -272,22 +856,91 @@ unsigned int funcname_from_buffer(language_def *lang, char *fname_buffer) {
 }
 
 void binscript_free(binscript_consumer *c) {
-    // don't invoke the free helper since the bitbuffer is
-    // a field of the consumer
-    if (c->direction == BIN2SCRIPT) {
-        bitbuffer_free(&(c->internal_buf));
-    } else if (c->direction == SCRIPT2BIN) {
+    if (c->direction == SCRIPT2BIN) {
         free_list(c->nodes);
     }
-    free(c);
+    if (c->prefetch != NULL)
+        bs_prefetch_free(c->prefetch);
+    bs_free(c->alloc, c->read_buf);
+    bs_free(c->lang->alloc, c);
 }
 
-size_t __string_encode_function_call(char *out, function_call *call,
-                                     bool keywords) {
+size_t arg_text_bound(argument_def *arg) {
+    size_t bytes = bits2bytes(arg->bitwidth);
+    switch (arg->type) {
+    case STRING:
+    case RAW_STRING:
+        return bytes;
+    case HEX:
+        // "<0b" + one digit per bit + two digits and a space per byte
+        return 5 + arg->bitwidth + 3 * bytes;
+    case INT:
+    case UNSIGNED_INT:
+        return 24;
+    case FLOAT:
+        // "%Lf" prints every integer digit
+        return LDBL_MAX_10_EXP + 16;
+    default:
+        return 0;
+    }
+}
+
+size_t call_text_bound(function_call *call) {
+    size_t bound = strlen(call->defn->name) + 3;
+    for (size_t i = 0; i < call->defn->argc; i++) {
+        bound += 1 + arg_text_bound(call->defn->arguments[i]);
+    }
+    return bound;
+}
+
+size_t string_encode_arg(char *out, function_call *call, size_t i) {
     char *origin = out;
+    argument_def *argdef = call->defn->arguments[i];
     bitbuffer b;
+    bs_slice slice;
     size_t bytewidth;
 
+    switch (argdef->type) {
+    case RAW_STRING:
+        slice = call_arg_slice(call, i);
+        out += sprintf(out, "%*.*s", (int)slice.len, (int)slice.len,
+                       slice.data);
+        break;
+    case HEX:
+        bytewidth = bits2bytes(argdef->bitwidth);
+        bitbuffer_init_from_buffer(&b, call->args[i], bytewidth);
+        bitbuffer_advance(&b, bytewidth * 8 - argdef->bitwidth);
+        out += sprintf(out, "<");
+        out += bitbuffer_sprintf_hex(out, &b);
+        out += sprintf(out, ">");
+        bitbuffer_free(&b);
+        break;
+    case STRING:
+        slice = call_arg_slice(call, i);
+        out += sprintf(out, "%.*s", (int)slice.len, slice.data);
+        break;
+    case INT:
+    case UNSIGNED_INT:
+        out += sprintf(out, "%Ld", *((long long *)(call->args[i])));
+        break;
+    case FLOAT:
+        out += sprintf(out, "%Lf", *((long double *)call->args[i]));
+        break;
+    case SKIP:
+        break;
+    default:
+        printf("unhandled argument type in string_encode_function_call (%s)\n",
+               typenames[argdef->type]);
+        exit(1);
+        break;
+    }
+    return out - origin;
+}
+
+size_t __string_encode_function_call(char *out, function_call *call,
+                                     bool keywords) {
+    char *origin = out;
+
     out += sprintf(out, "%s(", call->defn->name);
     for (unsigned int i = 0; i < call->defn->argc; i++) {
         argument_def **argdefs = call->defn->arguments;
@@ -295,39 +948,7 @@ size_t __string_encode_function_call(char *out, function_call *call,
             out += sprintf(out, "%s=", argdefs[i]->name);
         }
 
-        switch (argdefs[i]->type) {
-        case RAW_STRING:
-            out += sprintf(out, "%*s", argdefs[i]->bitwidth / 8,
-                           (char *)call->args[i]);
-            break;
-        case HEX:
-            bytewidth = bits2bytes(argdefs[i]->bitwidth);
-            bitbuffer_init_from_buffer(&b, call->args[i], bytewidth);
-            bitbuffer_advance(&b, bytewidth * 8 - argdefs[i]->bitwidth);
-            out += sprintf(out, "<");
-            out += bitbuffer_sprintf_hex(out, &b);
-            out += sprintf(out, ">");
-            bitbuffer_free(&b);
-            break;
-        case STRING:
-            out += sprintf(out, "%s", (char *)call->args[i]);
-            break;
-        case INT:
-        case UNSIGNED_INT:
-            out += sprintf(out, "%Ld", *((long long *)(call->args[i])));
-            break;
-        case FLOAT:
-            out += sprintf(out, "%Lf", *((long double *)call->args[i]));
-            break;
-        case SKIP:
-            break;
-        default:
-            printf(
-                "unhandled argument type in string_encode_function_call (%s)\n",
-                typenames[argdefs[i]->type]);
-            exit(1);
-            break;
-        }
+        out += string_encode_arg(out, call, i);
         if (argdefs[i]->type != SKIP && i + 1 < call->defn->argc) {
             out += sprintf(out, " ");
         }
@@ -354,3 +975,17 @@ size_t binary_encode_function_call(char *out, language_def *lang,
 
     return b.buffer - out;
 }
+
+binscript_error binary_encode_function_call_checked(char *out, size_t out_len,
+                                                    language_def *lang,
+                                                    function_call *call,
+                                                    size_t *written) {
+    bitbuffer b;
+    bitbuffer_init_from_buffer(&b, out, out_len);
+
+    *written = 0;
+    binscript_error e = encode_fn_call(&b, lang, call);
+    if (e == BS_OK)
+        *written = b.buffer - out;
+    return e;
+}
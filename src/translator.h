@@ -6,6 +6,9 @@
 
 #include "langdef.h"
 #include "bitbuffer.h"
+#include "callpool.h"
+#include "prefetch.h"
+#include "stats.h"
 #include "sweetexpressions.h"
 
 typedef enum binscript_parser_direction {
@@ -25,6 +28,19 @@ typedef enum binscript_source {
     FROM_MEMORY,
 } binscript_source;
 
+/**
+ * A consumer holds all of the state of one translation, and the
+ * library keeps no global state of its own, so any number of
+ * consumers may run at once on different threads, as long as each
+ * consumer is only used by one thread at a time. Consumers only read
+ * their language (see the notes on thread safety in langdef.h) and,
+ * for BIN2SCRIPT memory consumers, their input buffer, so both may be
+ * shared between consumers. SCRIPT2BIN consumers also rely on
+ * libsweetparse being reentrant when they are created.
+ *
+ * Calls that borrow from a shared input (see consumer_set_zero_copy)
+ * stay valid for as long as that input does, on any thread.
+ **/
 typedef struct binscript_consumer {
     language_def *lang;
     binscript_parser_direction direction;
@@ -34,10 +50,41 @@ typedef struct binscript_consumer {
 
     binscript_source parser_source; // the type of the inputdd
     void *source;                   // NULL if parser_source = FROM_MEMORY
+
+    // bytes left in the source of a BIN2SCRIPT memory consumer, or
+    // SIZE_MAX if its length is unknown (see consumer_set_source_len)
+    size_t source_remaining;
     swexp_list_node *nodes;
 
-    bitbuffer internal_buf;
-    size_t internal_buf_len;
+    // if set, string arguments of calls decoded from memory borrow
+    // from the source buffer instead of being copied
+    bool zero_copy;
+
+    // bytes of binary input (or statements of a script) consumed so far
+    size_t offset;
+
+    // the last error returned by binscript_next_checked, and the
+    // offset of the statement it was found in
+    binscript_error error;
+    size_t error_offset;
+
+    // counters to update as statements are consumed, or NULL
+    bs_stats *stats;
+
+    // what decoded calls and read buffers are allocated with. The
+    // consumer itself is allocated with its language's allocator.
+    const bs_allocator *alloc;
+
+    // where BIN2SCRIPT consumers take calls from, or NULL
+    bs_call_pool *pool;
+
+    // what file consumers read statements into, allocated with `alloc`
+    // and grown to fit the widest statement read so far
+    char *read_buf;
+    size_t read_buf_len;
+
+    // reads the file of a BIN2SCRIPT file consumer ahead, or NULL
+    bs_prefetch *prefetch;
 } binscript_consumer;
 
 binscript_consumer *
@@ -51,20 +98,201 @@ binscript_mem_consumer(language_def *lang, void *mem, const char *name,
 void consumer_set_size(binscript_consumer *c, binscript_endmode endmode,
                        unsigned int remaining);
 
+/**
+ * Bounds the input of a BIN2SCRIPT memory consumer to `len` bytes.
+ *
+ * Statements that would run past the end are reported as
+ * BS_TRUNCATED_STATEMENT instead of being read from whatever follows
+ * the input. Running out of input between statements ends the input,
+ * or is reported as BS_MISSING_TERMINATOR for NULL_TERMINATED
+ * consumers.
+ **/
+void consumer_set_source_len(binscript_consumer *c, size_t len);
+
+/**
+ * Enables or disables zero-copy decoding of string arguments.
+ *
+ * When enabled on a BIN2SCRIPT consumer reading from memory, the
+ * STRING and RAW_STRING arguments of decoded calls point into the
+ * source buffer whenever they are byte aligned within the call
+ * (call->borrowed is set). Such calls are only valid while the source
+ * buffer is; use call_escape() to give a call its own copies.
+ *
+ * File consumers always copy.
+ **/
+void consumer_set_zero_copy(binscript_consumer *c, bool zero_copy);
+
+/**
+ * Attaches stats for a consumer to count its work into (see stats.h),
+ * or detaches them if `stats` is NULL. The stats must count the
+ * consumer's language, and outlive the consumer or be detached first.
+ **/
+void consumer_set_stats(binscript_consumer *c, bs_stats *stats);
+
+/**
+ * Allocates the calls the consumer decodes, and the buffers it reads
+ * files through, with `alloc` (NULL for malloc) instead of the
+ * language's allocator. Calls remember their allocator, so calls
+ * decoded before and after the change are freed alike.
+ **/
+void consumer_set_allocator(binscript_consumer *c, const bs_allocator *alloc);
+
+/**
+ * Decodes calls of a BIN2SCRIPT consumer into calls taken from `pool`
+ * (see callpool.h), or allocates each call afresh if `pool` is NULL.
+ * The pool must be for the consumer's language. Calls that borrow
+ * their strings are never pooled.
+ **/
+void consumer_set_pool(binscript_consumer *c, bs_call_pool *pool);
+
+/**
+ * Reads the file of a BIN2SCRIPT file consumer on a background thread,
+ * `chunk_ct` chunks of `chunk_size` bytes ahead of the statements being
+ * decoded (see prefetch.h, which has the defaults for 0). For large
+ * files, where reading and decoding would otherwise take turns.
+ *
+ * The file must not be used by anything else until the consumer is
+ * freed, and is left past wherever the consumer stopped.
+ *
+ * returns false, leaving the consumer reading synchronously, if it is
+ * not a BIN2SCRIPT file consumer or the thread cannot be started.
+ **/
+bool consumer_set_prefetch(binscript_consumer *c, size_t chunk_size,
+                           unsigned int chunk_ct);
+
 function_call *binscript_next(binscript_consumer *consumer);
 function_call *binscript_next_fromscript(binscript_consumer *consumer);
 function_call *binscript_next_frombin(binscript_consumer *consumer);
 
+/**
+ * Gets the next call from a consumer like binscript_next, but reports
+ * bad input instead of exiting, so that one process can go on to
+ * serve other inputs.
+ *
+ * On success, *out holds the next call, or NULL at the end of the
+ * input. On failure *out is NULL, and the error and the offset of the
+ * failing statement are also stored in consumer->error and
+ * consumer->error_offset. The offset counts bytes for BIN2SCRIPT
+ * consumers and statements for SCRIPT2BIN consumers.
+ *
+ * SIZE_BYTES and SIZE_STATEMENTS consumers stop once the size given
+ * to consumer_set_size is used up. NULL_TERMINATED file consumers
+ * report BS_MISSING_TERMINATOR if the file ends without a terminator.
+ **/
+binscript_error binscript_next_checked(binscript_consumer *consumer,
+                                       function_call **out);
+
+/**
+ * A decoded argument, as handed to a visitor. Which member holds the
+ * value depends on the type of `def`.
+ **/
+typedef struct bs_value {
+    argument_def *def;
+    union {
+        long int i;     // INT, UNSIGNED_INT, and HEX as wide as a long
+        long double f;  // FLOAT
+        bs_slice bytes; // STRING up to its terminator, RAW_STRING, and
+                        // wider HEX, in binary order
+    };
+} bs_value;
+
+/**
+ * Callbacks for binscript_visit. Any of them may be NULL. Returning
+ * false from one stops the visit: no more callbacks are made, and the
+ * consumer is left past the current statement.
+ *
+ * statement: called before the arguments of each statement, with its
+ *      offset as counted by consumer->offset
+ * argument: called for every argument but SKIP ones, in order, with a
+ *      value that is only valid until the callback returns
+ * end: called after the arguments of each statement
+ **/
+typedef struct bs_visitor {
+    bool (*statement)(void *user, function_def *fn, size_t offset);
+    bool (*argument)(void *user, function_def *fn, unsigned int index,
+                     const bs_value *value);
+    bool (*end)(void *user, function_def *fn);
+} bs_visitor;
+
+/**
+ * Consumes statements, handing each one and its arguments to
+ * `visitor` instead of building calls, until the input ends, a
+ * callback returns false, or the input is bad. `user` is passed to
+ * every callback.
+ *
+ * BIN2SCRIPT consumers decode arguments straight into the value handed
+ * to the callback, and byte aligned strings point into the input, so
+ * visiting allocates nothing per statement. SCRIPT2BIN consumers build
+ * and free a call for each statement.
+ *
+ * returns BS_OK at the end of the input or when stopped, and otherwise
+ * the error, which is also stored like binscript_next_checked does.
+ * Callbacks for a statement that turns out to be bad may already have
+ * been made.
+ **/
+binscript_error binscript_visit(binscript_consumer *consumer,
+                                const bs_visitor *visitor, void *user);
+
 function_call *decode_function_call(language_def *l, char *databuffer,
                                     size_t databuffer_len);
+
+/**
+ * Decodes a function call like decode_function_call, but lets byte
+ * aligned string arguments borrow from `databuffer` (see
+ * consumer_set_zero_copy).
+ **/
+function_call *decode_function_call_borrowed(language_def *l,
+                                             char *databuffer,
+                                             size_t databuffer_len);
+
+/**
+ * Decodes a function call like decode_function_call, but reports
+ * unknown opcodes and truncated or malformed statements instead of
+ * exiting. *out is NULL on failure.
+ **/
+binscript_error decode_function_call_checked(language_def *l,
+                                             char *databuffer,
+                                             size_t databuffer_len,
+                                             function_call **out);
 unsigned int funcname_from_buffer(language_def *def, char *buffer);
 
 size_t binary_encode_function_call(char *databuffer, language_def *l,
                                    function_call *f);
 
+/**
+ * Encodes a function call into a buffer of out_len bytes like
+ * binary_encode_function_call, storing the number of bytes written in
+ * *written. Returns BS_OUT_OF_SPACE if the call does not fit, or the
+ * error of the first argument that has no encoding.
+ **/
+binscript_error binary_encode_function_call_checked(char *out, size_t out_len,
+                                                    language_def *l,
+                                                    function_call *f,
+                                                    size_t *written);
+
 size_t string_encode_function_call(char *out, function_call *call);
 size_t string_encode_function_call_keyworded(char *out, function_call *call);
 
+/**
+ * Writes the text of one argument of a call, as it appears in the
+ * output of string_encode_function_call. SKIP arguments write nothing.
+ *
+ * returns the number of characters written, not counting the null byte
+ **/
+size_t string_encode_arg(char *out, function_call *call, size_t index);
+
+/**
+ * upper bound on the length of the text of an argument, not counting
+ * the null byte
+ **/
+size_t arg_text_bound(argument_def *arg);
+
+/**
+ * upper bound on the length of string_encode_function_call's output,
+ * including the terminating null byte
+ **/
+size_t call_text_bound(function_call *call);
+
 void binscript_free(binscript_consumer *c);
 
 #endif
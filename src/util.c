@@ -7,6 +7,11 @@
 
 #include "util.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BS_X86_SHUFFLE 1
+#include <immintrin.h>
+#endif
+
 size_t bits2bytes(size_t bits) { return (bits / 8) + ((bits % 8) ? 1 : 0); }
 
 void print_chars(void *bin, size_t size) {
@@ -66,6 +71,117 @@ void swap_endian_on_field(void *addr, size_t size) {
     }
 }
 
+///////////////////////////
+// BULK ENDIANNESS SWAPS //
+///////////////////////////
+
+// byte shuffle masks reversing each 2, 4 and 8 byte lane of a 16 byte
+// vector
+static const unsigned char bswap_mask16[16] = { 1, 0, 3,  2,  5,  4,  7,  6,
+                                                9, 8, 11, 10, 13, 12, 15, 14 };
+static const unsigned char bswap_mask32[16] = { 3,  2,  1,  0,  7,  6,
+                                                5,  4,  11, 10, 9,  8,
+                                                15, 14, 13, 12 };
+static const unsigned char bswap_mask64[16] = { 7,  6,  5,  4,  3,  2,
+                                                1,  0,  15, 14, 13, 12,
+                                                11, 10, 9,  8 };
+
+#ifdef BS_X86_SHUFFLE
+// each kernel shuffles as many whole vectors as fit in `bytes`, and
+// returns the number of bytes it processed
+
+__attribute__((target("avx2"))) static size_t
+bswap_shuffle_avx2(unsigned char *p, size_t bytes, const unsigned char *m) {
+    __m256i mask =
+        _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)m));
+    size_t i = 0;
+    for (; i + 64 <= bytes; i += 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(p + i + 32));
+        _mm256_storeu_si256((__m256i *)(p + i), _mm256_shuffle_epi8(a, mask));
+        _mm256_storeu_si256((__m256i *)(p + i + 32),
+                            _mm256_shuffle_epi8(b, mask));
+    }
+    for (; i + 32 <= bytes; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(p + i));
+        _mm256_storeu_si256((__m256i *)(p + i), _mm256_shuffle_epi8(a, mask));
+    }
+    return i;
+}
+
+__attribute__((target("ssse3"))) static size_t
+bswap_shuffle_ssse3(unsigned char *p, size_t bytes, const unsigned char *m) {
+    __m128i mask = _mm_loadu_si128((const __m128i *)m);
+    size_t i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(p + i));
+        _mm_storeu_si128((__m128i *)(p + i), _mm_shuffle_epi8(a, mask));
+    }
+    return i;
+}
+#endif
+
+// swaps as much of the buffer as possible with vector shuffles, and
+// returns the number of bytes handled
+static size_t bswap_shuffle(unsigned char *p, size_t bytes,
+                            const unsigned char *mask) {
+#ifdef BS_X86_SHUFFLE
+    if (__builtin_cpu_supports("avx2")) {
+        size_t done = bswap_shuffle_avx2(p, bytes, mask);
+        return done + bswap_shuffle_ssse3(p + done, bytes - done, mask);
+    } else if (__builtin_cpu_supports("ssse3")) {
+        return bswap_shuffle_ssse3(p, bytes, mask);
+    }
+#endif
+    return 0;
+}
+
+void swap_endian_bulk16(void *addr, size_t count) {
+    unsigned char *p = addr;
+    size_t done = bswap_shuffle(p, count * 2, bswap_mask16) / 2;
+    for (size_t i = done; i < count; i++) {
+        swap_endian_fixed(p + i * 2, 2);
+    }
+}
+
+void swap_endian_bulk32(void *addr, size_t count) {
+    unsigned char *p = addr;
+    size_t done = bswap_shuffle(p, count * 4, bswap_mask32) / 4;
+    for (size_t i = done; i < count; i++) {
+        swap_endian_fixed(p + i * 4, 4);
+    }
+}
+
+void swap_endian_bulk64(void *addr, size_t count) {
+    unsigned char *p = addr;
+    size_t done = bswap_shuffle(p, count * 8, bswap_mask64) / 8;
+    for (size_t i = done; i < count; i++) {
+        swap_endian_fixed(p + i * 8, 8);
+    }
+}
+
+void swap_endian_bulk(void *addr, size_t width, size_t count) {
+    unsigned char *p = addr;
+    switch (width) {
+    case 0:
+    case 1:
+        return;
+    case 2:
+        swap_endian_bulk16(addr, count);
+        return;
+    case 4:
+        swap_endian_bulk32(addr, count);
+        return;
+    case 8:
+        swap_endian_bulk64(addr, count);
+        return;
+    default:
+        for (size_t i = 0; i < count; i++) {
+            swap_endian_on_field(p + i * width, width);
+        }
+    }
+}
+
 int memcmp_bits(void *a, void *b, size_t len) {
     size_t byte = len / 8;
     size_t bit = len % 8;
@@ -88,6 +204,33 @@ int memcmp_bits(void *a, void *b, size_t len) {
     return mcp;
 }
 
+uint64_t read_bits(const void *buf, size_t bit_offset, size_t bits) {
+    const unsigned char *p = (const unsigned char *)buf + bit_offset / 8;
+    unsigned int skip = bit_offset % 8;
+    uint64_t value = 0;
+
+    if (bits == 0)
+        return 0;
+
+    // wide reads could carry up to 7 excess bits past the top of the
+    // accumulator, so split them in two
+    if (bits > 56) {
+        uint64_t high = read_bits(buf, bit_offset, bits - 32);
+        return (high << 32) | read_bits(buf, bit_offset + bits - 32, 32);
+    }
+
+    // drop the bits before the offset from the first byte, then shift
+    // in whole bytes and trim the excess off the end
+    size_t available = 8 - skip;
+    value = *p++ & (0xFF >> skip);
+    while (available < bits) {
+        value = (value << 8) | *p++;
+        available += 8;
+    }
+
+    return value >> (available - bits);
+}
+
 void free_sequence(void *head, size_t count) {
     // workaround to avoid complaints from type checker
     void **realhead = (void **)head;
@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #define ANSI_COLOR_RED "\x1b[31m"
 #define ANSI_COLOR_GREEN "\x1b[32m"
@@ -36,6 +37,62 @@
  **/
 void swap_endian_on_field(void *addr, size_t size);
 
+/**
+ * swaps the endianness of a field in place, like swap_endian_on_field,
+ * but compiles down to a single byte swap instruction for 2, 4 and 8
+ * byte fields. When `size` is a compile time constant the dispatch is
+ * folded away entirely, so prefer this for fixed-width fields.
+ **/
+static inline void swap_endian_fixed(void *addr, size_t size) {
+#if defined(__GNUC__)
+    uint16_t v16;
+    uint32_t v32;
+    uint64_t v64;
+
+    switch (size) {
+    case 0:
+    case 1:
+        return;
+    case 2:
+        memcpy(&v16, addr, 2);
+        v16 = __builtin_bswap16(v16);
+        memcpy(addr, &v16, 2);
+        return;
+    case 4:
+        memcpy(&v32, addr, 4);
+        v32 = __builtin_bswap32(v32);
+        memcpy(addr, &v32, 4);
+        return;
+    case 8:
+        memcpy(&v64, addr, 8);
+        v64 = __builtin_bswap64(v64);
+        memcpy(addr, &v64, 8);
+        return;
+    default:
+        break;
+    }
+#endif
+    swap_endian_on_field(addr, size);
+}
+
+/**
+ * swaps the endianness of `count` consecutive fields of the same width,
+ * in place. For columns of same-width values this is much faster than
+ * swapping each field on its own.
+ *
+ * 2, 4 and 8 byte fields use AVX2 or SSSE3 byte shuffles when the CPU
+ * supports them, and byte swap builtins otherwise. Other widths fall
+ * back to swap_endian_on_field.
+ *
+ * addr: a pointer to the first field
+ * width: the width of each field in bytes
+ * count: the number of fields
+ **/
+void swap_endian_bulk(void *addr, size_t width, size_t count);
+void swap_endian_bulk16(void *addr, size_t count);
+void swap_endian_bulk32(void *addr, size_t count);
+void swap_endian_bulk64(void *addr, size_t count);
+
 /////////////////////////////////
 // BIT-BASED MEMORY OPERATIONS //
 /////////////////////////////////
@@ -61,6 +118,16 @@ size_t bits2bytes(size_t bits);
  **/
 int memcmp_bits(void *a, void *b, size_t len);
 
+/**
+ * Reads up to 64 bits starting at an arbitrary bit offset in a buffer,
+ * most significant bit first (the same bit order as a bitbuffer), and
+ * returns them in the low bits of the result. Reads no bytes past the
+ * last one containing requested bits.
+ *
+ * read_bits({ 0xAB, 0xCD }, 4, 8) = 0xBC
+ **/
+uint64_t read_bits(const void *buf, size_t bit_offset, size_t bits);
+
 ///////////////////
 // PRINT HELPERS //
 ///////////////////
@@ -0,0 +1,159 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "validate.h"
+#include "langdef.h"
+#include "translator.h"
+#include "util.h"
+
+void binscript_report_init(binscript_report *report,
+                           binscript_problem *problems, size_t max_problems,
+                           binscript_endmode endmode) {
+    report->endmode = endmode;
+    report->problems = problems;
+    report->max_problems = max_problems;
+    report->problem_ct = 0;
+    report->statement_ct = 0;
+    report->bytes_checked = 0;
+}
+
+static void report_problem(binscript_report *r, binscript_error error,
+                           size_t statement, size_t offset,
+                           size_t bit_offset, unsigned int opcode) {
+    if (r->problem_ct < r->max_problems) {
+        binscript_problem *p = &r->problems[r->problem_ct];
+        p->error = error;
+        p->statement = statement;
+        p->offset = offset;
+        p->bit_offset = bit_offset;
+        p->opcode = opcode;
+    }
+    r->problem_ct++;
+}
+
+// checks that a STRING field holds a null byte somewhere in its width
+static bool string_terminated(const unsigned char *buf, size_t bit_offset,
+                              size_t bits) {
+    size_t bytes = bits / 8;
+    if (bit_offset % 8 == 0) {
+        return memchr(buf + bit_offset / 8, '\0', bytes) != NULL;
+    }
+
+    for (size_t i = 0; i < bytes; i++) {
+        if (read_bits(buf, bit_offset + i * 8, 8) == 0)
+            return true;
+    }
+    return false;
+}
+
+// checks the fields of one statement, reporting problems that do not
+// affect the layout of the input
+static void validate_fields(function_def *fn, const unsigned char *buf,
+                            size_t bit_offset, binscript_report *r,
+                            size_t statement, size_t offset) {
+    for (size_t i = 0; i < fn->argc; i++) {
+        argument_def *arg = fn->arguments[i];
+
+        switch (arg->type) {
+        case STRING:
+            if (!string_terminated(buf, bit_offset, arg->bitwidth)) {
+                report_problem(r, BS_UNTERMINATED_STRING, statement, offset,
+                               bit_offset, fn->function_binary_value);
+            }
+            break;
+        case FLOAT:
+            if (arg->bitwidth != sizeof(float) * 8 &&
+                arg->bitwidth != sizeof(double) * 8 &&
+                arg->bitwidth != sizeof(long double) * 8) {
+                report_problem(r, BS_BAD_FLOAT_WIDTH, statement, offset,
+                               bit_offset, fn->function_binary_value);
+            }
+            break;
+        case INT:
+        case UNSIGNED_INT:
+            // only hex fields are decoded wider than a long
+            if (arg->bitwidth > sizeof(long int) * 8) {
+                report_problem(r, BS_BAD_ARGTYPE, statement, offset,
+                               bit_offset, fn->function_binary_value);
+            }
+            break;
+        default:
+            break;
+        }
+
+        bit_offset += arg->bitwidth;
+    }
+}
+
+bool binscript_validate(language_def *lang, const void *buf, size_t len,
+                        binscript_report *r) {
+    const unsigned char *bytes = (const unsigned char *)buf;
+    size_t name_width = lang->function_name_width;
+    size_t name_bytes = bits2bytes(name_width);
+    size_t offset = 0;
+    size_t initial_problems = r->problem_ct;
+
+    while (true) {
+        // the end of the input, without a terminator
+        if (offset >= len) {
+            if (r->endmode == NULL_TERMINATED) {
+                report_problem(r, BS_MISSING_TERMINATOR, r->statement_ct,
+                               offset, offset * 8, 0);
+            }
+            break;
+        }
+
+        // not enough input left for the name of a statement
+        if (len - offset < name_bytes) {
+            report_problem(r, BS_TRUNCATED_STATEMENT, r->statement_ct, offset,
+                           offset * 8, 0);
+            break;
+        }
+
+        unsigned int opcode =
+            (unsigned int)read_bits(bytes, offset * 8, name_width);
+
+        if (opcode == 0 && r->endmode == NULL_TERMINATED) {
+            offset += name_bytes;
+            break;
+        }
+
+        function_def *fn = lang_getfn(lang, opcode);
+        if (fn == NULL) {
+            report_problem(r, BS_UNKNOWN_OPCODE, r->statement_ct, offset,
+                           offset * 8, opcode);
+            break;
+        }
+
+        size_t width = bits2bytes(func_call_width(lang, fn));
+        if (width > len - offset) {
+            report_problem(r, BS_TRUNCATED_STATEMENT, r->statement_ct, offset,
+                           offset * 8, opcode);
+            break;
+        }
+
+        validate_fields(fn, bytes, offset * 8 + name_width, r,
+                        r->statement_ct, offset);
+
+        offset += width;
+        r->statement_ct++;
+    }
+
+    r->bytes_checked = offset < len ? offset : len;
+    return r->problem_ct == initial_problems;
+}
+
+void binscript_report_print(binscript_report *r) {
+    size_t shown = r->problem_ct < r->max_problems ? r->problem_ct
+                                                   : r->max_problems;
+    for (size_t i = 0; i < shown; i++) {
+        binscript_problem *p = &r->problems[i];
+        printf("%s in statement %zu (opcode 0x%x) at byte %zu (bit %zu)\n",
+               binscript_error_name(p->error), p->statement, p->opcode,
+               p->offset, p->bit_offset);
+    }
+    if (shown < r->problem_ct) {
+        printf("... and %zu more problems\n", r->problem_ct - shown);
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef BINSCRIPT_VALIDATE
+#define BINSCRIPT_VALIDATE
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "langdef.h"
+#include "translator.h"
+
+/**
+ * Validation of packed binaries without decoding them.
+ *
+ * binscript_validate walks the statements of a packed binary using
+ * only the widths recorded in the language, and checks that it could
+ * be decoded: every opcode resolves to a function, no statement runs
+ * past the end of the input, the null terminator is present when the
+ * end mode requires one, and fields hold values the decoder can
+ * represent. No function_calls or argument values are created.
+ **/
+
+typedef struct binscript_problem {
+    binscript_error error;
+    size_t statement;    // index of the offending statement
+    size_t offset;       // byte offset of the statement in the input
+    size_t bit_offset;   // bit offset of the problem in the input
+    unsigned int opcode; // binary name of the offending statement
+} binscript_problem;
+
+typedef struct binscript_report {
+    // how the end of the input is found. NULL_TERMINATED inputs must
+    // contain a terminator, for every other mode the whole buffer is
+    // the script.
+    binscript_endmode endmode;
+
+    // caller supplied storage for the first max_problems problems
+    binscript_problem *problems;
+    size_t max_problems;
+
+    // filled in by binscript_validate. problem_ct counts every problem
+    // found, even those that did not fit in `problems`.
+    size_t problem_ct;
+    size_t statement_ct;
+    size_t bytes_checked;
+} binscript_report;
+
+/**
+ * Initializes a report before validation
+ *
+ * report: the report to initialize
+ * problems: storage for up to max_problems problems (may be NULL if
+ *      max_problems is 0)
+ * max_problems: the number of problems to record in detail
+ * endmode: how the end of the input is found
+ **/
+void binscript_report_init(binscript_report *report,
+                           binscript_problem *problems, size_t max_problems,
+                           binscript_endmode endmode);
+
+/**
+ * Checks that a packed binary is well formed under a language.
+ *
+ * Validation continues past problems confined to a single field, and
+ * stops at the first problem that makes the position of the next
+ * statement unknowable (an unknown opcode, or a truncated statement).
+ *
+ * returns true if no problems were found.
+ *
+ * lang: the language of the binary
+ * buf: the packed binary
+ * len: length of the packed binary in bytes
+ * report: an initialized report, filled in with the results
+ **/
+bool binscript_validate(language_def *lang, const void *buf, size_t len,
+                        binscript_report *report);
+
+/**
+ * prints the problems recorded in a report, one per line
+ **/
+void binscript_report_print(binscript_report *report);
+
+#endif
@@ -0,0 +1,149 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "workpool.h"
+
+// the items a worker has yet to run. The owner takes items from the
+// front, thieves take from the back.
+typedef struct workpool_range {
+    pthread_mutex_t lock;
+    size_t next;
+    size_t end;
+} __attribute__((aligned(64))) workpool_range;
+
+typedef struct workpool {
+    workpool_range *ranges;
+    unsigned int worker_ct;
+    workpool_task task;
+    void *ctx;
+} workpool;
+
+typedef struct workpool_worker {
+    workpool *pool;
+    unsigned int index;
+    pthread_t thread;
+} workpool_worker;
+
+unsigned int workpool_cpu_count(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus < 1 ? 1 : (unsigned int)cpus;
+}
+
+// takes the next item from the front of a worker's own range
+static bool workpool_pop(workpool_range *r, size_t *item) {
+    bool found = false;
+    pthread_mutex_lock(&r->lock);
+    if (r->next < r->end) {
+        *item = r->next++;
+        found = true;
+    }
+    pthread_mutex_unlock(&r->lock);
+    return found;
+}
+
+// moves the back half of another worker's range into the range of
+// `self`. Returns false if every other worker is out of items.
+static bool workpool_steal(workpool *pool, unsigned int self) {
+    for (unsigned int i = 1; i < pool->worker_ct; i++) {
+        workpool_range *victim = &pool->ranges[(self + i) % pool->worker_ct];
+        size_t start, end;
+
+        pthread_mutex_lock(&victim->lock);
+        end = victim->end;
+        start = victim->next + (end - victim->next) / 2;
+        if (start < end) {
+            victim->end = start;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (start < end) {
+            workpool_range *own = &pool->ranges[self];
+            pthread_mutex_lock(&own->lock);
+            own->next = start;
+            own->end = end;
+            pthread_mutex_unlock(&own->lock);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void *workpool_worker_main(void *arg) {
+    workpool_worker *w = arg;
+    workpool *pool = w->pool;
+    size_t item;
+
+    // no items are added once the pool is running, so a worker that
+    // finds nothing to steal is done
+    do {
+        while (workpool_pop(&pool->ranges[w->index], &item)) {
+            pool->task(pool->ctx, item, w->index);
+        }
+    } while (workpool_steal(pool, w->index));
+
+    return NULL;
+}
+
+unsigned int workpool_run(unsigned int threads, size_t item_ct,
+                          workpool_task task, void *ctx) {
+    if (threads == 0)
+        threads = workpool_cpu_count();
+    if (threads > item_ct)
+        threads = item_ct == 0 ? 1 : (unsigned int)item_ct;
+
+    // nothing to share out
+    if (threads == 1) {
+        for (size_t i = 0; i < item_ct; i++) {
+            task(ctx, i, 0);
+        }
+        return 1;
+    }
+
+    workpool pool;
+    pool.worker_ct = threads;
+    pool.task = task;
+    pool.ctx = ctx;
+    if (0 != posix_memalign((void **)&pool.ranges, sizeof(workpool_range),
+                            sizeof(workpool_range) * threads)) {
+        printf("error allocating work pool\n");
+        exit(1);
+    }
+    workpool_worker *workers = malloc(sizeof(workpool_worker) * threads);
+
+    // deal out contiguous ranges of items
+    for (unsigned int i = 0; i < threads; i++) {
+        pthread_mutex_init(&pool.ranges[i].lock, NULL);
+        pool.ranges[i].next = item_ct * i / threads;
+        pool.ranges[i].end = item_ct * (i + 1) / threads;
+        workers[i].pool = &pool;
+        workers[i].index = i;
+    }
+
+    // the calling thread is worker 0
+    unsigned int started = 1;
+    for (unsigned int i = 1; i < threads; i++) {
+        if (0 != pthread_create(&workers[i].thread, NULL,
+                                workpool_worker_main, &workers[i])) {
+            break;
+        }
+        started++;
+    }
+
+    // items dealt to threads that could not be started are stolen by
+    // the workers that were
+    workpool_worker_main(&workers[0]);
+
+    for (unsigned int i = 1; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    for (unsigned int i = 0; i < threads; i++) {
+        pthread_mutex_destroy(&pool.ranges[i].lock);
+    }
+    free(pool.ranges);
+    free(workers);
+    return started;
+}
@@ -0,0 +1,42 @@
+#ifndef BINSCRIPT_WORKPOOL
+#define BINSCRIPT_WORKPOOL
+
+#include <stddef.h>
+
+/**
+ * A work-stealing thread pool for running a fixed set of independent
+ * tasks, such as converting a list of files.
+ *
+ * Items are dealt out to the workers in contiguous ranges, so that a
+ * worker handles neighbouring items while it has work of its own.
+ * Workers that run out steal the back half of another worker's range,
+ * so a few slow items do not leave the rest of the pool idle.
+ **/
+
+/**
+ * Called once for every item.
+ *
+ * ctx: the context passed to workpool_run
+ * item: the index of the item, in [0, item_ct)
+ * worker: the index of the worker running the item, in [0, threads).
+ *      A worker runs one item at a time, so per-worker state (reused
+ *      buffers, arenas) can be indexed by it without locking.
+ **/
+typedef void (*workpool_task)(void *ctx, size_t item, unsigned int worker);
+
+/**
+ * Runs `task` for every item in [0, item_ct) on `threads` threads,
+ * and returns once all of them are done. The calling thread is used
+ * as worker 0. A thread count of 0 uses one thread per online CPU.
+ *
+ * returns the number of workers that were used.
+ **/
+unsigned int workpool_run(unsigned int threads, size_t item_ct,
+                          workpool_task task, void *ctx);
+
+/**
+ * gets the number of online CPUs, or 1 if it cannot be determined
+ **/
+unsigned int workpool_cpu_count(void);
+
+#endif
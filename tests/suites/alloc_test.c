@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../mutest.h"
+#include "alloc.h"
+#include "convert.h"
+#include "langcache.h"
+#include "langdef.h"
+#include "parsescript.h"
+#include "translator.h"
+
+#define ALLOC_TEST_FILE "alloc_test.bin"
+#define ALLOC_TEST_CACHE "alloc_test.cache"
+
+static char *alloclang_src = "meta\n"
+                             "    endianness big\n"
+                             "    namewidth 8\n"
+                             "    nameshift 0\n"
+                             "\n"
+                             "def 0x01 hitbox { uint8(dmg) int8(angle) }\n"
+                             "def 0x02 wait { uint16(frames) }\n"
+                             "def 0x03 name { str16(text) }\n"
+                             "\n"
+                             "flow wait exit\n";
+
+// wait(1) hitbox(2 3) name(ab) wait(4)
+static char alloc_input[] = {
+    0x02, 0x00, 0x01, //
+    0x01, 0x02, 0x03, //
+    0x03, 'a',  'b',  //
+    0x02, 0x00, 0x04, //
+    0x00
+};
+
+void mu_test_alloc_language() {
+    bs_counting_allocator counter;
+    bs_counting_init(&counter, NULL);
+
+    language_def l;
+    mu_check(NULL == parse_language_from_str_with(&l, alloclang_src,
+                                                  "alloclang",
+                                                  &counter.allocator));
+    mu_check(l.alloc == &counter.allocator);
+
+    // so are the definitions parsed on the way: a function, its name,
+    // its argument array and each argument and its name, 17 in all,
+    // freed again once they are copied into the finalized block
+    mu_eq(int, 17 + 4, counter.allocations);
+    mu_eq(int, 17 + 2, counter.frees);
+    lang_build_dispatch(&l);
+
+    // the function table, its finalized block, the flow rule, the
+    // plans and the dispatch table are all that is left
+    mu_check(counter.allocations > 0);
+    mu_check(counter.bytes > 0);
+    mu_check(counter.peak_bytes >= counter.bytes);
+    size_t language_bytes = counter.bytes;
+
+    // consumers take the language's allocator, and calls remember it
+    bs_counting_reset(&counter);
+    binscript_consumer *c =
+        binscript_mem_consumer(&l, alloc_input, "alloc", BIN2SCRIPT);
+    function_call *call;
+    size_t statements = 0;
+    while (BS_OK == binscript_next_checked(c, &call) && call != NULL) {
+        mu_check(call->alloc == &counter.allocator);
+        free_call(call);
+        statements++;
+    }
+    binscript_free(c);
+    mu_eq(int, 4, statements);
+
+    // each call, its argument array, and one per argument, plus the
+    // consumer itself
+    mu_eq(int, 14, counter.allocations);
+    mu_eq(int, counter.allocations, counter.frees);
+    mu_eq(int, language_bytes, counter.bytes);
+    mu_check(counter.peak_bytes > language_bytes);
+
+    char *text = NULL;
+    size_t text_len = 0;
+    FILE *dump = open_memstream(&text, &text_len);
+    bs_counting_dump(&counter, statements, dump);
+    fclose(dump);
+    mu_check(strstr(text, "per statement 3.50 allocations\n") != NULL);
+    free(text);
+
+    free_lang(&l);
+    mu_eq(int, 0, counter.bytes);
+}
+
+void mu_test_alloc_consumer() {
+    language_def l;
+    mu_check(NULL == parse_language_from_str(&l, alloclang_src, "alloclang"));
+    mu_check(l.alloc == NULL);
+
+    FILE *f = fopen(ALLOC_TEST_FILE, "wb");
+    fwrite(alloc_input, 1, sizeof(alloc_input), f);
+    fclose(f);
+
+    // a consumer with an allocator of its own, over a language without
+    bs_counting_allocator counter;
+    bs_counting_init(&counter, NULL);
+    f = fopen(ALLOC_TEST_FILE, "rb");
+    binscript_consumer *c =
+        binscript_file_consumer(&l, f, ALLOC_TEST_FILE, BIN2SCRIPT);
+    consumer_set_size(c, NULL_TERMINATED, 0);
+    consumer_set_allocator(c, &counter.allocator);
+
+    function_call *calls[4];
+    size_t ct = 0;
+    function_call *call;
+    while (BS_OK == binscript_next_checked(c, &call) && call != NULL) {
+        calls[ct++] = call;
+    }
+    binscript_free(c);
+    fclose(f);
+    remove(ALLOC_TEST_FILE);
+    mu_eq(int, 4, ct);
+
+    // statements are read through one buffer, freed with the consumer
+    mu_eq(int, 14, counter.allocations);
+    mu_eq(int, 1, counter.frees);
+    size_t live = counter.bytes;
+    mu_check(live > 0);
+
+    // escaped and freed through the allocator they came from
+    call_escape(calls[2]);
+    for (size_t i = 0; i < ct; i++) {
+        free_call(calls[i]);
+    }
+    mu_eq(int, 0, counter.bytes);
+    mu_eq(int, counter.allocations, counter.frees);
+    mu_check(counter.peak_bytes >= live);
+    free_lang(&l);
+}
+
+void mu_test_alloc_script() {
+    bs_counting_allocator counter;
+    bs_counting_init(&counter, NULL);
+
+    language_def l;
+    mu_check(NULL == parse_language_from_str_with(&l, alloclang_src,
+                                                  "alloclang",
+                                                  &counter.allocator));
+    size_t language_bytes = counter.bytes;
+
+    char script[] = "wait(1)\nname(ab)\n";
+    bs_buffer out;
+    bs_buffer_init(&out);
+    mu_eq(int, BS_OK,
+          binscript_convert(&l, SCRIPT2BIN, NULL_TERMINATED, script,
+                            strlen(script), &out, NULL));
+    mu_eq(int, 7, out.len);
+    bs_buffer_free(&out);
+
+    // parsed calls are freed through the allocator too
+    mu_check(counter.allocations > 1);
+    mu_eq(int, language_bytes, counter.bytes);
+    free_lang(&l);
+    mu_eq(int, 0, counter.bytes);
+
+    // reallocating keeps the count of live bytes
+    bs_counting_reset(&counter);
+    char *p = bs_malloc(&counter.allocator, 16);
+    p = bs_realloc(&counter.allocator, p, 4096);
+    mu_eq(int, 4096, counter.bytes);
+    mu_eq(int, 1, counter.reallocations);
+    mu_check(bs_calloc(&counter.allocator, SIZE_MAX, 2) == NULL);
+    bs_free(&counter.allocator, p);
+    bs_free(&counter.allocator, NULL);
+    mu_eq(int, 0, counter.bytes);
+    mu_eq(int, 4096, counter.peak_bytes);
+}
+
+void mu_test_alloc_cached() {
+    language_def l;
+    mu_check(NULL == parse_language_from_str(&l, alloclang_src, "alloclang"));
+    mu_check(lang_cache_write(&l, 1, ALLOC_TEST_CACHE));
+    free_lang(&l);
+
+    // a cached language is one block and its flow rules
+    bs_counting_allocator counter;
+    bs_counting_init(&counter, NULL);
+    mu_check(lang_cache_load_with(&l, 1, ALLOC_TEST_CACHE,
+                                  &counter.allocator));
+    remove(ALLOC_TEST_CACHE);
+    mu_check(l.alloc == &counter.allocator);
+    mu_eq(int, 2, counter.allocations);
+    mu_eq(int, 1, l.flow_ct);
+
+    lang_build_dispatch(&l);
+    mu_check(counter.allocations > 2);
+    free_lang(&l);
+    mu_eq(int, 0, counter.bytes);
+    mu_eq(int, counter.allocations, counter.frees);
+}
@@ -71,6 +71,28 @@ void mu_test_bitbuffer_advance_sequential() {
     }
 }
 
+void mu_test_bitbuffer_try_advance() {
+    char data[2] = { 0 };
+    bitbuffer b;
+    bitbuffer_init_from_buffer(&b, data, sizeof(data));
+
+    mu_eq(int, 16, bitbuffer_remaining_bits(&b));
+    mu_check(bitbuffer_try_advance(&b, 5));
+    mu_eq(int, 11, bitbuffer_remaining_bits(&b));
+
+    // a failed advance leaves the bitbuffer where it was
+    mu_check(!bitbuffer_try_advance(&b, 12));
+    mu_eq(int, 11, bitbuffer_remaining_bits(&b));
+    mu_eq(int, 5, b.head_offset);
+
+    mu_check(bitbuffer_try_advance(&b, 11));
+    mu_eq(int, 0, bitbuffer_remaining_bits(&b));
+    mu_check(!bitbuffer_try_advance(&b, 1));
+    mu_check(bitbuffer_try_advance(&b, 0));
+
+    bitbuffer_free(&b);
+}
+
 void mu_test_bitbuffer_next() {
     bitbuffer b;
     char buff[] = "this is a test array";
@@ -154,3 +176,87 @@ void mu_test_bitbuffer_writeblock() {
         check_bitbuffer_invariants(b);
     }
 }
+
+void mu_test_bitbuffer_pop_unaligned() {
+    char buff[] = { 0x5a, 0xc3, 0x96, 0x3c };
+    char dest[4];
+
+    for (size_t offset = 0; offset < 16; offset++) {
+        for (size_t bits = 1; bits + offset <= 32; bits++) {
+            bitbuffer b;
+            bitbuffer_init_from_buffer(&b, buff, sizeof(buff));
+            bitbuffer_advance(&b, offset);
+            memset(dest, 0, sizeof(dest));
+
+            bitbuffer_pop(dest, &b, bits);
+            mu_eq(int, read_bits(buff, offset, bits),
+                  read_bits(dest, 0, bits));
+            check_bitbuffer_location(b, offset + bits);
+        }
+    }
+}
+
+// copies bit by bit, through a temporary so that overlaps work
+static void reference_copybits(unsigned char *dest, size_t dest_offset,
+                               const unsigned char *src, size_t src_offset,
+                               size_t bits) {
+    bool tmp[512];
+    for (size_t i = 0; i < bits; i++) {
+        size_t s = src_offset + i;
+        tmp[i] = (src[s / 8] >> (7 - s % 8)) & 1;
+    }
+    for (size_t i = 0; i < bits; i++) {
+        size_t d = dest_offset + i;
+        dest[d / 8] = (dest[d / 8] & ~(1 << (7 - d % 8))) |
+                      (tmp[i] << (7 - d % 8));
+    }
+}
+
+#define COPYBITS_BUFLEN 48
+
+void mu_test_bitbuffer_copybits() {
+    unsigned char src[COPYBITS_BUFLEN], dest[COPYBITS_BUFLEN],
+        expected[COPYBITS_BUFLEN];
+    srand(41);
+    for (size_t i = 0; i < COPYBITS_BUFLEN; i++) {
+        src[i] = (unsigned char)rand();
+    }
+
+    // every pair of offsets within two bytes, for lengths around the
+    // chunk sizes of the copy
+    for (size_t src_offset = 0; src_offset < 16; src_offset++) {
+        for (size_t dest_offset = 0; dest_offset < 16; dest_offset++) {
+            for (size_t bits = 0; bits <= 200; bits++) {
+                memset(dest, 0xa5, sizeof(dest));
+                memset(expected, 0xa5, sizeof(expected));
+
+                bitbuffer_copybits(dest, dest_offset, src, src_offset, bits);
+                reference_copybits(expected, dest_offset, src, src_offset,
+                                   bits);
+                mu_check(0 == memcmp(dest, expected, sizeof(dest)));
+            }
+        }
+    }
+}
+
+void mu_test_bitbuffer_copybits_overlap() {
+    unsigned char buff[COPYBITS_BUFLEN], expected[COPYBITS_BUFLEN];
+    srand(42);
+
+    // moves within one buffer in both directions, by every distance up
+    // to three bytes
+    for (size_t src_offset = 0; src_offset < 24; src_offset++) {
+        for (size_t dest_offset = 0; dest_offset < 24; dest_offset++) {
+            for (size_t bits = 1; bits <= 150; bits += 7) {
+                for (size_t i = 0; i < COPYBITS_BUFLEN; i++) {
+                    buff[i] = expected[i] = (unsigned char)rand();
+                }
+
+                bitbuffer_copybits(buff, dest_offset, buff, src_offset, bits);
+                reference_copybits(expected, dest_offset, expected,
+                                   src_offset, bits);
+                mu_check(0 == memcmp(buff, expected, sizeof(buff)));
+            }
+        }
+    }
+}
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../mutest.h"
+#include "alloc.h"
+#include "callpool.h"
+#include "langdef.h"
+#include "parsescript.h"
+#include "stats.h"
+#include "translator.h"
+
+#define CALLPOOL_TEST_FILE "callpool_test.bin"
+
+static language_def poollang;
+
+// wait(1) hitbox(2 -3) name(ab) wait(4) hitbox(5 6) name(cd)
+static char pool_input[] = {
+    0x02, 0x00, 0x01, //
+    0x01, 0x02, 0x83, //
+    0x03, 'a',  'b',  //
+    0x02, 0x00, 0x04, //
+    0x01, 0x05, 0x06, //
+    0x03, 'c',  'd',  //
+    0x00
+};
+
+int mu_init_callpool() {
+    detailed_parse_error *e = parse_language_from_str(
+        &poollang, "meta\n"
+                   "    endianness big\n"
+                   "    namewidth 8\n"
+                   "    nameshift 0\n"
+                   "\n"
+                   "def 0x01 hitbox { uint8(dmg) int8(angle) }\n"
+                   "def 0x02 wait { uint16(frames) }\n"
+                   "def 0x03 name { str16(text) }\n",
+        "poollang");
+    if (e != NULL) {
+        print_err(e);
+        free_err(e);
+        return 1;
+    }
+    return 0;
+}
+
+void mu_term_callpool() { free_lang(&poollang); }
+
+// decodes the input, checking each call, and freeing it right away
+static void decode_input(binscript_consumer *c) {
+    const char *names[] = { "wait", "hitbox", "name",
+                            "wait", "hitbox", "name" };
+    char text[64];
+    const char *expected[] = { "wait(1)",  "hitbox(2 -3)", "name(ab)",
+                               "wait(4)",  "hitbox(5 6)",  "name(cd)" };
+
+    function_call *call;
+    size_t ct = 0;
+    while (BS_OK == binscript_next_checked(c, &call) && call != NULL) {
+        mu_check(0 == strcmp(names[ct], call->defn->name));
+        string_encode_function_call(text, call);
+        mu_check(0 == strcmp(expected[ct], text));
+        free_call(call);
+        ct++;
+    }
+    mu_eq(int, 6, ct);
+    mu_eq(int, BS_OK, c->error);
+}
+
+void mu_test_callpool_reuse() {
+    bs_counting_allocator counter;
+    bs_counting_init(&counter, NULL);
+    bs_call_pool pool;
+    bs_call_pool_init(&pool, &poollang, &counter.allocator);
+
+    binscript_consumer *c =
+        binscript_mem_consumer(&poollang, pool_input, "pool", BIN2SCRIPT);
+    consumer_set_pool(c, &pool);
+    decode_input(c);
+    binscript_free(c);
+
+    // one call per function, reused for its second statement, besides
+    // the pool's own free lists
+    mu_eq(int, 3, pool.misses);
+    mu_eq(int, 3, pool.hits);
+    mu_eq(int, 3, pool.pooled);
+    uint64_t warm = counter.allocations;
+    mu_eq(int, 11, warm);
+
+    // the second pass allocates nothing
+    c = binscript_mem_consumer(&poollang, pool_input, "pool", BIN2SCRIPT);
+    consumer_set_pool(c, &pool);
+    decode_input(c);
+    binscript_free(c);
+    mu_eq(int, warm, counter.allocations);
+    mu_eq(int, 9, pool.hits);
+
+    // held calls are taken out of the pool, and new ones made
+    function_call *a = bs_call_pool_take(&pool, poollang.functions[0]);
+    function_call *b = bs_call_pool_take(&pool, poollang.functions[0]);
+    mu_check(a != b);
+    mu_check(a->pool == &pool && b->pool == &pool);
+    mu_eq(int, 4, pool.misses);
+    free_call(a);
+    free_call(b);
+    mu_eq(int, 4, pool.pooled);
+
+    bs_call_pool_free(&pool);
+    mu_eq(int, 0, counter.bytes);
+    mu_eq(int, counter.allocations, counter.frees);
+}
+
+void mu_test_callpool_file() {
+    FILE *f = fopen(CALLPOOL_TEST_FILE, "wb");
+    fwrite(pool_input, 1, sizeof(pool_input), f);
+    fclose(f);
+
+    bs_call_pool pool;
+    bs_call_pool_init(&pool, &poollang, NULL);
+    bs_stats stats;
+    bs_stats_init(&stats, &poollang);
+
+    f = fopen(CALLPOOL_TEST_FILE, "rb");
+    binscript_consumer *c =
+        binscript_file_consumer(&poollang, f, CALLPOOL_TEST_FILE, BIN2SCRIPT);
+    consumer_set_size(c, NULL_TERMINATED, 0);
+    consumer_set_pool(c, &pool);
+    consumer_set_stats(c, &stats);
+    decode_input(c);
+    binscript_free(c);
+    fclose(f);
+    remove(CALLPOOL_TEST_FILE);
+
+    mu_eq(int, 3, pool.hits);
+#ifndef BINSCRIPT_NO_STATS
+    // the read buffer, and the first call to each function
+    mu_eq(int, 11, stats.allocations);
+#endif
+    bs_stats_free(&stats);
+    bs_call_pool_free(&pool);
+}
+
+void mu_test_callpool_borrowed() {
+    bs_call_pool pool;
+    bs_call_pool_init(&pool, &poollang, NULL);
+
+    // borrowed strings are never pooled, other calls still are
+    binscript_consumer *c =
+        binscript_mem_consumer(&poollang, pool_input, "pool", BIN2SCRIPT);
+    consumer_set_zero_copy(c, true);
+    consumer_set_pool(c, &pool);
+    decode_input(c);
+    binscript_free(c);
+    mu_eq(int, 2, pool.hits);
+    mu_eq(int, 2, pool.pooled);
+
+    // truncated statements are found before a call is taken
+    char truncated[] = { 0x01, 0x02 };
+    c = binscript_mem_consumer(&poollang, truncated, "pool", BIN2SCRIPT);
+    consumer_set_source_len(c, sizeof(truncated));
+    consumer_set_pool(c, &pool);
+    function_call *call;
+    mu_eq(int, BS_TRUNCATED_STATEMENT, binscript_next_checked(c, &call));
+    binscript_free(c);
+    mu_eq(int, 2, pool.pooled);
+
+    bs_call_pool_free(&pool);
+}
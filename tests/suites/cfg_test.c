@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../mutest.h"
+#include "cfg.h"
+#include "langdef.h"
+#include "parsescript.h"
+
+static language_def cfglang;
+
+// op(1) loop(3) op(2) endloop call(+6) jump(0x110) op(4) ret
+static const char cfg_input[] = {
+    0x01, 0x01,       // 0: op
+    0x05, 0x03,       // 2: loop
+    0x01, 0x02,       // 4: op
+    0x06,             // 6: endloop
+    0x03, 0x00, 0x06, // 7: call, to 13
+    0x02, 0x01, 0x10, // 10: jump, to 16
+    0x01, 0x04,       // 13: op
+    0x04,             // 15: ret
+    0x00              // 16: terminator
+};
+
+int mu_init_cfg() {
+    detailed_parse_error *e = parse_language_from_str(
+        &cfglang, "meta\n"
+                  "    endianness big\n"
+                  "    namewidth 8\n"
+                  "    nameshift 0\n"
+                  "\n"
+                  "def 0x01 op { uint8(x) }\n"
+                  "def 0x02 jump { uint16(to) }\n"
+                  "def 0x03 call { int16(delta) }\n"
+                  "def 0x04 ret\n"
+                  "def 0x05 loop { uint8(times) }\n"
+                  "def 0x06 endloop\n"
+                  "\n"
+                  "flow jump jump to\n"
+                  "flow call call delta relative\n"
+                  "flow ret return\n"
+                  "flow loop loop_start\n"
+                  "flow endloop loop_end\n",
+        "cfglang");
+    if (e != NULL) {
+        print_err(e);
+        free_err(e);
+        return 1;
+    }
+    return 0;
+}
+
+void mu_term_cfg() { free_lang(&cfglang); }
+
+static bool has_edge(bs_cfg *cfg, size_t from, size_t to,
+                     bs_cfg_edge_kind kind) {
+    bs_cfg_block *block = &cfg->blocks[from];
+    for (size_t i = 0; i < block->edge_ct; i++) {
+        bs_cfg_edge *edge = &cfg->edges[block->first_edge + i];
+        if (edge->from == from && edge->to == to && edge->kind == kind)
+            return true;
+    }
+    return false;
+}
+
+static void check_graph(bs_cfg *cfg) {
+    mu_eq(int, 9, cfg->statement_ct);
+    mu_eq(int, 16, cfg->offsets[8]);
+    mu_eq(int, 0, cfg->unresolved_ct);
+
+    size_t firsts[] = { 0, 2, 4, 5, 6, 8 };
+    mu_eq(int, 6, cfg->block_ct);
+    for (size_t i = 0; i < cfg->block_ct; i++) {
+        mu_eq(int, firsts[i], cfg->blocks[i].first);
+    }
+
+    mu_eq(int, 6, cfg->edge_ct);
+    mu_check(has_edge(cfg, 0, 1, BS_EDGE_FALLTHROUGH));
+    mu_check(has_edge(cfg, 1, 1, BS_EDGE_LOOP));
+    mu_check(has_edge(cfg, 1, 2, BS_EDGE_FALLTHROUGH));
+    mu_check(has_edge(cfg, 2, 4, BS_EDGE_CALL));
+    mu_check(has_edge(cfg, 2, 3, BS_EDGE_FALLTHROUGH));
+    mu_check(has_edge(cfg, 3, 5, BS_EDGE_JUMP));
+    mu_eq(int, 0, cfg->blocks[4].edge_ct);
+    mu_eq(int, 0, cfg->blocks[5].edge_ct);
+
+    mu_eq(int, 6, bs_cfg_statement_at(cfg, 13));
+    mu_check(BS_CFG_NONE == bs_cfg_statement_at(cfg, 14));
+    mu_eq(int, 4, bs_cfg_block_of(cfg, 7));
+}
+
+void mu_test_cfg_blocks() {
+    bs_cfg cfg;
+    mu_eq(int, BS_OK,
+          bs_cfg_build(&cfg, &cfglang, cfg_input, sizeof(cfg_input),
+                       NULL_TERMINATED, 0x100, NULL));
+    check_graph(&cfg);
+    bs_cfg_free(&cfg);
+
+    // the scan reads the same rules out of the dispatch table
+    lang_build_dispatch(&cfglang);
+    mu_eq(int, BS_OK,
+          bs_cfg_build(&cfg, &cfglang, cfg_input, sizeof(cfg_input),
+                       NULL_TERMINATED, 0x100, NULL));
+    check_graph(&cfg);
+    bs_cfg_free(&cfg);
+}
+
+void mu_test_cfg_unresolved() {
+    // a jump into the middle of a statement, one past the end, and a
+    // loop end with no loop
+    const char input[] = { 0x01, 0x01, 0x02, 0x01, 0x01, 0x02,
+                           0x10, 0x00, 0x06, 0x01, 0x02 };
+    bs_cfg cfg;
+    mu_eq(int, BS_OK,
+          bs_cfg_build(&cfg, &cfglang, input, sizeof(input), MANUAL_CUTOFF,
+                       0x100, NULL));
+    mu_eq(int, 5, cfg.statement_ct);
+    mu_eq(int, 3, cfg.unresolved_ct);
+
+    // the jumps end their blocks without edges
+    mu_eq(int, 4, cfg.block_ct);
+    mu_eq(int, 0, cfg.blocks[0].edge_ct);
+    mu_eq(int, 0, cfg.blocks[1].edge_ct);
+    mu_check(has_edge(&cfg, 2, 3, BS_EDGE_FALLTHROUGH));
+    bs_cfg_free(&cfg);
+
+    size_t error_offset = 0;
+    const char bad[] = { 0x01, 0x01, 0x07, 0x00 };
+    mu_eq(int, BS_UNKNOWN_OPCODE,
+          bs_cfg_build(&cfg, &cfglang, bad, sizeof(bad), NULL_TERMINATED, 0,
+                       &error_offset));
+    mu_eq(int, 2, error_offset);
+    mu_eq(int, 0, cfg.statement_ct);
+    bs_cfg_free(&cfg);
+}
+
+void mu_test_cfg_melee() {
+    language_def meleelang;
+    FILE *f = fopen("./tests/languages/melee.langdef", "r");
+    parse_language_from_file(&meleelang, f, "melee.langdef");
+    fclose(f);
+
+    // wait_for(5), then goto the start of the script
+    const char input[] = { 0x08, 0x00, 0x00, 0x05, 0x1C, 0x00,
+                           0x00, 0x00, 0x80, 0x00, 0x00, 0x00,
+                           0x00, 0x00, 0x00, 0x00 };
+    bs_cfg cfg;
+    mu_eq(int, BS_OK,
+          bs_cfg_build(&cfg, &meleelang, input, sizeof(input),
+                       NULL_TERMINATED, 0x80000000, NULL));
+    mu_eq(int, 3, cfg.statement_ct);
+    mu_eq(int, 2, cfg.block_ct);
+    mu_eq(int, 1, cfg.edge_ct);
+    mu_check(has_edge(&cfg, 0, 0, BS_EDGE_JUMP));
+    bs_cfg_free(&cfg);
+
+    free_lang(&meleelang);
+}
+
+void mu_test_cfg_flow_decl_errors() {
+    const char *header = "meta\n"
+                         "    endianness big\n"
+                         "    namewidth 8\n"
+                         "    nameshift 0\n"
+                         "def 0x01 jump { uint16(to) float32(f) }\n";
+    const char *decls[] = {
+        "flow nope jump to\n",       "flow jump\n",
+        "flow jump sideways to\n",   "flow jump jump\n",
+        "flow jump return to\n",     "flow jump jump from\n",
+        "flow jump jump f\n",        "flow jump jump to backwards\n",
+        "flow jump exit\nflow jump exit\n",
+    };
+    PARSE_ERROR expected[] = {
+        UNKNOWN_FUNCTION_NAME, MALFORMED_FLOW_DECL, MALFORMED_FLOW_DECL,
+        MALFORMED_FLOW_DECL,   MALFORMED_FLOW_DECL, UNKNOWN_FUNCTION_NAME,
+        MALFORMED_FLOW_DECL,   MALFORMED_FLOW_DECL, MALFORMED_FLOW_DECL,
+    };
+
+    for (size_t i = 0; i < sizeof(decls) / sizeof(decls[0]); i++) {
+        char source[512];
+        snprintf(source, sizeof(source), "%s%s", header, decls[i]);
+
+        language_def l;
+        detailed_parse_error *e = parse_language_from_str(&l, source, "bad");
+        mu_check(e != NULL);
+        if (e != NULL)
+            mu_eq(int, expected[i], e->primitive_error);
+        free_err(e);
+        free_lang(&l);
+    }
+}
@@ -0,0 +1,155 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../mutest.h"
+#include "convert.h"
+#include "langdef.h"
+#include "parsescript.h"
+
+static language_def convertlang;
+
+int mu_init_convert() {
+    detailed_parse_error *e = parse_language_from_str(
+        &convertlang, "meta\n"
+                      "    endianness big\n"
+                      "    namewidth 8\n"
+                      "\n"
+                      "def 0x01 pair {\n"
+                      "    uint8(a) int8(b)\n"
+                      "}\n"
+                      "def 0x02 wide {\n"
+                      "    uint4(a) skip4 uint16(b)\n"
+                      "}\n"
+                      "def 0x03 label {\n"
+                      "    uint4(a) str16(tag) uint4(b)\n"
+                      "}\n",
+        "convertlang");
+    if (e != NULL) {
+        print_err(e);
+        free_err(e);
+        return 1;
+    }
+    return 0;
+}
+
+void mu_term_convert() { free_lang(&convertlang); }
+
+static char convert_bin[] = { 0x01, 0x10, 0x20,       // pair(16 32)
+                              0x02, 0x70, 0x01, 0x02, // wide(7 258)
+                              0x00 };
+static char *convert_text = "pair(16 32)\nwide(7 258)\n";
+
+void mu_test_convert_roundtrip() {
+    bs_buffer out;
+    size_t offset;
+    bs_buffer_init(&out);
+
+    mu_eq(int, BS_OK,
+          binscript_convert(&convertlang, BIN2SCRIPT, NULL_TERMINATED,
+                            convert_bin, sizeof(convert_bin), &out,
+                            &offset));
+    mu_eq(int, strlen(convert_text), out.len);
+    mu_check(0 == memcmp(convert_text, out.data, out.len));
+
+    // the buffer is reused, and only grows
+    char *text = strdup(convert_text);
+    size_t capacity = out.capacity;
+    bs_buffer_clear(&out);
+    mu_eq(int, BS_OK,
+          binscript_convert(&convertlang, SCRIPT2BIN, NULL_TERMINATED, text,
+                            strlen(text), &out, &offset));
+    mu_eq(int, capacity, out.capacity);
+    mu_eq(int, sizeof(convert_bin), out.len);
+    mu_check(0 == memcmp(convert_bin, out.data, out.len));
+
+    free(text);
+    bs_buffer_free(&out);
+}
+
+void mu_test_convert_errors() {
+    bs_buffer out;
+    size_t offset;
+    bs_buffer_init(&out);
+
+    // a terminator is required unless the whole input is statements
+    mu_eq(int, BS_MISSING_TERMINATOR,
+          binscript_convert(&convertlang, BIN2SCRIPT, NULL_TERMINATED,
+                            convert_bin, sizeof(convert_bin) - 1, &out,
+                            &offset));
+    mu_eq(int, 7, offset);
+
+    bs_buffer_clear(&out);
+    mu_eq(int, BS_OK,
+          binscript_convert(&convertlang, BIN2SCRIPT, MANUAL_CUTOFF,
+                            convert_bin, sizeof(convert_bin) - 1, &out,
+                            &offset));
+
+    // the second statement is cut short, the first is still converted
+    bs_buffer_clear(&out);
+    mu_eq(int, BS_TRUNCATED_STATEMENT,
+          binscript_convert(&convertlang, BIN2SCRIPT, MANUAL_CUTOFF,
+                            convert_bin, 5, &out, &offset));
+    mu_eq(int, 3, offset);
+    mu_eq(int, strlen("pair(16 32)\n"), out.len);
+
+    bs_buffer_clear(&out);
+    char *text = strdup("pair(1 2)\nnope(1)\n");
+    mu_eq(int, BS_BAD_SCRIPT,
+          binscript_convert(&convertlang, SCRIPT2BIN, NULL_TERMINATED, text,
+                            strlen(text), &out, &offset));
+    mu_eq(int, 1, offset);
+    mu_eq(int, 3, out.len);
+
+    free(text);
+    bs_buffer_free(&out);
+}
+
+void mu_test_convert_strings() {
+    // unaligned strings, full and padded
+    char bin[] = { 0x03, 0x56, 0x16, 0x21, 0x03, 0x56, 0x10, 0x01, 0x00 };
+    char *text = strdup("label(5 ab 1)\nlabel(5 a 1)\n");
+    bs_buffer out;
+    bs_buffer_init(&out);
+
+    mu_eq(int, BS_OK,
+          binscript_convert(&convertlang, SCRIPT2BIN, NULL_TERMINATED, text,
+                            strlen(text), &out, NULL));
+    mu_eq(int, sizeof(bin), out.len);
+    mu_check(0 == memcmp(bin, out.data, sizeof(bin)));
+
+    bs_buffer_clear(&out);
+    mu_eq(int, BS_OK,
+          binscript_convert(&convertlang, BIN2SCRIPT, NULL_TERMINATED, bin,
+                            sizeof(bin), &out, NULL));
+    mu_eq(int, strlen(text), out.len);
+    mu_check(0 == memcmp(text, out.data, out.len));
+
+    free(text);
+    bs_buffer_free(&out);
+}
+
+void mu_test_convert_pooled() {
+    bs_call_pool pool;
+    bs_buffer out;
+    bs_call_pool_init(&pool, &convertlang, NULL);
+    bs_buffer_init(&out);
+
+    // the first input fills the pool, and later ones reuse its calls
+    for (int i = 0; i < 3; i++) {
+        bs_buffer_clear(&out);
+        mu_eq(int, BS_OK,
+              binscript_convert_counted(&convertlang, BIN2SCRIPT,
+                                        NULL_TERMINATED, convert_bin,
+                                        sizeof(convert_bin), &out, NULL,
+                                        NULL, &pool));
+        mu_eq(int, strlen(convert_text), out.len);
+        mu_check(0 == memcmp(convert_text, out.data, out.len));
+    }
+    mu_eq(int, 2, pool.misses);
+    mu_eq(int, 4, pool.hits);
+    mu_eq(int, 2, pool.pooled);
+
+    bs_call_pool_free(&pool);
+    bs_buffer_free(&out);
+}
@@ -0,0 +1,262 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../mutest.h"
+#include "convert.h"
+#include "daemon.h"
+#include "langdef.h"
+#include "parsescript.h"
+
+#define DAEMON_TEST_SOCKET "daemon_test.sock"
+
+static language_def daemonlang;
+static bs_daemon *test_daemon;
+static pthread_t test_daemon_thread;
+
+static void *serve(void *arg) {
+    bs_daemon_run(arg);
+    return NULL;
+}
+
+int mu_init_daemon() {
+    detailed_parse_error *e =
+        parse_language_from_str(&daemonlang, "meta\n"
+                                             "    endianness big\n"
+                                             "    namewidth 8\n"
+                                             "\n"
+                                             "def 0x01 pair {\n"
+                                             "    uint8(a) int8(b)\n"
+                                             "}\n",
+                                "daemonlang");
+    if (e != NULL) {
+        print_err(e);
+        free_err(e);
+        return 1;
+    }
+
+    static language_def *langs[] = { &daemonlang };
+    static const char *names[] = { "daemonlang" };
+    test_daemon = bs_daemon_create(DAEMON_TEST_SOCKET, langs, names, 1, 4);
+    if (test_daemon == NULL)
+        return 1;
+    return pthread_create(&test_daemon_thread, NULL, serve, test_daemon);
+}
+
+void mu_term_daemon() {
+    bs_daemon_stop(test_daemon);
+    pthread_join(test_daemon_thread, NULL);
+    bs_daemon_free(test_daemon);
+    free_lang(&daemonlang);
+}
+
+static char daemon_bin[] = { 0x01, 0x10, 0x20, 0x01, 0x01, 0x02, 0x00 };
+static char *daemon_text = "pair(16 32)\npair(1 2)\n";
+
+void mu_test_daemon_requests() {
+    int fd = bs_client_connect(DAEMON_TEST_SOCKET);
+    bs_response_header r;
+    bs_buffer out;
+    bs_buffer_init(&out);
+    mu_check(fd >= 0);
+
+    mu_check(bs_client_send(fd, 7, BS_OP_DECODE, 0, 0, daemon_bin,
+                            sizeof(daemon_bin)));
+    mu_check(bs_client_recv(fd, &r, &out));
+    mu_eq(int, 7, r.id);
+    mu_eq(int, BS_OK, r.status);
+    mu_check(0 == strcmp(daemon_text, out.data));
+
+    bs_buffer_clear(&out);
+    mu_check(bs_client_send(fd, 8, BS_OP_ENCODE, 0, 0, daemon_text,
+                            strlen(daemon_text)));
+    mu_check(bs_client_recv(fd, &r, &out));
+    mu_eq(int, BS_OK, r.status);
+    mu_eq(int, sizeof(daemon_bin), out.len);
+    mu_check(0 == memcmp(daemon_bin, out.data, out.len));
+
+    // a binary cut off in its second statement
+    bs_buffer_clear(&out);
+    mu_check(bs_client_send(fd, 9, BS_OP_VALIDATE, 0, 0, daemon_bin, 4));
+    mu_check(bs_client_recv(fd, &r, &out));
+    mu_eq(int, BS_TRUNCATED_STATEMENT, r.status);
+    mu_eq(int, 3, r.offset);
+    mu_check(out.len > 0);
+
+    bs_buffer_clear(&out);
+    mu_check(bs_client_send(fd, 10, BS_OP_DECODE, 3, 0, daemon_bin,
+                            sizeof(daemon_bin)));
+    mu_check(bs_client_recv(fd, &r, &out));
+    mu_eq(int, BS_BAD_REQUEST, r.status);
+
+    bs_buffer_clear(&out);
+    mu_check(bs_client_send(fd, 11, BS_OP_LANGS, 0, 0, NULL, 0));
+    mu_check(bs_client_recv(fd, &r, &out));
+    mu_check(0 == strcmp("0 daemonlang\n", out.data));
+
+    close(fd);
+    bs_buffer_free(&out);
+}
+
+#define DAEMON_TEST_PIPELINE 200
+
+void mu_test_daemon_pipelined() {
+    int fds[2] = { bs_client_connect(DAEMON_TEST_SOCKET),
+                   bs_client_connect(DAEMON_TEST_SOCKET) };
+    bool seen[2][DAEMON_TEST_PIPELINE] = { { false } };
+    unsigned int ok = 0;
+    bs_response_header r;
+    bs_buffer out;
+    bs_buffer_init(&out);
+
+    // send everything before reading any response
+    for (unsigned int i = 0; i < DAEMON_TEST_PIPELINE; i++) {
+        for (int c = 0; c < 2; c++) {
+            mu_check(bs_client_send(fds[c], i, BS_OP_DECODE, 0, 0,
+                                    daemon_bin, sizeof(daemon_bin)));
+        }
+    }
+
+    // responses may come back in any order
+    for (int c = 0; c < 2; c++) {
+        for (unsigned int i = 0; i < DAEMON_TEST_PIPELINE; i++) {
+            bs_buffer_clear(&out);
+            if (bs_client_recv(fds[c], &r, &out) && r.status == BS_OK &&
+                r.id < DAEMON_TEST_PIPELINE && !seen[c][r.id] &&
+                0 == strcmp(daemon_text, out.data)) {
+                seen[c][r.id] = true;
+                ok++;
+            }
+        }
+        close(fds[c]);
+    }
+    mu_eq(int, 2 * DAEMON_TEST_PIPELINE, ok);
+    bs_buffer_free(&out);
+}
+
+// enough large requests that the daemon has to stop reading them
+#define DAEMON_TEST_STALLED (3 * BS_DAEMON_MAX_IN_FLIGHT)
+#define DAEMON_TEST_STALLED_STATEMENTS 10000
+
+typedef struct stalled_client {
+    int fd;
+    char *bin;
+    size_t len;
+    atomic_bool sent_all;
+} stalled_client;
+
+static void *send_stalled(void *arg) {
+    stalled_client *s = arg;
+    for (unsigned int i = 0; i < DAEMON_TEST_STALLED; i++) {
+        if (!bs_client_send(s->fd, i, BS_OP_DECODE, 0, 0, s->bin, s->len))
+            break;
+    }
+    atomic_store(&s->sent_all, true);
+    return NULL;
+}
+
+// connects a client that sends everything before reading anything
+static bool start_stalled(stalled_client *s, pthread_t *sender,
+                          const char *socket_path) {
+    s->len = DAEMON_TEST_STALLED_STATEMENTS * 3 + 1;
+    s->bin = malloc(s->len);
+    for (size_t i = 0; i < DAEMON_TEST_STALLED_STATEMENTS; i++) {
+        s->bin[i * 3] = 0x01;
+        s->bin[i * 3 + 1] = (char)i;
+        s->bin[i * 3 + 2] = (char)(i >> 8);
+    }
+    s->bin[s->len - 1] = 0x00;
+    atomic_init(&s->sent_all, false);
+    s->fd = bs_client_connect(socket_path);
+    if (s->fd < 0)
+        return false;
+    return 0 == pthread_create(sender, NULL, send_stalled, s);
+}
+
+void mu_test_daemon_stalled_client() {
+    stalled_client s;
+    pthread_t sender;
+    mu_check(start_stalled(&s, &sender, DAEMON_TEST_SOCKET));
+    nanosleep(&(struct timespec){ .tv_nsec = 100 * 1000 * 1000 }, NULL);
+
+    // is answered no sooner than another client
+    int fd = bs_client_connect(DAEMON_TEST_SOCKET);
+    struct timeval timeout = { .tv_sec = 10 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    bs_response_header r;
+    bs_buffer out;
+    bs_buffer_init(&out);
+    mu_check(bs_client_send(fd, 1, BS_OP_DECODE, 0, 0, daemon_bin,
+                            sizeof(daemon_bin)));
+    mu_check(bs_client_recv(fd, &r, &out));
+    mu_eq(int, BS_OK, r.status);
+    mu_check(0 == strcmp(daemon_text, out.data));
+    close(fd);
+
+    // and is not read from until it reads
+    mu_check(!atomic_load(&s.sent_all));
+    unsigned int ok = 0;
+    for (unsigned int i = 0; i < DAEMON_TEST_STALLED; i++) {
+        bs_buffer_clear(&out);
+        ok += bs_client_recv(s.fd, &r, &out) && r.status == BS_OK;
+    }
+    pthread_join(sender, NULL);
+    mu_eq(int, DAEMON_TEST_STALLED, ok);
+
+    close(s.fd);
+    free(s.bin);
+    bs_buffer_free(&out);
+}
+
+typedef struct stopping_daemon {
+    bs_daemon *daemon;
+    atomic_bool returned;
+} stopping_daemon;
+
+static void *serve_until_stopped(void *arg) {
+    stopping_daemon *s = arg;
+    bs_daemon_run(s->daemon);
+    atomic_store(&s->returned, true);
+    return NULL;
+}
+
+void mu_test_daemon_stop_stalled_client() {
+    static language_def *langs[] = { &daemonlang };
+    static const char *names[] = { "daemonlang" };
+    stopping_daemon d;
+    d.daemon =
+        bs_daemon_create("daemon_stop_test.sock", langs, names, 1, 2);
+    atomic_init(&d.returned, false);
+    mu_check(d.daemon != NULL);
+    pthread_t server;
+    pthread_create(&server, NULL, serve_until_stopped, &d);
+
+    // a client with its writer blocked and its reader at the limit
+    stalled_client s;
+    pthread_t sender;
+    mu_check(start_stalled(&s, &sender, "daemon_stop_test.sock"));
+    nanosleep(&(struct timespec){ .tv_nsec = 100 * 1000 * 1000 }, NULL);
+    mu_check(!atomic_load(&s.sent_all));
+
+    // does not keep the daemon from stopping
+    bs_daemon_stop(d.daemon);
+    for (int i = 0; i < 100 && !atomic_load(&d.returned); i++) {
+        nanosleep(&(struct timespec){ .tv_nsec = 100 * 1000 * 1000 },
+                  NULL);
+    }
+    mu_check(atomic_load(&d.returned));
+    if (!atomic_load(&d.returned))
+        return;
+
+    pthread_join(server, NULL);
+    pthread_join(sender, NULL);
+    bs_daemon_free(d.daemon);
+    close(s.fd);
+    free(s.bin);
+}
@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../mutest.h"
+#include "diff.h"
+#include "langdef.h"
+#include "parsescript.h"
+
+static language_def difflang;
+
+// wait(5), hitbox(2 1), wait(7), wait(8)
+static const char diff_a[] = { 0x02, 0x00, 0x05, 0x01, 0x02, 0x01, 0x02,
+                               0x00, 0x07, 0x02, 0x00, 0x08, 0x00 };
+
+// wait(5), hitbox(9 1), wait(8), wait(6)
+static const char diff_b[] = { 0x02, 0x00, 0x05, 0x01, 0x09, 0x01, 0x02,
+                               0x00, 0x08, 0x02, 0x00, 0x06, 0x00 };
+
+int mu_init_diff() {
+    detailed_parse_error *e = parse_language_from_str(
+        &difflang, "meta\n"
+                   "    endianness big\n"
+                   "    namewidth 8\n"
+                   "    nameshift 0\n"
+                   "\n"
+                   "def 0x01 hitbox { uint8(dmg) int8(angle) }\n"
+                   "def 0x02 wait { uint16(frames) }\n"
+                   "def 0x03 flags { uint4(lo) uint4(hi) uint4(extra) }\n",
+        "difflang");
+    if (e != NULL) {
+        print_err(e);
+        free_err(e);
+        return 1;
+    }
+    lang_build_dispatch(&difflang);
+    return 0;
+}
+
+void mu_term_diff() { free_lang(&difflang); }
+
+void mu_test_diff_identical() {
+    bs_diff d;
+    mu_eq(int, BS_OK,
+          bs_diff_binaries(&d, &difflang, diff_a, sizeof(diff_a), diff_a,
+                           sizeof(diff_a), NULL_TERMINATED));
+    mu_eq(int, 0, d.entry_ct);
+    mu_eq(int, 4, d.unchanged_ct);
+    bs_diff_free(&d);
+
+    // the padding after the last field is not part of the statement
+    char a[] = { 0x03, 0x12, 0x30, 0x00 };
+    char b[] = { 0x03, 0x12, 0x3f, 0x00 };
+    mu_eq(int, BS_OK,
+          bs_diff_binaries(&d, &difflang, a, sizeof(a), b, sizeof(b),
+                           NULL_TERMINATED));
+    mu_eq(int, 0, d.entry_ct);
+    bs_diff_free(&d);
+}
+
+void mu_test_diff_edits() {
+    bs_diff d;
+    mu_eq(int, BS_OK,
+          bs_diff_binaries(&d, &difflang, diff_a, sizeof(diff_a), diff_b,
+                           sizeof(diff_b), NULL_TERMINATED));
+    mu_eq(int, 2, d.unchanged_ct);
+    mu_eq(int, 3, d.entry_ct);
+
+    mu_eq(int, BS_DIFF_CHANGE, d.entries[0].kind);
+    mu_eq(int, 1, d.entries[0].a_statement);
+    mu_eq(int, 1, d.entries[0].b_statement);
+    mu_eq(int, 1, d.entries[0].field_ct);
+    mu_eq(int, 0, d.fields[d.entries[0].first_field]);
+
+    mu_eq(int, BS_DIFF_DELETE, d.entries[1].kind);
+    mu_eq(int, 2, d.entries[1].a_statement);
+    mu_check(BS_DIFF_NONE == d.entries[1].b_statement);
+
+    mu_eq(int, BS_DIFF_INSERT, d.entries[2].kind);
+    mu_eq(int, 3, d.entries[2].b_statement);
+    bs_diff_free(&d);
+}
+
+void mu_test_diff_fields() {
+    // fields sharing a byte are told apart
+    char a[] = { 0x03, 0x12, 0x30, 0x00 };
+    char b[] = { 0x03, 0x12, 0x40, 0x00 };
+    char c[] = { 0x03, 0x22, 0x40, 0x00 };
+    bs_diff d;
+
+    mu_eq(int, BS_OK,
+          bs_diff_binaries(&d, &difflang, a, sizeof(a), b, sizeof(b),
+                           NULL_TERMINATED));
+    mu_eq(int, 1, d.entry_ct);
+    mu_eq(int, BS_DIFF_CHANGE, d.entries[0].kind);
+    mu_eq(int, 1, d.entries[0].field_ct);
+    mu_eq(int, 2, d.fields[d.entries[0].first_field]);
+    bs_diff_free(&d);
+
+    mu_eq(int, BS_OK,
+          bs_diff_binaries(&d, &difflang, a, sizeof(a), c, sizeof(c),
+                           NULL_TERMINATED));
+    mu_eq(int, 1, d.entry_ct);
+    mu_eq(int, 2, d.entries[0].field_ct);
+    mu_eq(int, 0, d.fields[d.entries[0].first_field]);
+    mu_eq(int, 2, d.fields[d.entries[0].first_field + 1]);
+    bs_diff_free(&d);
+}
+
+void mu_test_diff_print() {
+    bs_diff d;
+    mu_eq(int, BS_OK,
+          bs_diff_binaries(&d, &difflang, diff_a, sizeof(diff_a), diff_b,
+                           sizeof(diff_b), NULL_TERMINATED));
+
+    FILE *out = tmpfile();
+    bs_diff_print(&d, out);
+    char printed[256] = { 0 };
+    rewind(out);
+    mu_check(0 < fread(printed, 1, sizeof(printed) - 1, out));
+    fclose(out);
+
+    mu_check(0 == strcmp(printed, "~ a:1 b:1 hitbox dmg: 2 -> 9\n"
+                                  "- a:2 wait(7)\n"
+                                  "+ b:3 wait(6)\n"));
+    bs_diff_free(&d);
+}
+
+void mu_test_diff_many() {
+    // a long run of waits, with every third one changed, every fifth
+    // dropped and a hitbox after every seventh
+    size_t n = 600;
+    char *a = malloc(n * 3 + 1);
+    char *b = malloc(n * 6 + 1);
+    size_t a_len = 0, b_len = 0;
+    size_t changed = 0, dropped = 0, added = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        a[a_len++] = 0x02;
+        a[a_len++] = (char)(i >> 8);
+        a[a_len++] = (char)i;
+
+        if (i % 5 == 0) {
+            dropped++;
+        } else {
+            b[b_len++] = 0x02;
+            b[b_len++] = (char)(i % 3 == 0 ? i >> 8 | 0x40 : i >> 8);
+            b[b_len++] = (char)i;
+            changed += i % 3 == 0;
+        }
+        if (i % 7 == 0) {
+            b[b_len++] = 0x01;
+            b[b_len++] = 0x01;
+            b[b_len++] = 0x01;
+            added++;
+        }
+    }
+    a[a_len++] = 0;
+    b[b_len++] = 0;
+
+    bs_diff d;
+    mu_eq(int, BS_OK,
+          bs_diff_binaries(&d, &difflang, a, a_len, b, b_len,
+                           NULL_TERMINATED));
+
+    // every statement of each binary is accounted for exactly once
+    size_t deletes = 0, inserts = 0, changes = 0;
+    for (size_t i = 0; i < d.entry_ct; i++) {
+        deletes += d.entries[i].kind == BS_DIFF_DELETE;
+        inserts += d.entries[i].kind == BS_DIFF_INSERT;
+        changes += d.entries[i].kind == BS_DIFF_CHANGE;
+    }
+    mu_eq(int, n, d.unchanged_ct + deletes + changes);
+    mu_eq(int, n - dropped + added, d.unchanged_ct + inserts + changes);
+    mu_eq(int, n - dropped - changed, d.unchanged_ct);
+    bs_diff_free(&d);
+
+    free(a);
+    free(b);
+}
+
+void mu_test_diff_disjoint() {
+    // binaries with no statement in common are more edits than the search
+    // takes, so both end up in one hunk where no delete pairs up
+    size_t n = 40000;
+    char *a = malloc(n * 3 + 1);
+    char *b = malloc(n * 3 + 1);
+    for (size_t i = 0; i < n; i++) {
+        a[i * 3] = 0x01;
+        a[i * 3 + 1] = (char)i;
+        a[i * 3 + 2] = (char)(i >> 8);
+        b[i * 3] = 0x02;
+        b[i * 3 + 1] = (char)(i >> 8);
+        b[i * 3 + 2] = (char)i;
+    }
+    a[n * 3] = 0;
+    b[n * 3] = 0;
+
+    bs_diff d;
+    mu_eq(int, BS_OK,
+          bs_diff_binaries(&d, &difflang, a, n * 3 + 1, b, n * 3 + 1,
+                           NULL_TERMINATED));
+    mu_eq(int, 2 * n, d.entry_ct);
+    mu_eq(int, 0, d.unchanged_ct);
+    mu_eq(int, BS_DIFF_DELETE, d.entries[0].kind);
+    mu_eq(int, BS_DIFF_DELETE, d.entries[n - 1].kind);
+    mu_eq(int, BS_DIFF_INSERT, d.entries[n].kind);
+    mu_eq(int, n - 1, d.entries[2 * n - 1].b_statement);
+    bs_diff_free(&d);
+
+    // and the same with every statement of `a` changed in `b`, which
+    // pairs every delete with the insert that replaced it
+    for (size_t i = 0; i < n; i++) {
+        b[i * 3] = 0x01;
+        b[i * 3 + 1] = (char)(i + 1);
+    }
+    mu_eq(int, BS_OK,
+          bs_diff_binaries(&d, &difflang, a, n * 3 + 1, b, n * 3 + 1,
+                           NULL_TERMINATED));
+    size_t changes = 0;
+    for (size_t i = 0; i < d.entry_ct; i++) {
+        changes += d.entries[i].kind == BS_DIFF_CHANGE;
+    }
+    mu_eq(int, n, changes + d.unchanged_ct);
+    bs_diff_free(&d);
+
+    free(a);
+    free(b);
+}
+
+void mu_test_diff_print_undecodable() {
+    // the index only measures widths, so a float16 that cannot be
+    // decoded still shows up as a change
+    language_def l;
+    detailed_parse_error *err = parse_language_from_str(
+        &l, "meta\n"
+            "    endianness big\n"
+            "    namewidth 8\n"
+            "    nameshift 0\n"
+            "\n"
+            "def 0x01 half { uint8(id) float16(value) }\n",
+        "halflang");
+    mu_check(err == NULL);
+    lang_build_dispatch(&l);
+
+    char a[] = { 0x01, 0x01, 0x3c, 0x00, 0x00 };
+    char b[] = { 0x01, 0x01, 0x40, 0x00, 0x00 };
+    bs_diff d;
+    mu_eq(int, BS_OK,
+          bs_diff_binaries(&d, &l, a, sizeof(a), b, sizeof(b),
+                           NULL_TERMINATED));
+    mu_eq(int, 1, d.entry_ct);
+    mu_eq(int, BS_DIFF_CHANGE, d.entries[0].kind);
+
+    FILE *out = tmpfile();
+    bs_diff_print(&d, out);
+    char printed[256] = { 0 };
+    rewind(out);
+    mu_check(0 < fread(printed, 1, sizeof(printed) - 1, out));
+    fclose(out);
+
+    mu_check(0 == strcmp(printed,
+                         "~ a:0 b:0 <half: BS_BAD_FLOAT_WIDTH>"
+                         "<half: BS_BAD_FLOAT_WIDTH>\n"));
+    bs_diff_free(&d);
+    free_lang(&l);
+}
+
+void mu_test_diff_bad_input() {
+    char unknown[] = { 0x02, 0x00, 0x01, 0x09, 0x00 };
+    bs_diff d;
+
+    mu_eq(int, BS_UNKNOWN_OPCODE,
+          bs_diff_binaries(&d, &difflang, diff_a, sizeof(diff_a), unknown,
+                           sizeof(unknown), NULL_TERMINATED));
+    mu_check(d.error_in_b);
+    mu_eq(int, 3, d.error_offset);
+    bs_diff_free(&d);
+}
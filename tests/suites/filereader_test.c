@@ -0,0 +1,141 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../mutest.h"
+#include "filereader.h"
+#include "workpool.h"
+
+#define FILEREADER_TEST_FILES 48
+
+static char *reader_paths[FILEREADER_TEST_FILES];
+
+// the size of each test file: empty, small, and some larger than a
+// read chunk. The last file is never written.
+static size_t test_file_size(size_t i) {
+    if (i % 16 == 3)
+        return 300 * 1024 + i;
+    return i % 5 == 0 ? 0 : i * 37;
+}
+
+static char test_file_byte(size_t i, size_t offset) {
+    return (char)('a' + (i + offset) % 26);
+}
+
+int mu_init_filereader() {
+    for (size_t i = 0; i < FILEREADER_TEST_FILES; i++) {
+        reader_paths[i] = malloc(64);
+        sprintf(reader_paths[i], "filereader_test_%zu.bin", i);
+        if (i == FILEREADER_TEST_FILES - 1)
+            continue;
+
+        FILE *f = fopen(reader_paths[i], "wb");
+        if (f == NULL)
+            return 1;
+        for (size_t j = 0; j < test_file_size(i); j++) {
+            fputc(test_file_byte(i, j), f);
+        }
+        fclose(f);
+    }
+    return 0;
+}
+
+void mu_term_filereader() {
+    for (size_t i = 0; i < FILEREADER_TEST_FILES; i++) {
+        remove(reader_paths[i]);
+        free(reader_paths[i]);
+    }
+}
+
+typedef struct reader_test {
+    bs_file_reader *reader;
+    unsigned int seen[FILEREADER_TEST_FILES];
+    bool intact[FILEREADER_TEST_FILES];
+    int sys_errno[FILEREADER_TEST_FILES];
+} reader_test;
+
+// takes one file from the reader and checks it, like a batch worker
+static void take_file(void *ctx, size_t item, unsigned int worker) {
+    reader_test *t = ctx;
+    (void)item;
+    (void)worker;
+
+    bs_read *read = bs_file_reader_next(t->reader);
+    if (read == NULL)
+        return;
+    size_t i = read->item;
+    bool intact = read->len == test_file_size(i) && read->data != NULL &&
+                  read->data[read->len] == '\0';
+    for (size_t j = 0; intact && j < read->len; j++) {
+        intact = read->data[j] == test_file_byte(i, j);
+    }
+    t->seen[i]++;
+    t->intact[i] = intact;
+    t->sys_errno[i] = read->sys_errno;
+    bs_file_reader_release(t->reader, read);
+}
+
+static void check_backend(bs_read_backend backend, unsigned int depth,
+                          unsigned int threads) {
+    reader_test *t = calloc(1, sizeof(reader_test));
+    t->reader = bs_file_reader_start((const char *const *)reader_paths,
+                                     FILEREADER_TEST_FILES, depth, backend);
+    if (t->reader == NULL) {
+        // io_uring can be missing or forbidden, threads cannot
+        mu_check(backend == BS_READ_IO_URING);
+        free(t);
+        return;
+    }
+    mu_check(bs_file_reader_backend(t->reader) != BS_READ_AUTO);
+    if (backend != BS_READ_AUTO)
+        mu_eq(int, backend, bs_file_reader_backend(t->reader));
+
+    workpool_run(threads, FILEREADER_TEST_FILES, take_file, t);
+    mu_check(bs_file_reader_next(t->reader) == NULL);
+    bs_file_reader_free(t->reader);
+
+    for (size_t i = 0; i < FILEREADER_TEST_FILES - 1; i++) {
+        mu_eq(int, 1, t->seen[i]);
+        mu_check(t->intact[i]);
+        mu_eq(int, 0, t->sys_errno[i]);
+    }
+    mu_eq(int, 1, t->seen[FILEREADER_TEST_FILES - 1]);
+    mu_eq(int, ENOENT, t->sys_errno[FILEREADER_TEST_FILES - 1]);
+    free(t);
+}
+
+void mu_test_filereader_threads() {
+    check_backend(BS_READ_THREADS, 8, 4);
+    // fewer slots than consumers, and a single slot
+    check_backend(BS_READ_THREADS, 2, 6);
+    check_backend(BS_READ_THREADS, 1, 1);
+}
+
+void mu_test_filereader_io_uring() {
+    check_backend(BS_READ_IO_URING, 8, 4);
+    check_backend(BS_READ_IO_URING, 2, 6);
+    check_backend(BS_READ_IO_URING, 1, 1);
+    check_backend(BS_READ_AUTO, 0, 4);
+}
+
+void mu_test_filereader_stop_early() {
+    bs_read_backend backends[] = { BS_READ_THREADS, BS_READ_AUTO };
+    for (size_t b = 0; b < 2; b++) {
+        // freeing a reader with reads in flight and taken
+        bs_file_reader *r = bs_file_reader_start(
+            (const char *const *)reader_paths, FILEREADER_TEST_FILES, 4,
+            backends[b]);
+        mu_check(r != NULL);
+        bs_read *read = bs_file_reader_next(r);
+        mu_check(read != NULL);
+        bs_file_reader_free(r);
+    }
+
+    // nothing to read
+    bs_file_reader *r = bs_file_reader_start(NULL, 0, 4, BS_READ_AUTO);
+    mu_check(r != NULL);
+    mu_check(bs_file_reader_next(r) == NULL);
+    bs_file_reader_free(r);
+}
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../mutest.h"
+#include "convert.h"
+#include "incremental.h"
+#include "langdef.h"
+#include "parsescript.h"
+
+static language_def inclang;
+
+int mu_init_incremental() {
+    detailed_parse_error *e = parse_language_from_str(
+        &inclang, "meta\n"
+                  "    endianness big\n"
+                  "    namewidth 8\n"
+                  "    nameshift 0\n"
+                  "\n"
+                  "def 0x01 hitbox { uint8(dmg) int8(angle) }\n"
+                  "def 0x02 wait { uint16(frames) }\n"
+                  "def 0x03 flag { uint4(value) }\n",
+        "inclang");
+    if (e != NULL) {
+        print_err(e);
+        free_err(e);
+        return 1;
+    }
+    return 0;
+}
+
+void mu_term_incremental() { free_lang(&inclang); }
+
+// checks an incremental build against converting the whole script
+static int matches_full_build(bs_incremental *inc, const char *script) {
+    bs_buffer full;
+    bs_buffer_init(&full);
+    char *text = strdup(script);
+    binscript_error e = binscript_convert(&inclang, SCRIPT2BIN, inc->endmode,
+                                          text, strlen(text), &full, NULL);
+    int same = e == BS_OK && full.len == inc->out.len &&
+               0 == memcmp(full.data, inc->out.data, full.len);
+    free(text);
+    bs_buffer_free(&full);
+    return same;
+}
+
+static binscript_error update(bs_incremental *inc, const char *script) {
+    return bs_incremental_update(inc, script, strlen(script), NULL);
+}
+
+void mu_test_incremental_edits() {
+    const char *scripts[] = {
+        "wait(1)\nhitbox(2 3)\nwait(4)\nflag(5)\n",
+        // same width
+        "wait(1)\nhitbox(9 3)\nwait(4)\nflag(5)\n",
+        // wider, then narrower
+        "wait(1)\nhitbox(9 3)\nhitbox(7 7)\nflag(5)\n",
+        "wait(1)\nflag(2)\nhitbox(7 7)\nflag(5)\n",
+        // inserted at either end
+        "flag(0)\nwait(1)\nflag(2)\nhitbox(7 7)\nflag(5)\n",
+        "flag(0)\nwait(1)\nflag(2)\nhitbox(7 7)\nflag(5)\nwait(6)\n",
+        // removed
+        "flag(0)\nwait(1)\nhitbox(7 7)\nflag(5)\nwait(6)\n",
+        "",
+    };
+    size_t reparsed[] = { 4, 1, 1, 1, 1, 1, 0, 0 };
+
+    bs_incremental inc;
+    bs_incremental_init(&inc, &inclang, NULL_TERMINATED);
+    for (size_t i = 0; i < sizeof(scripts) / sizeof(scripts[0]); i++) {
+        mu_eq(int, BS_OK, update(&inc, scripts[i]));
+        mu_eq(int, reparsed[i], inc.reparsed_ct);
+        mu_check(matches_full_build(&inc, scripts[i]));
+    }
+    mu_eq(int, 1, inc.out.len);
+    bs_incremental_free(&inc);
+}
+
+void mu_test_incremental_spans() {
+    bs_incremental inc;
+    bs_incremental_init(&inc, &inclang, MANUAL_CUTOFF);
+
+    // indented lines, comments and blank lines belong to the statement
+    // above them
+    const char *script = "; header\n"
+                         "wait(1)\n"
+                         "\n"
+                         "hitbox\n"
+                         "    2\n"
+                         "    3\n"
+                         "; trailing\n"
+                         "flag(4)";
+    mu_eq(int, BS_OK, update(&inc, script));
+    mu_eq(int, 3, inc.span_ct);
+    mu_eq(int, 9, inc.spans[0].text_offset);
+    mu_eq(int, 9, inc.spans[0].text_len);
+    mu_eq(int, 18, inc.spans[1].text_offset);
+    mu_eq(int, 30, inc.spans[1].text_len);
+    mu_eq(int, 0, inc.spans[0].out_offset);
+    mu_eq(int, 3, inc.spans[1].out_offset);
+    mu_eq(int, 3, inc.spans[1].out_len);
+    mu_eq(int, 6, inc.spans[2].out_offset);
+    mu_eq(int, 2, inc.spans[2].out_len);
+    mu_check(matches_full_build(&inc, script));
+
+    // editing the comment only touches its statement
+    const char *edited = "; header\n"
+                         "wait(1)\n"
+                         "\n"
+                         "hitbox\n"
+                         "    2\n"
+                         "    3\n"
+                         "; edited\n"
+                         "flag(4)";
+    mu_eq(int, BS_OK, update(&inc, edited));
+    mu_eq(int, 1, inc.reparsed_ct);
+    mu_check(matches_full_build(&inc, edited));
+
+    bs_incremental_free(&inc);
+}
+
+void mu_test_incremental_errors() {
+    bs_incremental inc;
+    bs_incremental_init(&inc, &inclang, NULL_TERMINATED);
+    const char *good = "wait(1)\nhitbox(2 3)\nflag(4)\n";
+    mu_eq(int, BS_OK, update(&inc, good));
+
+    size_t statement = 0;
+    const char *bad = "wait(1)\nhitbox(2 3)\nnope(4)\n";
+    mu_eq(int, BS_BAD_SCRIPT,
+          bs_incremental_update(&inc, bad, strlen(bad), &statement));
+    mu_eq(int, 2, statement);
+
+    // the failed update changed nothing
+    mu_check(matches_full_build(&inc, good));
+    mu_eq(int, 3, inc.span_ct);
+
+    const char *fixed = "wait(1)\nhitbox(2 3)\nflag(5)\n";
+    mu_eq(int, BS_OK, update(&inc, fixed));
+    mu_eq(int, 1, inc.reparsed_ct);
+    mu_check(matches_full_build(&inc, fixed));
+
+    bs_incremental_free(&inc);
+}
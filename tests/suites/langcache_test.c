@@ -0,0 +1,156 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "../mutest.h"
+#include "langcache.h"
+#include "langdef.h"
+#include "parsescript.h"
+
+#define LANGCACHE_TEST_PATH "langcache_test.bslc"
+
+static char *cache_test_source = "meta\n"
+                                 "    endianness big\n"
+                                 "    namewidth 6\n"
+                                 "    nameshift 2\n"
+                                 "\n"
+                                 "def 0x10 graphic {\n"
+                                 "    skip6 int4(gfx) skip4\n"
+                                 "    int4(zoff) int4(yoff) int4(xoff)\n"
+                                 "}\n"
+                                 "\n"
+                                 "def 0x08 test {\n"
+                                 "    skip2 uint32(intarg) float32(floatarg)\n"
+                                 "}\n"
+                                 "\n"
+                                 "def 0x0c empty\n"
+                                 "\n"
+                                 "flow test call intarg relative\n"
+                                 "flow empty return\n";
+
+static bool langs_equal(language_def *a, language_def *b) {
+    if (a->target_endianness != b->target_endianness ||
+        a->function_name_width != b->function_name_width ||
+        a->function_name_bitshift != b->function_name_bitshift ||
+        a->byte_aligned_functions != b->byte_aligned_functions ||
+        a->function_ct != b->function_ct || a->flow_ct != b->flow_ct)
+        return false;
+
+    for (unsigned int i = 0; i < a->flow_ct; i++) {
+        bs_flow_rule *ra = &a->flow[i], *rb = &b->flow[i];
+        if (ra->function_binary_value != rb->function_binary_value ||
+            ra->kind != rb->kind || ra->target_arg != rb->target_arg ||
+            ra->relative != rb->relative)
+            return false;
+    }
+
+    for (unsigned int i = 0; i < a->function_ct; i++) {
+        function_def *fa = a->functions[i], *fb = b->functions[i];
+        if (fa->function_binary_value != fb->function_binary_value ||
+            fa->argc != fb->argc || 0 != strcmp(fa->name, fb->name))
+            return false;
+
+        for (unsigned int j = 0; j < fa->argc; j++) {
+            argument_def *aa = fa->arguments[j], *ab = fb->arguments[j];
+            if (aa->type != ab->type || aa->bitwidth != ab->bitwidth ||
+                (aa->name == NULL) != (ab->name == NULL) ||
+                (aa->name != NULL && 0 != strcmp(aa->name, ab->name)))
+                return false;
+        }
+    }
+    return true;
+}
+
+void mu_test_lang_source_hash() {
+    mu_check(lang_source_hash("", 0) == 0xcbf29ce484222325ULL);
+    mu_check(lang_source_hash("a", 1) == 0xaf63dc4c8601ec8cULL);
+    mu_check(lang_source_hash("def 0x08 a", 10) !=
+             lang_source_hash("def 0x0c a", 10));
+}
+
+void mu_test_lang_cache_roundtrip() {
+    language_def parsed, cached;
+    detailed_parse_error *e =
+        parse_language_from_str(&parsed, cache_test_source, "cache_test");
+    mu_check(e == NULL);
+    free_err(e);
+
+    uint64_t hash =
+        lang_source_hash(cache_test_source, strlen(cache_test_source));
+
+    remove(LANGCACHE_TEST_PATH);
+    mu_check(!lang_cache_load(&cached, hash, LANGCACHE_TEST_PATH));
+    mu_check(lang_cache_write(&parsed, hash, LANGCACHE_TEST_PATH));
+
+    // a cache keyed by a different source hash is rejected
+    mu_check(!lang_cache_load(&cached, hash + 1, LANGCACHE_TEST_PATH));
+
+    mu_check(lang_cache_load(&cached, hash, LANGCACHE_TEST_PATH));
+    mu_check(cached.cache_map != NULL);
+    mu_check(langs_equal(&parsed, &cached));
+    mu_check(cached.finalized);
+    mu_eq(int, 2, cached.flow_ct);
+    mu_check(lang_getfn(&cached, 0x08 >> 2) ==
+             lang_getfnbyname(&cached, "test"));
+
+    free_lang(&cached);
+    free_lang(&parsed);
+    remove(LANGCACHE_TEST_PATH);
+}
+
+void mu_test_lang_cache_truncated() {
+    language_def parsed, cached;
+    detailed_parse_error *e =
+        parse_language_from_str(&parsed, cache_test_source, "cache_test");
+    mu_check(e == NULL);
+    free_err(e);
+
+    mu_check(lang_cache_write(&parsed, 1, LANGCACHE_TEST_PATH));
+
+    // chop the string table off the end of the cache
+    FILE *f = fopen(LANGCACHE_TEST_PATH, "rb");
+    char contents[4096];
+    size_t len = fread(contents, 1, sizeof(contents), f);
+    fclose(f);
+
+    f = fopen(LANGCACHE_TEST_PATH, "wb");
+    fwrite(contents, 1, len - 4, f);
+    fclose(f);
+
+    mu_check(!lang_cache_load(&cached, 1, LANGCACHE_TEST_PATH));
+
+    free_lang(&parsed);
+    remove(LANGCACHE_TEST_PATH);
+}
+
+void mu_test_parse_language_cached() {
+    FILE *f = fopen("./tests/languages/melee.langdef", "r");
+    language_def first, second, reference;
+
+    remove(LANGCACHE_TEST_PATH);
+
+    // first load misses the cache and writes it
+    detailed_parse_error *e =
+        parse_language_cached(&first, f, "melee.langdef", LANGCACHE_TEST_PATH);
+    mu_check(e == NULL);
+    mu_check(first.cache_map == NULL);
+
+    // second load comes from the cache
+    rewind(f);
+    e = parse_language_cached(&second, f, "melee.langdef",
+                              LANGCACHE_TEST_PATH);
+    mu_check(e == NULL);
+    mu_check(second.cache_map != NULL);
+
+    rewind(f);
+    e = parse_language_from_file(&reference, f, "melee.langdef");
+    mu_check(e == NULL);
+    fclose(f);
+
+    mu_check(langs_equal(&reference, &second));
+
+    free_lang(&first);
+    free_lang(&second);
+    free_lang(&reference);
+    remove(LANGCACHE_TEST_PATH);
+}
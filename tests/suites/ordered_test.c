@@ -0,0 +1,265 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../mutest.h"
+#include "convert.h"
+#include "langdef.h"
+#include "ordered.h"
+#include "parsescript.h"
+
+#define ORDERED_TEST_FILE "ordered_test.txt"
+#define ORDERED_TEST_CHUNKS 2000
+#define ORDERED_TEST_THREADS 4
+// enough statements for several chunks of binscript_convert_parallel
+#define ORDERED_TEST_ROUNDS 4000
+
+static language_def orderedlang;
+
+int mu_init_ordered() {
+    detailed_parse_error *e = parse_language_from_str(
+        &orderedlang, "meta\n"
+                      "    endianness big\n"
+                      "    namewidth 8\n"
+                      "    nameshift 0\n"
+                      "\n"
+                      "def 0x01 hitbox { uint8(dmg) int8(angle) }\n"
+                      "def 0x02 wait { uint16(frames) }\n"
+                      "def 0x03 name { str16(text) }\n"
+                      "def 0x04 blob { raw_str800(data) }\n",
+        "orderedlang");
+    if (e != NULL) {
+        print_err(e);
+        free_err(e);
+        return 1;
+    }
+    lang_build_dispatch(&orderedlang);
+    return 0;
+}
+
+void mu_term_ordered() { free_lang(&orderedlang); }
+
+// reads back the whole of the test file
+static void read_test_file(bs_buffer *out) {
+    FILE *f = fopen(ORDERED_TEST_FILE, "rb");
+    size_t got;
+    bs_buffer_clear(out);
+    do {
+        bs_buffer_reserve(out, 4096);
+        got = fread(out->data + out->len, 1, out->capacity - out->len, f);
+        out->len += got;
+    } while (got > 0);
+    fclose(f);
+}
+
+// compares the test file's contents with the text expected, which may
+// be empty (and then NULL)
+static bool same_text(const char *expected, size_t len, bs_buffer *got) {
+    return got->len == len &&
+           (len == 0 || 0 == memcmp(expected, got->data, len));
+}
+
+static void format_chunk(bs_buffer *out, size_t seq) {
+    bs_buffer_reserve(out, 32);
+    out->len += sprintf(out->data + out->len, "chunk %zu\n", seq);
+}
+
+typedef struct ordered_producer {
+    bs_ordered *o;
+    unsigned int index;
+} ordered_producer;
+
+// submits every ORDERED_TEST_THREADS'th chunk, so that the producers
+// race each other to the writer
+static void *produce(void *arg) {
+    ordered_producer *p = arg;
+    bs_buffer out;
+    bs_buffer_init(&out);
+    for (size_t seq = p->index; seq < ORDERED_TEST_CHUNKS;
+         seq += ORDERED_TEST_THREADS) {
+        format_chunk(&out, seq);
+        bs_ordered_submit(p->o, seq, &out);
+    }
+    bs_buffer_free(&out);
+    return NULL;
+}
+
+void mu_test_ordered_merges_in_order() {
+    bs_buffer expected, got;
+    bs_buffer_init(&expected);
+    bs_buffer_init(&got);
+    for (size_t seq = 0; seq < ORDERED_TEST_CHUNKS; seq++) {
+        format_chunk(&expected, seq);
+    }
+
+    // from the smallest window, where producers wait on each other, up
+    // to one that holds every chunk
+    unsigned int windows[] = { 1, 3, 64, ORDERED_TEST_CHUNKS };
+    for (size_t i = 0; i < sizeof(windows) / sizeof(windows[0]); i++) {
+        int fd = open(ORDERED_TEST_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        bs_ordered *o = bs_ordered_start(fd, windows[i]);
+        mu_check(o != NULL);
+
+        pthread_t threads[ORDERED_TEST_THREADS];
+        ordered_producer producers[ORDERED_TEST_THREADS];
+        for (unsigned int t = 0; t < ORDERED_TEST_THREADS; t++) {
+            producers[t] = (ordered_producer){ o, t };
+            pthread_create(&threads[t], NULL, produce, &producers[t]);
+        }
+        for (unsigned int t = 0; t < ORDERED_TEST_THREADS; t++) {
+            pthread_join(threads[t], NULL);
+        }
+        mu_eq(int, 0, bs_ordered_finish(o, ORDERED_TEST_CHUNKS));
+        close(fd);
+
+        read_test_file(&got);
+        mu_eq(int, expected.len, got.len);
+        mu_check(same_text(expected.data, expected.len, &got));
+    }
+
+    bs_buffer_free(&expected);
+    bs_buffer_free(&got);
+    remove(ORDERED_TEST_FILE);
+}
+
+void mu_test_ordered_stop_and_errors() {
+    bs_buffer out, got;
+    bs_buffer_init(&out);
+    bs_buffer_init(&got);
+
+    // chunks after the stop are dropped, even when submitted first
+    int fd = open(ORDERED_TEST_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    bs_ordered *o = bs_ordered_start(fd, 8);
+    for (size_t seq = 5; seq > 2; seq--) {
+        format_chunk(&out, seq);
+        bs_ordered_submit(o, seq - 1, &out);
+    }
+    bs_ordered_stop_after(o, 1);
+    bs_ordered_stop_after(o, 3);
+    format_chunk(&out, 1);
+    bs_ordered_submit(o, 1, &out);
+    format_chunk(&out, 0);
+    bs_ordered_submit(o, 0, &out);
+    mu_eq(int, 0, bs_ordered_finish(o, 5));
+    close(fd);
+
+    read_test_file(&got);
+    char *expected = "chunk 0\nchunk 1\n";
+    mu_eq(int, strlen(expected), got.len);
+    mu_check(same_text(expected, strlen(expected), &got));
+
+    // a failed write stops the output
+    fd = open(ORDERED_TEST_FILE, O_RDONLY);
+    o = bs_ordered_start(fd, 0);
+    for (size_t seq = 0; seq < 3; seq++) {
+        format_chunk(&out, seq);
+        bs_ordered_submit(o, seq, &out);
+    }
+    mu_eq(int, EBADF, bs_ordered_finish(o, 3));
+    close(fd);
+
+    // and finishing without chunks
+    o = bs_ordered_start(-1, 0);
+    mu_eq(int, 0, bs_ordered_finish(o, 0));
+
+    bs_buffer_free(&out);
+    bs_buffer_free(&got);
+    remove(ORDERED_TEST_FILE);
+}
+
+// builds rounds of statements of 3, 3, 3 and 101 bytes
+static void build_binary(bs_buffer *bin, size_t rounds, bool terminated) {
+    bs_buffer_clear(bin);
+    for (size_t i = 0; i < rounds; i++) {
+        char statements[] = { 0x01, (char)i, (char)-i, //
+                              0x02, (char)(i >> 8), (char)i,
+                              0x03, (char)('a' + i % 26), 'z' };
+        bs_buffer_reserve(bin, sizeof(statements) + 101);
+        memcpy(bin->data + bin->len, statements, sizeof(statements));
+        bin->len += sizeof(statements);
+
+        bin->data[bin->len++] = 0x04;
+        for (size_t j = 0; j < 100; j++) {
+            bin->data[bin->len++] = (char)((i + j) & 0xff);
+        }
+    }
+    if (terminated) {
+        bs_buffer_reserve(bin, 1);
+        bin->data[bin->len++] = 0x00;
+    }
+}
+
+// checks that converting on several threads gives the same text, error
+// and error offset as converting on one
+static void check_parallel(bs_buffer *bin, binscript_endmode endmode) {
+    bs_buffer expected, got;
+    bs_buffer_init(&expected);
+    bs_buffer_init(&got);
+    size_t expected_offset = 0;
+    binscript_error expected_error =
+        binscript_convert(&orderedlang, BIN2SCRIPT, endmode, bin->data,
+                          bin->len, &expected, &expected_offset);
+
+    unsigned int threads[] = { 1, 2, ORDERED_TEST_THREADS, 0 };
+    for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+        int fd = open(ORDERED_TEST_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        size_t offset = 0;
+        mu_eq(int, expected_error,
+              binscript_convert_parallel(&orderedlang, endmode, bin->data,
+                                         bin->len, threads[i], fd, &offset));
+        close(fd);
+        mu_eq(int, expected_offset, offset);
+
+        read_test_file(&got);
+        mu_eq(int, expected.len, got.len);
+        mu_check(same_text(expected.data, expected.len, &got));
+    }
+
+    bs_buffer_free(&expected);
+    bs_buffer_free(&got);
+}
+
+void mu_test_ordered_convert_parallel() {
+    bs_buffer bin;
+    bs_buffer_init(&bin);
+
+    build_binary(&bin, ORDERED_TEST_ROUNDS, true);
+    mu_check(bin.len > 4 * 64 * 1024);
+    check_parallel(&bin, NULL_TERMINATED);
+    check_parallel(&bin, MANUAL_CUTOFF);
+
+    // an empty binary, and one too short for a single chunk
+    build_binary(&bin, 0, true);
+    check_parallel(&bin, NULL_TERMINATED);
+    build_binary(&bin, 3, true);
+    check_parallel(&bin, NULL_TERMINATED);
+
+    bs_buffer_free(&bin);
+    remove(ORDERED_TEST_FILE);
+}
+
+void mu_test_ordered_convert_parallel_errors() {
+    bs_buffer bin;
+    bs_buffer_init(&bin);
+
+    // no terminator
+    build_binary(&bin, ORDERED_TEST_ROUNDS, false);
+    check_parallel(&bin, NULL_TERMINATED);
+
+    // an unknown opcode a few chunks in
+    build_binary(&bin, ORDERED_TEST_ROUNDS, true);
+    bin.data[3 * 104 * 1000] = 0x09;
+    check_parallel(&bin, NULL_TERMINATED);
+
+    // a statement cut short
+    build_binary(&bin, ORDERED_TEST_ROUNDS, false);
+    bin.len -= 50;
+    check_parallel(&bin, MANUAL_CUTOFF);
+
+    bs_buffer_free(&bin);
+    remove(ORDERED_TEST_FILE);
+}
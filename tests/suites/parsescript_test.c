@@ -153,6 +153,7 @@ bool test_fndef(function_def *expected, const char *str) {
     language.function_capacity = 0;
     language.functions = NULL;
     language.byte_aligned_functions = false;
+    language.alloc = NULL;
 
     // parse the sweet expression string to a function def
     swexp_list_node *swexp_list =
@@ -189,6 +190,7 @@ detailed_parse_error *test_parse(function_def *out, const char *str) {
     lang.function_ct = 0;
     lang.function_capacity = 0;
     lang.functions = NULL;
+    lang.alloc = NULL;
 
     // parse the sweet expression string to a function def
     swexp_list_node *swexp_list =
@@ -502,3 +504,46 @@ void mu_test_parse_language_from_str() {
 
     _free_lang(&lang, false);
 }
+
+void mu_test_lang_finalize() {
+    language_def lang;
+    detailed_parse_error *e =
+        parse_language_from_str(&lang, "meta\n"
+                                       "    namewidth 8\n"
+                                       "\n"
+                                       "def 0x10 second { uint8(a) }\n"
+                                       "def 0x04 first { uint8(b) skip8 }\n"
+                                       "def 0x10 shadowed { uint16(c) }\n"
+                                       "def 0x20 third\n",
+                                "<anon:test_finalize>");
+    mu_check(e == NULL);
+    free_err(e);
+
+    mu_check(lang.finalized);
+    mu_check(lang.arena != NULL);
+    mu_eq(int, 4, lang.function_ct);
+
+    // functions are sorted by binary value, keeping definition order
+    // between functions with the same value
+    mu_check(0 == strcmp("first", lang.functions[0]->name));
+    mu_check(0 == strcmp("second", lang.functions[1]->name));
+    mu_check(0 == strcmp("shadowed", lang.functions[2]->name));
+    mu_check(0 == strcmp("third", lang.functions[3]->name));
+
+    // arguments are laid out inline in the same order
+    mu_check(lang.functions[0]->arguments[1] ==
+             lang.functions[0]->arguments[0] + 1);
+    mu_check(lang.functions[1]->arguments[0] ==
+             lang.functions[0]->arguments[1] + 1);
+    mu_check(0 == strcmp("b", lang.functions[0]->arguments[0]->name));
+    mu_check(NULL == lang.functions[0]->arguments[1]->name);
+    mu_check(NULL == lang.functions[3]->arguments);
+
+    // lookups on duplicate values match the first definition
+    mu_check(lang_getfn(&lang, 0x10) == lang.functions[1]);
+    mu_check(lang_getfn(&lang, 0x20) == lang.functions[3]);
+    mu_check(lang_getfn(&lang, 0x08) == NULL);
+    mu_check(lang_getfn(&lang, 0x30) == NULL);
+
+    free_lang(&lang);
+}
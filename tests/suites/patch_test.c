@@ -0,0 +1,201 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../mutest.h"
+#include "langdef.h"
+#include "parsescript.h"
+#include "patch.h"
+
+#define PATCH_TEST_FILE "patch_test.bin"
+
+static language_def patchlang;
+
+// hitbox(0 1 2 1.0), wait(5), hitbox(1 -3 4 2.0), hitbox(2 0 15 0.0)
+static const char patch_input[] = {
+    0x01, 0x00, 0x12, 0x3f, 0x80, 0x00, 0x00, //
+    0x02, 0x00, 0x05,                         //
+    0x01, 0x01, 0xb4, 0x40, 0x00, 0x00, 0x00, //
+    0x01, 0x02, 0x0f, 0x00, 0x00, 0x00, 0x00, //
+    0x00
+};
+
+int mu_init_patch() {
+    detailed_parse_error *e = parse_language_from_str(
+        &patchlang, "meta\n"
+                    "    endianness big\n"
+                    "    namewidth 8\n"
+                    "    nameshift 0\n"
+                    "\n"
+                    "def 0x01 hitbox {\n"
+                    "    uint8(id) int4(angle) uint4(dmg) float32(kb)\n"
+                    "}\n"
+                    "def 0x02 wait { uint16(frames) }\n",
+        "patchlang");
+    if (e != NULL) {
+        print_err(e);
+        free_err(e);
+        return 1;
+    }
+    return 0;
+}
+
+void mu_term_patch() { free_lang(&patchlang); }
+
+void mu_test_patch_index() {
+    function_def *hitbox = lang_getfnbyname(&patchlang, "hitbox");
+    function_def *wait = lang_getfnbyname(&patchlang, "wait");
+    bs_index index;
+
+    mu_eq(int, BS_OK,
+          bs_index_build(&index, &patchlang, patch_input, sizeof(patch_input),
+                         NULL_TERMINATED, NULL));
+    mu_eq(int, 4, index.statement_ct);
+    mu_eq(int, 3, bs_index_count(&index, hitbox));
+    mu_eq(int, 1, bs_index_count(&index, wait));
+
+    mu_eq(int, 0, bs_index_nth(&index, hitbox, 0)->offset);
+    mu_eq(int, 10, bs_index_nth(&index, hitbox, 1)->offset);
+    mu_eq(int, 17, bs_index_nth(&index, hitbox, 2)->offset);
+    mu_check(bs_index_nth(&index, hitbox, 3) == NULL);
+    mu_eq(int, 7, bs_index_nth(&index, wait, 0)->offset);
+    mu_check(bs_index_nth(&index, wait, 0)->fn == wait);
+    bs_index_free(&index);
+
+    // the same through a dispatch table
+    lang_build_dispatch(&patchlang);
+    mu_eq(int, BS_OK,
+          bs_index_build(&index, &patchlang, patch_input, sizeof(patch_input),
+                         NULL_TERMINATED, NULL));
+    mu_eq(int, 17, bs_index_nth(&index, hitbox, 2)->offset);
+    bs_index_free(&index);
+
+    size_t offset = 0;
+    char unknown[] = { 0x02, 0x00, 0x05, 0x07, 0x00 };
+    mu_eq(int, BS_UNKNOWN_OPCODE,
+          bs_index_build(&index, &patchlang, unknown, sizeof(unknown),
+                         NULL_TERMINATED, &offset));
+    mu_eq(int, 3, offset);
+    mu_eq(int, 0, index.statement_ct);
+
+    mu_eq(int, BS_MISSING_TERMINATOR,
+          bs_index_build(&index, &patchlang, patch_input,
+                         sizeof(patch_input) - 1, NULL_TERMINATED, &offset));
+    mu_eq(int, BS_OK,
+          bs_index_build(&index, &patchlang, patch_input,
+                         sizeof(patch_input) - 1, MANUAL_CUTOFF, NULL));
+    mu_eq(int, 4, index.statement_ct);
+    bs_index_free(&index);
+}
+
+void mu_test_patch_fields() {
+    function_def *hitbox = lang_getfnbyname(&patchlang, "hitbox");
+    function_def *wait = lang_getfnbyname(&patchlang, "wait");
+    char buf[sizeof(patch_input)], expected[sizeof(patch_input)];
+    memcpy(buf, patch_input, sizeof(buf));
+    memcpy(expected, patch_input, sizeof(buf));
+
+    bs_index index;
+    mu_eq(int, BS_OK,
+          bs_index_build(&index, &patchlang, buf, sizeof(buf),
+                         NULL_TERMINATED, NULL));
+
+    // a 4 bit field sharing its byte with another
+    long value = 9;
+    mu_eq(int, BS_OK,
+          bs_patch_arg_by_name(&patchlang, buf, sizeof(buf),
+                               bs_index_nth(&index, hitbox, 1), "dmg",
+                               &value));
+    expected[12] = (char)0xb9;
+    mu_check(0 == memcmp(expected, buf, sizeof(buf)));
+
+    value = -7;
+    mu_eq(int, BS_OK,
+          bs_patch_arg(&patchlang, buf, sizeof(buf),
+                       bs_index_nth(&index, hitbox, 2), 1, &value));
+    expected[19] = (char)0xff;
+    mu_check(0 == memcmp(expected, buf, sizeof(buf)));
+
+    long double kb = 0.5;
+    mu_eq(int, BS_OK,
+          bs_patch_arg_by_name(&patchlang, buf, sizeof(buf),
+                               bs_index_nth(&index, hitbox, 0), "kb", &kb));
+    expected[3] = 0x3f;
+    expected[4] = 0x00;
+    mu_check(0 == memcmp(expected, buf, sizeof(buf)));
+
+    value = 300;
+    mu_eq(int, BS_OK,
+          bs_patch_arg_by_name(&patchlang, buf, sizeof(buf),
+                               bs_index_nth(&index, wait, 0), "frames",
+                               &value));
+    expected[8] = 0x01;
+    expected[9] = 0x2c;
+    mu_check(0 == memcmp(expected, buf, sizeof(buf)));
+
+    // failures leave the binary alone
+    value = 16;
+    mu_eq(int, BS_OUT_OF_RANGE,
+          bs_patch_arg_by_name(&patchlang, buf, sizeof(buf),
+                               bs_index_nth(&index, hitbox, 0), "dmg",
+                               &value));
+
+    // a signed field holds -(2^(w-1) - 1) to 2^(w-1) - 1
+    long out_of_range[] = { LONG_MIN, LONG_MAX, 8, -8 };
+    for (size_t i = 0; i < sizeof(out_of_range) / sizeof(long); i++) {
+        mu_eq(int, BS_OUT_OF_RANGE,
+              bs_patch_arg_by_name(&patchlang, buf, sizeof(buf),
+                                   bs_index_nth(&index, hitbox, 0), "angle",
+                                   &out_of_range[i]));
+    }
+    mu_eq(int, BS_UNMAPPED,
+          bs_patch_arg_by_name(&patchlang, buf, sizeof(buf),
+                               bs_index_nth(&index, hitbox, 0), "missing",
+                               &value));
+    mu_eq(int, BS_TRUNCATED_STATEMENT,
+          bs_patch_arg_by_name(&patchlang, buf, 20,
+                               bs_index_nth(&index, hitbox, 2), "kb", &kb));
+    mu_check(0 == memcmp(expected, buf, sizeof(buf)));
+
+    bs_index_free(&index);
+}
+
+void mu_test_patch_mmap() {
+    FILE *f = fopen(PATCH_TEST_FILE, "wb");
+    fwrite(patch_input, 1, sizeof(patch_input), f);
+    fclose(f);
+
+    int fd = open(PATCH_TEST_FILE, O_RDWR);
+    mu_check(fd >= 0);
+    char *map = mmap(NULL, sizeof(patch_input), PROT_READ | PROT_WRITE,
+                     MAP_SHARED, fd, 0);
+    mu_check(map != MAP_FAILED);
+
+    bs_index index;
+    mu_eq(int, BS_OK,
+          bs_index_build(&index, &patchlang, map, sizeof(patch_input),
+                         NULL_TERMINATED, NULL));
+    long value = 0x7f;
+    mu_eq(int, BS_OK,
+          bs_patch_arg_by_name(
+              &patchlang, map, sizeof(patch_input),
+              bs_index_nth(&index, lang_getfnbyname(&patchlang, "hitbox"), 2),
+              "id", &value));
+    bs_index_free(&index);
+    munmap(map, sizeof(patch_input));
+    close(fd);
+
+    char written[sizeof(patch_input)];
+    f = fopen(PATCH_TEST_FILE, "rb");
+    mu_eq(int, sizeof(written), fread(written, 1, sizeof(written), f));
+    fclose(f);
+    remove(PATCH_TEST_FILE);
+
+    mu_eq(int, 0x7f, written[18]);
+    written[18] = patch_input[18];
+    mu_check(0 == memcmp(patch_input, written, sizeof(written)));
+}
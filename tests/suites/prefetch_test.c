@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../mutest.h"
+#include "convert.h"
+#include "langdef.h"
+#include "parsescript.h"
+#include "prefetch.h"
+#include "translator.h"
+
+#define PREFETCH_TEST_FILE "prefetch_test.bin"
+#define PREFETCH_TEST_ROUNDS 200
+
+static language_def prefetchlang;
+
+int mu_init_prefetch() {
+    detailed_parse_error *e = parse_language_from_str(
+        &prefetchlang, "meta\n"
+                       "    endianness big\n"
+                       "    namewidth 8\n"
+                       "    nameshift 0\n"
+                       "\n"
+                       "def 0x01 hitbox { uint8(dmg) int8(angle) }\n"
+                       "def 0x02 wait { uint16(frames) }\n"
+                       "def 0x03 name { str16(text) }\n"
+                       "def 0x04 blob { raw_str800(data) }\n",
+        "prefetchlang");
+    if (e != NULL) {
+        print_err(e);
+        free_err(e);
+        return 1;
+    }
+    return 0;
+}
+
+void mu_term_prefetch() { free_lang(&prefetchlang); }
+
+// writes rounds of statements of 3 and 101 bytes, so that they straddle
+// small chunks at every offset, returning the size of the file
+static size_t write_test_file(size_t rounds, bool terminated) {
+    FILE *f = fopen(PREFETCH_TEST_FILE, "wb");
+    size_t size = 0;
+    for (size_t i = 0; i < rounds; i++) {
+        char statements[] = { 0x01, (char)i, (char)-i, //
+                              0x02, 0x00, (char)i,     //
+                              0x03, (char)('a' + i % 26), 'z' };
+        fwrite(statements, 1, sizeof(statements), f);
+        size += sizeof(statements);
+
+        fputc(0x04, f);
+        for (size_t j = 0; j < 100; j++) {
+            fputc((int)((i + j) & 0xff), f);
+        }
+        size += 101;
+    }
+    if (terminated) {
+        fputc(0x00, f);
+        size++;
+    }
+    fclose(f);
+    return size;
+}
+
+// converts the test file to text through a file consumer, prefetching
+// with the given chunks unless chunk_ct is 0
+static binscript_error convert_file(size_t chunk_size, unsigned int chunk_ct,
+                                    binscript_endmode endmode,
+                                    bs_buffer *out) {
+    FILE *f = fopen(PREFETCH_TEST_FILE, "rb");
+    binscript_consumer *c = binscript_file_consumer(
+        &prefetchlang, f, PREFETCH_TEST_FILE, BIN2SCRIPT);
+    consumer_set_size(c, endmode, 0);
+    if (chunk_ct > 0)
+        mu_check(consumer_set_prefetch(c, chunk_size, chunk_ct));
+
+    function_call *call;
+    binscript_error e;
+    char text[512];
+    bs_buffer_clear(out);
+    while (BS_OK == (e = binscript_next_checked(c, &call)) && call != NULL) {
+        size_t len = string_encode_function_call(text, call);
+        bs_buffer_reserve(out, len + 1);
+        memcpy(out->data + out->len, text, len);
+        out->len += len;
+        out->data[out->len++] = '\n';
+        free_call(call);
+    }
+    binscript_free(c);
+    fclose(f);
+    return e;
+}
+
+void mu_test_prefetch_matches_fread() {
+    bs_buffer expected, out;
+    bs_buffer_init(&expected);
+    bs_buffer_init(&out);
+    write_test_file(PREFETCH_TEST_ROUNDS, true);
+    mu_eq(int, BS_OK, convert_file(0, 0, NULL_TERMINATED, &expected));
+    mu_check(expected.len > 0);
+
+    size_t sizes[] = { 64, 100, 4096, 0 };
+    unsigned int counts[] = { 2, 3, 8 };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        for (size_t j = 0; j < sizeof(counts) / sizeof(counts[0]); j++) {
+            mu_eq(int, BS_OK,
+                  convert_file(sizes[i], counts[j], NULL_TERMINATED, &out));
+            mu_eq(int, expected.len, out.len);
+            mu_check(0 == memcmp(expected.data, out.data, out.len));
+        }
+    }
+
+    bs_buffer_free(&expected);
+    bs_buffer_free(&out);
+    remove(PREFETCH_TEST_FILE);
+}
+
+void mu_test_prefetch_end_of_file() {
+    bs_buffer out;
+    bs_buffer_init(&out);
+
+    // files that end between statements, exactly at the end of a chunk
+    // and in the middle of one
+    size_t size = write_test_file(2, false);
+    mu_eq(int, 220, size);
+    mu_eq(int, BS_MISSING_TERMINATOR,
+          convert_file(110, 2, NULL_TERMINATED, &out));
+    mu_eq(int, BS_OK, convert_file(110, 2, MANUAL_CUTOFF, &out));
+    mu_eq(int, BS_OK, convert_file(64, 2, MANUAL_CUTOFF, &out));
+
+    // and a file that ends in the middle of a statement
+    FILE *f = fopen(PREFETCH_TEST_FILE, "ab");
+    fputc(0x04, f);
+    fputc(0x01, f);
+    fclose(f);
+    mu_eq(int, BS_TRUNCATED_STATEMENT,
+          convert_file(64, 2, MANUAL_CUTOFF, &out));
+
+    bs_buffer_free(&out);
+    remove(PREFETCH_TEST_FILE);
+}
+
+void mu_test_prefetch_read() {
+    size_t size = write_test_file(PREFETCH_TEST_ROUNDS, true);
+    FILE *f = fopen(PREFETCH_TEST_FILE, "rb");
+    char *whole = malloc(size);
+    mu_eq(int, size, fread(whole, 1, size, f));
+    rewind(f);
+
+    // peeks across chunks leave the bytes to be read again
+    bs_prefetch *p = bs_prefetch_start(f, 64, 2, NULL);
+    mu_check(p != NULL);
+    char buf[256];
+    size_t got, offset = 0;
+    mu_eq(int, BS_OK, bs_prefetch_read(p, buf, 60, true, &got));
+    offset += got;
+    mu_eq(int, BS_OK, bs_prefetch_read(p, buf, 10, false, &got));
+    mu_eq(int, 10, got);
+    mu_check(0 == memcmp(whole + offset, buf, 10));
+
+    // reads wider than the whole ring
+    while (offset < size) {
+        mu_eq(int, BS_OK, bs_prefetch_read(p, buf, sizeof(buf), true, &got));
+        mu_check(got == sizeof(buf) || offset + got == size);
+        mu_check(0 == memcmp(whole + offset, buf, got));
+        offset += got;
+    }
+    mu_eq(int, BS_OK, bs_prefetch_read(p, buf, 1, true, &got));
+    mu_eq(int, 0, got);
+    bs_prefetch_free(p);
+
+    // stopping the reader while it waits on a full ring
+    rewind(f);
+    p = bs_prefetch_start(f, 64, 2, NULL);
+    mu_eq(int, BS_OK, bs_prefetch_read(p, buf, 1, true, &got));
+    bs_prefetch_free(p);
+    fclose(f);
+    free(whole);
+
+    // only binary file consumers prefetch
+    binscript_consumer *c = binscript_mem_consumer(&prefetchlang, buf,
+                                                   "prefetch", BIN2SCRIPT);
+    mu_check(!consumer_set_prefetch(c, 0, 0));
+    binscript_free(c);
+    remove(PREFETCH_TEST_FILE);
+}
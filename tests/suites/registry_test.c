@@ -0,0 +1,167 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../mutest.h"
+#include "langdef.h"
+#include "registry.h"
+#include "translator.h"
+
+#define REGISTRY_TEST_DIR "registry_test_langs"
+#define REGISTRY_THREADS 8
+
+static const char *registry_lang = "meta\n"
+                                   "    endianness big\n"
+                                   "    namewidth 6\n"
+                                   "    nameshift 2\n"
+                                   "\n"
+                                   "def 0x08 test {\n"
+                                   "    skip2 uint32(intarg)\n"
+                                   "}\n"
+                                   "def 0x18 stringmethod {\n"
+                                   "    skip2 str32(name)\n"
+                                   "}\n";
+
+static const char *registry_other_lang = "meta\n"
+                                         "    endianness little\n"
+                                         "    namewidth 8\n"
+                                         "    nameshift 0\n"
+                                         "\n"
+                                         "def 0x01 other {\n"
+                                         "    uint8(value)\n"
+                                         "}\n";
+
+static void write_lang(const char *path, const char *text) {
+    FILE *f = fopen(path, "w");
+    fputs(text, f);
+    fclose(f);
+}
+
+int mu_init_registry() {
+    mkdir(REGISTRY_TEST_DIR, 0755);
+    write_lang(REGISTRY_TEST_DIR "/first.langdef", registry_lang);
+    write_lang(REGISTRY_TEST_DIR "/copy.langdef", registry_lang);
+    write_lang(REGISTRY_TEST_DIR "/other.langdef", registry_other_lang);
+    return 0;
+}
+
+void mu_term_registry() {
+    remove(REGISTRY_TEST_DIR "/first.langdef");
+    remove(REGISTRY_TEST_DIR "/copy.langdef");
+    remove(REGISTRY_TEST_DIR "/other.langdef");
+    rmdir(REGISTRY_TEST_DIR);
+}
+
+void mu_test_registry_dedupe() {
+    bs_registry *reg = bs_registry_create();
+    bs_registry_add_search_path(reg, REGISTRY_TEST_DIR);
+
+    language_def *first = bs_registry_get(reg, "first");
+    mu_check(first != NULL);
+    mu_check(first->finalized);
+
+    // the same name, a path to the same file, and a different file
+    // with the same text all share one language
+    mu_check(bs_registry_get(reg, "first") == first);
+    mu_check(bs_registry_get(reg, REGISTRY_TEST_DIR "/first.langdef") ==
+             first);
+    mu_check(bs_registry_get(reg, "copy") == first);
+    mu_eq(int, 1, bs_registry_language_ct(reg));
+
+    language_def *other = bs_registry_get(reg, "other");
+    mu_check(other != NULL);
+    mu_check(other != first);
+    mu_eq(int, 2, bs_registry_language_ct(reg));
+
+    mu_check(bs_registry_get(reg, "missing") == NULL);
+    mu_eq(int, 2, bs_registry_language_ct(reg));
+
+    bs_registry_free(reg);
+}
+
+void mu_test_registry_dispatch() {
+    bs_registry *reg = bs_registry_create();
+    language_def *l =
+        bs_registry_get(reg, REGISTRY_TEST_DIR "/first.langdef");
+    mu_check(l != NULL);
+
+    // a 6 bit name gets a dense table covering every value
+    mu_check(l->dispatch != NULL);
+    mu_eq(int, 64, l->dispatch_len);
+    // binary values are stored without the name shift
+    mu_check(lang_getplan(l, 0x02) != NULL);
+    mu_check(lang_getplan(l, 0x02)->fn == lang_getfn(l, 0x02));
+    mu_eq(int, 40, lang_getplan(l, 0x02)->width);
+    mu_check(lang_getplan(l, 0x06)->strings_aligned);
+    mu_check(!lang_getplan(l, 0x02)->strings_aligned);
+    mu_check(lang_getplan(l, 0x04) == NULL);
+    mu_check(lang_getfn(l, 0x04) == NULL);
+    mu_check(lang_getplan(l, 1000) == NULL);
+
+    // decoding goes through the table. Skipped bits are argument 0.
+    char input[] = { 0x08, 0x00, 0x00, 0x01, 0x02,
+                     0x18, 'a',  'b',  0x00, 0x00, 0x00 };
+    binscript_consumer *c =
+        binscript_mem_consumer(l, input, "registry", BIN2SCRIPT);
+    function_call *call;
+    mu_eq(int, BS_OK, binscript_next_checked(c, &call));
+    mu_check(call != NULL);
+    mu_check(0 == strcmp(call->defn->name, "test"));
+    mu_eq(int, 0x0102, *(unsigned long *)call->args[1]);
+    free_call(call);
+
+    mu_eq(int, BS_OK, binscript_next_checked(c, &call));
+    mu_check(call != NULL);
+    mu_check(0 == strcmp((char *)call->args[1], "ab"));
+    free_call(call);
+
+    mu_eq(int, BS_OK, binscript_next_checked(c, &call));
+    mu_check(call == NULL);
+    binscript_free(c);
+
+    bs_registry_free(reg);
+}
+
+struct registry_worker {
+    pthread_t thread;
+    bs_registry *reg;
+    language_def *got[3];
+};
+
+static void *registry_get_all(void *arg) {
+    struct registry_worker *w = arg;
+    w->got[0] = bs_registry_get(w->reg, "first");
+    w->got[1] = bs_registry_get(w->reg, "copy");
+    w->got[2] = bs_registry_get(w->reg, "other");
+    return NULL;
+}
+
+void mu_test_registry_threads() {
+    bs_registry *reg = bs_registry_create();
+    bs_registry_add_search_path(reg, REGISTRY_TEST_DIR);
+
+    // every thread races to load the same languages first
+    struct registry_worker workers[REGISTRY_THREADS];
+    for (int i = 0; i < REGISTRY_THREADS; i++) {
+        workers[i].reg = reg;
+        pthread_create(&workers[i].thread, NULL, registry_get_all,
+                       &workers[i]);
+    }
+    for (int i = 0; i < REGISTRY_THREADS; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    for (int i = 0; i < REGISTRY_THREADS; i++) {
+        mu_check(workers[i].got[0] != NULL);
+        mu_check(workers[i].got[2] != NULL);
+        mu_check(workers[i].got[0] == workers[0].got[0]);
+        mu_check(workers[i].got[1] == workers[0].got[0]);
+        mu_check(workers[i].got[2] == workers[0].got[2]);
+    }
+    mu_eq(int, 2, bs_registry_language_ct(reg));
+
+    bs_registry_free(reg);
+}
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../mutest.h"
+#include "convert.h"
+#include "langdef.h"
+#include "parsescript.h"
+#include "stats.h"
+#include "translator.h"
+
+#define STATS_TEST_FILE "stats_test.bin"
+
+static language_def statslang;
+
+// wait(1) hitbox(2 3) flag(5) wait(4)
+static char stats_input[] = {
+    0x02, 0x00, 0x01, //
+    0x01, 0x02, 0x03, //
+    0x03, 0x50,       //
+    0x02, 0x00, 0x04, //
+    0x00
+};
+
+int mu_init_stats() {
+    detailed_parse_error *e = parse_language_from_str(
+        &statslang, "meta\n"
+                    "    endianness big\n"
+                    "    namewidth 8\n"
+                    "    nameshift 0\n"
+                    "\n"
+                    "def 0x01 hitbox { uint8(dmg) int8(angle) }\n"
+                    "def 0x02 wait { uint16(frames) }\n"
+                    "def 0x03 flag { uint4(value) }\n",
+        "statslang");
+    if (e != NULL) {
+        print_err(e);
+        free_err(e);
+        return 1;
+    }
+    return 0;
+}
+
+void mu_term_stats() { free_lang(&statslang); }
+
+void mu_test_stats_memory() {
+    bs_stats stats;
+    bs_stats_init(&stats, &statslang);
+    mu_eq(int, 256, stats.opcode_ct);
+
+    bs_buffer out;
+    bs_buffer_init(&out);
+    mu_eq(int, BS_OK,
+          binscript_convert_counted(&statslang, BIN2SCRIPT, NULL_TERMINATED,
+                                    stats_input, sizeof(stats_input), &out,
+                                    NULL, &stats, NULL));
+    bs_buffer_free(&out);
+
+#ifndef BINSCRIPT_NO_STATS
+    mu_eq(int, 4, stats.statements);
+    mu_eq(int, 11, stats.bytes);
+    mu_eq(int, 84, stats.bits);
+    // each call and its argument array, plus one per argument
+    mu_eq(int, 13, stats.allocations);
+    mu_eq(int, 0, stats.refills);
+    mu_eq(int, 2, stats.opcodes[0x02].statements);
+    mu_eq(int, 1, stats.opcodes[0x01].statements);
+    mu_eq(int, 0, stats.opcodes[0x04].statements);
+#else
+    mu_eq(int, 0, stats.statements);
+#endif
+    bs_stats_free(&stats);
+}
+
+void mu_test_stats_file() {
+    FILE *f = fopen(STATS_TEST_FILE, "wb");
+    fwrite(stats_input, 1, sizeof(stats_input), f);
+    fclose(f);
+
+    bs_stats stats;
+    bs_stats_init(&stats, &statslang);
+    f = fopen(STATS_TEST_FILE, "rb");
+    binscript_consumer *c =
+        binscript_file_consumer(&statslang, f, STATS_TEST_FILE, BIN2SCRIPT);
+    consumer_set_size(c, NULL_TERMINATED, 0);
+    consumer_set_stats(c, &stats);
+
+    function_call *call;
+    while (BS_OK == binscript_next_checked(c, &call) && call != NULL) {
+        free_call(call);
+    }
+    binscript_free(c);
+    fclose(f);
+    remove(STATS_TEST_FILE);
+
+#ifndef BINSCRIPT_NO_STATS
+    mu_eq(int, 4, stats.statements);
+    mu_eq(int, 11, stats.bytes);
+    // every statement is peeked at, then read whole, and the
+    // terminator is peeked at
+    mu_eq(int, 9, stats.refills);
+    // file statements are read through one buffer, sized for the
+    // first statement, which is as wide as any other
+    mu_eq(int, 14, stats.allocations);
+#endif
+    bs_stats_free(&stats);
+}
+
+void mu_test_stats_merge_dump() {
+    bs_stats a, b;
+    bs_stats_init(&a, &statslang);
+    bs_stats_init(&b, &statslang);
+
+    char script[] = "wait(1)\nhitbox(2 3)\n";
+    bs_buffer out;
+    bs_buffer_init(&out);
+    mu_eq(int, BS_OK,
+          binscript_convert_counted(&statslang, SCRIPT2BIN, NULL_TERMINATED,
+                                    script, strlen(script), &out, NULL, &a,
+                                    NULL));
+    bs_buffer_clear(&out);
+    mu_eq(int, BS_OK,
+          binscript_convert_counted(&statslang, BIN2SCRIPT, NULL_TERMINATED,
+                                    stats_input, sizeof(stats_input), &out,
+                                    NULL, &b, NULL));
+    bs_buffer_free(&out);
+
+    bs_stats_merge(&a, &b);
+    char *text = NULL;
+    size_t text_len = 0;
+    FILE *dump = open_memstream(&text, &text_len);
+    bs_stats_dump(&a, dump);
+    fclose(dump);
+
+#ifndef BINSCRIPT_NO_STATS
+    // scripts have no bytes, but their statements are counted
+    mu_eq(int, 6, a.statements);
+    mu_eq(int, 11, a.bytes);
+    mu_eq(int, 3, a.opcodes[0x02].statements);
+    mu_check(strstr(text, "statements  6\n") != NULL);
+    mu_check(strstr(text, "hitbox") != NULL);
+    mu_check(strstr(text, "flag") != NULL);
+#else
+    mu_check(strstr(text, "compiled out") != NULL);
+#endif
+    free(text);
+    bs_stats_free(&a);
+    bs_stats_free(&b);
+}
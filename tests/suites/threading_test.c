@@ -0,0 +1,183 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../mutest.h"
+#include "langcache.h"
+#include "langdef.h"
+#include "parsescript.h"
+#include "translator.h"
+#include "util.h"
+#include "validate.h"
+
+#define STRESS_THREADS 8
+#define STRESS_ROUNDS 200
+
+static language_def threadlang;
+
+// test(128 777.77), graphic(1 ...), stringmethod(ab wxyz), terminator
+static char stress_input[] = {
+    0x08, 0x00, 0x00, 0x00, 0x80, 0x44, 0x42, 0x71, 0x48,
+    0x10, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+    0x40, 0x59, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x40, 0x59, 0x06, 0x66, 0x66, 0x66, 0x66, 0x66,
+    0x18, 'a',  'b',  0x00, 0x00, 'w',  'x',  'y',  'z',
+    0x00
+};
+
+#define STRESS_STATEMENTS 3
+static char stress_expected[STRESS_STATEMENTS][256];
+static binscript_error stress_encode_errors[STRESS_STATEMENTS];
+
+int mu_init_threading() {
+    detailed_parse_error *e = parse_language_from_str(
+        &threadlang, "meta\n"
+                     "    endianness big\n"
+                     "    namewidth 6\n"
+                     "    nameshift 2\n"
+                     "\n"
+                     "def 0x08 test {\n"
+                     "    skip2 uint32(intarg) float32(floatarg)\n"
+                     "}\n"
+                     "def 0x10 graphic {\n"
+                     "    skip2 int32(gfx) skip32\n"
+                     "    float64(zoff) float64(yoff)\n"
+                     "}\n"
+                     "def 0x18 stringmethod {\n"
+                     "    skip2 str32(name_terminated)\n"
+                     "    raw_str32(name_nonterminated)\n"
+                     "}\n",
+        "threadlang");
+    if (e != NULL) {
+        print_err(e);
+        free_err(e);
+        return 1;
+    }
+
+    // decode once on the main thread for the reference output
+    binscript_consumer *c =
+        binscript_mem_consumer(&threadlang, stress_input, "ref", BIN2SCRIPT);
+    function_call *call;
+    char encoded[64];
+    size_t written;
+    for (int i = 0; i < STRESS_STATEMENTS; i++) {
+        if (binscript_next_checked(c, &call) != BS_OK || call == NULL)
+            return 1;
+        string_encode_function_call_keyworded(stress_expected[i], call);
+        stress_encode_errors[i] = binary_encode_function_call_checked(
+            encoded, sizeof(encoded), &threadlang, call, &written);
+        free_call(call);
+    }
+    binscript_free(c);
+    return 0;
+}
+
+void mu_term_threading() { free_lang(&threadlang); }
+
+// hashes everything a decoder can read from a language, to check that
+// sharing it between threads does not change it
+static uint64_t lang_fingerprint(language_def *l) {
+    char line[1024];
+    uint64_t hash = 0;
+    for (unsigned int i = 0; i < l->function_ct; i++) {
+        function_def *fn = l->functions[i];
+        int len = snprintf(line, sizeof(line), "%p %u %s %u %p", (void *)fn,
+                           fn->function_binary_value, fn->name, fn->argc,
+                           (void *)fn->arguments);
+        hash ^= lang_source_hash(line, len) + i;
+        for (unsigned int j = 0; j < fn->argc; j++) {
+            argument_def *a = fn->arguments[j];
+            len = snprintf(line, sizeof(line), "%d %u %s", (int)a->type,
+                           a->bitwidth, a->name ? a->name : "");
+            hash ^= lang_source_hash(line, len) + j;
+        }
+    }
+    return hash ^ l->function_ct ^ l->function_name_width;
+}
+
+struct stress_worker {
+    pthread_t thread;
+    unsigned int id;
+    unsigned int failures;
+};
+
+// decodes, re-encodes and validates the shared input from one thread
+static unsigned int stress_round(unsigned int id, unsigned int round) {
+    unsigned int failures = 0;
+    char out[1024], encoded[64];
+    size_t written;
+    function_call *call;
+
+    binscript_consumer *c;
+    FILE *f = NULL;
+    if ((id + round) % 2 == 0) {
+        c = binscript_mem_consumer(&threadlang, stress_input, "stress",
+                                   BIN2SCRIPT);
+        consumer_set_zero_copy(c, round % 3 == 0);
+    } else {
+        f = fmemopen(stress_input, sizeof(stress_input), "r");
+        c = binscript_file_consumer(&threadlang, f, "stress", BIN2SCRIPT);
+    }
+
+    char *head = stress_input;
+    for (int i = 0; i < STRESS_STATEMENTS; i++) {
+        if (binscript_next_checked(c, &call) != BS_OK || call == NULL) {
+            failures++;
+            break;
+        }
+
+        string_encode_function_call_keyworded(out, call);
+        failures += 0 != strcmp(stress_expected[i], out);
+
+        // calls that can be encoded round trip to the input
+        binscript_error e = binary_encode_function_call_checked(
+            encoded, sizeof(encoded), &threadlang, call, &written);
+        failures += e != stress_encode_errors[i];
+        failures += e == BS_OK && 0 != memcmp(head, encoded, written);
+
+        head += bits2bytes(func_call_width(&threadlang, call->defn));
+        free_call(call);
+    }
+
+    failures += binscript_next_checked(c, &call) != BS_OK || call != NULL;
+    binscript_free(c);
+    if (f != NULL)
+        fclose(f);
+
+    binscript_report r;
+    binscript_report_init(&r, NULL, 0, NULL_TERMINATED);
+    failures += !binscript_validate(&threadlang, stress_input,
+                                    sizeof(stress_input), &r);
+    return failures;
+}
+
+static void *stress_worker_main(void *arg) {
+    struct stress_worker *w = arg;
+    for (unsigned int round = 0; round < STRESS_ROUNDS; round++) {
+        w->failures += stress_round(w->id, round);
+    }
+    return NULL;
+}
+
+void mu_test_threading_shared_language() {
+    struct stress_worker workers[STRESS_THREADS];
+    uint64_t before = lang_fingerprint(&threadlang);
+
+    mu_check(threadlang.finalized);
+    for (unsigned int i = 0; i < STRESS_THREADS; i++) {
+        workers[i].id = i;
+        workers[i].failures = 0;
+        mu_check(0 == pthread_create(&workers[i].thread, NULL,
+                                     stress_worker_main, &workers[i]));
+    }
+
+    // mutest is not thread safe, so results are only checked here
+    for (unsigned int i = 0; i < STRESS_THREADS; i++) {
+        pthread_join(workers[i].thread, NULL);
+        mu_eq(int, 0, workers[i].failures);
+    }
+
+    mu_check(before == lang_fingerprint(&threadlang));
+}
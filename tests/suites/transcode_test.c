@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../mutest.h"
+#include "convert.h"
+#include "langdef.h"
+#include "parsescript.h"
+#include "transcode.h"
+#include "translator.h"
+
+static language_def old_lang, new_lang, narrow_lang;
+
+static char old_source[] =
+    "meta\n"
+    "    endianness big\n"
+    "    namewidth 8\n"
+    "    nameshift 0\n"
+    "\n"
+    "def 0x01 hit { uint8(dmg) int8(angle) str32(tag) }\n"
+    "def 0x02 wait { uint16(frames) }\n"
+    "def 0x03 debug { uint8(level) }\n";
+
+// opcodes renumbered and widened, `hit` renamed with its arguments
+// reordered and one renamed, a field widened and one added, `wait`
+// moved to floats and `debug` removed, in the other byte order
+static char new_source[] =
+    "meta\n"
+    "    endianness little\n"
+    "    namewidth 16\n"
+    "    nameshift 0\n"
+    "\n"
+    "def 0x0101 hitbox { int8(angle) uint16(damage) str64(tag) uint8(extra) }\n"
+    "def 0x0002 wait { float32(frames) }\n";
+
+static char narrow_source[] = "meta\n"
+                              "    endianness big\n"
+                              "    namewidth 8\n"
+                              "    nameshift 0\n"
+                              "\n"
+                              "def 0x01 hit { uint4(dmg) skip4 }\n"
+                              "def 0x02 wait { uint16(frames) }\n";
+
+static const char *old_to_new_map = "# hit became hitbox\n"
+                                    "function hit hitbox\n"
+                                    "argument hit dmg damage\n"
+                                    "\n"
+                                    "function debug -\n";
+
+// hit(18 -5 "ab"), wait(256), debug(7), terminator
+static char old_input[] = { 0x01, 0x12, 0x85, 'a',  'b', 0x00, 0x00,
+                            0x02, 0x01, 0x00, 0x03, 0x07, 0x00 };
+
+// hitbox(-5 18 "ab" 0), wait(256.0), terminator
+static char new_expected[] = { 0x01, 0x01, 0x85, 0x12, 0x00, 'a',  'b',
+                               0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                               0x00, 0x02, 0x00, 0x00, 0x80, 0x43, 0x00,
+                               0x00 };
+
+static int parse_test_lang(language_def *l, char *source, const char *name) {
+    detailed_parse_error *e = parse_language_from_str(l, source, name);
+    if (e != NULL) {
+        print_err(e);
+        free_err(e);
+        return 1;
+    }
+    return 0;
+}
+
+int mu_init_transcode() {
+    return parse_test_lang(&old_lang, old_source, "old") ||
+           parse_test_lang(&new_lang, new_source, "new") ||
+           parse_test_lang(&narrow_lang, narrow_source, "narrow");
+}
+
+void mu_term_transcode() {
+    free_lang(&old_lang);
+    free_lang(&new_lang);
+    free_lang(&narrow_lang);
+}
+
+static bs_transcoder *old_to_new() {
+    bs_transcoder *t = bs_transcoder_create(&old_lang, &new_lang);
+    if (BS_OK != bs_transcoder_load_map(t, old_to_new_map) ||
+        BS_OK != bs_transcoder_compile(t)) {
+        printf("%s\n", bs_transcoder_problem(t));
+        bs_transcoder_free(t);
+        return NULL;
+    }
+    return t;
+}
+
+void mu_test_transcode_buffer() {
+    bs_transcoder *t = old_to_new();
+    mu_check(t != NULL);
+
+    bs_buffer out;
+    bs_buffer_init(&out);
+    mu_eq(int, BS_OK,
+          bs_transcode_buffer(t, old_input, sizeof(old_input),
+                              NULL_TERMINATED, &out, NULL));
+    mu_eq(int, sizeof(new_expected), out.len);
+    mu_check(0 == memcmp(new_expected, out.data, sizeof(new_expected)));
+
+    // the output decodes with the new language
+    binscript_consumer *c =
+        binscript_mem_consumer(&new_lang, out.data, "new", BIN2SCRIPT);
+    consumer_set_source_len(c, out.len);
+    function_call *call;
+    mu_eq(int, BS_OK, binscript_next_checked(c, &call));
+    mu_check(call != NULL && 0 == strcmp(call->defn->name, "hitbox"));
+    mu_eq(int, -5, *(long *)call->args[0]);
+    mu_eq(int, 18, *(long *)call->args[1]);
+    mu_check(0 == strcmp((char *)call->args[2], "ab"));
+    mu_eq(int, 0, *(long *)call->args[3]);
+    free_call(call);
+
+    mu_eq(int, BS_OK, binscript_next_checked(c, &call));
+    mu_check(call != NULL && 0 == strcmp(call->defn->name, "wait"));
+    mu_check(256.0L == *(long double *)call->args[0]);
+    free_call(call);
+
+    mu_eq(int, BS_OK, binscript_next_checked(c, &call));
+    mu_check(call == NULL);
+    binscript_free(c);
+
+    bs_buffer_free(&out);
+    bs_transcoder_free(t);
+}
+
+void mu_test_transcode_stream() {
+    bs_transcoder *t = old_to_new();
+    mu_check(t != NULL);
+
+    FILE *in = fmemopen(old_input, sizeof(old_input), "rb");
+    FILE *out = tmpfile();
+    mu_eq(int, BS_OK, bs_transcode_stream(t, in, out, NULL_TERMINATED, NULL));
+
+    char written[64];
+    rewind(out);
+    mu_eq(int, sizeof(new_expected), fread(written, 1, sizeof(written), out));
+    mu_check(0 == memcmp(new_expected, written, sizeof(new_expected)));
+    fclose(in);
+    fclose(out);
+
+    // without the terminator
+    size_t offset = 0;
+    in = fmemopen(old_input, sizeof(old_input) - 1, "rb");
+    out = tmpfile();
+    mu_eq(int, BS_MISSING_TERMINATOR,
+          bs_transcode_stream(t, in, out, NULL_TERMINATED, &offset));
+    mu_eq(int, sizeof(old_input) - 1, offset);
+    fclose(in);
+    fclose(out);
+
+    in = fmemopen(old_input, sizeof(old_input) - 1, "rb");
+    out = tmpfile();
+    mu_eq(int, BS_OK, bs_transcode_stream(t, in, out, MANUAL_CUTOFF, NULL));
+    fclose(in);
+    fclose(out);
+
+    bs_transcoder_free(t);
+}
+
+void mu_test_transcode_bad_input() {
+    bs_transcoder *t = old_to_new();
+    mu_check(t != NULL);
+    bs_buffer out;
+    bs_buffer_init(&out);
+    size_t offset = 0;
+
+    char unknown[] = { 0x02, 0x00, 0x01, 0x09, 0x00 };
+    mu_eq(int, BS_UNKNOWN_OPCODE,
+          bs_transcode_buffer(t, unknown, sizeof(unknown), NULL_TERMINATED,
+                              &out, &offset));
+    mu_eq(int, 3, offset);
+
+    char truncated[] = { 0x02, 0x00, 0x01, 0x01, 0x12 };
+    bs_buffer_clear(&out);
+    mu_eq(int, BS_TRUNCATED_STATEMENT,
+          bs_transcode_buffer(t, truncated, sizeof(truncated),
+                              NULL_TERMINATED, &out, &offset));
+    mu_eq(int, 3, offset);
+    // the statements before the failure are kept
+    mu_eq(int, 6, out.len);
+
+    bs_buffer_free(&out);
+    bs_transcoder_free(t);
+}
+
+void mu_test_transcode_out_of_range() {
+    bs_transcoder *t = bs_transcoder_create(&old_lang, &narrow_lang);
+    bs_transcoder_map_function(t, "debug", NULL);
+    mu_eq(int, BS_OK, bs_transcoder_compile(t));
+
+    bs_buffer out;
+    bs_buffer_init(&out);
+    size_t offset = 0;
+
+    // 18 does not fit in 4 bits, 9 does
+    mu_eq(int, BS_OUT_OF_RANGE,
+          bs_transcode_buffer(t, old_input, sizeof(old_input),
+                              NULL_TERMINATED, &out, &offset));
+    mu_eq(int, 0, offset);
+
+    char small[] = { 0x01, 0x09, 0x00, 'a', 0x00, 0x00, 0x00, 0x00 };
+    bs_buffer_clear(&out);
+    mu_eq(int, BS_OK,
+          bs_transcode_buffer(t, small, sizeof(small), NULL_TERMINATED, &out,
+                              NULL));
+    mu_eq(int, 3, out.len);
+    mu_eq(int, 0x01, out.data[0]);
+    mu_eq(int, 0x90, (unsigned char)out.data[1]);
+
+    bs_buffer_free(&out);
+    bs_transcoder_free(t);
+}
+
+void mu_test_transcode_compile_errors() {
+    // debug has no counterpart
+    bs_transcoder *t = bs_transcoder_create(&old_lang, &new_lang);
+    bs_transcoder_map_function(t, "hit", "hitbox");
+    mu_eq(int, BS_UNMAPPED, bs_transcoder_compile(t));
+    mu_check(NULL != strstr(bs_transcoder_problem(t), "debug"));
+    bs_transcoder_free(t);
+
+    // a string cannot become a number
+    t = bs_transcoder_create(&old_lang, &new_lang);
+    mu_eq(int, BS_OK, bs_transcoder_load_map(t, old_to_new_map));
+    bs_transcoder_map_argument(t, "hit", "tag", "extra");
+    mu_eq(int, BS_BAD_ARGTYPE, bs_transcoder_compile(t));
+    bs_transcoder_free(t);
+
+    // mappings must name things that exist
+    t = bs_transcoder_create(&old_lang, &new_lang);
+    mu_eq(int, BS_OK, bs_transcoder_load_map(t, old_to_new_map));
+    bs_transcoder_map_argument(t, "hit", "missing", "extra");
+    mu_eq(int, BS_UNMAPPED, bs_transcoder_compile(t));
+    bs_transcoder_free(t);
+
+    t = bs_transcoder_create(&old_lang, &new_lang);
+    mu_eq(int, BS_BAD_SCRIPT, bs_transcoder_load_map(t, "function hit\n"));
+    mu_check(NULL != strstr(bs_transcoder_problem(t), "line 1"));
+    bs_transcoder_free(t);
+}
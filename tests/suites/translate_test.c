@@ -211,3 +211,208 @@ void mu_test_translate_melee() {
 
     free_lang(&meleelang);
 }
+
+void mu_test_translate_wide_hex() {
+    language_def hexlang;
+    detailed_parse_error *e = parse_language_from_str(
+        &hexlang, "meta\n"
+                  "    endianness big\n"
+                  "    namewidth 8\n"
+                  "    nameshift 0\n"
+                  "def 0x01 blob { hex80(data) uint8(after) }\n",
+        "hexlang");
+    mu_check(e == NULL);
+
+    // hex fields wider than a long are decoded whole
+    char input[] = { 0x01, 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB,
+                     0xCD, 0xEF, 0xFE, 0xDC, 0x07, 0x00 };
+    char out[1024];
+    binscript_consumer *c =
+        binscript_mem_consumer(&hexlang, input, "wide_hex", BIN2SCRIPT);
+    function_call *call;
+    mu_eq(int, BS_OK, binscript_next_checked(c, &call));
+    mu_check(call != NULL);
+    mu_check(0 == memcmp(call->args[0], input + 1, 10));
+    mu_eq(int, 7, *(long int *)call->args[1]);
+
+    string_encode_function_call(out, call);
+    mu_check(0 == strcmp("blob(<01 23 45 67 89 ab cd ef fe dc> 7)", out));
+    free_call(call);
+    binscript_free(c);
+    free_lang(&hexlang);
+}
+
+void mu_test_translate_zero_copy_strings() {
+    char input[] = { 0x18, 'a', 'b', 0x00, 0x00, 'w', 'x', 'y', 'z', 0x00 };
+    char out[1024];
+
+    binscript_consumer *c =
+        binscript_mem_consumer(&testlang, input, "zero_copy", BIN2SCRIPT);
+    consumer_set_zero_copy(c, true);
+
+    function_call *call = binscript_next(c);
+    mu_check(call != NULL);
+    mu_check(call->borrowed);
+
+    // both string arguments point into the input
+    mu_check(call->args[1] == input + 1);
+    mu_check(call->args[2] == input + 5);
+
+    bs_slice terminated = call_arg_slice(call, 1);
+    bs_slice raw = call_arg_slice(call, 2);
+    mu_eq(int, 2, terminated.len);
+    mu_eq(int, 4, raw.len);
+    mu_check(0 == memcmp(raw.data, "wxyz", 4));
+
+    string_encode_function_call(out, call);
+    mu_check(0 == strcmp("stringmethod(ab wxyz)", out));
+
+    // escaping copies the strings out of the input
+    call_escape(call);
+    mu_check(!call->borrowed);
+    mu_check(call->args[2] != input + 5);
+    memset(input, 'q', sizeof(input));
+    string_encode_function_call(out, call);
+    mu_check(0 == strcmp("stringmethod(ab wxyz)", out));
+    free_call(call);
+
+    binscript_free(c);
+}
+
+void mu_test_translate_copied_strings() {
+    char input[] = { 0x18, 'a', 'b', 0x00, 0x00, 'w', 'x', 'y', 'z', 0x00 };
+    char out[1024];
+
+    binscript_consumer *c =
+        binscript_mem_consumer(&testlang, input, "copied", BIN2SCRIPT);
+
+    function_call *call = binscript_next(c);
+    mu_check(call != NULL);
+    mu_check(!call->borrowed);
+    mu_check(call->args[2] != input + 5);
+
+    string_encode_function_call(out, call);
+    mu_check(0 == strcmp("stringmethod(ab wxyz)", out));
+
+    free_call(call);
+    mu_check(binscript_next(c) == NULL);
+    binscript_free(c);
+}
+
+void mu_test_translate_checked_errors() {
+    // test(128 777.77), then a statement with an unknown name
+    char input[] = { 0x08, 0x00, 0x00, 0x00, 0x80, 0x44,
+                     0x42, 0x71, 0x48, 0x04, 0x00 };
+    function_call *call;
+
+    binscript_consumer *c =
+        binscript_mem_consumer(&testlang, input, "checked", BIN2SCRIPT);
+    mu_eq(int, BS_OK, binscript_next_checked(c, &call));
+    mu_check(call != NULL);
+    free_call(call);
+
+    mu_eq(int, BS_UNKNOWN_OPCODE, binscript_next_checked(c, &call));
+    mu_check(call == NULL);
+    mu_eq(int, BS_UNKNOWN_OPCODE, c->error);
+    mu_eq(int, 9, c->error_offset);
+    binscript_free(c);
+
+    // the same input, cut off in the middle of the first statement
+    c = binscript_mem_consumer(&testlang, input, "truncated", BIN2SCRIPT);
+    consumer_set_size(c, SIZE_BYTES, 5);
+    mu_eq(int, BS_TRUNCATED_STATEMENT, binscript_next_checked(c, &call));
+    mu_eq(int, 0, c->error_offset);
+    binscript_free(c);
+
+    // sized inputs end without a terminator
+    c = binscript_mem_consumer(&testlang, input, "sized", BIN2SCRIPT);
+    consumer_set_size(c, SIZE_STATEMENTS, 1);
+    mu_eq(int, BS_OK, binscript_next_checked(c, &call));
+    mu_check(call != NULL);
+    free_call(call);
+    mu_eq(int, BS_OK, binscript_next_checked(c, &call));
+    mu_check(call == NULL);
+    binscript_free(c);
+
+    mu_eq(int, BS_UNKNOWN_OPCODE,
+          decode_function_call_checked(&testlang, input + 9, 2, &call));
+    mu_eq(int, BS_TRUNCATED_STATEMENT,
+          decode_function_call_checked(&testlang, input, 0, &call));
+}
+
+void mu_test_translate_checked_encode() {
+    char input[] = { 0x08, 0x00, 0x00, 0x00, 0x80, 0x44, 0x42, 0x71, 0x48 };
+    char out[sizeof(input)];
+    size_t written;
+    function_call *call;
+
+    mu_eq(int, BS_OK, decode_function_call_checked(&testlang, input,
+                                                   sizeof(input), &call));
+
+    mu_eq(int, BS_OUT_OF_SPACE,
+          binary_encode_function_call_checked(out, 4, &testlang, call,
+                                              &written));
+    mu_eq(int, 0, written);
+
+    mu_eq(int, BS_OK,
+          binary_encode_function_call_checked(out, sizeof(out), &testlang,
+                                              call, &written));
+    mu_eq(int, sizeof(input), written);
+    mu_check(0 == memcmp(input, out, sizeof(input)));
+    free_call(call);
+}
+
+void mu_test_translate_checked_script() {
+    function_call *call;
+    binscript_consumer *c = binscript_mem_consumer(
+        &testlang, "test(1 2.0)\nnosuchfn(1)\n", "script", SCRIPT2BIN);
+
+    mu_eq(int, BS_OK, binscript_next_checked(c, &call));
+    mu_check(call != NULL);
+    free_call(call);
+
+    mu_eq(int, BS_BAD_SCRIPT, binscript_next_checked(c, &call));
+    mu_check(call == NULL);
+    mu_eq(int, 1, c->error_offset);
+
+    mu_eq(int, BS_OK, binscript_next_checked(c, &call));
+    mu_check(call == NULL);
+    binscript_free(c);
+}
+
+void mu_test_translate_big_endian_narrow_fields() {
+    // big-endian fields that do not fill their last byte decode to their
+    // own bits, not to the bits shifted up to the top of that byte
+    language_def l;
+    detailed_parse_error *e = parse_language_from_str(
+        &l, "meta\n"
+            "    endianness big\n"
+            "    namewidth 8\n"
+            "\n"
+            "def 0x01 narrow { uint4(a) int4(b) uint12(c) uint4(d) }\n",
+        "narrowlang");
+    mu_check(e == NULL);
+
+    char input[] = { 0x01, 0x13, 0x3a, 0x5d, 0x00 };
+    char text[64];
+    function_call *call;
+    binscript_consumer *c =
+        binscript_mem_consumer(&l, input, "narrow", BIN2SCRIPT);
+    mu_eq(int, BS_OK, binscript_next_checked(c, &call));
+    mu_check(call != NULL);
+    text[string_encode_function_call(text, call)] = '\0';
+    mu_check(0 == strcmp("narrow(1 3 933 13)", text));
+    free_call(call);
+    binscript_free(c);
+
+    // and encode back to the same bytes
+    c = binscript_mem_consumer(&l, "narrow(1 3 933 13)\n", "narrow",
+                               SCRIPT2BIN);
+    char out[4] = { 0 };
+    mu_eq(int, BS_OK, binscript_next_checked(c, &call));
+    binary_encode_function_call(out, &l, call);
+    mu_check(0 == memcmp(input, out, sizeof(out)));
+    free_call(call);
+    binscript_free(c);
+    free_lang(&l);
+}
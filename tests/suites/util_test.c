@@ -56,3 +56,57 @@ void mu_test_swap_endian_on_field() {
     swap_endian_on_field(buff, 3);
     mu_check(0 == memcmp(buff, expt, 4));
 }
+
+void mu_test_swap_endian_fixed() {
+    unsigned char buff[16], expt[16];
+
+    // the fixed-width swap matches the generic swap for every width
+    for (size_t size = 0; size <= 16; size++) {
+        for (size_t i = 0; i < 16; i++) {
+            buff[i] = expt[i] = (unsigned char)(i * 17 + 3);
+        }
+        swap_endian_fixed(buff, size);
+        swap_endian_on_field(expt, size);
+        mu_check(0 == memcmp(buff, expt, 16));
+    }
+}
+
+void mu_test_swap_endian_bulk() {
+#define BULK_SWAP_MAX_FIELDS 100
+    unsigned char buff[BULK_SWAP_MAX_FIELDS * 8 + 1];
+    unsigned char expt[BULK_SWAP_MAX_FIELDS * 8 + 1];
+    size_t widths[] = { 1, 2, 3, 4, 8 };
+
+    // check every field count, so that both the vector kernels and the
+    // scalar tail are covered, and that the byte after the last field
+    // is untouched
+    for (size_t w = 0; w < sizeof(widths) / sizeof(size_t); w++) {
+        size_t width = widths[w];
+        for (size_t count = 0; count <= BULK_SWAP_MAX_FIELDS; count++) {
+            for (size_t i = 0; i < sizeof(buff); i++) {
+                buff[i] = expt[i] = (unsigned char)(i * 31 + count);
+            }
+
+            swap_endian_bulk(buff, width, count);
+            for (size_t i = 0; i < count; i++) {
+                swap_endian_on_field(expt + i * width, width);
+            }
+            mu_check(0 == memcmp(buff, expt, sizeof(buff)));
+        }
+    }
+}
+
+void mu_test_read_bits() {
+    unsigned char buf[] = { 0xAB, 0xCD, 0xEF, 0x01, 0x23, 0x45,
+                            0x67, 0x89, 0xAB, 0xCD };
+
+    mu_check(read_bits(buf, 0, 8) == 0xAB);
+    mu_check(read_bits(buf, 4, 8) == 0xBC);
+    mu_check(read_bits(buf, 0, 1) == 1);
+    mu_check(read_bits(buf, 1, 1) == 0);
+    mu_check(read_bits(buf, 3, 6) == 0x17);
+    mu_check(read_bits(buf, 0, 64) == 0xABCDEF0123456789ULL);
+    mu_check(read_bits(buf, 4, 64) == 0xBCDEF0123456789AULL);
+    mu_check(read_bits(buf, 7, 57) ==
+             (0xABCDEF0123456789ULL & ((1ULL << 57) - 1)));
+}
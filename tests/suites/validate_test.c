@@ -0,0 +1,142 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../mutest.h"
+#include "langdef.h"
+#include "parsescript.h"
+#include "translator.h"
+#include "validate.h"
+
+static language_def validatelang;
+
+int mu_init_validate() {
+    detailed_parse_error *e =
+        parse_language_from_str(&validatelang, "meta\n"
+                                               "    endianness big\n"
+                                               "    namewidth 8\n"
+                                               "\n"
+                                               "def 0x01 pair {\n"
+                                               "    uint8(a) uint8(b)\n"
+                                               "}\n"
+                                               "def 0x02 name {\n"
+                                               "    str32(name)\n"
+                                               "}\n"
+                                               "def 0x03 odd {\n"
+                                               "    uint4(a) str16(s) skip4\n"
+                                               "}\n"
+                                               "def 0x04 half {\n"
+                                               "    float16(h)\n"
+                                               "}\n"
+                                               "def 0x05 wide {\n"
+                                               "    hex72(h) uint72(u)\n"
+                                               "    int72(i)\n"
+                                               "}\n"
+                                               "def 0x85 high\n",
+                                "validatelang");
+    if (e != NULL) {
+        print_err(e);
+        free_err(e);
+        return 1;
+    }
+    return 0;
+}
+
+void mu_term_validate() { free_lang(&validatelang); }
+
+void mu_test_validate_ok() {
+    unsigned char bin[] = { 0x01, 0x10, 0x20,           // pair(16 32)
+                            0x02, 'a',  'b',  0,    0,  // name(ab)
+                            0x03, 0x1a, 0x00, 0x00,     // odd(1 "\xa0")
+                            0x85,                       // high()
+                            0x00 };
+    binscript_problem problems[4];
+    binscript_report r;
+
+    binscript_report_init(&r, problems, 4, NULL_TERMINATED);
+    mu_check(binscript_validate(&validatelang, bin, sizeof(bin), &r));
+    mu_eq(int, 0, r.problem_ct);
+    mu_eq(int, 4, r.statement_ct);
+    mu_eq(int, sizeof(bin), r.bytes_checked);
+
+    // without the terminator, only exact-size modes are valid
+    binscript_report_init(&r, problems, 4, NULL_TERMINATED);
+    mu_check(!binscript_validate(&validatelang, bin, sizeof(bin) - 1, &r));
+    mu_eq(int, 1, r.problem_ct);
+    mu_eq(binscript_error, BS_MISSING_TERMINATOR, problems[0].error);
+    mu_eq(int, sizeof(bin) - 1, problems[0].offset);
+
+    binscript_report_init(&r, problems, 4, SIZE_BYTES);
+    mu_check(binscript_validate(&validatelang, bin, sizeof(bin) - 1, &r));
+    mu_eq(int, 4, r.statement_ct);
+}
+
+void mu_test_validate_structural() {
+    unsigned char unknown[] = { 0x01, 0x10, 0x20, 0x07, 0x00 };
+    unsigned char truncated[] = { 0x01, 0x10, 0x20, 0x02, 'a' };
+    binscript_problem problems[4];
+    binscript_report r;
+
+    binscript_report_init(&r, problems, 4, NULL_TERMINATED);
+    mu_check(!binscript_validate(&validatelang, unknown, sizeof(unknown), &r));
+    mu_eq(int, 1, r.problem_ct);
+    mu_eq(binscript_error, BS_UNKNOWN_OPCODE, problems[0].error);
+    mu_eq(int, 1, problems[0].statement);
+    mu_eq(int, 3, problems[0].offset);
+    mu_eq(int, 0x07, problems[0].opcode);
+
+    binscript_report_init(&r, problems, 4, NULL_TERMINATED);
+    mu_check(
+        !binscript_validate(&validatelang, truncated, sizeof(truncated), &r));
+    mu_eq(int, 1, r.problem_ct);
+    mu_eq(binscript_error, BS_TRUNCATED_STATEMENT, problems[0].error);
+    mu_eq(int, 3, problems[0].offset);
+}
+
+void mu_test_validate_fields() {
+    unsigned char bin[] = { 0x02, 'a',  'b',  'c',  'd', // unterminated
+                            0x03, 0x1f, 0xff, 0xf0,      // unterminated
+                            0x04, 0x00, 0x00,            // float16
+                            0x02, 'a',  'b',  'c',  'd', // unterminated
+                            0x00 };
+    binscript_problem problems[2];
+    binscript_report r;
+
+    // field problems do not stop validation, and only the first
+    // max_problems are recorded
+    binscript_report_init(&r, problems, 2, NULL_TERMINATED);
+    mu_check(!binscript_validate(&validatelang, bin, sizeof(bin), &r));
+    mu_eq(int, 4, r.problem_ct);
+    mu_eq(int, 4, r.statement_ct);
+
+    mu_eq(binscript_error, BS_UNTERMINATED_STRING, problems[0].error);
+    mu_eq(int, 0, problems[0].statement);
+    mu_eq(int, 8, problems[0].bit_offset);
+
+    mu_eq(binscript_error, BS_UNTERMINATED_STRING, problems[1].error);
+    mu_eq(int, 1, problems[1].statement);
+    mu_eq(int, 5 * 8 + 12, problems[1].bit_offset);
+}
+
+void mu_test_validate_wide_ints() {
+    // ints wider than a long are refused by every decode path, so they
+    // are problems here too. Hex of any width decodes.
+    unsigned char bin[1 + 27 + 1] = { 0x05 };
+    binscript_problem problems[4];
+    binscript_report r;
+
+    binscript_report_init(&r, problems, 4, NULL_TERMINATED);
+    mu_check(!binscript_validate(&validatelang, bin, sizeof(bin), &r));
+    mu_eq(int, 2, r.problem_ct);
+    mu_eq(int, 1, r.statement_ct);
+
+    mu_eq(binscript_error, BS_BAD_ARGTYPE, problems[0].error);
+    mu_eq(int, 8 + 72, problems[0].bit_offset);
+    mu_eq(binscript_error, BS_BAD_ARGTYPE, problems[1].error);
+    mu_eq(int, 8 + 2 * 72, problems[1].bit_offset);
+
+    function_call *call;
+    mu_eq(binscript_error, BS_BAD_ARGTYPE,
+          decode_function_call_checked(&validatelang, (char *)bin,
+                                       sizeof(bin) - 1, &call));
+}
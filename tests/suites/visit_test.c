@@ -0,0 +1,275 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../mutest.h"
+#include "alloc.h"
+#include "langdef.h"
+#include "parsescript.h"
+#include "stats.h"
+#include "translator.h"
+
+#define VISIT_TEST_FILE "visit_test.bin"
+
+static language_def visitlang;
+
+// hitbox(2 -3) name(ab) shifted(1 cd 2) speed(1.5) blob(<...>) hitbox(4 5)
+static char visit_input[] = {
+    0x01, 0x02, 0x83,                                     //
+    0x02, 'a',  'b',                                      //
+    0x03, 0x16, 0x36, 0x42,                               //
+    0x04, 0x3f, 0xc0, 0x00, 0x00,                         //
+    0x05, 0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef, //
+    0xfe, 0xdc,                                           //
+    0x01, 0x04, 0x05,                                     //
+    0x00
+};
+
+int mu_init_visit() {
+    detailed_parse_error *e = parse_language_from_str(
+        &visitlang, "meta\n"
+                    "    endianness big\n"
+                    "    namewidth 8\n"
+                    "    nameshift 0\n"
+                    "\n"
+                    "def 0x01 hitbox { uint8(dmg) int8(angle) }\n"
+                    "def 0x02 name { str16(text) }\n"
+                    "def 0x03 shifted { uint4(a) str16(text) uint4(b) }\n"
+                    "def 0x04 speed { float32(value) }\n"
+                    "def 0x05 blob { hex80(data) }\n",
+        "visitlang");
+    if (e != NULL) {
+        print_err(e);
+        free_err(e);
+        return 1;
+    }
+    return 0;
+}
+
+void mu_term_visit() { free_lang(&visitlang); }
+
+// writes what it is shown into a line of text, and stops after
+// `stop_after` statements if that is not 0
+typedef struct visit_log {
+    char text[512];
+    size_t len;
+    unsigned int statements;
+    unsigned int stop_after;
+    size_t offsets[8];
+} visit_log;
+
+// appends to the text, dropping whatever does not fit
+static void log_printf(visit_log *log, const char *fmt, ...) {
+    va_list args;
+    if (log->len >= sizeof(log->text) - 1)
+        return;
+    va_start(args, fmt);
+    int n = vsnprintf(log->text + log->len, sizeof(log->text) - log->len, fmt,
+                      args);
+    va_end(args);
+    if (n > 0)
+        log->len += (size_t)n;
+    if (log->len > sizeof(log->text) - 1)
+        log->len = sizeof(log->text) - 1;
+}
+
+static bool log_statement(void *user, function_def *fn, size_t offset) {
+    visit_log *log = user;
+    if (log->statements < 8)
+        log->offsets[log->statements] = offset;
+    log_printf(log, "%s(", fn->name);
+    return true;
+}
+
+static bool log_argument(void *user, function_def *fn, unsigned int index,
+                         const bs_value *value) {
+    visit_log *log = user;
+    (void)fn;
+    if (index > 0)
+        log_printf(log, " ");
+    switch (value->def->type) {
+    case STRING:
+    case RAW_STRING:
+        log_printf(log, "%.*s", (int)value->bytes.len, value->bytes.data);
+        break;
+    case HEX:
+        if (value->def->bitwidth <= sizeof(long int) * 8) {
+            log_printf(log, "%lx", value->i);
+            break;
+        }
+        for (size_t i = 0; i < value->bytes.len; i++) {
+            log_printf(log, "%02x", (unsigned char)value->bytes.data[i]);
+        }
+        break;
+    case FLOAT:
+        log_printf(log, "%.2Lf", value->f);
+        break;
+    default:
+        log_printf(log, "%ld", value->i);
+        break;
+    }
+    return true;
+}
+
+static bool log_end(void *user, function_def *fn) {
+    visit_log *log = user;
+    (void)fn;
+    log_printf(log, ") ");
+    log->statements++;
+    return log->stop_after == 0 || log->statements < log->stop_after;
+}
+
+static const bs_visitor log_visitor = { log_statement, log_argument,
+                                        log_end };
+
+static const char visit_expected[] =
+    "hitbox(2 -3) name(ab) shifted(1 cd 2) speed(1.50) "
+    "blob(0123456789abcdeffedc) hitbox(4 5) ";
+
+void mu_test_visit_memory() {
+    visit_log log;
+    memset(&log, 0, sizeof(log));
+
+    binscript_consumer *c =
+        binscript_mem_consumer(&visitlang, visit_input, "visit", BIN2SCRIPT);
+    mu_eq(int, BS_OK, binscript_visit(c, &log_visitor, &log));
+    mu_check(0 == strcmp(visit_expected, log.text));
+    mu_eq(int, 6, log.statements);
+    mu_eq(int, 0, log.offsets[0]);
+    mu_eq(int, 3, log.offsets[1]);
+    mu_eq(int, 10, log.offsets[3]);
+    mu_eq(int, sizeof(visit_input) - 1, c->offset);
+    binscript_free(c);
+}
+
+void mu_test_visit_no_allocations() {
+    bs_counting_allocator counter;
+    bs_counting_init(&counter, NULL);
+    visit_log log;
+    memset(&log, 0, sizeof(log));
+
+    binscript_consumer *c =
+        binscript_mem_consumer(&visitlang, visit_input, "visit", BIN2SCRIPT);
+    consumer_set_allocator(c, &counter.allocator);
+    bs_counting_reset(&counter);
+    mu_eq(int, BS_OK, binscript_visit(c, &log_visitor, &log));
+    mu_eq(int, 0, counter.allocations);
+    binscript_free(c);
+
+    // values wider than the scratch space get a buffer of their own
+    language_def widelang;
+    detailed_parse_error *e = parse_language_from_str(
+        &widelang, "meta\n"
+                   "    endianness big\n"
+                   "    namewidth 8\n"
+                   "    nameshift 0\n"
+                   "\n"
+                   "def 0x01 wide { hex4096(data) }\n",
+        "widelang");
+    mu_check(e == NULL);
+    char wide[1 + 512 + 1];
+    memset(wide, 0xaa, sizeof(wide));
+    wide[0] = 0x01;
+    wide[sizeof(wide) - 1] = 0x00;
+
+    memset(&log, 0, sizeof(log));
+    c = binscript_mem_consumer(&widelang, wide, "wide", BIN2SCRIPT);
+    consumer_set_allocator(c, &counter.allocator);
+    bs_counting_reset(&counter);
+    mu_eq(int, BS_OK, binscript_visit(c, &log_visitor, &log));
+    mu_eq(int, 1, log.statements);
+    mu_eq(int, 1, counter.allocations);
+    mu_eq(int, 1, counter.frees);
+    binscript_free(c);
+    free_lang(&widelang);
+}
+
+void mu_test_visit_file() {
+    FILE *f = fopen(VISIT_TEST_FILE, "wb");
+    fwrite(visit_input, 1, sizeof(visit_input), f);
+    fclose(f);
+
+    bs_stats stats;
+    bs_stats_init(&stats, &visitlang);
+    visit_log log;
+    memset(&log, 0, sizeof(log));
+
+    f = fopen(VISIT_TEST_FILE, "rb");
+    binscript_consumer *c =
+        binscript_file_consumer(&visitlang, f, VISIT_TEST_FILE, BIN2SCRIPT);
+    consumer_set_size(c, NULL_TERMINATED, 0);
+    consumer_set_stats(c, &stats);
+    mu_eq(int, BS_OK, binscript_visit(c, &log_visitor, &log));
+    mu_check(0 == strcmp(visit_expected, log.text));
+    binscript_free(c);
+    fclose(f);
+    remove(VISIT_TEST_FILE);
+
+#ifndef BINSCRIPT_NO_STATS
+    mu_eq(int, 6, stats.statements);
+    mu_eq(int, sizeof(visit_input) - 1, stats.bytes);
+#endif
+    bs_stats_free(&stats);
+}
+
+void mu_test_visit_stop() {
+    visit_log log;
+    memset(&log, 0, sizeof(log));
+    log.stop_after = 2;
+
+    // the consumer is left after the statement that stopped the visit,
+    // and picks up from there
+    binscript_consumer *c =
+        binscript_mem_consumer(&visitlang, visit_input, "visit", BIN2SCRIPT);
+    mu_eq(int, BS_OK, binscript_visit(c, &log_visitor, &log));
+    mu_check(0 == strcmp("hitbox(2 -3) name(ab) ", log.text));
+    mu_eq(int, 6, c->offset);
+
+    function_call *call;
+    mu_eq(int, BS_OK, binscript_next_checked(c, &call));
+    mu_check(call != NULL && 0 == strcmp("shifted", call->defn->name));
+    free_call(call);
+
+    // callbacks may be left out
+    bs_visitor ends_only = { NULL, NULL, log_end };
+    log.stop_after = 0;
+    mu_eq(int, BS_OK, binscript_visit(c, &ends_only, &log));
+    mu_eq(int, 5, log.statements);
+    binscript_free(c);
+}
+
+void mu_test_visit_script() {
+    visit_log log;
+    memset(&log, 0, sizeof(log));
+
+    binscript_consumer *c = binscript_mem_consumer(
+        &visitlang, "hitbox(2 -3)\nname(ab)\nspeed(1.5)\n", "visit",
+        SCRIPT2BIN);
+    mu_eq(int, BS_OK, binscript_visit(c, &log_visitor, &log));
+    mu_check(0 == strcmp("hitbox(2 -3) name(ab) speed(1.50) ", log.text));
+    binscript_free(c);
+}
+
+void mu_test_visit_errors() {
+    visit_log log;
+    memset(&log, 0, sizeof(log));
+
+    // hitbox(2 -3), then an opcode the language does not have
+    char unknown[] = { 0x01, 0x02, 0x83, 0x7f, 0x00 };
+    binscript_consumer *c =
+        binscript_mem_consumer(&visitlang, unknown, "visit", BIN2SCRIPT);
+    mu_eq(int, BS_UNKNOWN_OPCODE, binscript_visit(c, &log_visitor, &log));
+    mu_eq(int, BS_UNKNOWN_OPCODE, c->error);
+    mu_eq(int, 3, c->error_offset);
+    mu_eq(int, 1, log.statements);
+    binscript_free(c);
+
+    char truncated[] = { 0x04, 0x3f, 0xc0 };
+    c = binscript_mem_consumer(&visitlang, truncated, "visit", BIN2SCRIPT);
+    consumer_set_source_len(c, sizeof(truncated));
+    mu_eq(int, BS_TRUNCATED_STATEMENT,
+          binscript_visit(c, &log_visitor, &log));
+    mu_eq(int, BS_TRUNCATED_STATEMENT, c->error);
+    binscript_free(c);
+}
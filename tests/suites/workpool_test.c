@@ -0,0 +1,63 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../mutest.h"
+#include "workpool.h"
+
+#define WORKPOOL_TEST_ITEMS 10000
+
+struct workpool_test_ctx {
+    unsigned int runs[WORKPOOL_TEST_ITEMS];
+    unsigned int worker_items[8];
+};
+
+static void count_item(void *ctx, size_t item, unsigned int worker) {
+    struct workpool_test_ctx *c = ctx;
+    c->runs[item]++;
+    c->worker_items[worker]++;
+
+    // make the first items much slower than the rest, so that the
+    // workers that were dealt them have their ranges stolen
+    if (item < 100) {
+        volatile unsigned int spin = 0;
+        for (unsigned int i = 0; i < 20000; i++)
+            spin += i;
+    }
+}
+
+void mu_test_workpool_runs_every_item_once() {
+    struct workpool_test_ctx *c = calloc(1, sizeof(*c));
+
+    unsigned int used =
+        workpool_run(8, WORKPOOL_TEST_ITEMS, count_item, c);
+    mu_check(used >= 1 && used <= 8);
+
+    unsigned int total = 0;
+    for (size_t i = 0; i < WORKPOOL_TEST_ITEMS; i++) {
+        mu_eq(int, 1, c->runs[i]);
+    }
+    for (unsigned int i = 0; i < 8; i++) {
+        total += c->worker_items[i];
+    }
+    mu_eq(int, WORKPOOL_TEST_ITEMS, total);
+    free(c);
+}
+
+void mu_test_workpool_small_batches() {
+    struct workpool_test_ctx *c = calloc(1, sizeof(*c));
+
+    // no items, and fewer items than threads
+    mu_eq(int, 1, workpool_run(4, 0, count_item, c));
+    mu_eq(int, 3, workpool_run(4, 3, count_item, c));
+    for (size_t i = 0; i < 3; i++) {
+        mu_eq(int, 1, c->runs[i]);
+    }
+    mu_eq(int, 0, c->runs[3]);
+
+    // one thread runs everything in order on the calling thread
+    memset(c, 0, sizeof(*c));
+    mu_eq(int, 1, workpool_run(1, 50, count_item, c));
+    mu_eq(int, 50, c->worker_items[0]);
+    free(c);
+}